@@ -1,7 +1,30 @@
 constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
-constant float gaussian_kernel = 1/9.0F;
 
 #define TEMPERATURES_COUNT 11
+/*tiles of the active region and the change per step below which a cell counts as settled, as in read_and_verify*/
+#define ACTIVE_TILE_SIZE 16
+#define ACTIVE_THRESHOLD (FLT_EPSILON * 1000.0F)
+/*spans of the geometry mask and the link bits of a cell, as in geometry.h*/
+#define GEOMETRY_SPAN_CELLS 64
+#define GEOMETRY_WEST 1
+#define GEOMETRY_EAST 2
+#define GEOMETRY_NORTH 4
+#define GEOMETRY_SOUTH 8
+
+/*
+ * index_t holds the index of a cell in a field. The program is built with -D HUGE_GRID only when a field has more
+ * cells than 32 bits can count (a deep volume); every other plate keeps the 32-bit arithmetic.
+ */
+#ifdef HUGE_GRID
+typedef ulong index_t;
+#else
+typedef uint index_t;
+#endif
+
+index_t cell_index(int x, int y, uint width)
+{
+	return (index_t)y * width + x;
+}
 
 struct vertex_args
 {
@@ -23,56 +46,624 @@ __constant struct vertex_args temperature_color[TEMPERATURES_COUNT] = {
 	{1315.0F, -1.0F, 1.0F, 1.0F, 1.0F}, //White
 };
 
-__kernel void simulate(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature, uint point_x, uint point_y, float point_temperature, __global struct vertex_args* plate_points, float gpu_percent)
+/*linear interpolation between the two colors that bracket the temperature*/
+void set_temperature_color(__global struct vertex_args* point, float temperature)
+{
+	if (temperature < temperature_color[TEMPERATURES_COUNT - 1].x)
+	{
+		for (int i = 0; i < TEMPERATURES_COUNT - 1; i++)
+		{
+			if (temperature < temperature_color[i].y)
+			{
+				float diff = temperature - temperature_color[i].x;
+				float diff_total = temperature_color[i].y - temperature_color[i].x;
+				float proc = diff / diff_total;
+
+				point->r = temperature_color[i].r + (temperature_color[i + 1].r - temperature_color[i].r) * proc;
+				point->g = temperature_color[i].g + (temperature_color[i + 1].g - temperature_color[i].g) * proc;
+				point->b = temperature_color[i].b + (temperature_color[i + 1].b - temperature_color[i].b) * proc;
+				break;
+			}
+		}
+	}
+	else
+	{
+		point->r = temperature_color[TEMPERATURES_COUNT - 1].r;
+		point->g = temperature_color[TEMPERATURES_COUNT - 1].g;
+		point->b = temperature_color[TEMPERATURES_COUNT - 1].b;
+	}
+}
+
+__kernel void simulate(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature, __global struct vertex_args* plate_points, ulong device_cells, float ratio)
 {
     int2 coords = (int2)(get_global_id(0), get_global_id(1));
-	int global_index = coords.y * width + coords.x;
+	index_t global_index = cell_index(coords.x, coords.y, width);
 	float4 color = (float4)(0.0F, 0.0F, 0.0F, 0.0F);
 	float4 ext_color = (float4)(air_temperature, air_temperature, air_temperature, air_temperature);
-	int i, j;
 
-	if (global_index > width * height * gpu_percent / 100.0F)
+	if (global_index >= device_cells)
+	{
+		return;
+	}
+
+	/*FTCS step, neighbours outside of the plate are at the air temperature; the sources are set afterwards by scatter_sources*/
+	float4 center = read_imagef(input, sampler, coords);
+	float4 neighbours = (coords.x > 0 ? read_imagef(input, sampler, (int2)(coords.x - 1, coords.y)) : ext_color) +
+		(coords.x + 1 < width ? read_imagef(input, sampler, (int2)(coords.x + 1, coords.y)) : ext_color) +
+		(coords.y > 0 ? read_imagef(input, sampler, (int2)(coords.x, coords.y - 1)) : ext_color) +
+		(coords.y + 1 < height ? read_imagef(input, sampler, (int2)(coords.x, coords.y + 1)) : ext_color);
+	color = center + ratio * (neighbours - 4.0F * center);
+	set_temperature_color(&plate_points[global_index], color.x);
+
+    write_imagef(output, coords, color);
+}
+
+/*cell (x, y) of the plate for the kernels generated from stencil.h, the air beyond it*/
+float stencil_cell(read_only image2d_t input, int x, int y, uint width, uint height, float air_temperature)
+{
+	return x < 0 || y < 0 || x >= width || y >= height ? air_temperature : read_imagef(input, sampler, (int2)(x, y)).x;
+}
+
+/*ghost cells of the generated simulate_boundary, beta of the way from the cell to the air, as boundary_ghost in boundary.h*/
+float boundary_blend(float center, float air_temperature, float beta)
+{
+	return center + min(beta, 1.0F) * (air_temperature - center);
+}
+
+float radiative_beta(float center, float air_temperature, float coefficient)
+{
+	float t = center + 273.15F;
+	float a = air_temperature + 273.15F;
+	return coefficient * (t * t + a * a) * (t + a);
+}
+
+/*FTCS step of one cell through its four faces, face_x[row * (width + 1) + col] west of the cell and face_y[row * width + col] north of it*/
+float4 material_step(read_only image2d_t input, int2 coords, uint width, uint height, float4 ext_color, float ratio, __global const float* face_x, __global const float* face_y)
+{
+	index_t i = cell_index(coords.x, coords.y, width);
+	index_t x = cell_index(coords.x, coords.y, width + 1);
+	float4 center = read_imagef(input, sampler, coords);
+	float4 flux = face_x[x] * ((coords.x > 0 ? read_imagef(input, sampler, (int2)(coords.x - 1, coords.y)) : ext_color) - center) +
+		face_x[x + 1] * ((coords.x + 1 < width ? read_imagef(input, sampler, (int2)(coords.x + 1, coords.y)) : ext_color) - center) +
+		face_y[i] * ((coords.y > 0 ? read_imagef(input, sampler, (int2)(coords.x, coords.y - 1)) : ext_color) - center) +
+		face_y[i + width] * ((coords.y + 1 < height ? read_imagef(input, sampler, (int2)(coords.x, coords.y + 1)) : ext_color) - center);
+	return center + ratio * flux;
+}
+
+/*either step, the faces are null on a uniform plate*/
+float4 cell_step(read_only image2d_t input, int2 coords, uint width, uint height, float4 ext_color, float ratio, __global const float* face_x, __global const float* face_y)
+{
+	if (face_x)
+		return material_step(input, coords, width, height, ext_color, ratio, face_x, face_y);
+
+	float4 center = read_imagef(input, sampler, coords);
+	float4 neighbours = (coords.x > 0 ? read_imagef(input, sampler, (int2)(coords.x - 1, coords.y)) : ext_color) +
+		(coords.x + 1 < width ? read_imagef(input, sampler, (int2)(coords.x + 1, coords.y)) : ext_color) +
+		(coords.y > 0 ? read_imagef(input, sampler, (int2)(coords.x, coords.y - 1)) : ext_color) +
+		(coords.y + 1 < height ? read_imagef(input, sampler, (int2)(coords.x, coords.y + 1)) : ext_color);
+	return center + ratio * (neighbours - 4.0F * center);
+}
+
+/*simulate on a plate of varying conductivity: every neighbour pulls through the harmonic mean conductivity of its face, already divided by the largest one*/
+__kernel void simulate_material(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature,
+	__global struct vertex_args* plate_points, ulong device_cells, float ratio, __global const float* face_x, __global const float* face_y)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	index_t global_index = cell_index(coords.x, coords.y, width);
+	float4 ext_color = (float4)(air_temperature, air_temperature, air_temperature, air_temperature);
+
+	if (global_index >= device_cells)
+	{
+		return;
+	}
+
+	float4 color = material_step(input, coords, width, height, ext_color, ratio, face_x, face_y);
+	set_temperature_color(&plate_points[global_index], color.x);
+
+    write_imagef(output, coords, color);
+}
+
+/*
+ * simulate over the cells of a geometry mask only: work group k steps span k, spans[3 * k] the row and
+ * spans[3 * k + 1], spans[3 * k + 2] its first and end column, item j its cell begin + j. The neighbours missing from
+ * links are the air, or the cell itself when the outline is insulated.
+ */
+__kernel void simulate_geometry(read_only image2d_t input, write_only image2d_t output, uint width, float air_temperature,
+	__global struct vertex_args* plate_points, float ratio, __global const uint* spans, __global const uchar* links, uint insulated)
+{
+	uint span = get_global_id(1);
+	int2 coords = (int2)(spans[3 * span + 1] + get_local_id(0), spans[3 * span]);
+	if (coords.x >= spans[3 * span + 2])
+		return;
+
+	index_t global_index = cell_index(coords.x, coords.y, width);
+	uchar link = links[global_index];
+	float center = read_imagef(input, sampler, coords).x;
+	float outside = insulated ? center : air_temperature;
+	float neighbours = (link & GEOMETRY_WEST ? read_imagef(input, sampler, (int2)(coords.x - 1, coords.y)).x : outside) +
+		(link & GEOMETRY_EAST ? read_imagef(input, sampler, (int2)(coords.x + 1, coords.y)).x : outside) +
+		(link & GEOMETRY_NORTH ? read_imagef(input, sampler, (int2)(coords.x, coords.y - 1)).x : outside) +
+		(link & GEOMETRY_SOUTH ? read_imagef(input, sampler, (int2)(coords.x, coords.y + 1)).x : outside);
+	float value = center + ratio * (neighbours - 4.0F * center);
+	set_temperature_color(&plate_points[global_index], value);
+	write_imagef(output, coords, (float4)(value, value, value, value));
+}
+
+/*
+ * Sources and sinks, applied after the step to the cells they cover and to no other: work-item j handles cell
+ * cells[first + j] of source owner[first + j]. The first fixed_count cells of the list are held at the value of their
+ * source; the others take the step again and add value, the heat their source puts in over the step. The faces are
+ * null on a uniform plate. With active tiles, a cell that moves flags its tile in changed, which is null otherwise.
+ */
+__kernel void scatter_sources(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature,
+	__global struct vertex_args* plate_points, float ratio, __global const uint* cells, __global const uint* owner, __global const float* values,
+	uint first, uint fixed_count, __global const float* face_x, __global const float* face_y, __global uchar* changed, uint tile_columns)
+{
+	uint j = first + get_global_id(0);
+	uint cell = cells[j];
+	int2 coords = (int2)(cell % width, cell / width);
+	float4 ext_color = (float4)(air_temperature, air_temperature, air_temperature, air_temperature);
+	float value = values[owner[j]];
+	float4 color = (float4)(value, value, value, value);
+
+	if (j >= fixed_count)
+		color += cell_step(input, coords, width, height, ext_color, ratio, face_x, face_y);
+	if (changed && fabs(color.x - read_imagef(input, sampler, coords).x) >= ACTIVE_THRESHOLD)
+		changed[coords.y / ACTIVE_TILE_SIZE * tile_columns + coords.x / ACTIVE_TILE_SIZE] = 1;
+	set_temperature_color(&plate_points[cell], color.x);
+
+	write_imagef(output, coords, color);
+}
+
+/*
+ * simulate over the active tiles only: work-item i steps cell i % (ACTIVE_TILE_SIZE * ACTIVE_TILE_SIZE) of tile
+ * tiles[i / (ACTIVE_TILE_SIZE * ACTIVE_TILE_SIZE)], row by row, and flags the tile in changed when the cell moved by
+ * ACTIVE_THRESHOLD or more. The faces are null on a uniform plate.
+ */
+__kernel void simulate_tiles(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature,
+	__global struct vertex_args* plate_points, ulong device_cells, float ratio, __global const uint* tiles, uint tile_columns, __global uchar* changed,
+	__global const float* face_x, __global const float* face_y)
+{
+	uint tile = tiles[get_global_id(0) / (ACTIVE_TILE_SIZE * ACTIVE_TILE_SIZE)];
+	uint within = get_global_id(0) % (ACTIVE_TILE_SIZE * ACTIVE_TILE_SIZE);
+	int2 coords = (int2)(tile % tile_columns * ACTIVE_TILE_SIZE + within % ACTIVE_TILE_SIZE, tile / tile_columns * ACTIVE_TILE_SIZE + within / ACTIVE_TILE_SIZE);
+	index_t global_index = cell_index(coords.x, coords.y, width);
+	float4 ext_color = (float4)(air_temperature, air_temperature, air_temperature, air_temperature);
+
+	if (coords.x >= width || coords.y >= height || global_index >= device_cells)
+	{
+		return;
+	}
+
+	float4 color = cell_step(input, coords, width, height, ext_color, ratio, face_x, face_y);
+	if (fabs(color.x - read_imagef(input, sampler, coords).x) >= ACTIVE_THRESHOLD)
+		changed[tile] = 1;
+	set_temperature_color(&plate_points[global_index], color.x);
+
+	write_imagef(output, coords, color);
+}
+
+/*
+ * Solver kernels. They work on plain float buffers of width * height cells: the five-point system
+ * (A x)_i = diagonal * x_i - neighbour * (sum of the neighbours inside the plate), with the air around the plate
+ * and the fixed source cell moved to the right hand side. A source at (-1, -1) means there is none.
+ * edge adds coupling to the air beyond the west, east, north and south edges on coarse grids.
+ */
+
+__kernel void colorize(__global const float* field, __global struct vertex_args* plate_points, uint count)
+{
+	index_t i = get_global_id(0);
+	if (i < count)
+		set_temperature_color(&plate_points[i], field[i]);
+}
+
+int is_source(int col, int row, int source_x, int source_y)
+{
+	return col == source_x && row == source_y;
+}
+
+float cell_diagonal(float diagonal, float4 edge, int col, int row, int width, int height)
+{
+	return diagonal + (col == 0 ? edge.x : 0.0F) + (col + 1 == width ? edge.y : 0.0F) + (row == 0 ? edge.z : 0.0F) + (row + 1 == height ? edge.w : 0.0F);
+}
+
+float inner_neighbour_sum(__global const float* x, int col, int row, int width, int height, int source_x, int source_y)
+{
+	index_t i = cell_index(col, row, width);
+	float sum = 0.0F;
+	if (col > 0 && !is_source(col - 1, row, source_x, source_y)) sum += x[i - 1];
+	if (col + 1 < width && !is_source(col + 1, row, source_x, source_y)) sum += x[i + 1];
+	if (row > 0 && !is_source(col, row - 1, source_x, source_y)) sum += x[i - width];
+	if (row + 1 < height && !is_source(col, row + 1, source_x, source_y)) sum += x[i + width];
+	return sum;
+}
+
+/*explicit part of the theta scheme: T + (1 - theta) * r * laplacian(T), air included*/
+__kernel void implicit_rhs(__global const float* field, __global float* rhs, uint width, uint height, float air_temperature, float explicit_ratio)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	index_t i = cell_index(col, row, width);
+	float center = field[i];
+	float neighbours = (col > 0 ? field[i - 1] : air_temperature) + (col + 1 < width ? field[i + 1] : air_temperature) +
+		(row > 0 ? field[i - width] : air_temperature) + (row + 1 < height ? field[i + width] : air_temperature);
+	rhs[i] = center + explicit_ratio * (neighbours - 4.0F * center);
+}
+
+/*moves the known air and source values to the right hand side*/
+__kernel void boundary_terms(__global float* rhs, uint width, uint height, float neighbour, int source_x, int source_y, float4 edge, float air_temperature, float source_temperature)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	index_t i = cell_index(col, row, width);
+	if (is_source(col, row, source_x, source_y))
 	{
+		rhs[i] = source_temperature;
 		return;
 	}
 
-	if (point_x == coords.x && point_y == coords.y)
+	float air_weight = (col == 0 ? neighbour + edge.x : 0.0F) + (col + 1 == width ? neighbour + edge.y : 0.0F) +
+		(row == 0 ? neighbour + edge.z : 0.0F) + (row + 1 == height ? neighbour + edge.w : 0.0F);
+	int source_count = is_source(col - 1, row, source_x, source_y) + is_source(col + 1, row, source_x, source_y) +
+		is_source(col, row - 1, source_x, source_y) + is_source(col, row + 1, source_x, source_y);
+	rhs[i] += air_weight * air_temperature + neighbour * source_count * source_temperature;
+}
+
+/*one color of a red-black Gauss-Seidel / SOR sweep, launched on ((width + 1) / 2, height) work items*/
+__kernel void red_black_sweep(__global const float* rhs, __global float* x, uint width, uint height, float diagonal, float neighbour, int source_x, int source_y, float4 edge,
+	uint color, float omega)
+{
+	int row = get_global_id(1);
+	int col = 2 * get_global_id(0) + ((row + color) & 1);
+	if (col >= width)
+		return;
+
+	index_t i = cell_index(col, row, width);
+	if (is_source(col, row, source_x, source_y))
 	{
-		color = (float4)(point_temperature, point_temperature, point_temperature, point_temperature);
+		x[i] = rhs[i];
+		return;
 	}
-	else {
-		for (i = -1; i <= 1; i++)
+
+	float solution = (rhs[i] + neighbour * inner_neighbour_sum(x, col, row, width, height, source_x, source_y)) / cell_diagonal(diagonal, edge, col, row, width, height);
+	x[i] += omega * (solution - x[i]);
+}
+
+/*max norm of (b - A x) / diagonal, every work group leaves one partial maximum*/
+__kernel void residual_norm(__global const float* rhs, __global const float* x, uint width, uint height, float diagonal, float neighbour, int source_x, int source_y,
+	float4 edge, __global float* partial, __local float* scratch)
+{
+	index_t count = (index_t)width * height;
+	float residual = 0.0F;
+	for (index_t i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		int col = i % width;
+		int row = i / width;
+		float cell = cell_diagonal(diagonal, edge, col, row, width, height);
+		float difference = is_source(col, row, source_x, source_y) ? rhs[i] - x[i] :
+			(rhs[i] - cell * x[i] + neighbour * inner_neighbour_sum(x, col, row, width, height, source_x, source_y)) / cell;
+		residual = fmax(residual, fabs(difference));
+	}
+
+	uint lid = get_local_id(0);
+	scratch[lid] = residual;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint stride = get_local_size(0) / 2; stride > 0; stride /= 2)
+	{
+		if (lid < stride)
+			scratch[lid] = fmax(scratch[lid], scratch[lid + stride]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0)
+		partial[get_group_id(0)] = scratch[0];
+}
+
+/*b - A x, zero on the source row*/
+__kernel void residual_field(__global const float* rhs, __global const float* x, __global float* residual, uint width, uint height, float diagonal, float neighbour,
+	int source_x, int source_y, float4 edge)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	index_t i = cell_index(col, row, width);
+	residual[i] = is_source(col, row, source_x, source_y) ? 0.0F :
+		rhs[i] - cell_diagonal(diagonal, edge, col, row, width, height) * x[i] + neighbour * inner_neighbour_sum(x, col, row, width, height, source_x, source_y);
+}
+
+/*a coarse cell covers 2x2 fine cells: the sum of their residuals is the coarse right hand side for a zero initial correction, the source is not corrected*/
+__kernel void restrict_residual(__global const float* residual, __global float* coarse_rhs, __global float* coarse_x, uint width, uint height, uint coarse_width,
+	int coarse_source_x, int coarse_source_y)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	int fine_col = 2 * col;
+	int fine_row = 2 * row;
+	index_t i = cell_index(fine_col, fine_row, width);
+
+	float sum = residual[i];
+	if (fine_col + 1 < width) sum += residual[i + 1];
+	if (fine_row + 1 < height) sum += residual[i + width];
+	if (fine_col + 1 < width && fine_row + 1 < height) sum += residual[i + width + 1];
+
+	coarse_rhs[cell_index(col, row, coarse_width)] = is_source(col, row, coarse_source_x, coarse_source_y) ? 0.0F : sum;
+	coarse_x[cell_index(col, row, coarse_width)] = 0.0F;
+}
+
+float coarse_value(__global const float* coarse, int col, int row, int coarse_width, int coarse_height, float ghost)
+{
+	return col >= 0 && row >= 0 && col < coarse_width && row < coarse_height ? coarse[cell_index(col, row, coarse_width)] : ghost;
+}
+
+/*bilinear interpolation between the 4 nearest coarse cell centers: x = keep * x + interpolated coarse field*/
+__kernel void prolongate(__global const float* coarse, __global float* x, uint width, uint coarse_width, uint coarse_height, float ghost, float keep)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	int coarse_col = col / 2;
+	int coarse_row = row / 2;
+	int other_col = coarse_col + ((col & 1) ? 1 : -1);
+	int other_row = coarse_row + ((row & 1) ? 1 : -1);
+
+	float value = 0.5625F * coarse_value(coarse, coarse_col, coarse_row, coarse_width, coarse_height, ghost) +
+		0.1875F * coarse_value(coarse, other_col, coarse_row, coarse_width, coarse_height, ghost) +
+		0.1875F * coarse_value(coarse, coarse_col, other_row, coarse_width, coarse_height, ghost) +
+		0.0625F * coarse_value(coarse, other_col, other_row, coarse_width, coarse_height, ghost);
+
+	index_t i = cell_index(col, row, width);
+	x[i] = keep * x[i] + value;
+}
+
+/*sum and maximum of a work group, stored as the pair partial[2 * group], partial[2 * group + 1]; scratch holds 2 values per work item*/
+void reduce_sum_max(float sum, float maximum, __global float* partial, __local float* scratch)
+{
+	uint lid = get_local_id(0);
+	uint size = get_local_size(0);
+	scratch[lid] = sum;
+	scratch[size + lid] = maximum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint stride = size / 2; stride > 0; stride /= 2)
+	{
+		if (lid < stride)
 		{
-			for (j = -1; j <= 1; j++)
+			scratch[lid] += scratch[lid + stride];
+			scratch[size + lid] = fmax(scratch[size + lid], scratch[size + lid + stride]);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0)
+	{
+		partial[2 * get_group_id(0)] = scratch[0];
+		partial[2 * get_group_id(0) + 1] = scratch[size];
+	}
+}
+
+/*
+ * Conjugate gradient: next_direction = z + beta * direction and product = A next_direction in one pass, with the
+ * partial sums of next_direction . product. z and direction are zero on the source, so product is too.
+ */
+__kernel void pcg_direction(__global const float* z, __global const float* direction, __global float* next_direction, __global float* product, uint width, uint height,
+	float diagonal, float neighbour, int source_x, int source_y, float4 edge, float beta, __global float* partial, __local float* scratch)
+{
+	index_t count = (index_t)width * height;
+	float dot = 0.0F;
+	for (index_t i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		int col = i % width;
+		int row = i / width;
+		float p = z[i] + beta * direction[i];
+		float sum = 0.0F;
+		if (col > 0) sum += z[i - 1] + beta * direction[i - 1];
+		if (col + 1 < width) sum += z[i + 1] + beta * direction[i + 1];
+		if (row > 0) sum += z[i - width] + beta * direction[i - width];
+		if (row + 1 < height) sum += z[i + width] + beta * direction[i + width];
+
+		float q = is_source(col, row, source_x, source_y) ? 0.0F : cell_diagonal(diagonal, edge, col, row, width, height) * p - neighbour * sum;
+		next_direction[i] = p;
+		product[i] = q;
+		dot += p * q;
+	}
+	reduce_sum_max(dot, 0.0F, partial, scratch);
+}
+
+/*x += alpha * direction, residual -= alpha * product and the Jacobi step z = residual / diagonal, with the partial r . z and max |z|*/
+__kernel void pcg_update(__global float* x, __global float* residual, __global float* z, __global const float* direction, __global const float* product, uint width, uint height,
+	float diagonal, float4 edge, float alpha, __global float* partial, __local float* scratch)
+{
+	index_t count = (index_t)width * height;
+	float dot = 0.0F;
+	float maximum = 0.0F;
+	for (index_t i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		int col = i % width;
+		int row = i / width;
+		float r = residual[i] - alpha * product[i];
+		float preconditioned = r / cell_diagonal(diagonal, edge, col, row, width, height);
+		x[i] += alpha * direction[i];
+		residual[i] = r;
+		z[i] = preconditioned;
+		dot += r * preconditioned;
+		maximum = fmax(maximum, fabs(preconditioned));
+	}
+	reduce_sum_max(dot, maximum, partial, scratch);
+}
+
+/*adds a red neighbour of a black cell to the sum of its z and takes its fill-in off the pivot*/
+void ic_red_neighbour(__global const float* z, int col, int row, int width, int height, float diagonal, float neighbour, int source_x, int source_y, float4 edge,
+	float* sum, float* pivot)
+{
+	if (col < 0 || row < 0 || col >= width || row >= height || is_source(col, row, source_x, source_y))
+		return;
+	*sum += z[cell_index(col, row, width)];
+	*pivot -= neighbour * neighbour / cell_diagonal(diagonal, edge, col, row, width, height);
+}
+
+/*
+ * Red-black incomplete Cholesky, forward substitution of the black cells. The red cells hold residual / diagonal from pcg_update;
+ * launched on ((width + 1) / 2, height) work items.
+ */
+__kernel void ic_black(__global const float* residual, __global float* z, uint width, uint height, float diagonal, float neighbour, int source_x, int source_y, float4 edge)
+{
+	int row = get_global_id(1);
+	int col = 2 * get_global_id(0) + ((row + 1) & 1);
+	if (col >= width || is_source(col, row, source_x, source_y))
+		return;
+
+	float sum = 0.0F;
+	float pivot = cell_diagonal(diagonal, edge, col, row, width, height);
+	ic_red_neighbour(z, col - 1, row, width, height, diagonal, neighbour, source_x, source_y, edge, &sum, &pivot);
+	ic_red_neighbour(z, col + 1, row, width, height, diagonal, neighbour, source_x, source_y, edge, &sum, &pivot);
+	ic_red_neighbour(z, col, row - 1, width, height, diagonal, neighbour, source_x, source_y, edge, &sum, &pivot);
+	ic_red_neighbour(z, col, row + 1, width, height, diagonal, neighbour, source_x, source_y, edge, &sum, &pivot);
+
+	index_t i = cell_index(col, row, width);
+	z[i] = (residual[i] + neighbour * sum) / pivot;
+}
+
+/*backward substitution of the red cells, with the partial residual . z and max |residual / diagonal|*/
+__kernel void ic_red(__global const float* residual, __global float* z, uint width, uint height, float diagonal, float neighbour, int source_x, int source_y, float4 edge,
+	__global float* partial, __local float* scratch)
+{
+	index_t count = (index_t)width * height;
+	float dot = 0.0F;
+	float maximum = 0.0F;
+	for (index_t i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		int col = i % width;
+		int row = i / width;
+		float cell = cell_diagonal(diagonal, edge, col, row, width, height);
+		float value = z[i];
+		if (0 == ((col + row) & 1) && !is_source(col, row, source_x, source_y))
+		{
+			value += neighbour * inner_neighbour_sum(z, col, row, width, height, source_x, source_y) / cell;
+			z[i] = value;
+		}
+		dot += residual[i] * value;
+		maximum = fmax(maximum, fabs(residual[i] / cell));
+	}
+	reduce_sum_max(dot, maximum, partial, scratch);
+}
+
+/*neighbours - 4 * center, the air beyond the plate*/
+float laplacian(__global const float* field, int col, int row, int width, int height, float air_temperature)
+{
+	index_t i = cell_index(col, row, width);
+	return (col > 0 ? field[i - 1] : air_temperature) + (col + 1 < width ? field[i + 1] : air_temperature) +
+		(row > 0 ? field[i - width] : air_temperature) + (row + 1 < height ? field[i + width] : air_temperature) - 4.0F * field[i];
+}
+
+/*first RKL2 stage: y1 = y0 + mu_tilde * r * L(y0), with r * L(y0) kept for the later stages*/
+__kernel void rkl2_first_stage(__global const float* y0, __global float* y1, __global float* m0, uint width, uint height, float air_temperature,
+	int source_x, int source_y, float source_temperature, float mu_tilde, float ratio)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	index_t i = cell_index(col, row, width);
+	if (is_source(col, row, source_x, source_y))
+	{
+		m0[i] = 0.0F;
+		y1[i] = source_temperature;
+		return;
+	}
+
+	float m = ratio * laplacian(y0, col, row, width, height, air_temperature);
+	m0[i] = m;
+	y1[i] = y0[i] + mu_tilde * m;
+}
+
+/*stage j: y_j = mu y_j-1 + nu y_j-2 + (1 - mu - nu) y0 + mu_tilde r L(y_j-1) + gamma_tilde r L(y0)*/
+__kernel void rkl2_stage(__global const float* y0, __global const float* previous, __global const float* before, __global const float* m0, __global float* next,
+	uint width, uint height, float air_temperature, int source_x, int source_y, float source_temperature, float mu, float nu, float mu_tilde, float gamma_tilde, float ratio)
+{
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+	index_t i = cell_index(col, row, width);
+	if (is_source(col, row, source_x, source_y))
+	{
+		next[i] = source_temperature;
+		return;
+	}
+
+	float m = ratio * laplacian(previous, col, row, width, height, air_temperature);
+	next[i] = mu * previous[i] + nu * before[i] + (1.0F - mu - nu) * y0[i] + mu_tilde * m + gamma_tilde * m0[i];
+}
+
+/*
+ * One Chebyshev iteration over the neighbour average: next = previous + omega * (average(current) - previous), written over
+ * previous, which is only read at its own cell. Leaves the partial max |average(current) - current| per group.
+ */
+__kernel void chebyshev_step(__global const float* current, __global float* previous, uint width, uint height, float air_temperature, int source_x, int source_y,
+	float source_temperature, float omega, __global float* partial, __local float* scratch)
+{
+	index_t count = (index_t)width * height;
+	float maximum = 0.0F;
+	for (index_t i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		int col = i % width;
+		int row = i / width;
+		float average = is_source(col, row, source_x, source_y) ? source_temperature : current[i] + 0.25F * laplacian(current, col, row, width, height, air_temperature);
+		maximum = fmax(maximum, fabs(average - current[i]));
+		previous[i] += omega * (average - previous[i]);
+	}
+	reduce_sum_max(0.0F, maximum, partial, scratch);
+}
+
+/*cell (x, y, z) of a volume stored plane by plane, the air beyond it*/
+float volume_at(__global const float* field, int x, int y, int z, int width, int height, int depth, float air_temperature)
+{
+	if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth)
+		return air_temperature;
+	return field[((index_t)z * height + y) * width + x];
+}
+
+/*
+ * 3D FTCS step of one cell with the 7-point Laplacian or the 27-point one, (14 faces + 3 edges + 1 corners - 128 center) / 30.
+ * The mouse heats the top face, z = 0.
+ */
+__kernel void simulate_volume(__global const float* input, __global float* output, uint width, uint height, uint depth, float air_temperature, float ratio,
+	uint stencil, int point_x, int point_y, float point_temperature)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int z = get_global_id(2);
+	index_t i = ((index_t)z * height + y) * width + x;
+	if (0 == z && x == point_x && y == point_y)
+	{
+		output[i] = point_temperature;
+		return;
+	}
+
+	float center = input[i];
+	float sum = 0.0F;
+	if (27 == stencil)
+	{
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
 			{
-				if (coords.x + i < 0 || coords.x + i >= width || coords.y + j < 0 || coords.y + j >= height) color += ext_color * gaussian_kernel;
-				else color += read_imagef(input, sampler, (int2)(coords.x + i, coords.y + j)) * gaussian_kernel;
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int n = abs(dx) + abs(dy) + abs(dz);
+					if (n > 0)
+						sum += (1 == n ? 14.0F : 2 == n ? 3.0F : 1.0F) * volume_at(input, x + dx, y + dy, z + dz, width, height, depth, air_temperature);
+				}
 			}
 		}
+		sum = (sum - 128.0F * center) / 30.0F;
 	}
-	if (color.x < temperature_color[TEMPERATURES_COUNT - 1].x)
-    {
-        for (int i = 0; i < TEMPERATURES_COUNT - 1; i++)
-        {
-            if (color.x < temperature_color[i].y)
-            {
-                float diff = color.x - temperature_color[i].x;
-                float diff_total = temperature_color[i].y - temperature_color[i].x;
-                float proc = diff / diff_total;
-
-                plate_points[global_index].r = temperature_color[i].r + (temperature_color[i + 1].r - temperature_color[i].r) * proc;
-                plate_points[global_index].g = temperature_color[i].g + (temperature_color[i + 1].g - temperature_color[i].g) * proc;
-                plate_points[global_index].b = temperature_color[i].b + (temperature_color[i + 1].b - temperature_color[i].b) * proc;
-                break;
-            }
-        }
-    }
-    else
-    {
-        plate_points[global_index].r = temperature_color[TEMPERATURES_COUNT - 1].r;
-        plate_points[global_index].g = temperature_color[TEMPERATURES_COUNT - 1].g;
-        plate_points[global_index].b = temperature_color[TEMPERATURES_COUNT - 1].b;
-    }
+	else
+	{
+		sum = volume_at(input, x - 1, y, z, width, height, depth, air_temperature) + volume_at(input, x + 1, y, z, width, height, depth, air_temperature) +
+			volume_at(input, x, y - 1, z, width, height, depth, air_temperature) + volume_at(input, x, y + 1, z, width, height, depth, air_temperature) +
+			volume_at(input, x, y, z - 1, width, height, depth, air_temperature) + volume_at(input, x, y, z + 1, width, height, depth, air_temperature) - 6.0F * center;
+	}
+	output[i] = center + ratio * sum;
+}
 
-    write_imagef(output, coords, color);
-}
\ No newline at end of file
+/*the top face of the volume into the displayed image*/
+__kernel void volume_surface(__global const float* volume, write_only image2d_t output, uint width, __global struct vertex_args* plate_points)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	index_t i = cell_index(coords.x, coords.y, width);
+	float value = volume[i];
+	set_temperature_color(&plate_points[i], value);
+	write_imagef(output, coords, (float4)(value, value, value, value));
+}
@@ -1,10 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iosfwd>
 #include <iostream>
+#include <limits>
 #include <ostream>
 #include <sstream>
 
 
 
+#include "active_tiles.h"
+#include "archive.h"
 #include "ocl_args.h"
 
 #include <stdlib.h>
@@ -22,18 +28,34 @@
 #include <GLFW/glfw3.h>
 
 
+#include "boundary.h"
+#include "chebyshev.h"
+#include "field_codec.h"
+#include "geometry.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "input_log.h"
+#include "jfnk.h"
 #include "log_utils.h"
+#include "material.h"
 #include "ocl_context.h"
 #include "ocl_kernel.h"
 #include "ocl_memory.h"
+#include "out_of_core.h"
+#include "parallel.h"
+#include "playback.h"
+#include "snapshot.h"
+#include "solver.h"
+#include "sources.h"
+#include "stencil.h"
 #include "utils.h"
+#include "volume.h"
 
 #define APP_NAME "Heat Transfer Simulation"
 #define IMGUI_OFFSET_TOOLBOX 200
-#define CPU_THREAD_COUNT 4
+/*the f split of index_check: the CPU threads get the last tenth of a percent of the plate, its highest indices*/
+#define INDEX_CHECK_PERCENT 99.9F
 
 static const char* vertex_shader_text =
 "#version 110\n"
@@ -55,12 +77,12 @@ static const char* fragment_shader_text =
 "    gl_FragColor = vec4(color, 1.0);\n"
 "}\n";
 
-int setup_ocl(ocl_args_d_t* ocl, const cl_device_type device_type, const char* program_name, const char* kernel_name, const char* preferred_platform)
+int setup_ocl(ocl_args_d_t* ocl, const cl_device_type device_type, const char* program_name, const char* kernel_name, const char* generated_source, const char* preferred_platform)
 {
 	if (CL_SUCCESS != setup_open_cl(ocl, device_type, preferred_platform))
 		return -1;
 
-	if (CL_SUCCESS != setup_ocl_kernel(ocl, program_name, kernel_name))
+	if (CL_SUCCESS != setup_ocl_kernel(ocl, program_name, kernel_name, generated_source))
 		return -1;
 
     return CL_SUCCESS;
@@ -84,7 +106,7 @@ void log_device_info(const ocl_args_d_t& ocl)
 	}
 }
 
-int setup_device_memory(ocl_args_d_t* ocl, struct vertex_args* plate_points,const cl_uint array_width, const cl_uint array_height, const float plate_initial_temperature)
+int setup_device_memory(ocl_args_d_t* ocl, struct vertex_args* plate_points,const cl_uint array_width, const cl_uint array_height, const float plate_initial_temperature, const bool in_place)
 {
 	const auto optimized_size = ((sizeof(cl_float) * array_width * array_height - 1) / 64 + 1) * 64;
 	auto* input = static_cast<cl_float*>(_aligned_malloc(optimized_size, 4096));
@@ -96,7 +118,12 @@ int setup_device_memory(ocl_args_d_t* ocl, struct vertex_args* plate_points,cons
 	
 	generate_input(input, array_width, array_height, plate_initial_temperature);
 
-	if (CL_SUCCESS != create_buffer_arguments(ocl, input, plate_points, array_width, array_height))
+	if (CL_SUCCESS != create_buffer_arguments(ocl, input, plate_points, array_width, array_height, in_place))
+		return -1;
+
+	/*a generated stencil is checked against the CPU one on a test field, then the plate is written back*/
+	if (ocl->stencil_order > 2 && (CL_SUCCESS != check_stencil(ocl, ocl->stencil_order, array_width, array_height, plate_initial_temperature, stencil_ratio_limit(ocl->stencil_order)) ||
+		CL_SUCCESS != write_field(ocl, array_width, array_height, input)))
 		return -1;
 
 	_aligned_free(input);
@@ -104,9 +131,15 @@ int setup_device_memory(ocl_args_d_t* ocl, struct vertex_args* plate_points,cons
     return CL_SUCCESS;
 }
 
-int execute_kernel(ocl_args_d_t& ocl, const cl_uint array_width, const cl_uint array_height, float air_temperature, float point_temperature, unsigned point_x, unsigned point_y, cl_float gpu_percent)
+int execute_kernel(ocl_args_d_t& ocl, material_map& material, boundary_conditions& boundary, const cl_uint array_width, const cl_uint array_height, float air_temperature, cl_float gpu_percent,
+	cl_float ratio)
 {	
-	if (CL_SUCCESS != set_kernel_arguments(&ocl, array_width, array_height, air_temperature, point_x, point_y, point_temperature, gpu_percent))
+	if (!material.uniform)
+		return execute_material_kernel(&ocl, &material, array_width, array_height, air_temperature, gpu_percent, ratio);
+	if (boundary.enabled)
+		return execute_boundary_kernel(&ocl, &boundary, array_width, array_height, air_temperature, gpu_percent, ratio);
+
+	if (CL_SUCCESS != set_kernel_arguments(&ocl, array_width, array_height, air_temperature, gpu_percent, ratio))
 		return -1;
 	if (CL_SUCCESS != execute_add_kernel(&ocl, array_width, array_height))
 		return -1;
@@ -140,7 +173,8 @@ void gl_setup_shader(GLuint& program, GLint& mvp_location)
 	glVertexAttribPointer(vcol_location, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex_args), reinterpret_cast<void*>(sizeof(float) * 2));
 }
 
-void draw_pixels(cl_uint array_width, cl_uint array_height, vertex_args** plate_points, GLFWwindow* window, GLuint vertex_buffer, GLuint program, GLint mvp_location)
+void draw_pixels(cl_uint array_width, cl_uint array_height, vertex_args** plate_points, GLFWwindow* window, GLuint vertex_buffer, GLuint program, GLint mvp_location,
+	const std::vector<GLint>& part_first, const std::vector<GLsizei>& part_count)
 {
 	/*setup viewport*/
 	int width, height;
@@ -157,7 +191,11 @@ void draw_pixels(cl_uint array_width, cl_uint array_height, vertex_args** plate_
 	glUseProgram(program);
 	glUniformMatrix4fv(mvp_location, 1, GL_FALSE, glm::value_ptr(mvp));
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glDrawArrays(GL_POINTS, 0, array_width * array_height);
+	/*with a geometry mask only the runs of the part are drawn, the rest shows the background*/
+	if (part_first.empty())
+		glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(static_cast<size_t>(array_width) * array_height));
+	else
+		glMultiDrawArrays(GL_POINTS, part_first.data(), part_count.data(), static_cast<GLsizei>(part_first.size()));
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
 	*plate_points = static_cast<struct vertex_args*>(glMapBuffer(GL_ARRAY_BUFFER, GL_READ_WRITE));
 }
@@ -197,31 +235,82 @@ void create_gl_buffer(cl_uint array_width, cl_uint array_height, GLuint& vertex_
 {
 	glGenBuffers(1, &vertex_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, array_width * array_height * sizeof(struct vertex_args), nullptr, GL_DYNAMIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(static_cast<size_t>(array_width) * array_height * sizeof(struct vertex_args)), nullptr, GL_DYNAMIC_DRAW);
 	*plate_points = static_cast<struct vertex_args*>(glMapBuffer(GL_ARRAY_BUFFER, GL_READ_WRITE));
 	for (cl_uint i = 0; i < array_height; i++)
 	{
 		for (cl_uint j = 0; j < array_width; j++)
 		{
-			static_cast<struct vertex_args*>(*plate_points)[i * array_width + j].x = 2 * (j / static_cast<float>(array_width) - 0.5F);
-			static_cast<struct vertex_args*>(*plate_points)[i * array_width + j].y = 2 * (i / static_cast<float>(array_height) - 0.5F);
+			static_cast<struct vertex_args*>(*plate_points)[static_cast<size_t>(i) * array_width + j].x = 2 * (j / static_cast<float>(array_width) - 0.5F);
+			static_cast<struct vertex_args*>(*plate_points)[static_cast<size_t>(i) * array_width + j].y = 2 * (i / static_cast<float>(array_height) - 0.5F);
 		}
 	}
 }
 
-void imgui_draw_toolbox(float& air_temperature, float& point_temperature, float& gpu_percent, bool& simulate_ocl, const bool convergence_check)
+void imgui_draw_toolbox(float& air_temperature, float& point_temperature, float& gpu_percent, bool& simulate_ocl, bool& save_snapshot, bool& codec_report, const bool convergence_check, const heat_model& model,
+	int& solver, bool& solver_on_cpu, const solver_state& solver_info, const bool in_place, const char* solver_lock)
 {
 	ImGui::Begin("Toolbox");                     
 
 	ImGui::SliderFloat("Point temperature", &point_temperature, 0.0f, 10000.0f);
 	ImGui::SliderFloat("Air temperature", &air_temperature, 0.0f, 70.0F);
-	ImGui::SliderFloat("f", &gpu_percent, 0.0f, 100.0F);
+	/*a feature that only one solver runs fixes the solver*/
+	if (*solver_lock)
+		ImGui::Text("Solver: %s, %s", solver_names[solver], solver_lock);
+	else
+		ImGui::Combo("Solver", &solver, solver_names, SOLVER_COUNT);
+	if (SOLVER_FTCS == solver)
+		ImGui::SliderFloat("f", &gpu_percent, 0.0f, 100.0F);
+	else if (has_device_step(static_cast<solver_kind>(solver)) && !in_place)
+		ImGui::Checkbox("Solve on the CPU", &solver_on_cpu);
 	ImGui::Checkbox("Simulation running", &simulate_ocl);
+	save_snapshot = ImGui::Button("Save snapshot");
+	ImGui::SameLine();
+	codec_report = ImGui::Button("Codec report");
 	if (convergence_check)
 	{
 		ImGui::Text("Convergence reached.");
 	}
 
+	const auto framerate = ImGui::GetIO().Framerate;
+	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / framerate, framerate);
+	/*one step per frame*/
+	const auto time_step = solver_time_step(model, static_cast<solver_kind>(solver));
+	if (is_steady_solver(static_cast<solver_kind>(solver)))
+		ImGui::Text("Steady state");
+	else
+		ImGui::Text("dt=%g s, %.4f simulated s per wall s", time_step, simulate_ocl ? framerate * time_step : 0.0F);
+	if ((SOLVER_JFNK == solver || SOLVER_JFNK_STEADY == solver) && solver_info.jfnk)
+		ImGui::Text("%u Newton steps, %u GMRES iterations, %.3f ms per Newton step, residual %g", solver_info.jfnk->newton_steps, solver_info.iterations,
+			solver_info.jfnk->newton_steps ? 1000.0 * solver_info.jfnk->seconds / solver_info.jfnk->newton_steps : 0.0, solver_info.residual);
+	else if (SOLVER_FTCS != solver)
+		ImGui::Text("%u iterations, residual %g", solver_info.iterations, solver_info.residual);
+	ImGui::End();
+}
+
+void imgui_draw_playback(playback_state& playback)
+{
+	ImGui::Begin("Toolbox");
+
+	auto frame = static_cast<int>(playback_frame(&playback));
+	const auto last = static_cast<int>(playback.archive.frame_count - 1);
+	if (ImGui::SliderInt("Frame", &frame, 0, last))
+		seek_playback(&playback, frame);
+	/*only this thread writes them, so they are read without the lock*/
+	auto speed = playback.speed;
+	auto playing = playback.playing;
+	auto changed = ImGui::SliderFloat("Frames per second", &speed, -240.0F, 240.0F);
+	changed |= ImGui::Checkbox("Playing", &playing);
+	ImGui::SameLine();
+	if (ImGui::Button("Reverse"))
+	{
+		speed = -speed;
+		changed = true;
+	}
+	if (changed)
+		set_playback_speed(&playback, speed, playing);
+	ImGui::Text("Step %llu", static_cast<unsigned long long>(playback.archive.index[frame].step));
+
 	const auto framerate = ImGui::GetIO().Framerate;
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / framerate, framerate);
 	ImGui::End();
@@ -242,66 +331,61 @@ void imgui_setup(GLFWwindow* window)
 	ImGui_ImplOpenGL3_Init();
 }
 
-void cpu_simulate(const int t_id, const float* input, float* output, const cl_int width, const cl_int height, const float air_temperature, const cl_int point_x, const cl_int point_y, const float point_temperature, struct vertex_args* plate_points, const float gpu_percent)
+void cpu_simulate(const int t_id, const float* input, float* output, const cl_uint width, const cl_uint height, const float air_temperature, struct vertex_args* plate_points, const float gpu_percent, const float ratio, const material_map* material,
+	const cl_uint stencil_order, const boundary_conditions* boundary)
 {
-	const auto cpu_work_size = width * height * (100 - static_cast<int>(gpu_percent)) / 100;
-	const auto cpu_thread_work_size = cpu_work_size / CPU_THREAD_COUNT;
-
-	const auto thread_start = (width * height * static_cast<int>(gpu_percent)) / 100 + t_id * cpu_thread_work_size;
-	auto thread_end = thread_start + cpu_thread_work_size;
-	if (t_id == CPU_THREAD_COUNT - 1)
-		thread_end = width * height;
-		
+	/*the cells past the device ones, split evenly; size_t so a plate past 2^31 cells does not overflow*/
+	const auto count = static_cast<size_t>(width) * height;
+	const auto cpu_first = static_cast<size_t>(device_cell_count(width, height, gpu_percent));
+	const auto thread_start = cpu_first + (count - cpu_first) * t_id / CPU_THREAD_COUNT;
+	const auto thread_end = cpu_first + (count - cpu_first) * (t_id + 1) / CPU_THREAD_COUNT;
 
-	auto const gaussian_kernel = 1 / 9.0F;
+	/*the wider stencils and the edge models, the same as their generated kernels*/
+	if (!material && (stencil_order > 2 || boundary))
+	{
+		if (boundary)
+			step_boundary_cells(*boundary, input, output, width, height, air_temperature, ratio, thread_start, thread_end);
+		else
+			step_stencil(stencil_order, input, output, width, height, air_temperature, ratio, thread_start, thread_end);
+		for (auto i = thread_start; i < thread_end; i++)
+			set_temperature_color(plate_points[i], output[i]);
+		return;
+	}
 
 	for (auto i = thread_start; i < thread_end; i++)
 	{
-		output[i] = 0;
-		if (point_y * width + point_x == i)
+		/*the sources are set afterwards, by the scatter kernel*/
+		if (material)
 		{
-			output[i] = point_temperature;
+			output[i] = material_step(*material, input, static_cast<cl_uint>(i % width), static_cast<cl_uint>(i / width), air_temperature, ratio);
 		}
 		else {
-			for (auto j = -1; j <= 1; j++)
-			{
-				for (auto k = -1; k <= 1; k++)
-				{
-					if (i % width + j < 0 || i % width + j >= width || i / width + k < 0 || i / width + k >= height)
-						output[i] += air_temperature * gaussian_kernel;
-					else 
-						output[i] += input[i + j * width + k] * gaussian_kernel;
-				}
-			}
+			/*FTCS step, neighbours outside of the plate are at the air temperature*/
+			const auto x = i % width;
+			const auto y = i / width;
+			const auto center = input[i];
+			const auto neighbours = (x > 0 ? input[i - 1] : air_temperature) + (x + 1 < width ? input[i + 1] : air_temperature) +
+				(y > 0 ? input[i - width] : air_temperature) + (y + 1 < height ? input[i + width] : air_temperature);
+			output[i] = center + ratio * (neighbours - 4 * center);
 		}
 
-		if (output[i] < temperature_color[TEMPERATURES_COUNT - 1].x)
-		{
-			for (auto j = 0; j < TEMPERATURES_COUNT - 1; j++)
-			{
-				if (output[i] < temperature_color[j].y)
-				{
-					const auto diff = output[i] - temperature_color[j].x;
-					const auto diff_total = temperature_color[j].y - temperature_color[j].x;
-					const auto proc = diff / diff_total;
-
-					plate_points[i].r = temperature_color[j].r + (temperature_color[j + 1].r - temperature_color[j].r) * proc;
-					plate_points[i].g = temperature_color[j].g + (temperature_color[j + 1].g - temperature_color[j].g) * proc;
-					plate_points[i].b = temperature_color[j].b + (temperature_color[j + 1].b - temperature_color[j].b) * proc;
-					break;
-				}
-			}
-		}
-		else
-		{
-			plate_points[i].r = temperature_color[TEMPERATURES_COUNT - 1].r;
-			plate_points[i].g = temperature_color[TEMPERATURES_COUNT - 1].g;
-			plate_points[i].b = temperature_color[TEMPERATURES_COUNT - 1].b;
-		}
+		set_temperature_color(plate_points[i], output[i]);
 	}
 }
 
-int run_cpu_thread(const ocl_args_d_t& ocl, cl_uint array_width, cl_uint array_height, float air_temperature, float point_temperature, int point_x, int point_y, float gpu_percent, vertex_args* plate_points)
+/*the CPU part of the active tiles, every CPU_THREAD_COUNT-th of them from t_id on*/
+void cpu_simulate_tiles(const int t_id, const float* input, float* output, const cl_uint width, const cl_uint height, const float air_temperature, struct vertex_args* plate_points, const float gpu_percent, const float ratio, const material_map* material, tile_tracker* tiles)
+{
+	const auto cpu_start = static_cast<size_t>(device_cell_count(width, height, gpu_percent));
+	for (auto k = static_cast<size_t>(t_id); k < tiles->active.size(); k += CPU_THREAD_COUNT)
+	{
+		const auto tile = tiles->active[k];
+		if (step_tile_cpu(*tiles, tile, cpu_start, input, output, width, height, air_temperature, material, ratio, plate_points))
+			tiles->changed[tile] = 1;
+	}
+}
+
+int run_cpu_thread(const ocl_args_d_t& ocl, const material_map& material, tile_tracker& tiles, const geometry_mask& geometry, const boundary_conditions& boundary, cl_uint array_width, cl_uint array_height, float air_temperature, float gpu_percent, float ratio, vertex_args* plate_points)
 {
 	std::thread cpu_threads[CPU_THREAD_COUNT];
 	size_t origin[] = { 0, 0, 0 };
@@ -332,9 +416,24 @@ int run_cpu_thread(const ocl_args_d_t& ocl, cl_uint array_width, cl_uint array_h
 		return -1;
 	}
     		
+	const auto first_span = geometry_device_spans(geometry, gpu_percent);
+	const auto cpu_spans = geometry.spans.size() - first_span;
 	for (auto i = 0; i < CPU_THREAD_COUNT; i++)
 	{
-		std::thread t(cpu_simulate, i, input, output, array_width, array_height, air_temperature, point_x, point_y, point_temperature, plate_points, gpu_percent);
+		if (geometry.enabled)
+		{
+			cpu_threads[i] = std::thread(step_geometry_spans, std::cref(geometry), input, output, air_temperature, ratio, plate_points,
+				first_span + cpu_spans * i / CPU_THREAD_COUNT, first_span + cpu_spans * (i + 1) / CPU_THREAD_COUNT);
+			continue;
+		}
+		if (tiles.enabled)
+		{
+			cpu_threads[i] = std::thread(cpu_simulate_tiles, i, input, output, array_width, array_height, air_temperature, plate_points, gpu_percent, ratio,
+				material.uniform ? nullptr : &material, &tiles);
+			continue;
+		}
+		std::thread t(cpu_simulate, i, input, output, array_width, array_height, air_temperature, plate_points, gpu_percent, ratio,
+			material.uniform ? nullptr : &material, ocl.stencil_order, boundary.enabled ? &boundary : nullptr);
 		cpu_threads[i] = std::move(t);
 	}
 
@@ -360,13 +459,667 @@ int run_cpu_thread(const ocl_args_d_t& ocl, cl_uint array_width, cl_uint array_h
 	return CL_SUCCESS;
 }
 
+int simulate_frame(ocl_args_d_t& ocl, material_map& material, source_set& sources, tile_tracker& tiles, volume_state& volume, geometry_mask& geometry, boundary_conditions& boundary, cl_uint array_width, cl_uint array_height, const input_state& input, const heat_model& model, solver_state& solver, vertex_args* plate_points)
+{
+	const auto kind = static_cast<solver_kind>(input.solver);
+	if (SOLVER_FTCS != kind)
+	{
+		const plate_problem problem = { array_width, array_height, input.air_temperature, input.point_x, input.point_y, input.point_temperature };
+		if (input.running && CL_SUCCESS != step_solver(&ocl, &solver, kind, static_cast<solver_backend>(input.backend), problem, model, plate_points))
+			return -1;
+		/*the tiles know nothing of what another solver did to the field*/
+		wake_all_tiles(&tiles);
+		return CL_SUCCESS;
+	}
+
+	const auto time_step = explicit_time_step(model);
+	const auto ratio = diffusion_ratio(model, time_step);
+	if (!input.running)
+		return CL_SUCCESS;
+
+	/*a thick plate steps its volume, on the device unless all of it is given to the CPU, and shows the top face*/
+	if (volume.enabled)
+		return step_volume(&ocl, &volume, input.gpu_percent > 0, input.air_temperature, input.point_x, input.point_y, input.point_temperature, ratio, plate_points);
+	wake_tiles(&tiles, array_width, array_height, input.air_temperature, input.point_x, input.point_y);
+
+	/*CPU threads*/
+	if (input.gpu_percent < 100 && CL_SUCCESS != run_cpu_thread(ocl, material, tiles, geometry, boundary, array_width, array_height, input.air_temperature, input.gpu_percent, ratio, plate_points))
+		return -1;
+
+	/*kernel execution: only if there is not an equilibrium, and with active tiles only where there is not*/
+	if (input.gpu_percent > 0 && tiles.enabled && CL_SUCCESS != execute_tile_kernel(&ocl, &tiles, material, array_width, array_height, input.air_temperature, input.gpu_percent, ratio))
+		return -1;
+	if (input.gpu_percent > 0 && geometry.enabled && CL_SUCCESS != execute_geometry_kernel(&ocl, &geometry, input.air_temperature, input.gpu_percent, ratio))
+		return -1;
+	if (input.gpu_percent > 0 && !tiles.enabled && !geometry.enabled && CL_SUCCESS != execute_kernel(ocl, material, boundary, array_width, array_height, input.air_temperature, input.gpu_percent, ratio))
+		return -1;
+
+	/*the mouse and the configured sources, over both parts of the plate*/
+	if (CL_SUCCESS != execute_source_kernel(&ocl, &sources, material, array_width, array_height, input.air_temperature, input.point_x, input.point_y,
+		input.point_temperature, ratio, time_step, tiles.device.changed, tiles.columns))
+		return -1;
+
+	return update_active_tiles(&ocl, &tiles);
+}
+
+void swap_fields(ocl_args_d_t& ocl)
+{
+	auto* aux = ocl.output;
+	ocl.output = ocl.input;
+	ocl.input = aux;
+}
+
+int run_replay(ocl_args_d_t& ocl, material_map& material, geometry_mask& geometry, boundary_conditions& boundary, const app_config& config)
+{
+	input_player player;
+	input_state input;
+	solver_state solver;
+	source_set sources;
+	tile_tracker tiles;
+	volume_state volume;
+	cl_ulong frames = 0;
+	cl_ulong steps = 0;
+	double simulated_seconds = 0.0;
+
+	if (CL_SUCCESS != open_input_player(&player, config.replay_file.c_str()))
+		return -1;
+
+	const auto array_width = player.width;
+	const auto array_height = player.height;
+	const auto& model = player.model;
+	init_solver(&solver, player.solver_options);
+	solver.conductivity = &config.conductivity;
+	if (!material.conductivity.empty() && (material.width != array_width || material.height != array_height))
+	{
+		log_error("Error: the material map is %ux%u, the recorded plate %ux%u.\n", material.width, material.height, array_width, array_height);
+		return -1;
+	}
+	/*the edge models are built into the kernels from the config, they have to be the ones of the session*/
+	if (!same_recorded_boundary(&player, boundary))
+	{
+		log_error("Error: the boundary models differ from the ones '%s' was recorded with, replay it with the same boundary settings.\n", config.replay_file.c_str());
+		return -1;
+	}
+	/*so does the part, which decides the cells stepped and the sources kept*/
+	if (geometry.enabled && (geometry.width != array_width || geometry.height != array_height))
+	{
+		log_error("Error: the geometry mask is %ux%u, the recorded plate %ux%u.\n", geometry.width, geometry.height, array_width, array_height);
+		return -1;
+	}
+	if (geometry_hash(geometry) != player.geometry_hash)
+	{
+		log_error("Error: the geometry mask differs from the one '%s' was recorded with, replay it with the same geometry_map.\n", config.replay_file.c_str());
+		return -1;
+	}
+	setup_source_cells(&sources, config.sources, array_width, array_height, geometry.enabled ? &geometry : nullptr);
+	init_tile_tracker(&tiles, array_width, array_height, config.active_tiles);
+	/*the input log records a 2D plate*/
+	init_volume(&volume, array_width, array_height, 1, config.stencil, player.plate_initial_temperature);
+	if (CL_SUCCESS != setup_ocl_sources(&ocl, &sources) || CL_SUCCESS != setup_ocl_tiles(&ocl, &tiles) || CL_SUCCESS != setup_ocl_geometry(&ocl, &geometry))
+		return -1;
+	log_info("\nreplay=%s\nwidth=%u\nheight=%u\nplate_temp=%f\ntime_step=%g\nframes=%llu\n", config.replay_file.c_str(), array_width, array_height,
+		player.plate_initial_temperature, model.time_step, static_cast<unsigned long long>(input_frame_count(&player)));
+
+	/*no window: the kernels still color the plate, into host memory nobody draws*/
+	auto* plate_points = static_cast<struct vertex_args*>(_aligned_malloc(sizeof(struct vertex_args) * array_width * array_height, 4096));
+	if (nullptr == plate_points)
+	{
+		log_error("Error: _aligned_malloc failed to allocate buffers.\n");
+		return -1;
+	}
+
+	if (CL_SUCCESS != setup_device_memory(&ocl, plate_points, array_width, array_height, player.plate_initial_temperature, false))
+		return -1;
+
+	const auto start = std::chrono::steady_clock::now();
+	while (next_input(&player, input))
+	{
+		if (CL_SUCCESS != simulate_frame(ocl, material, sources, tiles, volume, geometry, boundary, array_width, array_height, input, model, solver, plate_points))
+			return -1;
+
+		/*buffers are swapped on every frame, paused or not, exactly like the interactive loop does*/
+		swap_fields(ocl);
+		frames++;
+		if (input.running)
+		{
+			steps++;
+			simulated_seconds += solver_time_step(model, static_cast<solver_kind>(input.solver));
+		}
+	}
+	const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<cl_float> field(static_cast<size_t>(array_width) * array_height);
+	if (CL_SUCCESS != read_field(&ocl, array_width, array_height, field.data()))
+		return -1;
+
+	log_info("replay: frames=%llu steps=%llu time=%.3fs (%.1f steps/s, %.4f simulated s per wall s) checksum=%016llx\n", static_cast<unsigned long long>(frames),
+		static_cast<unsigned long long>(steps), seconds, seconds > 0.0 ? steps / seconds : 0.0, seconds > 0.0 ? simulated_seconds / seconds : 0.0,
+		static_cast<unsigned long long>(hash_bytes(field.data(), sizeof(cl_float) * field.size())));
+
+	/*the device buffer still points at the host memory until the context goes away*/
+	clReleaseMemObject(ocl.plate_points);
+	ocl.plate_points = nullptr;
+	_aligned_free(plate_points);
+
+	return CL_SUCCESS;
+}
+
+/*
+ * Runs the explicit kernel and the configured solver over the same simulated time, from the same plate with the source
+ * in the middle, and compares the final fields. Steady solvers solve once.
+ */
+int run_benchmark(ocl_args_d_t& ocl, material_map& material, source_set& sources, tile_tracker& tiles, volume_state& volume, geometry_mask& geometry, boundary_conditions& boundary, const app_config& config, const cl_uint array_width, const cl_uint array_height, const cl_float plate_initial_temperature,
+	const cl_float air_temperature, const cl_float point_temperature)
+{
+	const auto count = static_cast<size_t>(array_width) * array_height;
+	const auto& model = config.model;
+	const solver_kind kinds[] = { SOLVER_FTCS, config.solver };
+	std::vector<cl_float> fields[2];
+
+	auto* plate_points = static_cast<struct vertex_args*>(_aligned_malloc(sizeof(struct vertex_args) * count, 4096));
+	if (nullptr == plate_points)
+	{
+		log_error("Error: _aligned_malloc failed to allocate buffers.\n");
+		return -1;
+	}
+	if (CL_SUCCESS != setup_device_memory(&ocl, plate_points, array_width, array_height, plate_initial_temperature, false))
+		return -1;
+
+	std::vector<cl_float> initial(count);
+	generate_input(initial.data(), array_width, array_height, plate_initial_temperature);
+
+	for (auto k = 0; k < 2; k++)
+	{
+		const auto kind = kinds[k];
+		const auto time_step = solver_time_step(model, kind);
+		const auto steps = time_step > 0.0F ? static_cast<cl_ulong>(std::ceil(config.benchmark_time / time_step)) : 1;
+		const input_state input = { static_cast<cl_int>(array_width / 2), static_cast<cl_int>(array_height / 2), air_temperature, point_temperature, 100.0F, 1,
+			static_cast<cl_uint>(kind), static_cast<cl_uint>(config.backend) };
+		solver_state solver;
+		init_solver(&solver, config.solver_options);
+		solver.conductivity = &config.conductivity;
+		fields[k].resize(count);
+		sources.time = 0.0;
+		wake_all_tiles(&tiles);
+
+		if (CL_SUCCESS != write_field(&ocl, array_width, array_height, initial.data()) || CL_SUCCESS != reset_volume(&ocl, &volume, plate_initial_temperature))
+			return -1;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (cl_ulong step = 0; step < steps; step++)
+		{
+			if (CL_SUCCESS != simulate_frame(ocl, material, sources, tiles, volume, geometry, boundary, array_width, array_height, input, model, solver, plate_points))
+				return -1;
+			swap_fields(ocl);
+		}
+		if (CL_SUCCESS != read_field(&ocl, array_width, array_height, fields[k].data()))
+			return -1;
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		log_info("benchmark: solver=%s steps=%llu dt=%g simulated=%gs time=%.3fs (%.1f steps/s)\n", solver_names[kind], static_cast<unsigned long long>(steps),
+			time_step, time_step * steps, seconds, seconds > 0.0 ? steps / seconds : 0.0);
+		if ((SOLVER_JFNK == kind || SOLVER_JFNK_STEADY == kind) && solver.jfnk)
+		{
+			const auto newton_steps = solver.jfnk->total_newton_steps;
+			log_info("benchmark: %llu Newton steps, %.3f ms per Newton step\n", static_cast<unsigned long long>(newton_steps),
+				newton_steps ? 1000.0 * solver.jfnk->total_seconds / newton_steps : 0.0);
+		}
+	}
+
+	auto max_difference = 0.0;
+	auto sum_difference = 0.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto difference = std::fabs(static_cast<double>(fields[1][i]) - fields[0][i]);
+		max_difference = std::max(max_difference, difference);
+		sum_difference += difference;
+	}
+	log_info("benchmark: %s against ftcs, max difference %g, mean difference %g degrees\n", solver_names[config.solver], max_difference, sum_difference / count);
+
+	clReleaseMemObject(ocl.plate_points);
+	ocl.plate_points = nullptr;
+	_aligned_free(plate_points);
+
+	return CL_SUCCESS;
+}
+
+int save_field(ocl_args_d_t& ocl, const material_map& material, cl_uint array_width, cl_uint array_height, cl_ulong step, const app_config& config, bool save_snapshot, bool codec_report, archive_writer* archive)
+{
+	std::vector<cl_float> field(static_cast<size_t>(array_width) * array_height);
+	if (CL_SUCCESS != read_field(&ocl, array_width, array_height, field.data()))
+		return -1;
+
+	if (codec_report)
+		log_codec_report(field.data(), array_width, array_height);
+
+	if (save_snapshot)
+	{
+		/*a zero tolerance keeps the snapshot bit-exact*/
+		const auto mode = config.snapshot_tolerance > 0.0F ? CODEC_LOSSY : CODEC_LOSSLESS;
+		std::ostringstream file_name;
+		file_name << "snapshot_" << step << ".hts";
+		/*a loaded conductivity map is part of the checkpoint*/
+		const auto* conductivity = material.conductivity.empty() ? nullptr : material.conductivity.data();
+		if (CL_SUCCESS != write_snapshot(file_name.str().c_str(), field.data(), conductivity, array_width, array_height, step, mode, config.snapshot_tolerance))
+			return -1;
+	}
+
+	if (archive && CL_SUCCESS != append_archive_frame(archive, step, field.data()))
+		return -1;
+
+	return CL_SUCCESS;
+}
+
+/*
+ * writes the archive frame at or before export_step as a snapshot of the pyramid level that fits in playback_max_width x
+ * playback_max_height, decoding only that level
+ */
+int run_archive_export(const app_config& config)
+{
+	archive_reader archive;
+	if (CL_SUCCESS != open_archive_reader(&archive, config.playback_file.c_str()))
+		return -1;
+
+	auto result = -1;
+	const auto frame = find_archive_frame(&archive, config.export_step);
+	if (frame < 0)
+	{
+		log_error("Error: archive '%s' has no frame at or before step %llu.\n", config.playback_file.c_str(), static_cast<unsigned long long>(config.export_step));
+	}
+	else
+	{
+		const auto level = choose_archive_level(&archive, config.playback_max_width, config.playback_max_height);
+		cl_uint width, height;
+		archive_level_size(archive.width, archive.height, level, &width, &height);
+		std::vector<cl_float> field(static_cast<size_t>(width) * height);
+		const auto step = archive.index[frame].step;
+		if (CL_SUCCESS == read_archive_level(&archive, frame, level, field.data()) &&
+			CL_SUCCESS == write_snapshot(config.export_file.c_str(), field.data(), nullptr, width, height, step, CODEC_LOSSLESS, 0.0F))
+		{
+			log_info("Exported step %llu of '%s' at level %u (%ux%u) to '%s'.\n", static_cast<unsigned long long>(step), config.playback_file.c_str(), level, width, height,
+				config.export_file.c_str());
+			result = CL_SUCCESS;
+		}
+	}
+
+	close_archive_reader(&archive);
+	return result;
+}
+
+int run_playback(const app_config& config)
+{
+	playback_state playback;
+	struct vertex_args* plate_points = nullptr;
+	cl_long displayed_frame = -1;
+
+	if (CL_SUCCESS != open_playback(&playback, config.playback_file.c_str(), config.playback_max_width, config.playback_max_height))
+		return -1;
+
+	/*the window shows the pyramid level that fits the screen, not the full plate*/
+	const auto array_width = playback.width;
+	const auto array_height = playback.height;
+	log_info("\nplayback=%s\nwidth=%u\nheight=%u\nlevel=%u\nframes=%llu\n", config.playback_file.c_str(), playback.archive.width, playback.archive.height,
+		playback.level, static_cast<unsigned long long>(playback.archive.frame_count));
+
+	GLFWwindow* window;
+	if (0 != setup_ogl(array_width, array_height, window)) return -1;
+
+	GLuint vertex_buffer;
+	create_gl_buffer(array_width, array_height, vertex_buffer, &plate_points);
+
+	GLuint program;
+	GLint mvp_location;
+	gl_setup_shader(program, mvp_location);
+
+	imgui_setup(window);
+
+	while (!glfwWindowShouldClose(window))
+	{
+		ImGui_ImplOpenGL3_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+
+		advance_playback(&playback, ImGui::GetIO().DeltaTime);
+
+		/*only recolor when the playhead moved onto a frame that is already decoded*/
+		const auto frame = playback_frame(&playback);
+		if (frame != displayed_frame && draw_playback_frame(&playback, frame, plate_points))
+			displayed_frame = frame;
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		draw_pixels(array_width, array_height, &plate_points, window, vertex_buffer, program, mvp_location, {}, {});
+
+		imgui_draw_playback(playback);
+
+		ImGui::Render();
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+
+	close_playback(&playback);
+
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	return 0;
+}
+
+/*
+ * Steps a plate that lives in the out_of_core file, on the CPU and headless, for out_of_core_time simulated seconds in
+ * passes of out_of_core_halo steps. out_of_core_check:1 also steps a copy of the plate in memory and compares the time
+ * and the result; the plate must fit in memory twice for that.
+ */
+int run_out_of_core(const app_config& config, const cl_uint array_width, const cl_uint array_height, const cl_float plate_initial_temperature,
+	const cl_float air_temperature, const cl_float point_temperature)
+{
+	const auto& model = config.model;
+	if (SOLVER_FTCS != config.solver || !config.material_file.empty() || !config.sources.empty() || !config.geometry_file.empty() || config.plate_depth > 1 ||
+		config.stencil_order > 2)
+		log_error("Warning: out_of_core runs ftcs on a uniform 2D plate, the source in the middle and air at the edges; the other plate settings are ignored.\n");
+	const auto tile_size = std::max(config.out_of_core_tile, 1u);
+	const auto halo = std::max(config.out_of_core_halo, 1u);
+	const auto slot_count = config.out_of_core_slots > 0 ? config.out_of_core_slots : 2 * CPU_THREAD_COUNT + 2;
+
+	out_of_core_plate plate;
+	if (CL_SUCCESS != open_out_of_core_plate(&plate, config.out_of_core_file.c_str(), array_width, array_height, plate_initial_temperature, tile_size, halo, slot_count))
+		return -1;
+
+	const auto count = static_cast<size_t>(array_width) * array_height;
+	const auto point_x = static_cast<cl_int>(array_width / 2);
+	const auto point_y = static_cast<cl_int>(array_height / 2);
+	const auto ratio = diffusion_ratio(model, model.time_step);
+	const auto steps = std::max(static_cast<cl_ulong>(std::ceil(config.out_of_core_time / model.time_step)), static_cast<cl_ulong>(1));
+	std::vector<cl_float> fields[2];
+	if (config.out_of_core_check)
+	{
+		fields[0].assign(out_of_core_field(plate), out_of_core_field(plate) + count);
+		fields[1].resize(count);
+	}
+
+	cl_uint passes = 0;
+	auto load_seconds = 0.0;
+	auto step_seconds = 0.0;
+	auto write_seconds = 0.0;
+	const auto start = std::chrono::steady_clock::now();
+	for (cl_ulong step = 0; step < steps; passes++)
+	{
+		const auto pass_steps = static_cast<cl_uint>(std::min(static_cast<cl_ulong>(halo), steps - step));
+		step_out_of_core(&plate, air_temperature, point_x, point_y, point_temperature, ratio, pass_steps);
+		load_seconds += plate.load_seconds;
+		step_seconds += plate.step_seconds;
+		write_seconds += plate.write_seconds;
+		step += pass_steps;
+	}
+	const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	log_info("out_of_core: steps=%llu passes=%u dt=%g simulated=%gs time=%.3fs (%.1f Mcell steps/s) at step %llu; loading %.3fs, stepping %.3fs over %d threads, writing %.3fs\n",
+		static_cast<unsigned long long>(steps), passes, model.time_step, model.time_step * steps, seconds, seconds > 0.0 ? count * steps / seconds / 1.0e6 : 0.0,
+		static_cast<unsigned long long>(out_of_core_state(plate).steps), load_seconds, step_seconds, CPU_THREAD_COUNT, write_seconds);
+
+	if (config.out_of_core_check)
+	{
+		const auto in_core_start = std::chrono::steady_clock::now();
+		for (cl_ulong step = 0; step < steps; step++)
+		{
+			step_in_core(fields[0].data(), fields[1].data(), array_width, array_height, air_temperature, point_x, point_y, point_temperature, ratio);
+			fields[0].swap(fields[1]);
+		}
+		const auto in_core_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - in_core_start).count();
+
+		const auto* field = out_of_core_field(plate);
+		auto max_difference = 0.0;
+		for (size_t i = 0; i < count; i++)
+			max_difference = std::max(max_difference, std::fabs(static_cast<double>(field[i]) - fields[0][i]));
+		log_info("out_of_core: in memory time=%.3fs (%.1f Mcell steps/s), out of core %.2fx as long, max difference %g degrees\n", in_core_seconds,
+			in_core_seconds > 0.0 ? count * steps / in_core_seconds / 1.0e6 : 0.0, in_core_seconds > 0.0 ? seconds / in_core_seconds : 0.0, max_difference);
+	}
+
+	close_out_of_core_plate(&plate);
+	return CL_SUCCESS;
+}
+
+/*
+ * index_check:1 steps the CPU part of a plate meant to be past 2^31 cells through cpu_simulate, with the f split at
+ * INDEX_CHECK_PERCENT so the threads get the cells past 32-bit indices. The fields and the vertices are only reserved,
+ * and just the pages the CPU part may touch are committed: a thread that strays from its range faults instead of passing.
+ * Every cell and its color are checked against the step of the initial field, which is a formula of the cell. index_check:2
+ * also commits the whole plate and round-trips it through the codec.
+ */
+int run_index_check(const app_config& config, const cl_uint array_width, const cl_uint array_height, const cl_float air_temperature)
+{
+	const auto count = static_cast<size_t>(array_width) * array_height;
+	if (count <= 0x80000000ULL)
+		log_error("Warning: index_check on a %ux%u plate stays within 2^31 cells, make it larger to check the 64-bit indices.\n", array_width, array_height);
+
+	const auto initial = [array_width](const size_t i)
+	{
+		return 20.0F + static_cast<cl_float>(i % array_width % 1000) * 0.5F + static_cast<cl_float>(i / array_width % 9) * 30.0F;
+	};
+	const auto first = static_cast<size_t>(device_cell_count(array_width, array_height, INDEX_CHECK_PERCENT));
+	/*the rows above the CPU part are read by its first row*/
+	const auto read_first = first > array_width ? first - array_width : 0;
+
+	auto* input = static_cast<cl_float*>(VirtualAlloc(nullptr, count * sizeof(cl_float), MEM_RESERVE, PAGE_NOACCESS));
+	auto* output = static_cast<cl_float*>(VirtualAlloc(nullptr, count * sizeof(cl_float), MEM_RESERVE, PAGE_NOACCESS));
+	auto* plate_points = static_cast<vertex_args*>(VirtualAlloc(nullptr, count * sizeof(vertex_args), MEM_RESERVE, PAGE_NOACCESS));
+	auto result = -1;
+	if (!input || !output || !plate_points ||
+		!VirtualAlloc(input + read_first, (count - read_first) * sizeof(cl_float), MEM_COMMIT, PAGE_READWRITE) ||
+		!VirtualAlloc(output + first, (count - first) * sizeof(cl_float), MEM_COMMIT, PAGE_READWRITE) ||
+		!VirtualAlloc(plate_points + first, (count - first) * sizeof(vertex_args), MEM_COMMIT, PAGE_READWRITE))
+	{
+		log_error("Error: Couldn't reserve the %llu cells of index_check.\n", static_cast<unsigned long long>(count));
+	}
+	else
+	{
+		parallel_for(count - read_first, [&](const size_t begin, const size_t end)
+		{
+			for (auto i = read_first + begin; i < read_first + end; i++)
+				input[i] = initial(i);
+		});
+		parallel_for(count - first, [&](const size_t begin, const size_t end)
+		{
+			std::fill(output + first + begin, output + first + end, std::numeric_limits<cl_float>::quiet_NaN());
+		});
+
+		const auto ratio = diffusion_ratio(config.model, config.model.time_step);
+		const auto start = std::chrono::steady_clock::now();
+		std::thread threads[CPU_THREAD_COUNT];
+		for (auto t = 0; t < CPU_THREAD_COUNT; t++)
+			threads[t] = std::thread(cpu_simulate, t, input, output, array_width, array_height, air_temperature, plate_points, INDEX_CHECK_PERCENT, ratio, nullptr, 2U, nullptr);
+		for (auto& thread : threads)
+			thread.join();
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		/*the ranges run over the whole plate, only the CPU part is compared; a cell never written is still NaN*/
+		const auto max_difference = parallel_reduce(count, 0.0F, [&](const size_t begin, const size_t end)
+		{
+			auto difference = 0.0F;
+			for (auto i = std::max(begin, first); i < end; i++)
+			{
+				const auto x = i % array_width;
+				const auto y = i / array_width;
+				const auto center = initial(i);
+				const auto neighbours = (x > 0 ? initial(i - 1) : air_temperature) + (x + 1 < array_width ? initial(i + 1) : air_temperature) +
+					(y > 0 ? initial(i - array_width) : air_temperature) + (y + 1 < array_height ? initial(i + array_width) : air_temperature);
+				const auto expected = center + ratio * (neighbours - 4 * center);
+				vertex_args color = {};
+				set_temperature_color(color, expected);
+				const auto cell = std::fabs(output[i] - expected);
+				difference = std::max(difference, cell == cell ? cell : std::numeric_limits<cl_float>::infinity());
+				if (color.r != plate_points[i].r || color.g != plate_points[i].g || color.b != plate_points[i].b)
+					difference = std::numeric_limits<cl_float>::infinity();
+			}
+			return difference;
+		}, [](const cl_float a, const cl_float b) { return std::max(a, b); });
+		log_info("index_check: %ux%u plate, %llu cells, CPU part [%llu, %llu) stepped in %.3fs over %d threads, max difference %g degrees\n", array_width, array_height,
+			static_cast<unsigned long long>(count), static_cast<unsigned long long>(first), static_cast<unsigned long long>(count), seconds, CPU_THREAD_COUNT, max_difference);
+		result = max_difference < CL_FLT_EPSILON * 1000 ? CL_SUCCESS : -1;
+
+		/*the codec walks the whole field, so the whole of both fields is needed*/
+		if (CL_SUCCESS == result && config.index_check > 1)
+		{
+			std::vector<unsigned char> stream;
+			if (!VirtualAlloc(input, count * sizeof(cl_float), MEM_COMMIT, PAGE_READWRITE) || !VirtualAlloc(output, count * sizeof(cl_float), MEM_COMMIT, PAGE_READWRITE))
+			{
+				log_error("Error: Couldn't commit the %llu cells of index_check:2.\n", static_cast<unsigned long long>(count));
+				result = -1;
+			}
+			else
+			{
+				parallel_for(count, [&](const size_t begin, const size_t end)
+				{
+					for (auto i = begin; i < end; i++)
+						input[i] = initial(i);
+				});
+				result = encode_field(input, array_width, array_height, CODEC_LOSSLESS, 0.0F, stream) == CL_SUCCESS &&
+					decode_field(stream.data(), stream.size(), output, array_width, array_height) == CL_SUCCESS ? CL_SUCCESS : -1;
+				const auto codec_difference = CL_SUCCESS == result ? max_field_error(input, output, count) : 0.0F;
+				log_info("index_check: codec round trip of %llu cells in %llu bytes, max difference %g degrees\n", static_cast<unsigned long long>(count),
+					static_cast<unsigned long long>(stream.size()), codec_difference);
+				if (codec_difference != 0.0F)
+					result = -1;
+			}
+		}
+		log_info("index_check: %s\n", CL_SUCCESS == result ? "passed" : "FAILED");
+	}
+
+	for (auto* reserved : { static_cast<void*>(input), static_cast<void*>(output), static_cast<void*>(plate_points) })
+	{
+		if (reserved)
+			VirtualFree(reserved, 0, MEM_RELEASE);
+	}
+	return result;
+}
+
+/*steps to solver_tolerance from plate_temp for plain averaging and for the Chebyshev recurrence, the same stop rules for both*/
+int run_chebyshev_check(const app_config& config, const cl_uint array_width, const cl_uint array_height, const cl_float plate_initial_temperature,
+	const cl_float air_temperature, const cl_float point_temperature)
+{
+	const plate_problem problem = { array_width, array_height, air_temperature, static_cast<cl_int>(array_width / 2), static_cast<cl_int>(array_height / 2), point_temperature };
+	const auto tolerance = config.solver_options.tolerance;
+	const std::vector<cl_float> initial(static_cast<size_t>(array_width) * array_height, plate_initial_temperature);
+
+	auto plain = initial;
+	cl_float plain_residual;
+	auto start = std::chrono::steady_clock::now();
+	const auto plain_steps = plain_averaging_steps(problem, plain.data(), tolerance, CL_UINT_MAX, &plain_residual);
+	const auto plain_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	/*the recurrence is not capped by solver_max_iterations either*/
+	solver_state solver;
+	init_solver(&solver, config.solver_options);
+	solver.settings.max_iterations = CL_UINT_MAX;
+	std::vector<cl_float> accelerated(initial.size());
+	start = std::chrono::steady_clock::now();
+	chebyshev_solve_cpu(&solver, problem, initial.data(), accelerated.data());
+	const auto accelerated_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	log_info("chebyshev_check: %ux%u to %g degrees; plain averaging %u steps (%.3fs, last change %g), chebyshev %u steps (%.3fs, last change %g), %.1fx fewer, max difference %g degrees\n",
+		array_width, array_height, tolerance, plain_steps, plain_seconds, plain_residual, solver.iterations, accelerated_seconds, solver.residual,
+		solver.iterations > 0 ? static_cast<double>(plain_steps) / solver.iterations : 0.0, max_field_error(plain.data(), accelerated.data(), plain.size()));
+	return CL_SUCCESS;
+}
+
+/*the supported combinations, checked once the config is read; anything outside them stops the run instead of being dropped:
+  material map, sources, active tiles, wider stencils, boundary models, a thick plate and a geometry mask: solver ftcs only
+  conductivity table: solver jfnk or jfnk_steady only
+  in_place: solver sor on the CPU backend, without active tiles, wider stencils, a thick plate or a geometry mask
+  thick plate: none of the material map, sources, active tiles, wider stencils, boundary models or a geometry mask
+  geometry mask: no material map, active tiles, wider stencils or boundary models; fixed sources set the cells of the part
+  wider stencils and boundary models: a uniform plate, without active tiles or each other
+  power sources: the 5-point stencil without boundary models or a geometry mask*/
+int check_supported_features(const app_config& config, const material_map& material, const geometry_mask& geometry, const boundary_conditions& boundary)
+{
+	const auto* const solver = solver_names[config.solver];
+	const auto is_power = [](const heat_source& source) { return SOURCE_POWER == source.mode; };
+	const auto power_sources = std::any_of(config.sources.begin(), config.sources.end(), is_power);
+	const auto thick = config.plate_depth > 1;
+	const auto wide = config.stencil_order > 2;
+	if (!is_stencil_order(config.stencil_order))
+	{
+		log_error("Error: stencil_order %u is not 2, 4 or 6.\n", config.stencil_order);
+		return -1;
+	}
+	if (SOLVER_FTCS != config.solver && (!material.uniform || !config.sources.empty() || config.active_tiles || wide || boundary.enabled || thick || geometry.enabled))
+	{
+		log_error("Error: solver '%s' cannot run a material map, sources, active tiles, stencil_order above 2, boundary models, plate_depth above 1 or a geometry mask, only ftcs does.\n", solver);
+		return -1;
+	}
+	if (!config.conductivity.factors.empty() && SOLVER_JFNK != config.solver && SOLVER_JFNK_STEADY != config.solver)
+	{
+		log_error("Error: solver '%s' keeps the conductivity constant, only jfnk and jfnk_steady use the conductivity table.\n", solver);
+		return -1;
+	}
+	if (config.in_place && !solves_in_place(config.solver))
+	{
+		log_error("Error: solver '%s' cannot run in place, only sor does.\n", solver);
+		return -1;
+	}
+	if (config.in_place && BACKEND_CPU != config.backend)
+	{
+		log_error("Error: in_place solves on the CPU, backend:cpu is needed; the device sweeps would need field buffers besides the image.\n");
+		return -1;
+	}
+	if (thick && (!material.uniform || !config.sources.empty() || config.active_tiles || wide || boundary.enabled || geometry.enabled))
+	{
+		log_error("Error: plate_depth %u runs the volume without material map, sources, active tiles, stencil_order above 2, boundary models or a geometry mask.\n", config.plate_depth);
+		return -1;
+	}
+	if (geometry.enabled && (!material.uniform || config.active_tiles || wide || boundary.enabled))
+	{
+		log_error("Error: a geometry mask runs without material map, active tiles, stencil_order above 2 or boundary models.\n");
+		return -1;
+	}
+	if ((wide || boundary.enabled) && (!material.uniform || config.active_tiles || (wide && boundary.enabled)))
+	{
+		log_error("Error: stencil_order above 2 and boundary models need a uniform plate without active tiles, and not both at once.\n");
+		return -1;
+	}
+	if (power_sources && (wide || boundary.enabled || geometry.enabled))
+	{
+		log_error("Error: power sources need the 5-point stencil without boundary models or a geometry mask.\n");
+		return -1;
+	}
+	return CL_SUCCESS;
+}
+
+/*what keeps the toolbox from switching the solver, empty when it can*/
+std::string solver_fixed_by(const app_config& config, const material_map& material, const geometry_mask& geometry, const boundary_conditions& boundary)
+{
+	if (config.in_place)
+		return "in place on the CPU";
+	if (config.plate_depth > 1)
+		return std::to_string(config.plate_depth) + " cells deep";
+	if (geometry.enabled)
+		return "geometry mask";
+	if (!material.uniform)
+		return "material map";
+	if (!config.sources.empty())
+		return "sources";
+	if (boundary.enabled)
+		return "boundary models";
+	if (config.stencil_order > 2)
+		return "stencil_order " + std::to_string(config.stencil_order);
+	if (config.active_tiles)
+		return "active tiles";
+	if (!config.conductivity.factors.empty())
+		return "conductivity table";
+	return std::string();
+}
+
 int main()
 {
 	ocl_args_d_t ocl;
 	const cl_device_type device_type = CL_DEVICE_TYPE_GPU;
 	const char* preferred_platform = INTEL_PLATFORM;
 	const auto* program_name = "simulation.cl";
-	const auto* kernel_name = "simulate";
 	const auto* input_file = "config.in";
 	cl_uint array_width = 640;
 	cl_uint array_height = 480;
@@ -377,18 +1130,116 @@ int main()
 	auto point_y = 0;
 	float gpu_percent = 100;
 	auto simulate_ocl = true;
+	auto save_snapshot = false;
+	auto codec_report = false;
+	cl_ulong step = 0;
+	app_config config;
+	material_map material;
+	source_set sources;
+	tile_tracker tiles;
+	volume_state volume;
+	geometry_mask geometry;
+	boundary_conditions boundary;
+	solver_state solver;
+	archive_writer archive = {};
+	input_recorder recorder = {};
 	struct vertex_args* plate_points = nullptr;
 
-	read_config(input_file, preferred_platform, array_width, array_height, plate_initial_temperature, air_temperature, point_temperature);
+	read_config(input_file, preferred_platform, array_width, array_height, plate_initial_temperature, air_temperature, point_temperature, config);
+
+	/*the largest conductivity of the map goes into the diffusivity, so the stable time step accounts for it*/
+	init_material_map(&material, array_width, array_height);
+	if (!config.material_file.empty() && CL_SUCCESS != load_material_map(&material, config.material_file.c_str(), config.materials, array_width, array_height))
+		return -1;
+	config.model.diffusivity *= material.scale;
+
+	if (!config.source_file.empty() && CL_SUCCESS != load_heat_sources(config.source_file.c_str(), config.sources))
+		return -1;
+
+	/*k(T) as factors of the boundary conductivity, for the Newton-Krylov solvers*/
+	if (!config.conductivity_file.empty() && CL_SUCCESS != load_conductivity_curve(config.conductivity_file.c_str(), config.boundary.conductivity, config.conductivity))
+		return -1;
+
+	/*a geometry mask is stepped span by span with the plain stencil*/
+	init_geometry_mask(&geometry, array_width, array_height);
+	if (!config.geometry_file.empty() && CL_SUCCESS != load_geometry_mask(&geometry, config.geometry_file.c_str(), config.geometry_insulated, array_width, array_height))
+		return -1;
+
+	if (CL_SUCCESS != resolve_time_step(config.model))
+		return -1;
+	resolve_boundary(&boundary, config.boundary, config.model);
+
+	/*every feature runs as configured or the run stops here, see check_supported_features*/
+	if (CL_SUCCESS != check_supported_features(config, material, geometry, boundary))
+		return -1;
+
+	/*the wider stencils are stable for a smaller ratio*/
+	ocl.stencil_order = config.stencil_order;
+	if (config.stencil_order > 2)
+		config.model.time_step = std::min(config.model.time_step, max_stable_time_step(config.model) * stencil_ratio_limit(config.stencil_order) / stencil_ratio_limit(2));
+	/*only a volume past 2^32 cells needs the 64-bit indices in the kernels*/
+	ocl.huge_grid = static_cast<cl_ulong>(array_width) * array_height * std::max(config.plate_depth, 1U) > INDEX_32_CELLS;
+	const auto& model = config.model;
+	init_solver(&solver, config.solver_options);
+	solver.conductivity = &config.conductivity;
+	auto solver_index = static_cast<int>(config.solver);
+	auto solver_on_cpu = BACKEND_CPU == config.backend;
+	const auto solver_lock = solver_fixed_by(config, material, geometry, boundary);
+
+	/*a recorded run is played back instead of simulated, or one of its frames exported at a coarse level*/
+	if (!config.playback_file.empty() && !config.export_file.empty())
+		return run_archive_export(config);
+	if (!config.playback_file.empty())
+		return run_playback(config);
+
+	/*a plate larger than memory is stepped from its file by the CPU, headless*/
+	if (!config.out_of_core_file.empty())
+		return run_out_of_core(config, array_width, array_height, plate_initial_temperature, air_temperature, point_temperature);
+
+	/*the CPU partition of a plate past 32-bit indices, checked cell by cell, headless*/
+	if (config.index_check)
+		return run_index_check(config, array_width, array_height, air_temperature);
+
+	/*steps to convergence of plain averaging and of the Chebyshev recurrence, headless on the CPU*/
+	if (config.chebyshev_check)
+		return run_chebyshev_check(config, array_width, array_height, plate_initial_temperature, air_temperature, point_temperature);
 
 	/*setup openCL kernel*/
-	if (CL_SUCCESS != setup_ocl(&ocl, device_type, program_name, kernel_name, preferred_platform))
+	const auto generated_source = stencil_program_source() + boundary_program_source(boundary);
+	if (CL_SUCCESS != setup_ocl(&ocl, device_type, program_name, stencil_kernel_name(config.stencil_order), generated_source.c_str(), preferred_platform))
 		return -1;
 	
 	/*show device info*/
 	log_device_info(ocl);
+
+	if (CL_SUCCESS != setup_ocl_material(&ocl, &material) || CL_SUCCESS != setup_ocl_boundary(&ocl, &boundary))
+		return -1;
+
+	/*a recorded input log is replayed headless, as fast as possible*/
+	if (!config.replay_file.empty())
+		return run_replay(ocl, material, geometry, boundary, config);
+
+	setup_source_cells(&sources, config.sources, array_width, array_height, geometry.enabled ? &geometry : nullptr);
+	init_tile_tracker(&tiles, array_width, array_height, config.active_tiles);
+	init_volume(&volume, array_width, array_height, config.plate_depth, config.stencil, plate_initial_temperature);
+	if (CL_SUCCESS != setup_ocl_sources(&ocl, &sources) || CL_SUCCESS != setup_ocl_tiles(&ocl, &tiles) || CL_SUCCESS != setup_ocl_volume(&ocl, &volume) ||
+		CL_SUCCESS != setup_ocl_geometry(&ocl, &geometry))
+		return -1;
+
+	/*a benchmark runs headless too*/
+	if (config.benchmark_time > 0.0F)
+		return run_benchmark(ocl, material, sources, tiles, volume, geometry, boundary, config, array_width, array_height, plate_initial_temperature, air_temperature, point_temperature);
+
 	/*show simulation info*/
-	log_info("\nwidth=%u\nheight=%u\nplate_temp=%f\nair_temp=%f\npoint_temp=%f\n", array_width, array_height, plate_initial_temperature, air_temperature, point_temperature);
+	log_info("\nwidth=%u\nheight=%u\nplate_temp=%f\nair_temp=%f\npoint_temp=%f\ndiffusivity=%g\ncell_size=%g\ntime_step=%g\nsolver=%s\n", array_width, array_height,
+		plate_initial_temperature, air_temperature, point_temperature, model.diffusivity, model.cell_size, model.time_step, solver_names[config.solver]);
+
+	/*GL draws and maps the vertices with int counts, a larger plate only runs headless*/
+	if (static_cast<size_t>(array_width) * array_height > static_cast<size_t>(std::numeric_limits<GLsizei>::max()))
+	{
+		log_error("Error: A %ux%u plate has more cells than OpenGL can draw, run it headless with out_of_core or index_check.\n", array_width, array_height);
+		return -1;
+	}
 
 	/*setup openGL*/
 	GLFWwindow* window;
@@ -398,15 +1249,57 @@ int main()
 	GLuint vertex_buffer;
 	create_gl_buffer(array_width, array_height, vertex_buffer, &plate_points);
 
+	/*the spans of the mask merged back into the runs of each row, one draw range each*/
+	std::vector<GLint> part_first;
+	std::vector<GLsizei> part_count;
+	for (const auto& span : geometry.spans)
+	{
+		/*within GLint, the plate was checked against it above*/
+		const auto first = static_cast<GLint>(static_cast<size_t>(span.row) * array_width + span.begin);
+		if (!part_first.empty() && part_first.back() + part_count.back() == first)
+			part_count.back() += span.end - span.begin;
+		else
+		{
+			part_first.push_back(first);
+			part_count.push_back(span.end - span.begin);
+		}
+	}
+
 	/*initialize shader*/
 	GLuint program;
 	GLint mvp_location;
 	gl_setup_shader(program, mvp_location);
 	
 	/*setup device global memory*/
-	if (CL_SUCCESS != setup_device_memory(&ocl, plate_points, array_width, array_height, plate_initial_temperature))
+	if (CL_SUCCESS != setup_device_memory(&ocl, plate_points, array_width, array_height, plate_initial_temperature, config.in_place))
 		return -1;
 	
+	/*the run is recorded frame by frame, appending to an existing archive from the field of its last frame*/
+	if (!config.archive_file.empty())
+	{
+		const auto mode = config.archive_tolerance > 0.0F ? CODEC_LOSSY : CODEC_LOSSLESS;
+		if (CL_SUCCESS != open_archive_writer(&archive, config.archive_file.c_str(), array_width, array_height, mode, config.archive_tolerance, config.archive_levels))
+			return -1;
+		if (!archive.index.empty() && volume.enabled)
+		{
+			log_error("Error: archive '%s' holds frames of the top face only, a thick plate can't continue from it; start a new archive.\n", config.archive_file.c_str());
+			return -1;
+		}
+		if (!archive.index.empty())
+		{
+			std::vector<cl_float> field(static_cast<size_t>(array_width) * array_height);
+			if (CL_SUCCESS != read_last_archive_frame(&archive, field.data()) || CL_SUCCESS != write_field(&ocl, array_width, array_height, field.data()))
+				return -1;
+			colorize_field(field.data(), plate_points, field.size());
+			wake_all_tiles(&tiles);
+			step = archive.index.back().step;
+			log_info("Archive '%s' continues from step %llu.\n", config.archive_file.c_str(), static_cast<unsigned long long>(step));
+		}
+	}
+
+	if (!config.record_file.empty() && CL_SUCCESS != open_input_recorder(&recorder, config.record_file.c_str(), array_width, array_height, plate_initial_temperature, model, config.solver_options, boundary, geometry_hash(geometry)))
+		return -1;
+
 	/*UI setup*/
 	imgui_setup(window);
 	
@@ -419,25 +1312,29 @@ int main()
     	
     	/*input*/
     	calculate_mouse_position(array_width, array_height, point_x, point_y, window);
-    	
-		/*CPU threads*/
-    	if (simulate_ocl && gpu_percent < 100 && CL_SUCCESS != run_cpu_thread(ocl, array_width, array_height, air_temperature, point_temperature, point_x, point_y, gpu_percent, plate_points))
-	        return -1;
+		/*the mouse only heats the part, the air around it is not stepped*/
+		if (point_x >= 0 && point_y >= 0 && !geometry_contains(geometry, static_cast<cl_uint>(point_x), static_cast<cl_uint>(point_y)))
+			point_x = point_y = -1;
+		const input_state input = { point_x, point_y, air_temperature, point_temperature, gpu_percent, simulate_ocl, static_cast<cl_uint>(solver_index),
+			static_cast<cl_uint>(solver_on_cpu ? BACKEND_CPU : BACKEND_OPENCL) };
+		if (recorder.file && CL_SUCCESS != record_input(&recorder, input))
+			return -1;
 
-		/*kernel execution: only if there is not an equilibrium*/
-		if (simulate_ocl && gpu_percent > 0 && CL_SUCCESS != execute_kernel(ocl, array_width, array_height, air_temperature, point_temperature, point_x, point_y, gpu_percent))
+		if (CL_SUCCESS != simulate_frame(ocl, material, sources, tiles, volume, geometry, boundary, array_width, array_height, input, model, solver, plate_points))
 			return -1;
     	
 		/* Render here */
 		glClear(GL_COLOR_BUFFER_BIT);
 
-    	/*read temperatures and update the plate points*/
-		const auto convergence_check = read_and_verify(&ocl, array_width, array_height, plate_points);
+    	/*read temperatures and update the plate points; with active tiles the plate has converged once none is left*/
+		const auto use_tiles = tiles.enabled && SOLVER_FTCS == solver_index && simulate_ocl;
+		const auto convergence_check = use_tiles ? tiles.active.empty() : read_and_verify(&ocl, array_width, array_height, plate_points);
 
     	/*draw the pixels representing the temperature*/
-		draw_pixels(array_width, array_height, &plate_points, window, vertex_buffer, program, mvp_location);
+		draw_pixels(array_width, array_height, &plate_points, window, vertex_buffer, program, mvp_location, part_first, part_count);
     	
-		imgui_draw_toolbox(air_temperature, point_temperature, gpu_percent, simulate_ocl, convergence_check);
+		imgui_draw_toolbox(air_temperature, point_temperature, gpu_percent, simulate_ocl, save_snapshot, codec_report, convergence_check, model, solver_index, solver_on_cpu, solver, config.in_place,
+			solver_lock.c_str());
     	
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -448,11 +1345,20 @@ int main()
         /* Poll for and process events */
         glfwPollEvents();
 
-		auto* aux = ocl.output;
-		ocl.output = ocl.input;
-		ocl.input = aux;
+		swap_fields(ocl);
+		if (simulate_ocl)
+			step++;
+
+		/*snapshots and archive frames are taken from the field that was just computed*/
+		const auto archive_frame = archive.file && simulate_ocl && 0 == step % (config.archive_interval ? config.archive_interval : 1);
+		if ((save_snapshot || codec_report || archive_frame) &&
+			CL_SUCCESS != save_field(ocl, material, array_width, array_height, step, config, save_snapshot, codec_report, archive_frame ? &archive : nullptr))
+			return -1;
     }
 
+	close_archive_writer(&archive);
+	close_input_recorder(&recorder);
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -0,0 +1,204 @@
+#include "active_tiles.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+#include "log_utils.h"
+#include "material.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "ocl_solver.h"
+#include "utils.h"
+
+ocl_tiles_t::ocl_tiles_t() :
+    kernel(nullptr),
+    tiles(nullptr),
+    changed(nullptr)
+{
+}
+
+ocl_tiles_t::~ocl_tiles_t()
+{
+    if (kernel)
+        clReleaseKernel(kernel);
+    for (auto* buffer : { tiles, changed })
+    {
+        if (buffer)
+            clReleaseMemObject(buffer);
+    }
+}
+
+/*every tile starts active, nothing is known to be settled*/
+void init_tile_tracker(tile_tracker* tracker, const cl_uint width, const cl_uint height, const bool enabled)
+{
+    tracker->enabled = enabled;
+    tracker->columns = (width + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE;
+    tracker->rows = (height + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE;
+    const auto count = static_cast<size_t>(tracker->columns) * tracker->rows;
+    tracker->active.resize(count);
+    for (size_t tile = 0; tile < count; tile++)
+        tracker->active[tile] = static_cast<cl_uint>(tile);
+    tracker->changed.assign(count, 0);
+    tracker->device_changed.assign(count, 0);
+    tracker->air_temperature = 0.0F;
+    tracker->point_x = -1;
+    tracker->point_y = -1;
+}
+
+static int write_tiles(ocl_args_d_t* ocl, cl_mem buffer, const void* data, const size_t size)
+{
+    if (0 == size)
+        return CL_SUCCESS;
+    const auto err = clEnqueueWriteBuffer(ocl->command_queue, buffer, true, 0, size, data, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueWriteBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+int setup_ocl_tiles(ocl_args_d_t* ocl, tile_tracker* tracker)
+{
+    if (!tracker->enabled)
+        return CL_SUCCESS;
+
+    auto* device = &tracker->device;
+    if (CL_SUCCESS != create_solver_kernel(ocl, "simulate_tiles", &device->kernel))
+        return -1;
+    device->tiles = create_solver_buffer(ocl, sizeof(cl_uint) * tracker->changed.size());
+    device->changed = create_solver_buffer(ocl, tracker->changed.size());
+    if (nullptr == device->tiles || nullptr == device->changed)
+        return -1;
+    if (CL_SUCCESS != write_tiles(ocl, device->tiles, tracker->active.data(), sizeof(cl_uint) * tracker->active.size()) ||
+        CL_SUCCESS != write_tiles(ocl, device->changed, tracker->device_changed.data(), tracker->device_changed.size()))
+        return -1;
+    return CL_SUCCESS;
+}
+
+/*flagged as changed, every tile is active on the next step*/
+void wake_all_tiles(tile_tracker* tracker)
+{
+    std::fill(tracker->changed.begin(), tracker->changed.end(), static_cast<cl_uchar>(1));
+}
+
+/*the controls the kernels cannot see change in: the air around every edge and the cell the mouse left*/
+void wake_tiles(tile_tracker* tracker, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_int point_x, const cl_int point_y)
+{
+    if (!tracker->enabled)
+        return;
+
+    if (air_temperature != tracker->air_temperature)
+        wake_all_tiles(tracker);
+    const auto moved = point_x != tracker->point_x || point_y != tracker->point_y;
+    if (moved && tracker->point_x >= 0 && tracker->point_y >= 0 && static_cast<cl_uint>(tracker->point_x) < width && static_cast<cl_uint>(tracker->point_y) < height)
+        tracker->changed[tracker->point_y / ACTIVE_TILE_SIZE * tracker->columns + tracker->point_x / ACTIVE_TILE_SIZE] = 1;
+
+    tracker->air_temperature = air_temperature;
+    tracker->point_x = point_x;
+    tracker->point_y = point_y;
+}
+
+/*the CPU part of a tile, the cells from first_cell on; true when one of them moved by the threshold or more*/
+bool step_tile_cpu(const tile_tracker& tracker, const cl_uint tile, const size_t first_cell, const cl_float* input, cl_float* output, const cl_uint width,
+    const cl_uint height, const cl_float air_temperature, const material_map* material, const cl_float ratio, vertex_args* plate_points)
+{
+    const auto left = tile % tracker.columns * ACTIVE_TILE_SIZE;
+    const auto top = tile / tracker.columns * ACTIVE_TILE_SIZE;
+    const auto right = std::min(left + ACTIVE_TILE_SIZE, width);
+    const auto bottom = std::min(top + ACTIVE_TILE_SIZE, height);
+    auto changed = false;
+    for (auto y = top; y < bottom; y++)
+    {
+        for (auto x = left; x < right; x++)
+        {
+            const auto i = static_cast<size_t>(y) * width + x;
+            if (i < first_cell)
+                continue;
+
+            if (material)
+            {
+                output[i] = material_step(*material, input, x, y, air_temperature, ratio);
+            }
+            else
+            {
+                const auto center = input[i];
+                const auto neighbours = (x > 0 ? input[i - 1] : air_temperature) + (x + 1 < width ? input[i + 1] : air_temperature) +
+                    (y > 0 ? input[i - width] : air_temperature) + (y + 1 < height ? input[i + width] : air_temperature);
+                output[i] = center + ratio * (neighbours - 4 * center);
+            }
+            changed = changed || std::abs(output[i] - input[i]) >= ACTIVE_THRESHOLD;
+            set_temperature_color(plate_points[i], output[i]);
+        }
+    }
+    return changed;
+}
+
+int execute_tile_kernel(ocl_args_d_t* ocl, tile_tracker* tracker, const material_map& material, const cl_uint width, const cl_uint height, const cl_float air_temperature,
+    const cl_float gpu_percent, const cl_float ratio)
+{
+    if (tracker->active.empty())
+        return CL_SUCCESS;
+
+    auto* device = &tracker->device;
+    const cl_mem face_x = material.uniform ? nullptr : material.device.face_x;
+    const cl_mem face_y = material.uniform ? nullptr : material.device.face_y;
+    const size_t global_work_size[] = { tracker->active.size() * ACTIVE_TILE_SIZE * ACTIVE_TILE_SIZE };
+    if (CL_SUCCESS != set_kernel_args(device->kernel, 0, ocl->input, ocl->output, width, height, air_temperature, ocl->plate_points, device_cell_count(width, height, gpu_percent), ratio,
+        device->tiles, tracker->columns, device->changed, face_x, face_y) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->kernel, 1, global_work_size, nullptr))
+        return -1;
+
+    const auto err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*merges the flags of the step that just ran, grows them by one tile into the next active list and clears them*/
+int update_active_tiles(ocl_args_d_t* ocl, tile_tracker* tracker)
+{
+    if (!tracker->enabled)
+        return CL_SUCCESS;
+
+    auto* device = &tracker->device;
+    const auto count = tracker->changed.size();
+    auto err = clEnqueueReadBuffer(ocl->command_queue, device->changed, true, 0, count, tracker->device_changed.data(), 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueReadBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    for (size_t tile = 0; tile < count; tile++)
+        tracker->changed[tile] |= tracker->device_changed[tile];
+
+    const auto columns = tracker->columns;
+    const auto rows = tracker->rows;
+    tracker->active.clear();
+    for (cl_uint row = 0; row < rows; row++)
+    {
+        for (cl_uint col = 0; col < columns; col++)
+        {
+            auto active = false;
+            for (auto y = row > 0 ? row - 1 : 0; !active && y <= std::min(row + 1, rows - 1); y++)
+            {
+                for (auto x = col > 0 ? col - 1 : 0; !active && x <= std::min(col + 1, columns - 1); x++)
+                    active = 0 != tracker->changed[static_cast<size_t>(y) * columns + x];
+            }
+            if (active)
+                tracker->active.push_back(row * columns + col);
+        }
+    }
+
+    /*only flags that were set need clearing on the device*/
+    const auto any_device = std::find(tracker->device_changed.begin(), tracker->device_changed.end(), static_cast<cl_uchar>(1)) != tracker->device_changed.end();
+    std::fill(tracker->changed.begin(), tracker->changed.end(), static_cast<cl_uchar>(0));
+    std::fill(tracker->device_changed.begin(), tracker->device_changed.end(), static_cast<cl_uchar>(0));
+    if (any_device && CL_SUCCESS != write_tiles(ocl, device->changed, tracker->device_changed.data(), count))
+        return -1;
+    return write_tiles(ocl, device->tiles, tracker->active.data(), sizeof(cl_uint) * tracker->active.size());
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+/*the same tile size and threshold as simulation.cl; the threshold is the convergence test of read_and_verify*/
+#define ACTIVE_TILE_SIZE 16
+#define ACTIVE_THRESHOLD (CL_FLT_EPSILON * 1000)
+
+struct ocl_args_d_t;
+struct material_map;
+struct vertex_args;
+
+/*device copies of the active list and the change flags, and the kernel that steps the list*/
+struct ocl_tiles_t
+{
+    ocl_tiles_t();
+    ~ocl_tiles_t();
+
+    cl_kernel        kernel;
+    cl_mem           tiles;
+    cl_mem           changed;
+};
+
+/*
+ * Sparse stepping for the explicit solver. The plate is cut into ACTIVE_TILE_SIZE square tiles; a step only touches the
+ * tiles in active, and every tile it touches is flagged in changed when one of its cells moved by ACTIVE_THRESHOLD or
+ * more, on the device by the kernels and on the host by the CPU threads, each in its own copy. After the step the flags
+ * are merged and a tile stays active when it or one of its 8 neighbours changed: a settled tile next to a moving one
+ * wakes up before the front reaches it. The cells a step skips keep their last two values, which differ by less than
+ * the threshold, so swapping the fields leaves them settled. A new air temperature or another solver wakes every tile,
+ * the cell the mouse leaves wakes its own; the sources flag the cells they move.
+ */
+struct tile_tracker
+{
+    bool             enabled;
+    cl_uint          columns;
+    cl_uint          rows;
+    std::vector<cl_uint> active;
+    std::vector<cl_uchar> changed;
+    std::vector<cl_uchar> device_changed;
+    cl_float         air_temperature;
+    cl_int           point_x;
+    cl_int           point_y;
+    ocl_tiles_t      device;
+};
+
+void init_tile_tracker(tile_tracker* tracker, cl_uint width, cl_uint height, bool enabled);
+int setup_ocl_tiles(ocl_args_d_t* ocl, tile_tracker* tracker);
+void wake_all_tiles(tile_tracker* tracker);
+void wake_tiles(tile_tracker* tracker, cl_uint width, cl_uint height, cl_float air_temperature, cl_int point_x, cl_int point_y);
+bool step_tile_cpu(const tile_tracker& tracker, cl_uint tile, size_t first_cell, const cl_float* input, cl_float* output, cl_uint width, cl_uint height,
+    cl_float air_temperature, const material_map* material, cl_float ratio, vertex_args* plate_points);
+int execute_tile_kernel(ocl_args_d_t* ocl, tile_tracker* tracker, const material_map& material, cl_uint width, cl_uint height, cl_float air_temperature,
+    cl_float gpu_percent, cl_float ratio);
+int update_active_tiles(ocl_args_d_t* ocl, tile_tracker* tracker);
@@ -0,0 +1,212 @@
+#include "adi.h"
+
+#include <algorithm>
+#include <xmmintrin.h>
+
+
+#include "parallel.h"
+
+/*
+ * Peaceman-Rachford splitting: half a step implicit along x and explicit along y, then the other way around, with
+ * h = r / 2 both times. Each implicit half is a set of independent tridiagonal systems (1 + 2h) T_i - h T_i-1 - h T_i+1,
+ * the air beyond the ends moves to the right hand side. The systems of all lines share their coefficients, so the
+ * Thomas factors are computed once per step and the lines are eliminated ADI_BATCH at a time, one SSE lane per line.
+ * The solver only sweeps down columns, where the lanes are contiguous; the x half works on the transposed field.
+ * The source line has an identity row and is solved on its own.
+ */
+
+struct thomas_factors
+{
+    std::vector<cl_float> upper;
+    std::vector<cl_float> pivot;
+};
+
+static void factor_line(thomas_factors& factors, const cl_uint length, const cl_float half_ratio)
+{
+    factors.upper.resize(length);
+    factors.pivot.resize(length);
+    auto previous = 0.0F;
+    for (cl_uint i = 0; i < length; i++)
+    {
+        factors.pivot[i] = 1.0F / (1.0F + 2.0F * half_ratio - half_ratio * previous);
+        factors.upper[i] = half_ratio * factors.pivot[i];
+        previous = factors.upper[i];
+    }
+}
+
+/*lanes consecutive columns starting at col, solved with the shared factors*/
+template <int Vectors>
+static void solve_batch(cl_float* field, const cl_uint width, const cl_uint length, const cl_uint col, const thomas_factors& factors, const cl_float half_ratio, const cl_float air_temperature)
+{
+    const auto half_ratio4 = _mm_set1_ps(half_ratio);
+    const auto air4 = _mm_set1_ps(half_ratio * air_temperature);
+    __m128 value[Vectors];
+    for (auto v = 0; v < Vectors; v++)
+        value[v] = _mm_setzero_ps();
+
+    for (cl_uint i = 0; i < length; i++)
+    {
+        auto* row = field + static_cast<size_t>(i) * width + col;
+        const auto pivot4 = _mm_set1_ps(factors.pivot[i]);
+        for (auto v = 0; v < Vectors; v++)
+        {
+            auto d = _mm_loadu_ps(row + 4 * v);
+            if (0 == i)
+                d = _mm_add_ps(d, air4);
+            if (i + 1 == length)
+                d = _mm_add_ps(d, air4);
+            value[v] = _mm_mul_ps(_mm_add_ps(d, _mm_mul_ps(half_ratio4, value[v])), pivot4);
+            _mm_storeu_ps(row + 4 * v, value[v]);
+        }
+    }
+
+    for (auto i = static_cast<int>(length) - 2; i >= 0; i--)
+    {
+        auto* row = field + static_cast<size_t>(i) * width + col;
+        const auto upper4 = _mm_set1_ps(factors.upper[i]);
+        for (auto v = 0; v < Vectors; v++)
+        {
+            value[v] = _mm_add_ps(_mm_loadu_ps(row + 4 * v), _mm_mul_ps(upper4, value[v]));
+            _mm_storeu_ps(row + 4 * v, value[v]);
+        }
+    }
+}
+
+/*one column with its own coefficients, fixed_row (-1 for none) is an identity row at fixed_value*/
+static void solve_line(cl_float* field, const cl_uint width, const cl_uint length, const cl_uint col, const cl_float half_ratio, const cl_float air_temperature,
+    const cl_int fixed_row, const cl_float fixed_value, std::vector<cl_float>& upper)
+{
+    upper.resize(length);
+    auto previous_upper = 0.0F;
+    auto previous_value = 0.0F;
+    for (cl_uint i = 0; i < length; i++)
+    {
+        auto& cell = field[static_cast<size_t>(i) * width + col];
+        if (static_cast<cl_int>(i) == fixed_row)
+        {
+            upper[i] = 0.0F;
+            cell = fixed_value;
+        }
+        else
+        {
+            const auto pivot = 1.0F / (1.0F + 2.0F * half_ratio - half_ratio * previous_upper);
+            const auto air = (0 == i ? half_ratio * air_temperature : 0.0F) + (i + 1 == length ? half_ratio * air_temperature : 0.0F);
+            upper[i] = i + 1 < length ? half_ratio * pivot : 0.0F;
+            cell = (cell + air + half_ratio * previous_value) * pivot;
+        }
+        previous_upper = upper[i];
+        previous_value = cell;
+    }
+
+    for (auto i = static_cast<int>(length) - 2; i >= 0; i--)
+        field[static_cast<size_t>(i) * width + col] += upper[i] * field[static_cast<size_t>(i + 1) * width + col];
+}
+
+/*
+ * Implicit half step down every column of a width x length field, in place. Threads take whole batches of columns;
+ * the last few columns and the source column are solved one by one.
+ */
+static void sweep_columns(cl_float* field, const cl_uint width, const cl_uint length, const cl_float half_ratio, const cl_float air_temperature,
+    const cl_int source_col, const cl_int source_row, const cl_float source_temperature, const thomas_factors& factors, std::vector<cl_float>& source_line)
+{
+    const auto has_source = source_col >= 0 && source_col < static_cast<cl_int>(width) && source_row >= 0 && source_row < static_cast<cl_int>(length);
+    if (has_source)
+    {
+        source_line.resize(length);
+        for (cl_uint i = 0; i < length; i++)
+            source_line[i] = field[static_cast<size_t>(i) * width + source_col];
+    }
+
+    const auto batches = width / ADI_BATCH;
+    parallel_for(batches, [&](const size_t begin, const size_t end)
+    {
+        for (auto batch = begin; batch < end; batch++)
+            solve_batch<ADI_BATCH / 4>(field, width, length, static_cast<cl_uint>(batch * ADI_BATCH), factors, half_ratio, air_temperature);
+    });
+
+    std::vector<cl_float> upper;
+    for (auto col = batches * ADI_BATCH; col < width; col++)
+    {
+        if (has_source && static_cast<cl_int>(col) == source_col)
+            continue;
+        solve_line(field, width, length, col, half_ratio, air_temperature, -1, 0.0F, upper);
+    }
+
+    if (has_source)
+    {
+        for (cl_uint i = 0; i < length; i++)
+            field[static_cast<size_t>(i) * width + source_col] = source_line[i];
+        solve_line(field, width, length, source_col, half_ratio, air_temperature, source_row, source_temperature, upper);
+    }
+}
+
+/*destination = source transposed, source is width x height; tiles keep both sides of the copy in the cache*/
+static void transpose(const cl_float* source, cl_float* destination, const cl_uint width, const cl_uint height)
+{
+    const auto tile_rows = (height + ADI_TILE - 1) / ADI_TILE;
+    parallel_for(tile_rows, [&](const size_t begin, const size_t end)
+    {
+        for (auto tile_row = begin; tile_row < end; tile_row++)
+        {
+            const auto row_end = std::min<size_t>(height, (tile_row + 1) * ADI_TILE);
+            for (size_t tile_col = 0; tile_col < width; tile_col += ADI_TILE)
+            {
+                const auto col_end = std::min<size_t>(width, tile_col + ADI_TILE);
+                for (auto row = tile_row * ADI_TILE; row < row_end; row++)
+                {
+                    for (auto col = tile_col; col < col_end; col++)
+                        destination[col * height + row] = source[row * width + col];
+                }
+            }
+        }
+    });
+}
+
+/*field + h * (second difference along the rows or the columns), with the air beyond the plate*/
+static void explicit_half(const cl_float* field, cl_float* result, const cl_uint width, const cl_uint height, const cl_float half_ratio, const cl_float air_temperature,
+    const bool along_columns)
+{
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * width + col;
+                const auto neighbours = along_columns ?
+                    (row > 0 ? field[i - width] : air_temperature) + (row + 1 < height ? field[i + width] : air_temperature) :
+                    (col > 0 ? field[i - 1] : air_temperature) + (col + 1 < width ? field[i + 1] : air_temperature);
+                result[i] = field[i] + half_ratio * (neighbours - 2.0F * field[i]);
+            }
+        }
+    });
+}
+
+/*a direct solve: no iterations and no residual to report*/
+int adi_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    const auto half_ratio = 0.5F * diffusion_ratio(model, model.time_step);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    solver->rhs.resize(count);
+    solver->transposed.resize(count);
+    auto* rhs = solver->rhs.data();
+    auto* transposed = solver->transposed.data();
+    std::vector<cl_float> source_line;
+    thomas_factors factors;
+
+    /*implicit along x: the rows of the field are the columns of the transposed one*/
+    explicit_half(input, rhs, problem.width, problem.height, half_ratio, problem.air_temperature, true);
+    transpose(rhs, transposed, problem.width, problem.height);
+    factor_line(factors, problem.width, half_ratio);
+    sweep_columns(transposed, problem.height, problem.width, half_ratio, problem.air_temperature, problem.point_y, problem.point_x, problem.point_temperature, factors, source_line);
+    transpose(transposed, rhs, problem.height, problem.width);
+
+    /*implicit along y*/
+    explicit_half(rhs, output, problem.width, problem.height, half_ratio, problem.air_temperature, false);
+    factor_line(factors, problem.height, half_ratio);
+    sweep_columns(output, problem.width, problem.height, half_ratio, problem.air_temperature, problem.point_x, problem.point_y, problem.point_temperature, factors, source_line);
+
+    solver->iterations = 0;
+    solver->residual = 0.0F;
+    return CL_SUCCESS;
+}
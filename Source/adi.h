@@ -0,0 +1,11 @@
+#pragma once
+#include <CL/cl.h>
+
+#include "solver.h"
+
+/*square tiles of the transpose, 32 x 32 floats fit the L1 cache twice*/
+#define ADI_TILE 32
+/*columns solved together by one thread, 4 SSE vectors of 4 lines*/
+#define ADI_BATCH 16
+
+int adi_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
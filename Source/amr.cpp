@@ -0,0 +1,511 @@
+#include "amr.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+#include "parallel.h"
+
+/*
+ * Block-structured adaptive refinement. Level amr_levels - 1 has the cells of the plate, every coarser level cells twice
+ * as large; a level 0 patch covers AMR_PATCH_SIZE << (amr_levels - 1) cells of the plate on a side. The leaves of the
+ * quadtree tile the plate once. A leaf is split in four when two neighbouring cells differ by more than amr_threshold
+ * degrees, and four sibling leaves merge back when none of their neighbours differ by more than a quarter of it; leaves
+ * on the edge of the plate or under the source always run at full resolution, so the air and the source sit exactly
+ * where FTCS has them. Neighbouring leaves differ by one level at most.
+ * A step of time_step seconds runs level 0 at its own stability limit and every finer level in up to 4 substeps of its
+ * parent step. The ghost cells around a leaf come from the composite field at its level: neighbours of the same level
+ * as they are, finer ones averaged, coarser ones interpolated bilinearly in space and linearly in time across their
+ * last step. The leaves of a level are independent tasks within a step.
+ */
+
+static cl_uint finest_level(const amr_state& amr)
+{
+    return amr.levels - 1;
+}
+
+/*size of the patch on a side, in cells of the plate*/
+static cl_uint patch_span(const amr_state& amr, const cl_uint level)
+{
+    return AMR_PATCH_SIZE << (finest_level(amr) - level);
+}
+
+/*cell (col, row) of level covers the cells of the plate from col << shift, row << shift on*/
+static bool outside_plate(const amr_state& amr, const cl_uint level, const cl_int col, const cl_int row)
+{
+    const auto shift = finest_level(amr) - level;
+    return col < 0 || row < 0 || static_cast<cl_uint>(col) << shift >= amr.width || static_cast<cl_uint>(row) << shift >= amr.height;
+}
+
+/*the leaf holding cell (col, row) of level, or the patch of that level above it when it is refined further*/
+static size_t find_patch(const amr_state& amr, const cl_uint level, const cl_int col, const cl_int row)
+{
+    const auto root = AMR_PATCH_SIZE << level;
+    auto index = static_cast<size_t>(row / root) * amr.roots_x + col / root;
+    for (;;)
+    {
+        const auto& patch = amr.patches[index];
+        if (patch.children < 0 || patch.level == level)
+            return index;
+        const auto child = AMR_PATCH_SIZE << (level - patch.level - 1);
+        index = patch.children + (col / child & 1) + 2 * (row / child & 1);
+    }
+}
+
+static cl_float patch_value(const amr_patch& patch, const size_t i, const double time)
+{
+    if (time >= patch.end || patch.end <= patch.start)
+        return patch.values[i];
+    const auto f = static_cast<cl_float>((time - patch.start) / (patch.end - patch.start));
+    return patch.previous[i] + f * (patch.values[i] - patch.previous[i]);
+}
+
+/*the composite field at cell (col, row) of level and time, the air beyond the plate*/
+static cl_float sample(const amr_state& amr, const cl_uint level, const cl_int col, const cl_int row, const double time, const cl_float air_temperature)
+{
+    if (outside_plate(amr, level, col, row))
+        return air_temperature;
+
+    const auto& patch = amr.patches[find_patch(amr, level, col, row)];
+    if (patch.children >= 0)
+    {
+        /*the 2 x 2 block is in one child; read it directly when that is a leaf*/
+        const auto i = 2 * (col - static_cast<cl_int>(patch.x * AMR_PATCH_SIZE));
+        const auto j = 2 * (row - static_cast<cl_int>(patch.y * AMR_PATCH_SIZE));
+        const auto size = static_cast<cl_int>(AMR_PATCH_SIZE);
+        const auto& child = amr.patches[patch.children + i / size + 2 * (j / size)];
+        if (child.children < 0 && !outside_plate(amr, level + 1, 2 * col + 1, 2 * row + 1))
+        {
+            const auto k = static_cast<size_t>(j % size) * AMR_PATCH_SIZE + i % size;
+            return 0.25F * (patch_value(child, k, time) + patch_value(child, k + 1, time) + patch_value(child, k + AMR_PATCH_SIZE, time) +
+                patch_value(child, k + AMR_PATCH_SIZE + 1, time));
+        }
+        return 0.25F * (sample(amr, level + 1, 2 * col, 2 * row, time, air_temperature) + sample(amr, level + 1, 2 * col + 1, 2 * row, time, air_temperature) +
+            sample(amr, level + 1, 2 * col, 2 * row + 1, time, air_temperature) + sample(amr, level + 1, 2 * col + 1, 2 * row + 1, time, air_temperature));
+    }
+    if (patch.level == level)
+    {
+        const auto i = static_cast<size_t>(row - patch.y * AMR_PATCH_SIZE) * AMR_PATCH_SIZE + (col - patch.x * AMR_PATCH_SIZE);
+        return patch_value(patch, i, time);
+    }
+
+    const auto scale = static_cast<double>(1 << (level - patch.level));
+    const auto u = (col + 0.5) / scale - 0.5;
+    const auto v = (row + 0.5) / scale - 0.5;
+    const auto col0 = static_cast<cl_int>(std::floor(u));
+    const auto row0 = static_cast<cl_int>(std::floor(v));
+    const auto fu = static_cast<cl_float>(u - col0);
+    const auto fv = static_cast<cl_float>(v - row0);
+    const auto coarse = patch.level;
+
+    /*inside the leaf the four coarse cells are its own*/
+    const auto i = col0 - static_cast<cl_int>(patch.x * AMR_PATCH_SIZE);
+    const auto j = row0 - static_cast<cl_int>(patch.y * AMR_PATCH_SIZE);
+    if (i >= 0 && j >= 0 && i + 1 < static_cast<cl_int>(AMR_PATCH_SIZE) && j + 1 < static_cast<cl_int>(AMR_PATCH_SIZE) && !outside_plate(amr, coarse, col0 + 1, row0 + 1))
+    {
+        const auto k = static_cast<size_t>(j) * AMR_PATCH_SIZE + i;
+        const auto top = (1.0F - fu) * patch_value(patch, k, time) + fu * patch_value(patch, k + 1, time);
+        const auto bottom = (1.0F - fu) * patch_value(patch, k + AMR_PATCH_SIZE, time) + fu * patch_value(patch, k + AMR_PATCH_SIZE + 1, time);
+        return (1.0F - fv) * top + fv * bottom;
+    }
+    const auto top = (1.0F - fu) * sample(amr, coarse, col0, row0, time, air_temperature) + fu * sample(amr, coarse, col0 + 1, row0, time, air_temperature);
+    const auto bottom = (1.0F - fu) * sample(amr, coarse, col0, row0 + 1, time, air_temperature) + fu * sample(amr, coarse, col0 + 1, row0 + 1, time, air_temperature);
+    return (1.0F - fv) * top + fv * bottom;
+}
+
+/*the patch and a ring of ghost cells, (AMR_PATCH_SIZE + 2) on a side*/
+static void gather_patch(const amr_state& amr, const amr_patch& patch, const double time, const cl_float air_temperature, cl_float* padded)
+{
+    const auto size = AMR_PATCH_SIZE + 2;
+    const auto col0 = static_cast<cl_int>(patch.x * AMR_PATCH_SIZE) - 1;
+    const auto row0 = static_cast<cl_int>(patch.y * AMR_PATCH_SIZE) - 1;
+    for (cl_uint j = 0; j < size; j++)
+    {
+        for (cl_uint i = 0; i < size; i++)
+        {
+            const auto col = col0 + static_cast<cl_int>(i);
+            const auto row = row0 + static_cast<cl_int>(j);
+            const auto inside = i > 0 && j > 0 && i <= AMR_PATCH_SIZE && j <= AMR_PATCH_SIZE;
+            if (outside_plate(amr, patch.level, col, row))
+                padded[j * size + i] = air_temperature;
+            else
+                padded[j * size + i] = inside ? patch.values[(j - 1) * AMR_PATCH_SIZE + i - 1] : sample(amr, patch.level, col, row, time, air_temperature);
+        }
+    }
+}
+
+/*largest difference between two neighbouring cells of the patch and its ghosts*/
+static cl_float largest_jump(const cl_float* padded)
+{
+    const auto size = AMR_PATCH_SIZE + 2;
+    auto jump = 0.0F;
+    for (cl_uint j = 1; j <= AMR_PATCH_SIZE; j++)
+    {
+        for (cl_uint i = 1; i <= AMR_PATCH_SIZE; i++)
+        {
+            const auto center = padded[j * size + i];
+            jump = std::max({ jump, std::fabs(center - padded[j * size + i - 1]), std::fabs(center - padded[j * size + i + 1]),
+                std::fabs(center - padded[(j - 1) * size + i]), std::fabs(center - padded[(j + 1) * size + i]) });
+        }
+    }
+    return jump;
+}
+
+/*patches on the edge of the plate or under the source stay at full resolution*/
+static bool needs_finest(const amr_state& amr, const cl_uint level, const cl_uint x, const cl_uint y, const plate_problem& problem)
+{
+    const auto span = patch_span(amr, level);
+    const auto left = x * span;
+    const auto top = y * span;
+    if (0 == left || 0 == top || left + span >= amr.width || top + span >= amr.height)
+        return true;
+    return problem.point_x >= static_cast<cl_int>(left) && problem.point_x < static_cast<cl_int>(left + span) &&
+        problem.point_y >= static_cast<cl_int>(top) && problem.point_y < static_cast<cl_int>(top + span);
+}
+
+/*
+ * true when a patch of level + 1 next to the patch is split, the cheap and slightly eager side of the balance: a leaf
+ * two levels finer than level on its edge lies in one of them
+ */
+static bool has_finer_neighbour(const amr_state& amr, const cl_uint level, const cl_uint x, const cl_uint y)
+{
+    if (level + 2 > finest_level(amr))
+        return false;
+
+    const auto fine = level + 1;
+    const auto col = static_cast<cl_int>(2 * x * AMR_PATCH_SIZE);
+    const auto row = static_cast<cl_int>(2 * y * AMR_PATCH_SIZE);
+    const auto size = static_cast<cl_int>(AMR_PATCH_SIZE);
+    const cl_int cells[8][2] = { { col - 1, row }, { col - 1, row + size }, { col + 2 * size, row }, { col + 2 * size, row + size },
+        { col, row - 1 }, { col + size, row - 1 }, { col, row + 2 * size }, { col + size, row + 2 * size } };
+    for (const auto& cell : cells)
+    {
+        if (outside_plate(amr, fine, cell[0], cell[1]))
+            continue;
+        const auto& patch = amr.patches[find_patch(amr, fine, cell[0], cell[1])];
+        if (patch.level == fine && patch.children >= 0)
+            return true;
+    }
+    return false;
+}
+
+/*the cells of the plate under a cell of the patch, averaged; cells beyond the plate get the air*/
+static void restrict_field(const amr_state& amr, amr_patch& patch, const cl_float* field, const cl_float air_temperature)
+{
+    const auto shift = finest_level(amr) - patch.level;
+    const auto n = 1u << shift;
+    for (cl_uint j = 0; j < AMR_PATCH_SIZE; j++)
+    {
+        for (cl_uint i = 0; i < AMR_PATCH_SIZE; i++)
+        {
+            const auto left = (patch.x * AMR_PATCH_SIZE + i) << shift;
+            const auto top = (patch.y * AMR_PATCH_SIZE + j) << shift;
+            auto sum = 0.0;
+            cl_uint count = 0;
+            for (auto y = top; y < std::min(top + n, amr.height); y++)
+            {
+                for (auto x = left; x < std::min(left + n, amr.width); x++, count++)
+                    sum += field[static_cast<size_t>(y) * amr.width + x];
+            }
+            patch.values[j * AMR_PATCH_SIZE + i] = count ? static_cast<cl_float>(sum / count) : air_temperature;
+        }
+    }
+}
+
+static void init_patch(amr_patch& patch, const cl_uint level, const cl_uint x, const cl_uint y, const double time)
+{
+    patch.used = true;
+    patch.level = level;
+    patch.x = x;
+    patch.y = y;
+    patch.children = -1;
+    patch.start = time;
+    patch.end = time;
+    patch.values.resize(AMR_PATCH_SIZE * AMR_PATCH_SIZE);
+    patch.next.resize(AMR_PATCH_SIZE * AMR_PATCH_SIZE);
+}
+
+/*splits a leaf; the children take the field when there is one, the interpolated parent otherwise*/
+static void refine_patch(amr_state& amr, const size_t index, const cl_float* field, const cl_float air_temperature)
+{
+    cl_int children;
+    if (!amr.free.empty())
+    {
+        children = amr.free.back();
+        amr.free.pop_back();
+    }
+    else
+    {
+        children = static_cast<cl_int>(amr.patches.size());
+        amr.patches.resize(amr.patches.size() + 4);
+    }
+
+    const auto parent = amr.patches[index];
+    for (cl_uint q = 0; q < 4; q++)
+    {
+        auto& child = amr.patches[children + q];
+        init_patch(child, parent.level + 1, 2 * parent.x + (q & 1), 2 * parent.y + (q >> 1), amr.time);
+        if (field)
+        {
+            restrict_field(amr, child, field, air_temperature);
+            continue;
+        }
+        for (cl_uint j = 0; j < AMR_PATCH_SIZE; j++)
+        {
+            for (cl_uint i = 0; i < AMR_PATCH_SIZE; i++)
+                child.values[j * AMR_PATCH_SIZE + i] = sample(amr, child.level, child.x * AMR_PATCH_SIZE + i, child.y * AMR_PATCH_SIZE + j, amr.time, air_temperature);
+        }
+    }
+    for (cl_uint q = 0; q < 4; q++)
+        amr.patches[children + q].previous = amr.patches[children + q].values;
+    amr.patches[index].children = children;
+}
+
+/*merges four leaves back into their parent, their cells averaged in 2 x 2 blocks*/
+static void coarsen_patch(amr_state& amr, const size_t index)
+{
+    auto& parent = amr.patches[index];
+    const auto children = parent.children;
+    const auto half = AMR_PATCH_SIZE / 2;
+    for (cl_uint j = 0; j < AMR_PATCH_SIZE; j++)
+    {
+        for (cl_uint i = 0; i < AMR_PATCH_SIZE; i++)
+        {
+            const auto& child = amr.patches[children + (i / half) + 2 * (j / half)];
+            const auto ci = 2 * (i % half);
+            const auto cj = 2 * (j % half);
+            const auto* v = child.values.data();
+            parent.values[j * AMR_PATCH_SIZE + i] = 0.25F * (v[cj * AMR_PATCH_SIZE + ci] + v[cj * AMR_PATCH_SIZE + ci + 1] +
+                v[(cj + 1) * AMR_PATCH_SIZE + ci] + v[(cj + 1) * AMR_PATCH_SIZE + ci + 1]);
+        }
+    }
+    parent.previous = parent.values;
+    parent.start = parent.end = amr.time;
+    parent.children = -1;
+    for (cl_uint q = 0; q < 4; q++)
+        amr.patches[children + q].used = false;
+    amr.free.push_back(children);
+}
+
+static bool is_leaf(const amr_patch& patch)
+{
+    return patch.used && patch.children < 0;
+}
+
+/*
+ * Splits until every leaf meets the criteria and the one level balance holds, then merges the groups of four that are
+ * flat enough; one merge per group and call, so the tree thins out over a few steps. field rebuilds from a plate field.
+ */
+static void regrid(amr_state& amr, const plate_problem& problem, const cl_float threshold, const cl_float* field)
+{
+    std::vector<cl_float> padded((AMR_PATCH_SIZE + 2) * (AMR_PATCH_SIZE + 2));
+    for (auto changed = true; changed;)
+    {
+        changed = false;
+        const auto count = amr.patches.size();
+        for (size_t index = 0; index < count; index++)
+        {
+            const auto& patch = amr.patches[index];
+            if (!is_leaf(patch) || patch.level == finest_level(amr) || outside_plate(amr, patch.level, patch.x * AMR_PATCH_SIZE, patch.y * AMR_PATCH_SIZE))
+                continue;
+
+            auto refine = needs_finest(amr, patch.level, patch.x, patch.y, problem) || has_finer_neighbour(amr, patch.level, patch.x, patch.y);
+            if (!refine)
+            {
+                gather_patch(amr, patch, amr.time, problem.air_temperature, padded.data());
+                refine = largest_jump(padded.data()) > threshold;
+            }
+            if (refine)
+            {
+                refine_patch(amr, index, field, problem.air_temperature);
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t index = 0; index < amr.patches.size(); index++)
+    {
+        const auto& patch = amr.patches[index];
+        if (!patch.used || patch.children < 0 || needs_finest(amr, patch.level, patch.x, patch.y, problem) || has_finer_neighbour(amr, patch.level, patch.x, patch.y))
+            continue;
+
+        auto flat = true;
+        for (cl_uint q = 0; flat && q < 4; q++)
+        {
+            const auto& child = amr.patches[patch.children + q];
+            if (!is_leaf(child))
+            {
+                flat = false;
+                break;
+            }
+            gather_patch(amr, child, amr.time, problem.air_temperature, padded.data());
+            flat = largest_jump(padded.data()) <= 0.25F * threshold;
+        }
+        if (flat)
+            coarsen_patch(amr, index);
+    }
+}
+
+/*level 0 covers the plate with whole patches, the tree is grown from the field*/
+static void build_tree(amr_state& amr, const plate_problem& problem, const cl_uint levels, const cl_float threshold, const cl_float* field)
+{
+    amr.width = problem.width;
+    amr.height = problem.height;
+    amr.levels = levels;
+    const auto span = patch_span(amr, 0);
+    amr.roots_x = (problem.width + span - 1) / span;
+    amr.roots_y = (problem.height + span - 1) / span;
+    amr.time = 0.0;
+    amr.steps = 0;
+    amr.point_x = problem.point_x;
+    amr.point_y = problem.point_y;
+    amr.patches.assign(static_cast<size_t>(amr.roots_x) * amr.roots_y, amr_patch());
+    amr.free.clear();
+    for (cl_uint y = 0; y < amr.roots_y; y++)
+    {
+        for (cl_uint x = 0; x < amr.roots_x; x++)
+        {
+            auto& patch = amr.patches[static_cast<size_t>(y) * amr.roots_x + x];
+            init_patch(patch, 0, x, y, amr.time);
+            restrict_field(amr, patch, field, problem.air_temperature);
+            patch.previous = patch.values;
+        }
+    }
+    regrid(amr, problem, threshold, field);
+}
+
+/*one FTCS step of every leaf of level, from time over time_step; then the finer levels catch up in substeps*/
+static void advance_level(amr_state& amr, const cl_uint level, const double time, const double time_step, const plate_problem& problem, const heat_model& model, cl_uint* steps)
+{
+    std::vector<size_t> leaves;
+    auto finer = false;
+    for (size_t index = 0; index < amr.patches.size(); index++)
+    {
+        const auto& patch = amr.patches[index];
+        if (is_leaf(patch) && patch.level == level && !outside_plate(amr, level, patch.x * AMR_PATCH_SIZE, patch.y * AMR_PATCH_SIZE))
+            leaves.push_back(index);
+        finer = finer || (patch.used && patch.level > level);
+    }
+
+    const auto cell_size = static_cast<double>(model.cell_size) * (1u << (finest_level(amr) - level));
+    const auto ratio = static_cast<cl_float>(model.diffusivity * time_step / (cell_size * cell_size));
+    const auto source = level == finest_level(amr) && problem.point_x >= 0 && problem.point_y >= 0 &&
+        static_cast<cl_uint>(problem.point_x) < amr.width && static_cast<cl_uint>(problem.point_y) < amr.height;
+    parallel_tasks(leaves.size(), [&](const size_t task)
+    {
+        auto& patch = amr.patches[leaves[task]];
+        const auto size = AMR_PATCH_SIZE + 2;
+        cl_float padded[size * size];
+        gather_patch(amr, patch, time, problem.air_temperature, padded);
+        for (cl_uint j = 0; j < AMR_PATCH_SIZE; j++)
+        {
+            for (cl_uint i = 0; i < AMR_PATCH_SIZE; i++)
+            {
+                const auto* c = padded + (j + 1) * size + i + 1;
+                patch.next[j * AMR_PATCH_SIZE + i] = *c + ratio * (c[-1] + c[1] + c[-static_cast<cl_int>(size)] + c[size] - 4.0F * *c);
+            }
+        }
+
+        const auto col = static_cast<cl_int>(problem.point_x) - static_cast<cl_int>(patch.x * AMR_PATCH_SIZE);
+        const auto row = static_cast<cl_int>(problem.point_y) - static_cast<cl_int>(patch.y * AMR_PATCH_SIZE);
+        if (source && col >= 0 && row >= 0 && col < static_cast<cl_int>(AMR_PATCH_SIZE) && row < static_cast<cl_int>(AMR_PATCH_SIZE))
+            patch.next[row * AMR_PATCH_SIZE + col] = problem.point_temperature;
+    });
+
+    /*the new values only replace the old ones once every leaf of the level has read its neighbours*/
+    for (const auto index : leaves)
+    {
+        auto& patch = amr.patches[index];
+        std::swap(patch.previous, patch.values);
+        std::swap(patch.values, patch.next);
+        patch.start = time;
+        patch.end = time + time_step;
+    }
+    *steps += static_cast<cl_uint>(leaves.size());
+
+    if (!finer)
+        return;
+    const auto fine_cell = cell_size / 2.0;
+    const auto limit = fine_cell * fine_cell / (4.0 * model.diffusivity);
+    const auto substeps = std::max(1, static_cast<int>(std::ceil(time_step / limit * (1.0 - 1e-6))));
+    for (auto k = 0; k < substeps; k++)
+        advance_level(amr, level + 1, time + k * time_step / substeps, time_step / substeps, problem, model, steps);
+}
+
+/*
+ * The tree outlives the step; it is grown again when the field it is handed is not the one it rendered last, after a
+ * replay, a benchmark run or another solver. Leaf steps are reported as iterations.
+ */
+int amr_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    auto& amr = solver_module(solver->amr);
+    const auto levels = std::max(1u, std::min(solver->settings.amr_levels, 8u));
+    const auto threshold = solver->settings.amr_threshold;
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    if (amr.patches.empty() || amr.width != problem.width || amr.height != problem.height || amr.levels != levels || amr.rendered.size() != count ||
+        0 != memcmp(amr.rendered.data(), input, sizeof(cl_float) * count))
+        build_tree(amr, problem, levels, threshold, input);
+    else if (0 == amr.steps % AMR_REGRID_INTERVAL || problem.point_x != amr.point_x || problem.point_y != amr.point_y)
+        regrid(amr, problem, threshold, nullptr);
+    amr.steps++;
+    amr.point_x = problem.point_x;
+    amr.point_y = problem.point_y;
+
+    const auto coarse_cell = static_cast<double>(model.cell_size) * (1u << (levels - 1));
+    const auto limit = coarse_cell * coarse_cell / (4.0 * model.diffusivity);
+    const auto steps = std::max(1, static_cast<int>(std::ceil(model.time_step / limit * (1.0 - 1e-6))));
+    cl_uint leaf_steps = 0;
+    for (auto k = 0; k < steps; k++)
+        advance_level(amr, 0, amr.time + k * static_cast<double>(model.time_step) / steps, static_cast<double>(model.time_step) / steps, problem, model, &leaf_steps);
+    amr.time += model.time_step;
+
+    /*the display grid takes the finest leaves as they are and interpolates the coarser ones bilinearly, ghosts included*/
+    std::vector<size_t> leaves;
+    for (size_t index = 0; index < amr.patches.size(); index++)
+    {
+        if (is_leaf(amr.patches[index]))
+            leaves.push_back(index);
+    }
+    parallel_tasks(leaves.size(), [&](const size_t task)
+    {
+        const auto& patch = amr.patches[leaves[task]];
+        const auto span = patch_span(amr, patch.level);
+        const auto left = patch.x * span;
+        const auto top = patch.y * span;
+        if (left >= problem.width || top >= problem.height)
+            return;
+        const auto right = std::min(left + span, problem.width);
+        const auto bottom = std::min(top + span, problem.height);
+        if (patch.level == levels - 1)
+        {
+            for (auto row = top; row < bottom; row++)
+                std::copy_n(patch.values.data() + (row - top) * AMR_PATCH_SIZE, right - left, output + static_cast<size_t>(row) * problem.width + left);
+            return;
+        }
+
+        const auto size = AMR_PATCH_SIZE + 2;
+        cl_float padded[size * size];
+        gather_patch(amr, patch, amr.time, problem.air_temperature, padded);
+        const auto step = 1.0F / static_cast<cl_float>(span / AMR_PATCH_SIZE);
+        for (auto row = top; row < bottom; row++)
+        {
+            const auto v = (row - top + 0.5F) * step + 0.5F;
+            const auto j = static_cast<cl_uint>(v);
+            const auto fv = v - j;
+            for (auto col = left; col < right; col++)
+            {
+                const auto u = (col - left + 0.5F) * step + 0.5F;
+                const auto i = static_cast<cl_uint>(u);
+                const auto fu = u - i;
+                const auto* c = padded + j * size + i;
+                output[static_cast<size_t>(row) * problem.width + col] = (1.0F - fv) * ((1.0F - fu) * c[0] + fu * c[1]) + fv * ((1.0F - fu) * c[size] + fu * c[size + 1]);
+            }
+        }
+    });
+    amr.rendered.assign(output, output + count);
+
+    solver->iterations = leaf_steps;
+    solver->residual = 0.0F;
+    return CL_SUCCESS;
+}
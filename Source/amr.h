@@ -0,0 +1,49 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "solver.h"
+
+#define AMR_PATCH_SIZE 16
+#define AMR_REGRID_INTERVAL 4
+
+/*
+ * One patch of the AMR quadtree: AMR_PATCH_SIZE square cells of its level, patch (x, y) of that level. values is the
+ * field at end and previous at start, the two ends of the last step of the level, so finer patches can interpolate in
+ * time between them; next is where a step writes. children is the first of four consecutive patches, -1 for a leaf.
+ */
+struct amr_patch
+{
+    bool             used;
+    cl_uint          level;
+    cl_uint          x;
+    cl_uint          y;
+    cl_int           children;
+    double           start;
+    double           end;
+    std::vector<cl_float> values;
+    std::vector<cl_float> previous;
+    std::vector<cl_float> next;
+};
+
+/*
+ * the quadtree over the plate, roots_x * roots_y level 0 patches first; free holds the first slot of released groups of
+ * four. The tree is regridded every AMR_REGRID_INTERVAL steps and when the source moves.
+ */
+struct amr_state
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_uint          levels;
+    cl_uint          roots_x;
+    cl_uint          roots_y;
+    double           time;
+    cl_uint          steps;
+    cl_int           point_x;
+    cl_int           point_y;
+    std::vector<amr_patch> patches;
+    std::vector<cl_int> free;
+    std::vector<cl_float> rendered;
+};
+
+int amr_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
@@ -0,0 +1,600 @@
+#include "archive.h"
+
+#include <io.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <Windows.h>
+
+
+#include "log_utils.h"
+#include "utils.h"
+
+#define ARCHIVE_MAGIC 0x52415448
+#define ARCHIVE_FRAME_MAGIC 0x52465448
+#define ARCHIVE_INDEX_MAGIC 0x58495448
+#define ARCHIVE_VERSION 1
+
+/*
+ * Layout: archive_file_header, then one frame_header + codec stream per frame, then the index
+ * (8-byte aligned) and the trailer that closes the file. Every append overwrites the old index with the
+ * new frame and writes a fresh index + trailer behind it, flushing the frame first. A crash can therefore
+ * only leave a torn tail: the trailer no longer matches and the frames, which are self-describing and
+ * hashed, are scanned to rebuild the index up to the last complete one.
+ * A frame may carry a mip pyramid: level_count > 1 means its payload starts with a table of
+ * level_count + 1 offsets followed by one codec stream per level, each level half the size of the previous.
+ */
+
+struct archive_file_header
+{
+    cl_uint magic;
+    cl_uint version;
+    cl_uint width;
+    cl_uint height;
+};
+
+struct frame_header
+{
+    cl_uint magic;
+    cl_uint level_count;
+    cl_ulong step;
+    cl_ulong stream_size;
+    cl_ulong stream_hash;
+};
+
+struct archive_trailer
+{
+    cl_uint magic;
+    cl_uint reserved;
+    cl_ulong frame_count;
+    cl_ulong index_offset;
+    cl_ulong index_hash;
+};
+
+static bool valid_trailer(const archive_trailer& trailer, const cl_ulong file_size)
+{
+    return ARCHIVE_INDEX_MAGIC == trailer.magic &&
+        trailer.index_offset <= file_size &&
+        trailer.frame_count <= (file_size - trailer.index_offset) / sizeof(archive_index_entry) &&
+        trailer.index_offset + trailer.frame_count * sizeof(archive_index_entry) + sizeof(archive_trailer) == file_size;
+}
+
+static cl_ulong file_size_of(FILE* file)
+{
+    _fseeki64(file, 0, SEEK_END);
+    return static_cast<cl_ulong>(_ftelli64(file));
+}
+
+static bool write_all(FILE* file, const void* data, const size_t size)
+{
+    return 0 == size || fwrite(data, 1, size, file) == size;
+}
+
+static bool sync_file(FILE* file)
+{
+    return 0 == fflush(file) && 0 == _commit(_fileno(file));
+}
+
+/*rebuilds the index of a writer by walking the frames, stops at the first one that is torn or corrupt*/
+static void recover_archive_index(archive_writer* archive, const cl_ulong file_size)
+{
+    std::vector<unsigned char> stream;
+    auto offset = static_cast<cl_ulong>(sizeof(archive_file_header));
+    archive->index.clear();
+
+    while (offset + sizeof(frame_header) <= file_size)
+    {
+        frame_header header;
+        _fseeki64(archive->file, offset, SEEK_SET);
+        if (fread(&header, sizeof(frame_header), 1, archive->file) != 1 || ARCHIVE_FRAME_MAGIC != header.magic ||
+            header.stream_size > file_size - offset - sizeof(frame_header))
+            break;
+
+        stream.resize(header.stream_size);
+        if (fread(stream.data(), 1, stream.size(), archive->file) != stream.size() || hash_bytes(stream.data(), stream.size()) != header.stream_hash)
+            break;
+
+        if (!archive->index.empty() && header.step <= archive->index.back().step)
+            break;
+
+        archive->index.push_back({ header.step, offset, header.stream_size });
+        offset += sizeof(frame_header) + header.stream_size;
+    }
+
+    archive->end = offset;
+}
+
+static int write_archive_index(archive_writer* archive)
+{
+    static const unsigned char padding[8] = { 0 };
+    const auto index_offset = (archive->end + 7) / 8 * 8;
+    const auto index_size = archive->index.size() * sizeof(archive_index_entry);
+    const archive_trailer trailer = { ARCHIVE_INDEX_MAGIC, 0, archive->index.size(), index_offset,
+        hash_bytes(archive->index.data(), index_size) };
+
+    _fseeki64(archive->file, archive->end, SEEK_SET);
+    if (!write_all(archive->file, padding, static_cast<size_t>(index_offset - archive->end)) ||
+        !write_all(archive->file, archive->index.data(), index_size) ||
+        !write_all(archive->file, &trailer, sizeof(archive_trailer)) ||
+        !sync_file(archive->file) ||
+        0 != _chsize_s(_fileno(archive->file), static_cast<long long>(index_offset + index_size + sizeof(archive_trailer))) ||
+        !sync_file(archive->file))
+    {
+        log_error("Error: Couldn't write the archive index.\n");
+        return -1;
+    }
+
+    return CL_SUCCESS;
+}
+
+int open_archive_writer(archive_writer* archive, const char* file_name, const cl_uint width, const cl_uint height, const codec_mode mode, const cl_float tolerance, const cl_uint levels)
+{
+    archive->levels = levels;
+    archive->width = width;
+    archive->height = height;
+    archive->mode = mode;
+    archive->tolerance = tolerance;
+    archive->index.clear();
+
+    archive->file = nullptr;
+    fopen_s(&archive->file, file_name, "r+b");
+    if (nullptr == archive->file)
+    {
+        fopen_s(&archive->file, file_name, "w+b");
+        if (nullptr == archive->file)
+        {
+            log_error("Error: Couldn't create archive file '%s'.\n", file_name);
+            return -1;
+        }
+
+        const archive_file_header header = { ARCHIVE_MAGIC, ARCHIVE_VERSION, width, height };
+        archive->end = sizeof(archive_file_header);
+        if (!write_all(archive->file, &header, sizeof(archive_file_header)))
+        {
+            log_error("Error: Couldn't write archive file '%s'.\n", file_name);
+            close_archive_writer(archive);
+            return -1;
+        }
+
+        return write_archive_index(archive);
+    }
+
+    archive_file_header header;
+    if (fread(&header, sizeof(archive_file_header), 1, archive->file) != 1 || ARCHIVE_MAGIC != header.magic || ARCHIVE_VERSION != header.version)
+    {
+        log_error("Error: '%s' is not an archive file.\n", file_name);
+        close_archive_writer(archive);
+        return -1;
+    }
+    if (header.width != width || header.height != height)
+    {
+        log_error("Error: archive '%s' holds a %ux%u plate, expected %ux%u.\n", file_name, header.width, header.height, width, height);
+        close_archive_writer(archive);
+        return -1;
+    }
+
+    const auto file_size = file_size_of(archive->file);
+    archive_trailer trailer = {};
+    if (file_size >= sizeof(archive_file_header) + sizeof(archive_trailer))
+    {
+        _fseeki64(archive->file, file_size - sizeof(archive_trailer), SEEK_SET);
+        if (fread(&trailer, sizeof(archive_trailer), 1, archive->file) != 1)
+            trailer.magic = 0;
+    }
+
+    if (valid_trailer(trailer, file_size))
+    {
+        archive->index.resize(trailer.frame_count);
+        _fseeki64(archive->file, trailer.index_offset, SEEK_SET);
+        const auto index_size = archive->index.size() * sizeof(archive_index_entry);
+        if ((0 == index_size || fread(archive->index.data(), index_size, 1, archive->file) == 1) &&
+            hash_bytes(archive->index.data(), index_size) == trailer.index_hash)
+        {
+            archive->end = archive->index.empty() ? sizeof(archive_file_header) : archive->index.back().offset + sizeof(frame_header) + archive->index.back().size;
+            return CL_SUCCESS;
+        }
+    }
+
+    /*the last append didn't complete*/
+    recover_archive_index(archive, file_size);
+    log_info("Archive '%s' was not closed cleanly, recovered %llu frames.\n", file_name, static_cast<unsigned long long>(archive->index.size()));
+    return write_archive_index(archive);
+}
+
+void archive_level_size(const cl_uint width, const cl_uint height, const cl_uint level, cl_uint* level_width, cl_uint* level_height)
+{
+    *level_width = width;
+    *level_height = height;
+    for (cl_uint i = 0; i < level; i++)
+    {
+        *level_width = (*level_width + 1) / 2;
+        *level_height = (*level_height + 1) / 2;
+    }
+}
+
+/*2x2 box filter, odd edges average only the cells that exist; rows are split between the threads*/
+void downsample_field(const cl_float* field, const cl_uint width, const cl_uint height, cl_float* level)
+{
+    cl_uint level_width, level_height;
+    archive_level_size(width, height, 1, &level_width, &level_height);
+
+    std::thread threads[CPU_THREAD_COUNT];
+    for (auto t = 0; t < CPU_THREAD_COUNT; t++)
+    {
+        threads[t] = std::thread([=]()
+        {
+            for (auto y = static_cast<cl_uint>(t); y < level_height; y += CPU_THREAD_COUNT)
+            {
+                const auto y1 = 2 * y + 1 < height ? 2 * y + 1 : 2 * y;
+                for (cl_uint x = 0; x < level_width; x++)
+                {
+                    const auto x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+                    const auto row = static_cast<size_t>(2 * y) * width;
+                    const auto row1 = static_cast<size_t>(y1) * width;
+                    level[static_cast<size_t>(y) * level_width + x] = 0.25F * (field[row + 2 * x] + field[row + x1] + field[row1 + 2 * x] + field[row1 + x1]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static int encode_pyramid(const archive_writer* archive, const cl_float* field, std::vector<unsigned char>& payload)
+{
+    std::vector<cl_ulong> offsets(archive->levels + 1, 0);
+    std::vector<std::vector<unsigned char>> streams(archive->levels);
+    std::vector<cl_float> level_field[2];
+    const auto* source = field;
+    auto width = archive->width;
+    auto height = archive->height;
+
+    for (cl_uint level = 0; level < archive->levels; level++)
+    {
+        if (level > 0)
+        {
+            auto& target = level_field[level % 2];
+            cl_uint level_width, level_height;
+            archive_level_size(width, height, 1, &level_width, &level_height);
+            target.resize(static_cast<size_t>(level_width) * level_height);
+            downsample_field(source, width, height, target.data());
+            source = target.data();
+            width = level_width;
+            height = level_height;
+        }
+
+        if (CL_SUCCESS != encode_field(source, width, height, archive->mode, archive->tolerance, streams[level]))
+            return -1;
+        offsets[level + 1] = offsets[level] + streams[level].size();
+    }
+
+    const auto table_size = sizeof(cl_ulong) * offsets.size();
+    payload.resize(table_size + offsets[archive->levels]);
+    memcpy(payload.data(), offsets.data(), table_size);
+    for (cl_uint level = 0; level < archive->levels; level++)
+        memcpy(payload.data() + table_size + offsets[level], streams[level].data(), streams[level].size());
+
+    return CL_SUCCESS;
+}
+
+int append_archive_frame(archive_writer* archive, const cl_ulong step, const cl_float* field)
+{
+    if (!archive->index.empty() && step <= archive->index.back().step)
+    {
+        log_error("Error: archive frames must have increasing steps, got %llu after %llu.\n",
+            static_cast<unsigned long long>(step), static_cast<unsigned long long>(archive->index.back().step));
+        return -1;
+    }
+
+    std::vector<unsigned char> stream;
+    if (archive->levels <= 1)
+    {
+        if (CL_SUCCESS != encode_field(field, archive->width, archive->height, archive->mode, archive->tolerance, stream))
+            return -1;
+    }
+    else if (CL_SUCCESS != encode_pyramid(archive, field, stream))
+        return -1;
+
+    const frame_header header = { ARCHIVE_FRAME_MAGIC, archive->levels <= 1 ? 1 : archive->levels, step, stream.size(), hash_bytes(stream.data(), stream.size()) };
+
+    /*the frame must be durable before an index may point at it*/
+    _fseeki64(archive->file, archive->end, SEEK_SET);
+    if (!write_all(archive->file, &header, sizeof(frame_header)) || !write_all(archive->file, stream.data(), stream.size()) || !sync_file(archive->file))
+    {
+        log_error("Error: Couldn't append frame %llu to the archive.\n", static_cast<unsigned long long>(step));
+        return -1;
+    }
+
+    archive->index.push_back({ step, archive->end, stream.size() });
+    archive->end += sizeof(frame_header) + stream.size();
+
+    return write_archive_index(archive);
+}
+
+/*decodes the full-size level of the last frame, so a reopened archive continues from the field it ends with*/
+int read_last_archive_frame(archive_writer* archive, cl_float* field)
+{
+    if (archive->index.empty())
+    {
+        log_error("Error: archive has no frame to continue from.\n");
+        return -1;
+    }
+
+    const auto& entry = archive->index.back();
+    frame_header header;
+    std::vector<unsigned char> payload(static_cast<size_t>(entry.size));
+    _fseeki64(archive->file, entry.offset, SEEK_SET);
+    if (fread(&header, sizeof(frame_header), 1, archive->file) != 1 || (!payload.empty() && fread(payload.data(), 1, payload.size(), archive->file) != payload.size()))
+    {
+        log_error("Error: Couldn't read frame %llu of the archive.\n", static_cast<unsigned long long>(entry.step));
+        return -1;
+    }
+
+    auto offset = static_cast<cl_ulong>(0);
+    auto size = entry.size;
+    if (header.level_count > 1)
+    {
+        const auto table_size = sizeof(cl_ulong) * (header.level_count + 1);
+        cl_ulong offsets[2];
+        if (table_size > entry.size)
+            return -1;
+        memcpy(offsets, payload.data(), sizeof(offsets));
+        if (offsets[0] > offsets[1] || table_size + offsets[1] > entry.size)
+        {
+            log_error("Error: archive frame %llu has a corrupt level table.\n", static_cast<unsigned long long>(entry.step));
+            return -1;
+        }
+        offset = table_size + offsets[0];
+        size = offsets[1] - offsets[0];
+    }
+
+    return decode_field(payload.data() + offset, static_cast<size_t>(size), field, archive->width, archive->height);
+}
+
+void close_archive_writer(archive_writer* archive)
+{
+    if (archive->file)
+    {
+        fclose(archive->file);
+        archive->file = nullptr;
+    }
+}
+
+int open_archive_reader(archive_reader* archive, const char* file_name)
+{
+    archive->file = nullptr;
+    archive->mapping = nullptr;
+    archive->view = nullptr;
+    archive->index = nullptr;
+    archive->frame_count = 0;
+    archive->recovered_index.clear();
+
+    /*a run that is still being recorded can be read at the same time*/
+    auto* file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        log_error("Error: Couldn't find archive file '%s'.\n", file_name);
+        return -1;
+    }
+    archive->file = file;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || static_cast<cl_ulong>(file_size.QuadPart) < sizeof(archive_file_header))
+    {
+        log_error("Error: '%s' is not an archive file.\n", file_name);
+        close_archive_reader(archive);
+        return -1;
+    }
+    archive->size = static_cast<cl_ulong>(file_size.QuadPart);
+
+    archive->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr != archive->mapping)
+        archive->view = static_cast<const unsigned char*>(MapViewOfFile(archive->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (nullptr == archive->view)
+    {
+        log_error("Error: Couldn't map archive file '%s' (error %lu).\n", file_name, GetLastError());
+        close_archive_reader(archive);
+        return -1;
+    }
+
+    archive_file_header header;
+    memcpy(&header, archive->view, sizeof(archive_file_header));
+    if (ARCHIVE_MAGIC != header.magic || ARCHIVE_VERSION != header.version)
+    {
+        log_error("Error: '%s' is not an archive file.\n", file_name);
+        close_archive_reader(archive);
+        return -1;
+    }
+    archive->width = header.width;
+    archive->height = header.height;
+
+    archive_trailer trailer = {};
+    if (archive->size >= sizeof(archive_file_header) + sizeof(archive_trailer))
+        memcpy(&trailer, archive->view + archive->size - sizeof(archive_trailer), sizeof(archive_trailer));
+
+    if (valid_trailer(trailer, archive->size) && 0 == trailer.index_offset % 8)
+    {
+        const auto* index = reinterpret_cast<const archive_index_entry*>(archive->view + trailer.index_offset);
+        if (hash_bytes(index, trailer.frame_count * sizeof(archive_index_entry)) == trailer.index_hash)
+        {
+            /*the index is used in place, straight from the mapping*/
+            archive->index = index;
+            archive->frame_count = trailer.frame_count;
+            return CL_SUCCESS;
+        }
+    }
+
+    /*torn tail: rebuild the index in memory, the file is left to the writer to repair*/
+    auto offset = static_cast<cl_ulong>(sizeof(archive_file_header));
+    while (offset + sizeof(frame_header) <= archive->size)
+    {
+        frame_header frame;
+        memcpy(&frame, archive->view + offset, sizeof(frame_header));
+        if (ARCHIVE_FRAME_MAGIC != frame.magic || frame.stream_size > archive->size - offset - sizeof(frame_header) ||
+            hash_bytes(archive->view + offset + sizeof(frame_header), static_cast<size_t>(frame.stream_size)) != frame.stream_hash ||
+            (!archive->recovered_index.empty() && frame.step <= archive->recovered_index.back().step))
+            break;
+
+        archive->recovered_index.push_back({ frame.step, offset, frame.stream_size });
+        offset += sizeof(frame_header) + frame.stream_size;
+    }
+    archive->index = archive->recovered_index.data();
+    archive->frame_count = archive->recovered_index.size();
+    log_info("Archive '%s' has no valid index, recovered %llu frames.\n", file_name, static_cast<unsigned long long>(archive->frame_count));
+
+    return CL_SUCCESS;
+}
+
+void close_archive_reader(archive_reader* archive)
+{
+    if (archive->view)
+        UnmapViewOfFile(archive->view);
+    if (archive->mapping)
+        CloseHandle(archive->mapping);
+    if (archive->file)
+        CloseHandle(archive->file);
+
+    archive->view = nullptr;
+    archive->mapping = nullptr;
+    archive->file = nullptr;
+    archive->index = nullptr;
+    archive->frame_count = 0;
+}
+
+/*latest frame recorded at or before step, -1 if the archive starts later*/
+cl_long find_archive_frame(const archive_reader* archive, const cl_ulong step)
+{
+    const auto* end = archive->index + archive->frame_count;
+    const auto* frame = std::upper_bound(archive->index, end, step,
+        [](const cl_ulong value, const archive_index_entry& entry) { return value < entry.step; });
+
+    return static_cast<cl_long>(frame - archive->index) - 1;
+}
+
+/*codec stream of one pyramid level of a frame, level 0 being the full plate*/
+static const unsigned char* frame_stream(const archive_reader* archive, const cl_ulong frame, const cl_uint level, size_t* stream_size)
+{
+    if (frame >= archive->frame_count)
+    {
+        log_error("Error: archive has no frame %llu.\n", static_cast<unsigned long long>(frame));
+        return nullptr;
+    }
+
+    const auto& entry = archive->index[frame];
+    if (entry.offset + sizeof(frame_header) + entry.size > archive->size)
+    {
+        log_error("Error: archive frame %llu is outside of the file.\n", static_cast<unsigned long long>(frame));
+        return nullptr;
+    }
+
+    frame_header header;
+    memcpy(&header, archive->view + entry.offset, sizeof(frame_header));
+    const auto* payload = archive->view + entry.offset + sizeof(frame_header);
+    if (header.level_count <= 1)
+    {
+        *stream_size = static_cast<size_t>(entry.size);
+        return level == 0 ? payload : nullptr;
+    }
+
+    const auto table_size = sizeof(cl_ulong) * (header.level_count + 1);
+    cl_ulong offsets[2];
+    if (level >= header.level_count || table_size > entry.size)
+        return nullptr;
+    memcpy(offsets, payload + sizeof(cl_ulong) * level, sizeof(offsets));
+    if (offsets[0] > offsets[1] || table_size + offsets[1] > entry.size)
+    {
+        log_error("Error: archive frame %llu has a corrupt level table.\n", static_cast<unsigned long long>(frame));
+        return nullptr;
+    }
+
+    *stream_size = static_cast<size_t>(offsets[1] - offsets[0]);
+    return payload + table_size + offsets[0];
+}
+
+cl_uint archive_level_count(const archive_reader* archive, const cl_ulong frame)
+{
+    if (frame >= archive->frame_count)
+        return 0;
+
+    frame_header header;
+    memcpy(&header, archive->view + archive->index[frame].offset, sizeof(frame_header));
+    return header.level_count <= 1 ? 1 : header.level_count;
+}
+
+/*deepest level that still covers max_width x max_height, levels missing from the frame are derived on read*/
+cl_uint choose_archive_level(const archive_reader* archive, const cl_uint max_width, const cl_uint max_height)
+{
+    cl_uint level = 0;
+    auto width = archive->width;
+    auto height = archive->height;
+    while ((width > max_width || height > max_height) && (width > 1 || height > 1))
+    {
+        archive_level_size(archive->width, archive->height, ++level, &width, &height);
+    }
+    return level;
+}
+
+int read_archive_frame(const archive_reader* archive, const cl_ulong frame, cl_float* field)
+{
+    return read_archive_level(archive, frame, 0, field);
+}
+
+int read_archive_level(const archive_reader* archive, const cl_ulong frame, const cl_uint level, cl_float* field)
+{
+    const auto level_count = archive_level_count(archive, frame);
+    const auto stored_level = level < level_count ? level : level_count - 1;
+
+    size_t stream_size;
+    const auto* stream = frame_stream(archive, frame, stored_level, &stream_size);
+    if (nullptr == stream)
+        return -1;
+
+    cl_uint width, height;
+    archive_level_size(archive->width, archive->height, stored_level, &width, &height);
+    if (stored_level == level)
+        return decode_field(stream, stream_size, field, width, height);
+
+    /*the frame was recorded without this level: reduce the smallest stored one*/
+    std::vector<cl_float> source(static_cast<size_t>(width) * height);
+    std::vector<cl_float> target;
+    if (CL_SUCCESS != decode_field(stream, stream_size, source.data(), width, height))
+        return -1;
+
+    for (auto current = stored_level; current < level; current++)
+    {
+        cl_uint level_width, level_height;
+        archive_level_size(width, height, 1, &level_width, &level_height);
+        if (current + 1 == level)
+        {
+            downsample_field(source.data(), width, height, field);
+            break;
+        }
+
+        target.resize(static_cast<size_t>(level_width) * level_height);
+        downsample_field(source.data(), width, height, target.data());
+        source.swap(target);
+        width = level_width;
+        height = level_height;
+    }
+
+    return CL_SUCCESS;
+}
+
+int read_archive_tile(const archive_reader* archive, const cl_ulong frame, const cl_uint level, const cl_uint tile_x, const cl_uint tile_y,
+    cl_float* tile, cl_uint* tile_width, cl_uint* tile_height)
+{
+    size_t stream_size;
+    const auto* stream = frame_stream(archive, frame, level, &stream_size);
+    if (nullptr == stream)
+    {
+        log_error("Error: archive frame %llu has no level %u.\n", static_cast<unsigned long long>(frame), level);
+        return -1;
+    }
+
+    cl_uint width, height;
+    archive_level_size(archive->width, archive->height, level, &width, &height);
+    return decode_field_tile(stream, stream_size, width, height, tile_x, tile_y, tile, tile_width, tile_height);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <CL/cl.h>
+#include <stdio.h>
+#include <vector>
+
+#include "field_codec.h"
+
+/*each level halves the one above, a 32-bit side is down to one cell after 32 of them*/
+#define ARCHIVE_MAX_LEVELS 32
+
+struct archive_index_entry
+{
+    cl_ulong step;
+    cl_ulong offset;
+    cl_ulong size;
+};
+
+struct archive_writer
+{
+    FILE*            file;
+    cl_uint          width;
+    cl_uint          height;
+    codec_mode       mode;
+    cl_float         tolerance;
+    cl_uint          levels;
+    cl_ulong         end;
+    std::vector<archive_index_entry> index;
+};
+
+struct archive_reader
+{
+    void*            file;
+    void*            mapping;
+    const unsigned char* view;
+    cl_ulong         size;
+    cl_uint          width;
+    cl_uint          height;
+    const archive_index_entry* index;
+    cl_ulong         frame_count;
+    std::vector<archive_index_entry> recovered_index;
+};
+
+void archive_level_size(cl_uint width, cl_uint height, cl_uint level, cl_uint* level_width, cl_uint* level_height);
+void downsample_field(const cl_float* field, cl_uint width, cl_uint height, cl_float* level);
+
+int open_archive_writer(archive_writer* archive, const char* file_name, cl_uint width, cl_uint height, codec_mode mode, cl_float tolerance, cl_uint levels);
+int append_archive_frame(archive_writer* archive, cl_ulong step, const cl_float* field);
+int read_last_archive_frame(archive_writer* archive, cl_float* field);
+void close_archive_writer(archive_writer* archive);
+
+int open_archive_reader(archive_reader* archive, const char* file_name);
+void close_archive_reader(archive_reader* archive);
+cl_long find_archive_frame(const archive_reader* archive, cl_ulong step);
+cl_uint archive_level_count(const archive_reader* archive, cl_ulong frame);
+cl_uint choose_archive_level(const archive_reader* archive, cl_uint max_width, cl_uint max_height);
+int read_archive_frame(const archive_reader* archive, cl_ulong frame, cl_float* field);
+int read_archive_level(const archive_reader* archive, cl_ulong frame, cl_uint level, cl_float* field);
+int read_archive_tile(const archive_reader* archive, cl_ulong frame, cl_uint level, cl_uint tile_x, cl_uint tile_y, cl_float* tile, cl_uint* tile_width, cl_uint* tile_height);
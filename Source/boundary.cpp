@@ -0,0 +1,212 @@
+#include "boundary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+
+#include "heat_model.h"
+#include "log_utils.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "ocl_solver.h"
+#include "utils.h"
+
+const char* const boundary_model_names[BOUNDARY_MODEL_COUNT] = { "dirichlet", "insulated", "convective", "radiative" };
+const char* const boundary_edge_names[BOUNDARY_EDGES] = { "west", "east", "north", "south" };
+
+ocl_boundary_t::ocl_boundary_t() :
+    kernel(nullptr)
+{
+}
+
+ocl_boundary_t::~ocl_boundary_t()
+{
+    if (kernel)
+        clReleaseKernel(kernel);
+}
+
+/*dirichlet, insulated, convective,<h> or radiative,<emissivity>*/
+static bool parse_edge_boundary(const std::string& value, edge_boundary& edge)
+{
+    const auto comma = value.find(',');
+    const auto name = value.substr(0, comma);
+    for (auto m = 0; m < BOUNDARY_MODEL_COUNT; m++)
+    {
+        if (name != boundary_model_names[m])
+            continue;
+
+        edge.model = static_cast<boundary_model>(m);
+        edge.value = 0.0F;
+        const auto needs_value = BOUNDARY_CONVECTIVE == edge.model || BOUNDARY_RADIATIVE == edge.model;
+        if (needs_value != (std::string::npos != comma))
+            return false;
+        if (!needs_value)
+            return true;
+        try
+        {
+            edge.value = std::stof(value.substr(comma + 1), nullptr);
+        }
+        catch (...)
+        {
+            return false;
+        }
+        return edge.value >= 0.0F && (BOUNDARY_CONVECTIVE == edge.model || edge.value <= 1.0F);
+    }
+    return false;
+}
+
+/*boundary sets all four edges, boundary_west, boundary_east, boundary_north and boundary_south one each*/
+bool parse_boundary_setting(const std::string& name, const std::string& value, boundary_settings& settings)
+{
+    edge_boundary edge;
+    if (!parse_edge_boundary(value, edge))
+        return false;
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+    {
+        if (name == "boundary" || name == std::string("boundary_") + boundary_edge_names[e])
+            settings.edges[e] = edge;
+    }
+    return name == "boundary" || std::any_of(boundary_edge_names, boundary_edge_names + BOUNDARY_EDGES,
+        [&name](const char* edge_name) { return name == std::string("boundary_") + edge_name; });
+}
+
+/*the coefficients of the edges for the cell size of the model*/
+void resolve_boundary(boundary_conditions* boundary, const boundary_settings& settings, const heat_model& model)
+{
+    boundary->enabled = false;
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+    {
+        const auto& edge = settings.edges[e];
+        boundary->models[e] = edge.model;
+        boundary->coefficients[e] = 0.0F;
+        if (BOUNDARY_CONVECTIVE == edge.model)
+        {
+            boundary->coefficients[e] = edge.value * model.cell_size / settings.conductivity;
+            if (boundary->coefficients[e] > 1.0F)
+            {
+                log_error("Warning: the %s edge has a Biot number of %g per cell, treated as 1, the air temperature.\n", boundary_edge_names[e], boundary->coefficients[e]);
+                boundary->coefficients[e] = 1.0F;
+            }
+        }
+        else if (BOUNDARY_RADIATIVE == edge.model)
+        {
+            boundary->coefficients[e] = edge.value * BOUNDARY_STEFAN_BOLTZMANN * model.cell_size / settings.conductivity;
+        }
+        boundary->enabled = boundary->enabled || BOUNDARY_DIRICHLET != edge.model;
+    }
+}
+
+/*the ghost value of edge e in the generated kernel, the model written in so no edge tests it*/
+static std::string ghost_expression(const boundary_conditions& boundary, const int e)
+{
+    static const char* const components[BOUNDARY_EDGES] = { "x", "y", "z", "w" };
+    switch (boundary.models[e])
+    {
+    case BOUNDARY_INSULATED:
+        return "center";
+    case BOUNDARY_CONVECTIVE:
+        return std::string("boundary_blend(center, air_temperature, coefficients.") + components[e] + ")";
+    case BOUNDARY_RADIATIVE:
+        return std::string("boundary_blend(center, air_temperature, radiative_beta(center, air_temperature, coefficients.") + components[e] + "))";
+    default:
+        return "air_temperature";
+    }
+}
+
+/*simulate with the ghost cells of the configured edges; empty when every edge is Dirichlet*/
+std::string boundary_program_source(const boundary_conditions& boundary)
+{
+    if (!boundary.enabled)
+        return std::string();
+
+    std::ostringstream source;
+    source << "\n/*generated from boundary_conditions in boundary.h: ";
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+        source << (e ? ", " : "") << boundary_edge_names[e] << " " << boundary_model_names[boundary.models[e]];
+    source << "*/\n"
+        "__kernel void simulate_boundary(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature,\n"
+        "\t__global struct vertex_args* plate_points, ulong device_cells, float ratio, float4 coefficients)\n"
+        "{\n"
+        "\tint2 coords = (int2)(get_global_id(0), get_global_id(1));\n"
+        "\tindex_t global_index = cell_index(coords.x, coords.y, width);\n"
+        "\tif (global_index >= device_cells)\n"
+        "\t\treturn;\n"
+        "\n"
+        "\tfloat center = read_imagef(input, sampler, coords).x;\n"
+        "\tfloat neighbours = (coords.x > 0 ? read_imagef(input, sampler, (int2)(coords.x - 1, coords.y)).x : " << ghost_expression(boundary, 0) << ") +\n"
+        "\t\t(coords.x + 1 < width ? read_imagef(input, sampler, (int2)(coords.x + 1, coords.y)).x : " << ghost_expression(boundary, 1) << ") +\n"
+        "\t\t(coords.y > 0 ? read_imagef(input, sampler, (int2)(coords.x, coords.y - 1)).x : " << ghost_expression(boundary, 2) << ") +\n"
+        "\t\t(coords.y + 1 < height ? read_imagef(input, sampler, (int2)(coords.x, coords.y + 1)).x : " << ghost_expression(boundary, 3) << ");\n"
+        "\tfloat value = center + ratio * (neighbours - 4.0F * center);\n"
+        "\tset_temperature_color(&plate_points[global_index], value);\n"
+        "\twrite_imagef(output, coords, (float4)(value, value, value, value));\n"
+        "}\n";
+    return source.str();
+}
+
+int setup_ocl_boundary(ocl_args_d_t* ocl, boundary_conditions* boundary)
+{
+    if (!boundary->enabled)
+        return CL_SUCCESS;
+    return create_solver_kernel(ocl, "simulate_boundary", &boundary->device.kernel);
+}
+
+/*
+ * The explicit step of the cells [first, last) in row order, the same arithmetic as simulate_boundary. Only the cells
+ * of the first and last row and column meet a ghost; the rest of each row takes the plain stencil.
+ */
+void step_boundary_cells(const boundary_conditions& boundary, const cl_float* input, cl_float* output, const cl_uint width, const cl_uint height,
+    const cl_float air_temperature, const cl_float ratio, const size_t first, const size_t last)
+{
+    const auto edge_cell = [&](const size_t i, const cl_uint x, const cl_uint y)
+    {
+        const auto center = input[i];
+        const auto neighbours = (x > 0 ? input[i - 1] : boundary_ghost(boundary.models[0], boundary.coefficients[0], center, air_temperature)) +
+            (x + 1 < width ? input[i + 1] : boundary_ghost(boundary.models[1], boundary.coefficients[1], center, air_temperature)) +
+            (y > 0 ? input[i - width] : boundary_ghost(boundary.models[2], boundary.coefficients[2], center, air_temperature)) +
+            (y + 1 < height ? input[i + width] : boundary_ghost(boundary.models[3], boundary.coefficients[3], center, air_temperature));
+        output[i] = center + ratio * (neighbours - 4.0F * center);
+    };
+
+    for (auto row_start = first - first % width; row_start < last; row_start += width)
+    {
+        const auto y = static_cast<cl_uint>(row_start / width);
+        const auto begin = static_cast<cl_uint>(std::max(first, row_start) - row_start);
+        const auto end = static_cast<cl_uint>(std::min(last, row_start + width) - row_start);
+        const auto inner_row = y > 0 && y + 1 < height;
+        const auto inner_begin = inner_row ? std::min(std::max(begin, 1u), end) : end;
+        const auto inner_end = inner_row ? std::max(inner_begin, std::min(end, width - 1)) : inner_begin;
+
+        for (auto x = begin; x < inner_begin; x++)
+            edge_cell(row_start + x, x, y);
+        for (auto x = inner_begin; x < inner_end; x++)
+        {
+            const auto i = row_start + x;
+            output[i] = input[i] + ratio * (input[i - 1] + input[i + 1] + input[i - width] + input[i + width] - 4.0F * input[i]);
+        }
+        for (auto x = inner_end; x < end; x++)
+            edge_cell(row_start + x, x, y);
+    }
+}
+
+int execute_boundary_kernel(ocl_args_d_t* ocl, boundary_conditions* boundary, const cl_uint width, const cl_uint height, const cl_float air_temperature,
+    const cl_float gpu_percent, const cl_float ratio)
+{
+    cl_float4 coefficients;
+    memcpy(&coefficients, boundary->coefficients, sizeof(coefficients));
+    const size_t global_work_size[] = { width, height };
+    if (CL_SUCCESS != set_kernel_args(boundary->device.kernel, 0, ocl->input, ocl->output, width, height, air_temperature, ocl->plate_points, device_cell_count(width, height, gpu_percent), ratio,
+        coefficients) ||
+        CL_SUCCESS != run_solver_kernel(ocl, boundary->device.kernel, 2, global_work_size, nullptr))
+        return -1;
+
+    const auto err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
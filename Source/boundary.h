@@ -0,0 +1,93 @@
+#pragma once
+#include <CL/cl.h>
+#include <string>
+
+struct ocl_args_d_t;
+struct heat_model;
+struct vertex_args;
+
+#define BOUNDARY_EDGES 4
+/*Stefan-Boltzmann constant in W / (m^2 K^4) and the offset of the Kelvin scale*/
+#define BOUNDARY_STEFAN_BOLTZMANN 5.670374e-8F
+#define BOUNDARY_KELVIN 273.15F
+
+enum boundary_model
+{
+    BOUNDARY_DIRICHLET,
+    BOUNDARY_INSULATED,
+    BOUNDARY_CONVECTIVE,
+    BOUNDARY_RADIATIVE,
+    BOUNDARY_MODEL_COUNT
+};
+
+extern const char* const boundary_model_names[BOUNDARY_MODEL_COUNT];
+/*west, east, north, south, the order of the edges everywhere*/
+extern const char* const boundary_edge_names[BOUNDARY_EDGES];
+
+/*the model of one edge; value is the heat transfer coefficient h in W / (m^2 K) or the emissivity*/
+struct edge_boundary
+{
+    boundary_model   model;
+    cl_float         value;
+};
+
+/*what the config asks for, conductivity in W / (m K)*/
+struct boundary_settings
+{
+    edge_boundary    edges[BOUNDARY_EDGES];
+    cl_float         conductivity;
+};
+
+/*the generated kernel for the models of the four edges*/
+struct ocl_boundary_t
+{
+    ocl_boundary_t();
+    ~ocl_boundary_t();
+
+    cl_kernel        kernel;
+};
+
+/*
+ * The edges of the plate as seen by the explicit step. A neighbour beyond an edge is a ghost cell, center +
+ * beta * (air - center): beta 1 is the air itself (Dirichlet, what the plain kernel does), 0 the cell itself (insulated),
+ * and in between heat leaves through the edge at h (T - air), beta = h dx / k (convective), or by radiation linearised
+ * around the cell, h = emissivity sigma (T^2 + air^2) (T + air) in Kelvin (radiative). coefficients[e] is that beta for
+ * a convective edge and emissivity sigma dx / k for a radiative one; beta is capped at 1 so the step stays stable. A
+ * plate with only Dirichlet edges is not enabled and runs the plain kernel.
+ */
+struct boundary_conditions
+{
+    bool             enabled;
+    boundary_model   models[BOUNDARY_EDGES];
+    cl_float         coefficients[BOUNDARY_EDGES];
+    ocl_boundary_t   device;
+};
+
+/*the ghost value beyond an edge of the given model*/
+inline cl_float boundary_ghost(const boundary_model model, const cl_float coefficient, const cl_float center, const cl_float air_temperature)
+{
+    switch (model)
+    {
+    case BOUNDARY_INSULATED:
+        return center;
+    case BOUNDARY_CONVECTIVE:
+        return center + coefficient * (air_temperature - center);
+    case BOUNDARY_RADIATIVE:
+    {
+        const auto t = center + BOUNDARY_KELVIN;
+        const auto a = air_temperature + BOUNDARY_KELVIN;
+        const auto beta = coefficient * (t * t + a * a) * (t + a);
+        return center + (beta < 1.0F ? beta : 1.0F) * (air_temperature - center);
+    }
+    default:
+        return air_temperature;
+    }
+}
+
+bool parse_boundary_setting(const std::string& name, const std::string& value, boundary_settings& settings);
+void resolve_boundary(boundary_conditions* boundary, const boundary_settings& settings, const heat_model& model);
+std::string boundary_program_source(const boundary_conditions& boundary);
+int setup_ocl_boundary(ocl_args_d_t* ocl, boundary_conditions* boundary);
+void step_boundary_cells(const boundary_conditions& boundary, const cl_float* input, cl_float* output, cl_uint width, cl_uint height, cl_float air_temperature,
+    cl_float ratio, size_t first, size_t last);
+int execute_boundary_kernel(ocl_args_d_t* ocl, boundary_conditions* boundary, cl_uint width, cl_uint height, cl_float air_temperature, cl_float gpu_percent, cl_float ratio);
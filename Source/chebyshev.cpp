@@ -0,0 +1,156 @@
+#include "chebyshev.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+#include "linear_system.h"
+#include "ocl_args.h"
+#include "parallel.h"
+
+/*
+ * Steady state by Chebyshev semi-iteration over the explicit averaging step. Plain averaging (ftcs at the stability limit)
+ * is Jacobi and needs O(n^2) steps; weighting each step by the Chebyshev recurrence with the Jacobi rate rho of the plate,
+ * x(k+1) = x(k-1) + omega(k+1) * (average(x(k)) - x(k-1)), brings that down to O(n) at the same cost per step.
+ * The largest |average(x) - x| is measured on the fly and stops the iteration at solver_tolerance, or once it has not
+ * reached a new low for CHEBYSHEV_STALLED_CHECKS checks: it is not monotone early on, but a lasting stall means the float
+ * rounding of the field has been reached.
+ */
+
+/*omega(1) = 1, omega(2) = 1 / (1 - rho^2 / 2), omega(k + 1) = 1 / (1 - rho^2 omega(k) / 4)*/
+static cl_float next_omega(const cl_float omega, const cl_uint iteration, const cl_float rho)
+{
+    if (0 == iteration)
+        return 1.0F;
+    if (1 == iteration)
+        return 1.0F / (1.0F - 0.5F * rho * rho);
+    return 1.0F / (1.0F - 0.25F * rho * rho * omega);
+}
+
+/*previous becomes the next iterate; returns the largest change the plain averaging step would make to current*/
+static cl_float chebyshev_step(const plate_problem& problem, const cl_float* current, cl_float* previous, const cl_float omega)
+{
+    const linear_system source = { problem.width, problem.height, 0.0F, 0.0F, problem.point_x, problem.point_y, {} };
+    return parallel_reduce(problem.height, 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto residual = 0.0F;
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < problem.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * problem.width + col;
+                const auto average = is_source(source, col, row) ? problem.point_temperature :
+                    0.25F * neighbour_sum(current, col, row, problem.width, problem.height, problem.air_temperature);
+                residual = std::max(residual, std::fabs(average - current[i]));
+                previous[i] += omega * (average - previous[i]);
+            }
+        }
+        return residual;
+    }, [](const cl_float a, const cl_float b) { return std::max(a, b); });
+}
+
+/*
+ * Iterates output, with scratch holding the older iterate, until tolerance, max_iterations or a stall. Without accelerate
+ * omega stays 1 and every step is the plain average, which is what chebyshev_check counts the recurrence against; its
+ * change creeps down so slowly on a large plate that it is only taken as stalled after AVERAGING_STALLED_CHECKS checks.
+ */
+static cl_uint relax(const plate_problem& problem, cl_float* output, cl_float* scratch, const bool accelerate, const cl_float tolerance,
+    const cl_uint max_iterations, cl_float* residual)
+{
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    const auto rho = jacobi_radius(problem.width, problem.height);
+    std::copy(output, output + count, scratch);
+
+    /*the two iterates swap roles every step*/
+    auto* current = output;
+    auto* previous = scratch;
+    auto omega = 1.0F;
+    auto best_residual = std::numeric_limits<cl_float>::max();
+    cl_uint stalled_checks = 0;
+    cl_uint iterations = 0;
+    *residual = tolerance + 1.0F;
+    while (*residual > tolerance && iterations < max_iterations)
+    {
+        omega = accelerate ? next_omega(omega, iterations, rho) : 1.0F;
+        *residual = chebyshev_step(problem, current, previous, omega);
+        std::swap(current, previous);
+        iterations++;
+
+        if (0 == iterations % LINEAR_CHECK_INTERVAL)
+        {
+            stalled_checks = *residual < best_residual ? 0 : stalled_checks + 1;
+            best_residual = std::min(best_residual, *residual);
+            if ((accelerate ? CHEBYSHEV_STALLED_CHECKS : AVERAGING_STALLED_CHECKS) == stalled_checks)
+                break;
+        }
+    }
+
+    if (current != output)
+        std::copy(current, current + count, output);
+    return iterations;
+}
+
+int chebyshev_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output)
+{
+    const auto& settings = solver->settings;
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    std::copy(input, input + count, output);
+    solver->rhs.resize(count);
+    solver->iterations = relax(problem, output, solver->rhs.data(), true, settings.tolerance, settings.max_iterations, &solver->residual);
+    return CL_SUCCESS;
+}
+
+cl_uint plain_averaging_steps(const plate_problem& problem, cl_float* field, const cl_float tolerance, const cl_uint max_steps, cl_float* residual)
+{
+    std::vector<cl_float> scratch(static_cast<size_t>(problem.width) * problem.height);
+    return relax(problem, field, scratch.data(), false, tolerance, max_steps, residual);
+}
+
+/*same recurrence on device->field and device->rhs; the partial maxima are only read back every LINEAR_CHECK_INTERVAL steps*/
+int chebyshev_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem)
+{
+    auto& device = solver->device;
+    const auto& settings = solver->settings;
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    const auto rho = jacobi_radius(problem.width, problem.height);
+
+    if (CL_SUCCESS != load_solver_field(ocl, &device) || CL_SUCCESS != copy_solver_buffer(ocl, device.field, device.rhs, 0, count))
+        return -1;
+
+    auto current = device.field;
+    auto previous = device.rhs;
+    auto omega = 1.0F;
+    auto best_residual = std::numeric_limits<cl_float>::max();
+    cl_uint stalled_checks = 0;
+    solver->iterations = 0;
+    solver->residual = settings.tolerance + 1.0F;
+    while (solver->residual > settings.tolerance && solver->iterations < settings.max_iterations)
+    {
+        omega = next_omega(omega, solver->iterations, rho);
+        if (CL_SUCCESS != set_kernel_args(device.chebyshev_step, 0, current, previous, problem.width, problem.height, problem.air_temperature, problem.point_x, problem.point_y,
+            problem.point_temperature, omega, device.partial, local_arg{ 2 * sizeof(cl_float) * device.group_size }))
+            return -1;
+
+        cl_float sum;
+        const auto check = 0 == (solver->iterations + 1) % LINEAR_CHECK_INTERVAL || solver->iterations + 1 == settings.max_iterations;
+        const auto err = check ? reduce_sum_max_kernel(ocl, &device, device.chebyshev_step, &sum, &solver->residual) : run_group_kernel(ocl, &device, device.chebyshev_step);
+        if (CL_SUCCESS != err)
+            return -1;
+        std::swap(current, previous);
+        solver->iterations++;
+
+        if (check)
+        {
+            stalled_checks = solver->residual < best_residual ? 0 : stalled_checks + 1;
+            best_residual = std::min(best_residual, solver->residual);
+            if (CHEBYSHEV_STALLED_CHECKS == stalled_checks)
+                break;
+        }
+    }
+
+    if (current != device.field && CL_SUCCESS != copy_solver_buffer(ocl, current, device.field, 0, count))
+        return -1;
+    return store_solver_field(ocl, &device);
+}
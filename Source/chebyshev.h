@@ -0,0 +1,11 @@
+#pragma once
+#include <CL/cl.h>
+
+#include "solver.h"
+
+#define CHEBYSHEV_STALLED_CHECKS 4
+#define AVERAGING_STALLED_CHECKS 256
+
+cl_uint plain_averaging_steps(const plate_problem& problem, cl_float* field, cl_float tolerance, cl_uint max_steps, cl_float* residual);
+int chebyshev_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output);
+int chebyshev_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem);
@@ -0,0 +1,457 @@
+#include "field_codec.h"
+
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+
+#include "log_utils.h"
+#include "utils.h"
+
+#define CODEC_MAGIC 0x43465448
+#define CODEC_MAX_QUANTUM 1073741824.0
+
+/*
+ * The field is cut into CODEC_TILE_SIZE x CODEC_TILE_SIZE tiles that are coded independently, so they can be
+ * encoded in parallel and decoded one at a time. Every cell is predicted from its already coded left, upper
+ * and upper-left neighbours (Lorenzo predictor) and only the prediction residual is stored:
+ * - lossless: the residual is computed on the order-preserving integer image of the float bits;
+ * - lossy: the residual is quantized with a bin of 2 * tolerance, and the predictor runs on the reconstructed
+ *   values so the error never accumulates; cells that can't honour the bound are stored verbatim.
+ * A diffusion field is smooth, so most residuals are zero and are written as zero runs.
+ */
+
+struct codec_header
+{
+    cl_uint magic;
+    cl_uint mode;
+    cl_uint width;
+    cl_uint height;
+    cl_uint tile_size;
+    cl_float tolerance;
+};
+
+struct token_writer
+{
+    std::vector<unsigned char>* out;
+    cl_ulong zero_run;
+};
+
+struct token_reader
+{
+    const unsigned char* current;
+    const unsigned char* end;
+    cl_ulong zero_run;
+    /*cells of the tile not read yet, a run may not reach past them*/
+    cl_ulong remaining;
+};
+
+static void put_varint(std::vector<unsigned char>& out, cl_ulong value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static bool get_varint(token_reader& reader, cl_ulong& value)
+{
+    value = 0;
+    for (auto shift = 0; shift < 64 && reader.current < reader.end; shift += 7)
+    {
+        const auto byte = *reader.current++;
+        value |= static_cast<cl_ulong>(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void flush_zero_run(token_writer& writer)
+{
+    if (writer.zero_run > 0)
+    {
+        put_varint(*writer.out, writer.zero_run << 1 | 1);
+        writer.zero_run = 0;
+    }
+}
+
+static void write_code(token_writer& writer, const cl_long code)
+{
+    if (0 == code)
+    {
+        writer.zero_run++;
+        return;
+    }
+
+    flush_zero_run(writer);
+    const auto zigzag = static_cast<cl_ulong>(code) << 1 ^ static_cast<cl_ulong>(code >> 63);
+    put_varint(*writer.out, zigzag << 1);
+}
+
+static void write_escape(token_writer& writer, const cl_float value)
+{
+    flush_zero_run(writer);
+    put_varint(*writer.out, 0);
+
+    unsigned char bytes[sizeof(cl_float)];
+    memcpy(bytes, &value, sizeof(cl_float));
+    writer.out->insert(writer.out->end(), bytes, bytes + sizeof(cl_float));
+}
+
+/*returns false on a corrupt stream, sets escaped when the next cell is stored verbatim in value*/
+static bool read_code(token_reader& reader, cl_long& code, bool& escaped, cl_float& value)
+{
+    escaped = false;
+    if (0 == reader.remaining)
+        return false;
+    reader.remaining--;
+    if (reader.zero_run > 0)
+    {
+        reader.zero_run--;
+        code = 0;
+        return true;
+    }
+
+    cl_ulong token;
+    if (!get_varint(reader, token))
+        return false;
+
+    if (token & 1)
+    {
+        /*a run holds at least the cell being read*/
+        const auto run = token >> 1;
+        if (0 == run || run - 1 > reader.remaining)
+            return false;
+        reader.zero_run = run - 1;
+        code = 0;
+        return true;
+    }
+
+    if (0 == token)
+    {
+        if (reader.end - reader.current < static_cast<ptrdiff_t>(sizeof(cl_float)))
+            return false;
+        memcpy(&value, reader.current, sizeof(cl_float));
+        reader.current += sizeof(cl_float);
+        escaped = true;
+        return true;
+    }
+
+    const auto zigzag = token >> 1;
+    code = static_cast<cl_long>(zigzag >> 1) ^ -static_cast<cl_long>(zigzag & 1);
+    return true;
+}
+
+static cl_uint to_ordered(const cl_float value)
+{
+    cl_uint bits;
+    memcpy(&bits, &value, sizeof(cl_uint));
+    return (bits & 0x80000000U) ? ~bits : bits | 0x80000000U;
+}
+
+static cl_float from_ordered(const cl_uint ordered)
+{
+    const cl_uint bits = (ordered & 0x80000000U) ? ordered & 0x7FFFFFFFU : ~ordered;
+    cl_float value;
+    memcpy(&value, &bits, sizeof(cl_float));
+    return value;
+}
+
+template <typename T>
+static T lorenzo_predict(const T* tile, const cl_uint x, const cl_uint y, const cl_uint tile_width)
+{
+    if (x == 0 && y == 0) return T(0);
+    if (y == 0) return tile[x - 1];
+    if (x == 0) return tile[(y - 1) * tile_width];
+    return tile[y * tile_width + x - 1] + tile[(y - 1) * tile_width + x] - tile[(y - 1) * tile_width + x - 1];
+}
+
+static void encode_tile(const cl_float* field, const cl_uint width, const cl_uint x0, const cl_uint y0, const cl_uint tile_width, const cl_uint tile_height,
+    const codec_mode mode, const cl_float tolerance, std::vector<unsigned char>& out)
+{
+    token_writer writer = { &out, 0 };
+
+    if (CODEC_LOSSLESS == mode)
+    {
+        std::vector<cl_long> ordered(tile_width * tile_height);
+        for (cl_uint y = 0; y < tile_height; y++)
+        {
+            for (cl_uint x = 0; x < tile_width; x++)
+            {
+                const auto value = static_cast<cl_long>(to_ordered(field[static_cast<size_t>(y0 + y) * width + x0 + x]));
+                ordered[y * tile_width + x] = value;
+                write_code(writer, value - lorenzo_predict(ordered.data(), x, y, tile_width));
+            }
+        }
+    }
+    else
+    {
+        const auto bin = 2.0 * tolerance;
+        std::vector<cl_float> reconstructed(tile_width * tile_height);
+        for (cl_uint y = 0; y < tile_height; y++)
+        {
+            for (cl_uint x = 0; x < tile_width; x++)
+            {
+                const auto value = field[static_cast<size_t>(y0 + y) * width + x0 + x];
+                const auto prediction = lorenzo_predict(reconstructed.data(), x, y, tile_width);
+                const auto quantum = std::round((value - static_cast<double>(prediction)) / bin);
+                auto& cell = reconstructed[y * tile_width + x];
+
+                if (std::fabs(quantum) < CODEC_MAX_QUANTUM)
+                {
+                    const auto code = static_cast<cl_long>(quantum);
+                    cell = static_cast<cl_float>(prediction + code * bin);
+                    if (std::fabs(cell - value) <= tolerance)
+                    {
+                        write_code(writer, code);
+                        continue;
+                    }
+                }
+
+                /*NaN, huge jumps or rounding that breaks the bound*/
+                cell = value;
+                write_escape(writer, value);
+            }
+        }
+    }
+
+    flush_zero_run(writer);
+}
+
+static bool decode_tile(const unsigned char* tile_stream, const size_t tile_stream_size, cl_float* field, const cl_uint width, const cl_uint x0, const cl_uint y0,
+    const cl_uint tile_width, const cl_uint tile_height, const codec_mode mode, const cl_float tolerance)
+{
+    token_reader reader = { tile_stream, tile_stream + tile_stream_size, 0, static_cast<cl_ulong>(tile_width) * tile_height };
+    cl_long code;
+    bool escaped;
+    cl_float value;
+
+    if (CODEC_LOSSLESS == mode)
+    {
+        std::vector<cl_long> ordered(tile_width * tile_height);
+        for (cl_uint y = 0; y < tile_height; y++)
+        {
+            for (cl_uint x = 0; x < tile_width; x++)
+            {
+                if (!read_code(reader, code, escaped, value) || escaped)
+                    return false;
+                const auto cell = lorenzo_predict(ordered.data(), x, y, tile_width) + code;
+                ordered[y * tile_width + x] = cell;
+                field[static_cast<size_t>(y0 + y) * width + x0 + x] = from_ordered(static_cast<cl_uint>(cell));
+            }
+        }
+    }
+    else
+    {
+        const auto bin = 2.0 * tolerance;
+        std::vector<cl_float> reconstructed(tile_width * tile_height);
+        for (cl_uint y = 0; y < tile_height; y++)
+        {
+            for (cl_uint x = 0; x < tile_width; x++)
+            {
+                if (!read_code(reader, code, escaped, value))
+                    return false;
+                auto& cell = reconstructed[y * tile_width + x];
+                cell = escaped ? value : static_cast<cl_float>(lorenzo_predict(reconstructed.data(), x, y, tile_width) + code * bin);
+                field[static_cast<size_t>(y0 + y) * width + x0 + x] = cell;
+            }
+        }
+    }
+
+    return true;
+}
+
+int encode_field(const cl_float* field, const cl_uint width, const cl_uint height, const codec_mode mode, const cl_float tolerance, std::vector<unsigned char>& stream)
+{
+    if (CODEC_LOSSY == mode && !(tolerance > 0.0F))
+    {
+        log_error("Error: lossy encoding needs a positive tolerance, got %f.\n", tolerance);
+        return -1;
+    }
+
+    const auto tiles_x = (width + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto tiles_y = (height + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto tile_count = tiles_x * tiles_y;
+    std::vector<std::vector<unsigned char>> tiles(tile_count);
+
+    /*tiles are independent, so the threads simply stride over them*/
+    std::thread threads[CPU_THREAD_COUNT];
+    for (auto t = 0; t < CPU_THREAD_COUNT; t++)
+    {
+        threads[t] = std::thread([&, t]()
+        {
+            for (auto i = static_cast<cl_uint>(t); i < tile_count; i += CPU_THREAD_COUNT)
+            {
+                const auto x0 = i % tiles_x * CODEC_TILE_SIZE;
+                const auto y0 = i / tiles_x * CODEC_TILE_SIZE;
+                const auto tile_width = width - x0 < CODEC_TILE_SIZE ? width - x0 : CODEC_TILE_SIZE;
+                const auto tile_height = height - y0 < CODEC_TILE_SIZE ? height - y0 : CODEC_TILE_SIZE;
+                encode_tile(field, width, x0, y0, tile_width, tile_height, mode, tolerance, tiles[i]);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    codec_header header = { CODEC_MAGIC, static_cast<cl_uint>(mode), width, height, CODEC_TILE_SIZE, tolerance };
+    std::vector<cl_ulong> offsets(tile_count + 1, 0);
+    for (cl_uint i = 0; i < tile_count; i++)
+        offsets[i + 1] = offsets[i] + tiles[i].size();
+
+    const auto table_size = sizeof(cl_ulong) * offsets.size();
+    stream.resize(sizeof(codec_header) + table_size + offsets[tile_count]);
+    memcpy(stream.data(), &header, sizeof(codec_header));
+    memcpy(stream.data() + sizeof(codec_header), offsets.data(), table_size);
+    auto* payload = stream.data() + sizeof(codec_header) + table_size;
+    for (cl_uint i = 0; i < tile_count; i++)
+    {
+        if (!tiles[i].empty())
+            memcpy(payload + offsets[i], tiles[i].data(), tiles[i].size());
+    }
+
+    return CL_SUCCESS;
+}
+
+/*validates the header and tile table of a stream, the table is copied because the stream may not be aligned*/
+static bool parse_stream(const unsigned char* stream, const size_t stream_size, const cl_uint width, const cl_uint height, codec_header& header,
+    std::vector<cl_ulong>& offsets, const unsigned char*& payload, size_t& payload_size)
+{
+    if (stream_size < sizeof(codec_header))
+    {
+        log_error("Error: field stream is truncated.\n");
+        return false;
+    }
+    memcpy(&header, stream, sizeof(codec_header));
+
+    if (CODEC_MAGIC != header.magic || header.width != width || header.height != height || header.tile_size != CODEC_TILE_SIZE)
+    {
+        log_error("Error: field stream doesn't describe a %ux%u plate.\n", width, height);
+        return false;
+    }
+
+    if ((CODEC_LOSSLESS != header.mode && CODEC_LOSSY != header.mode) || (CODEC_LOSSY == header.mode && !(header.tolerance > 0.0F)))
+    {
+        log_error("Error: field stream has an unknown codec mode %u.\n", header.mode);
+        return false;
+    }
+
+    const auto tiles_x = (width + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto tiles_y = (height + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto table_size = sizeof(cl_ulong) * (tiles_x * tiles_y + 1);
+    if (stream_size < sizeof(codec_header) + table_size)
+    {
+        log_error("Error: field stream is truncated.\n");
+        return false;
+    }
+
+    offsets.resize(tiles_x * tiles_y + 1);
+    memcpy(offsets.data(), stream + sizeof(codec_header), table_size);
+    payload = stream + sizeof(codec_header) + table_size;
+    payload_size = stream_size - sizeof(codec_header) - table_size;
+    return true;
+}
+
+int decode_field(const unsigned char* stream, const size_t stream_size, cl_float* field, const cl_uint width, const cl_uint height)
+{
+    codec_header header;
+    std::vector<cl_ulong> offsets;
+    const unsigned char* payload;
+    size_t payload_size;
+    if (!parse_stream(stream, stream_size, width, height, header, offsets, payload, payload_size))
+        return -1;
+
+    const auto tiles_x = (width + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto tile_count = static_cast<cl_uint>(offsets.size() - 1);
+
+    bool tile_ok[CPU_THREAD_COUNT];
+    std::thread threads[CPU_THREAD_COUNT];
+    for (auto t = 0; t < CPU_THREAD_COUNT; t++)
+    {
+        tile_ok[t] = true;
+        threads[t] = std::thread([&, t]()
+        {
+            for (auto i = static_cast<cl_uint>(t); i < tile_count && tile_ok[t]; i += CPU_THREAD_COUNT)
+            {
+                if (offsets[i] > offsets[i + 1] || offsets[i + 1] > payload_size)
+                {
+                    tile_ok[t] = false;
+                    break;
+                }
+                const auto x0 = i % tiles_x * CODEC_TILE_SIZE;
+                const auto y0 = i / tiles_x * CODEC_TILE_SIZE;
+                const auto tile_width = width - x0 < CODEC_TILE_SIZE ? width - x0 : CODEC_TILE_SIZE;
+                const auto tile_height = height - y0 < CODEC_TILE_SIZE ? height - y0 : CODEC_TILE_SIZE;
+                tile_ok[t] = decode_tile(payload + offsets[i], offsets[i + 1] - offsets[i], field, width, x0, y0, tile_width, tile_height,
+                    static_cast<codec_mode>(header.mode), header.tolerance);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto ok : tile_ok)
+    {
+        if (!ok)
+        {
+            log_error("Error: field stream is corrupt.\n");
+            return -1;
+        }
+    }
+
+    return CL_SUCCESS;
+}
+
+int decode_field_tile(const unsigned char* stream, const size_t stream_size, const cl_uint width, const cl_uint height, const cl_uint tile_x, const cl_uint tile_y,
+    cl_float* tile, cl_uint* tile_width, cl_uint* tile_height)
+{
+    codec_header header;
+    std::vector<cl_ulong> offsets;
+    const unsigned char* payload;
+    size_t payload_size;
+    if (!parse_stream(stream, stream_size, width, height, header, offsets, payload, payload_size))
+        return -1;
+
+    const auto tiles_x = (width + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    const auto tiles_y = (height + CODEC_TILE_SIZE - 1) / CODEC_TILE_SIZE;
+    if (tile_x >= tiles_x || tile_y >= tiles_y)
+    {
+        log_error("Error: tile (%u, %u) is outside of the %ux%u tile grid.\n", tile_x, tile_y, tiles_x, tiles_y);
+        return -1;
+    }
+
+    const auto i = tile_y * tiles_x + tile_x;
+    const auto x0 = tile_x * CODEC_TILE_SIZE;
+    const auto y0 = tile_y * CODEC_TILE_SIZE;
+    *tile_width = width - x0 < CODEC_TILE_SIZE ? width - x0 : CODEC_TILE_SIZE;
+    *tile_height = height - y0 < CODEC_TILE_SIZE ? height - y0 : CODEC_TILE_SIZE;
+
+    /*the tile is decoded into its own buffer, so it is addressed with its own width and a zero origin*/
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > payload_size ||
+        !decode_tile(payload + offsets[i], offsets[i + 1] - offsets[i], tile, *tile_width, 0, 0, *tile_width, *tile_height,
+            static_cast<codec_mode>(header.mode), header.tolerance))
+    {
+        log_error("Error: field stream is corrupt.\n");
+        return -1;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_float max_field_error(const cl_float* expected, const cl_float* actual, const size_t count)
+{
+    cl_float max_error = 0.0F;
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto error = std::fabs(expected[i] - actual[i]);
+        if (error > max_error)
+            max_error = error;
+    }
+    return max_error;
+}
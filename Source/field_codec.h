@@ -0,0 +1,17 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#define CODEC_TILE_SIZE 64
+
+enum codec_mode
+{
+    CODEC_LOSSLESS = 0,
+    CODEC_LOSSY = 1
+};
+
+int encode_field(const cl_float* field, cl_uint width, cl_uint height, codec_mode mode, cl_float tolerance, std::vector<unsigned char>& stream);
+int decode_field(const unsigned char* stream, size_t stream_size, cl_float* field, cl_uint width, cl_uint height);
+int decode_field_tile(const unsigned char* stream, size_t stream_size, cl_uint width, cl_uint height, cl_uint tile_x, cl_uint tile_y,
+    cl_float* tile, cl_uint* tile_width, cl_uint* tile_height);
+cl_float max_field_error(const cl_float* expected, const cl_float* actual, size_t count);
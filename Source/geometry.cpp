@@ -0,0 +1,239 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <utility>
+#include <stdio.h>
+
+
+#include "log_utils.h"
+#include "material.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "ocl_solver.h"
+#include "utils.h"
+
+ocl_geometry_t::ocl_geometry_t() :
+    kernel(nullptr),
+    spans(nullptr),
+    links(nullptr)
+{
+}
+
+ocl_geometry_t::~ocl_geometry_t()
+{
+    if (kernel)
+        clReleaseKernel(kernel);
+    for (auto* buffer : { spans, links })
+    {
+        if (buffer)
+            clReleaseMemObject(buffer);
+    }
+}
+
+/*no mask: the whole rectangle is the part and the plain stencil runs*/
+void init_geometry_mask(geometry_mask* mask, const cl_uint width, const cl_uint height)
+{
+    mask->enabled = false;
+    mask->insulated = false;
+    mask->width = width;
+    mask->height = height;
+    mask->cell_count = static_cast<size_t>(width) * height;
+    mask->spans.clear();
+    mask->links.clear();
+}
+
+/*binary PGM (P5), a gray level above half of maxval is a cell of the part*/
+static int read_mask_image(FILE* fp, const char* file_name, const cl_uint width, const cl_uint height, std::vector<cl_uchar>& inside)
+{
+    cl_uint image_width, image_height, max_value;
+    if ('P' != fgetc(fp) || '5' != fgetc(fp) ||
+        !read_pgm_value(fp, &image_width) || !read_pgm_value(fp, &image_height) || !read_pgm_value(fp, &max_value) || 0 == max_value || max_value > 65535)
+    {
+        log_error("Error: '%s' is not a binary PGM image.\n", file_name);
+        return -1;
+    }
+    if (image_width != width || image_height != height)
+    {
+        log_error("Error: geometry mask '%s' is %ux%u, the plate is %ux%u.\n", file_name, image_width, image_height, width, height);
+        return -1;
+    }
+
+    const auto count = static_cast<size_t>(width) * height;
+    const size_t sample_size = max_value < 256 ? 1 : 2;
+    std::vector<unsigned char> samples(count * sample_size);
+    if (fread(samples.data(), 1, samples.size(), fp) != samples.size())
+    {
+        log_error("Error: geometry mask '%s' is truncated.\n", file_name);
+        return -1;
+    }
+
+    inside.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        /*16 bit samples are big endian*/
+        const cl_uint level = 1 == sample_size ? samples[i] : samples[2 * i] << 8 | samples[2 * i + 1];
+        inside[i] = 2 * level > max_value ? 1 : 0;
+    }
+    return CL_SUCCESS;
+}
+
+/*the runs of every row, cut to GEOMETRY_SPAN_CELLS, and the links of the cells in them*/
+static void build_spans(geometry_mask* mask, const std::vector<cl_uchar>& inside)
+{
+    const auto width = mask->width;
+    const auto height = mask->height;
+    mask->links.assign(inside.size(), 0);
+    for (cl_uint row = 0; row < height; row++)
+    {
+        const auto* cells = inside.data() + static_cast<size_t>(row) * width;
+        for (cl_uint col = 0; col < width;)
+        {
+            if (!cells[col])
+            {
+                col++;
+                continue;
+            }
+            auto end = col;
+            while (end < width && cells[end])
+                end++;
+            for (auto begin = col; begin < end; begin += GEOMETRY_SPAN_CELLS)
+                mask->spans.push_back({ row, begin, std::min(begin + GEOMETRY_SPAN_CELLS, end) });
+
+            for (auto x = col; x < end; x++)
+            {
+                const auto i = static_cast<size_t>(row) * width + x;
+                mask->links[i] = static_cast<cl_uchar>((x > col ? GEOMETRY_WEST : 0) | (x + 1 < end ? GEOMETRY_EAST : 0) |
+                    (row > 0 && inside[i - width] ? GEOMETRY_NORTH : 0) | (row + 1 < height && inside[i + width] ? GEOMETRY_SOUTH : 0));
+            }
+            mask->cell_count += end - col;
+            col = end;
+        }
+    }
+}
+
+int load_geometry_mask(geometry_mask* mask, const char* file_name, const bool insulated, const cl_uint width, const cl_uint height)
+{
+    init_geometry_mask(mask, width, height);
+
+    FILE* fp = nullptr;
+    fopen_s(&fp, file_name, "rb");
+    if (nullptr == fp)
+    {
+        log_error("Error: Couldn't open geometry mask '%s'.\n", file_name);
+        return -1;
+    }
+    std::vector<cl_uchar> inside;
+    const auto err = read_mask_image(fp, file_name, width, height, inside);
+    fclose(fp);
+    if (CL_SUCCESS != err)
+        return -1;
+
+    mask->cell_count = 0;
+    build_spans(mask, inside);
+    if (0 == mask->cell_count)
+    {
+        log_error("Error: geometry mask '%s' has no cell inside the part.\n", file_name);
+        return -1;
+    }
+
+    mask->enabled = true;
+    mask->insulated = insulated;
+    log_info("Geometry mask %s: %llu of %llu cells in %llu spans, %s outline\n", file_name, static_cast<unsigned long long>(mask->cell_count),
+        static_cast<unsigned long long>(static_cast<size_t>(width) * height), static_cast<unsigned long long>(mask->spans.size()),
+        insulated ? "insulated" : "air");
+    return CL_SUCCESS;
+}
+
+int setup_ocl_geometry(ocl_args_d_t* ocl, geometry_mask* mask)
+{
+    if (!mask->enabled)
+        return CL_SUCCESS;
+
+    auto* device = &mask->device;
+    if (CL_SUCCESS != create_solver_kernel(ocl, "simulate_geometry", &device->kernel))
+        return -1;
+
+    cl_int err;
+    device->spans = clCreateBuffer(ocl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(geometry_span) * mask->spans.size(), mask->spans.data(), &err);
+    if (CL_SUCCESS == err)
+        device->links = clCreateBuffer(ocl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, mask->links.size(), mask->links.data(), &err);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clCreateBuffer for the geometry mask returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*whether a cell is in the part, found among the spans, which are in row order; every cell is without a mask*/
+bool geometry_contains(const geometry_mask& mask, const cl_uint col, const cl_uint row)
+{
+    if (!mask.enabled)
+        return true;
+    const auto span = std::upper_bound(mask.spans.begin(), mask.spans.end(), std::make_pair(row, col), [](const std::pair<cl_uint, cl_uint>& cell, const geometry_span& s)
+    {
+        return cell.first < s.row || (cell.first == s.row && cell.second < s.end);
+    });
+    return span != mask.spans.end() && span->row == row && span->begin <= col;
+}
+
+/*identifies the part and how its outline behaves, 0 without a mask*/
+cl_ulong geometry_hash(const geometry_mask& mask)
+{
+    if (!mask.enabled)
+        return 0;
+    const cl_uint shape[] = { mask.width, mask.height, mask.insulated ? 1U : 0U };
+    return hash_bytes(mask.spans.data(), sizeof(geometry_span) * mask.spans.size(), hash_bytes(shape, sizeof(shape)));
+}
+
+/*the device steps the first spans and the CPU the rest, split by cells as the plain plate is*/
+size_t geometry_device_spans(const geometry_mask& mask, const cl_float gpu_percent)
+{
+    const auto cells = static_cast<double>(mask.cell_count) * gpu_percent / 100.0;
+    size_t stepped = 0;
+    size_t k = 0;
+    for (; k < mask.spans.size() && stepped < cells; k++)
+        stepped += mask.spans[k].end - mask.spans[k].begin;
+    return k;
+}
+
+void step_geometry_spans(const geometry_mask& mask, const cl_float* input, cl_float* output, const cl_float air_temperature, const cl_float ratio,
+    vertex_args* plate_points, const size_t first, const size_t last)
+{
+    const auto width = static_cast<size_t>(mask.width);
+    for (auto k = first; k < last; k++)
+    {
+        const auto& span = mask.spans[k];
+        const auto row_start = span.row * width;
+        for (auto i = row_start + span.begin; i < row_start + span.end; i++)
+        {
+            const auto outside = mask.insulated ? input[i] : air_temperature;
+            output[i] = geometry_step(input, i, width, mask.links[i], outside, ratio);
+            set_temperature_color(plate_points[i], output[i]);
+        }
+    }
+}
+
+/*one work group of GEOMETRY_SPAN_CELLS items per span, item j on cell begin + j*/
+int execute_geometry_kernel(ocl_args_d_t* ocl, geometry_mask* mask, const cl_float air_temperature, const cl_float gpu_percent, const cl_float ratio)
+{
+    const auto span_count = geometry_device_spans(*mask, gpu_percent);
+    if (0 == span_count)
+        return CL_SUCCESS;
+
+    auto* device = &mask->device;
+    const size_t global_work_size[] = { GEOMETRY_SPAN_CELLS, span_count };
+    const size_t local_work_size[] = { GEOMETRY_SPAN_CELLS, 1 };
+    if (CL_SUCCESS != set_kernel_args(device->kernel, 0, ocl->input, ocl->output, mask->width, air_temperature, ocl->plate_points, ratio, device->spans, device->links,
+        static_cast<cl_uint>(mask->insulated)) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->kernel, 2, global_work_size, local_work_size))
+        return -1;
+
+    const auto err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
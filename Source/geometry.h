@@ -0,0 +1,71 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+/*longest span of one work group; longer runs of the mask are cut*/
+#define GEOMETRY_SPAN_CELLS 64
+/*bits of a cell link, set when that neighbour is a cell of the part*/
+#define GEOMETRY_WEST 1
+#define GEOMETRY_EAST 2
+#define GEOMETRY_NORTH 4
+#define GEOMETRY_SOUTH 8
+
+struct ocl_args_d_t;
+struct vertex_args;
+
+/*cells [begin, end) of row, all of them inside the part*/
+struct geometry_span
+{
+    cl_uint          row;
+    cl_uint          begin;
+    cl_uint          end;
+};
+
+/*device copies of the spans and the links and the kernel that steps them*/
+struct ocl_geometry_t
+{
+    ocl_geometry_t();
+    ~ocl_geometry_t();
+
+    cl_kernel        kernel;
+    cl_mem           spans;
+    cl_mem           links;
+};
+
+/*
+ * The part as a mask over the plate, read from an image. Its cells are kept as run-length row spans of at most
+ * GEOMETRY_SPAN_CELLS cells in row order, so a step walks the spans and never tests a cell against the mask. links[i]
+ * holds the GEOMETRY_* bits of the neighbours of cell i that are in the part too; every other neighbour is the air, or
+ * with insulated the cell itself, so no heat crosses the outline. The cells outside the part keep their value, are
+ * not stepped and are not drawn.
+ */
+struct geometry_mask
+{
+    bool             enabled;
+    bool             insulated;
+    cl_uint          width;
+    cl_uint          height;
+    size_t           cell_count;
+    std::vector<geometry_span> spans;
+    std::vector<cl_uchar> links;
+    ocl_geometry_t   device;
+};
+
+/*FTCS step of cell i of the part, the missing neighbours replaced by outside*/
+inline cl_float geometry_step(const cl_float* input, const size_t i, const size_t width, const cl_uchar links, const cl_float outside, const cl_float ratio)
+{
+    const auto center = input[i];
+    const auto neighbours = (links & GEOMETRY_WEST ? input[i - 1] : outside) + (links & GEOMETRY_EAST ? input[i + 1] : outside) +
+        (links & GEOMETRY_NORTH ? input[i - width] : outside) + (links & GEOMETRY_SOUTH ? input[i + width] : outside);
+    return center + ratio * (neighbours - 4.0F * center);
+}
+
+void init_geometry_mask(geometry_mask* mask, cl_uint width, cl_uint height);
+int load_geometry_mask(geometry_mask* mask, const char* file_name, bool insulated, cl_uint width, cl_uint height);
+int setup_ocl_geometry(ocl_args_d_t* ocl, geometry_mask* mask);
+bool geometry_contains(const geometry_mask& mask, cl_uint col, cl_uint row);
+cl_ulong geometry_hash(const geometry_mask& mask);
+size_t geometry_device_spans(const geometry_mask& mask, cl_float gpu_percent);
+void step_geometry_spans(const geometry_mask& mask, const cl_float* input, cl_float* output, cl_float air_temperature, cl_float ratio, vertex_args* plate_points,
+    size_t first, size_t last);
+int execute_geometry_kernel(ocl_args_d_t* ocl, geometry_mask* mask, cl_float air_temperature, cl_float gpu_percent, cl_float ratio);
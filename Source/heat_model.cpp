@@ -0,0 +1,48 @@
+#include "heat_model.h"
+
+
+#include "log_utils.h"
+
+/*
+ * Explicit FTCS step of the heat equation dT/dt = alpha * laplacian(T) on a square grid:
+ * T' = T + r * (T_west + T_east + T_north + T_south - 4 * T), with r = alpha * dt / dx^2.
+ * The scheme is stable for r <= 1/4, which bounds dt by dx^2 / (4 * alpha).
+ */
+
+cl_float max_stable_time_step(const heat_model& model)
+{
+    return model.cell_size * model.cell_size / (4.0F * model.diffusivity);
+}
+
+/*explicit solvers never go past the stability limit, implicit ones take the configured step as is*/
+cl_float explicit_time_step(const heat_model& model)
+{
+    const auto max_time_step = max_stable_time_step(model);
+    return model.time_step < max_time_step ? model.time_step : max_time_step;
+}
+
+cl_float diffusion_ratio(const heat_model& model, const cl_float time_step)
+{
+    return model.diffusivity * time_step / (model.cell_size * model.cell_size);
+}
+
+/*a zero time step asks for the largest stable one; the limit only exists for a positive diffusivity and cell size*/
+int resolve_time_step(heat_model& model)
+{
+    if (!(model.diffusivity > 0.0F) || !(model.cell_size > 0.0F))
+    {
+        log_error("Error: diffusivity %g and cell_size %g have to be positive.\n", model.diffusivity, model.cell_size);
+        return -1;
+    }
+
+    const auto max_time_step = max_stable_time_step(model);
+    if (model.time_step <= 0.0F)
+    {
+        model.time_step = max_time_step;
+    }
+    else if (model.time_step > max_time_step)
+    {
+        log_error("Warning: time step %g s is unstable for explicit solvers, they will use %g s.\n", model.time_step, max_time_step);
+    }
+    return CL_SUCCESS;
+}
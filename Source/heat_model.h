@@ -0,0 +1,14 @@
+#pragma once
+#include <CL/cl.h>
+
+struct heat_model
+{
+    cl_float         diffusivity;
+    cl_float         cell_size;
+    cl_float         time_step;
+};
+
+cl_float max_stable_time_step(const heat_model& model);
+cl_float explicit_time_step(const heat_model& model);
+cl_float diffusion_ratio(const heat_model& model, cl_float time_step);
+int resolve_time_step(heat_model& model);
@@ -0,0 +1,80 @@
+#include "implicit_solver.h"
+
+
+#include "linear_system.h"
+#include "ocl_args.h"
+#include "parallel.h"
+#include "pcg.h"
+
+/*
+ * Theta scheme for dT/dt = alpha * laplacian(T): (I - theta * r * L) T' = (I + (1 - theta) * r * L) T, with r = alpha * dt / dx^2.
+ * theta = 1/2 is Crank-Nicolson, theta = 1 backward Euler; both are stable for any dt, so one step can cover
+ * many explicit ones. The system is solved with red-black Gauss-Seidel or preconditioned conjugate gradient, starting from the current field.
+ */
+
+static linear_system implicit_system(const solver_state* solver, const plate_problem& problem, const heat_model& model)
+{
+    const auto implicit_ratio = solver->settings.theta * diffusion_ratio(model, model.time_step);
+    return { problem.width, problem.height, 1.0F + 4.0F * implicit_ratio, implicit_ratio, problem.point_x, problem.point_y, {} };
+}
+
+int implicit_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    const auto system = implicit_system(solver, problem, model);
+    const auto explicit_ratio = (1.0F - solver->settings.theta) * diffusion_ratio(model, model.time_step);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+
+    solver->rhs.resize(count);
+    auto* rhs = solver->rhs.data();
+    parallel_for(problem.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < problem.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * problem.width + col;
+                const auto neighbours = neighbour_sum(input, col, row, problem.width, problem.height, problem.air_temperature);
+                rhs[i] = input[i] + explicit_ratio * (neighbours - 4.0F * input[i]);
+                output[i] = input[i];
+            }
+        }
+    });
+    add_boundary_terms(system, problem.air_temperature, problem.point_temperature, rhs);
+
+    const auto& settings = solver->settings;
+    const auto stats = LINEAR_PCG == settings.linear_solver ?
+        solve_pcg(system, rhs, output, settings.preconditioner, settings.tolerance, settings.max_iterations, solver_module(solver->pcg)) :
+        solve_red_black(system, rhs, output, 1.0F, settings.tolerance, settings.max_iterations);
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    return CL_SUCCESS;
+}
+
+int implicit_step_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem, const heat_model& model)
+{
+    auto& device = solver->device;
+    const auto& settings = solver->settings;
+    const auto system = implicit_system(solver, problem, model);
+    const auto explicit_ratio = (1.0F - settings.theta) * diffusion_ratio(model, model.time_step);
+    const size_t global_work_size[] = { problem.width, problem.height };
+
+    if (CL_SUCCESS != load_solver_field(ocl, &device))
+        return -1;
+
+    if (CL_SUCCESS != set_kernel_args(device.implicit_rhs, 0, device.field, device.rhs, problem.width, problem.height, problem.air_temperature, explicit_ratio) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device.implicit_rhs, 2, global_work_size, nullptr) ||
+        CL_SUCCESS != device_boundary_terms(ocl, &device, system, device.rhs, problem.air_temperature, problem.point_temperature))
+        return -1;
+
+    linear_stats stats;
+    const auto err = LINEAR_PCG == settings.linear_solver ?
+        device_solve_pcg(ocl, &device, system, device.rhs, device.field, settings.preconditioner, settings.tolerance, settings.max_iterations, &stats) :
+        device_solve_red_black(ocl, &device, system, 1.0F, settings.tolerance, settings.max_iterations, &stats);
+    if (CL_SUCCESS != err)
+        return -1;
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    return store_solver_field(ocl, &device);
+}
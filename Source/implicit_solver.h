@@ -0,0 +1,7 @@
+#pragma once
+#include <CL/cl.h>
+
+#include "solver.h"
+
+int implicit_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
+int implicit_step_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem, const heat_model& model);
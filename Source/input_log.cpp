@@ -0,0 +1,194 @@
+#include "input_log.h"
+
+#include <cstring>
+
+
+#include "log_utils.h"
+
+#define INPUT_LOG_MAGIC 0x4C495448
+/*bumped whenever the header or input_state change; the first logs had no version and kept the width there*/
+#define INPUT_LOG_VERSION 4
+
+/*
+ * The log holds one record per run of identical frames: the control inputs and how many consecutive
+ * frames used them. The mouse rests most of the time, so a long session compresses to a few records.
+ */
+
+struct input_log_header
+{
+    cl_uint magic;
+    cl_uint version;
+    cl_uint width;
+    cl_uint height;
+    cl_float plate_initial_temperature;
+    heat_model model;
+    solver_settings solver_options;
+    cl_uint boundary_models[BOUNDARY_EDGES];
+    cl_float boundary_coefficients[BOUNDARY_EDGES];
+    cl_ulong geometry_hash;
+};
+
+struct input_log_record
+{
+    cl_uint repeat;
+    input_state input;
+};
+
+static int flush_input_run(input_recorder* recorder)
+{
+    if (0 == recorder->repeat)
+        return CL_SUCCESS;
+
+    const input_log_record record = { recorder->repeat, recorder->last };
+    recorder->repeat = 0;
+    if (fwrite(&record, sizeof(input_log_record), 1, recorder->file) != 1)
+    {
+        log_error("Error: Couldn't write the input log.\n");
+        return -1;
+    }
+
+    return CL_SUCCESS;
+}
+
+int open_input_recorder(input_recorder* recorder, const char* file_name, const cl_uint width, const cl_uint height, const cl_float plate_initial_temperature, const heat_model& model,
+    const solver_settings& solver_options, const boundary_conditions& boundary, const cl_ulong geometry_hash)
+{
+    recorder->repeat = 0;
+    recorder->file = nullptr;
+    fopen_s(&recorder->file, file_name, "wb");
+    if (nullptr == recorder->file)
+    {
+        log_error("Error: Couldn't create input log '%s'.\n", file_name);
+        return -1;
+    }
+
+    input_log_header header = { INPUT_LOG_MAGIC, INPUT_LOG_VERSION, width, height, plate_initial_temperature, model, solver_options };
+    header.geometry_hash = geometry_hash;
+    /*a boundary that was not enabled ran the plain kernel, whatever the config asked for*/
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+    {
+        header.boundary_models[e] = boundary.enabled ? boundary.models[e] : BOUNDARY_DIRICHLET;
+        header.boundary_coefficients[e] = boundary.enabled ? boundary.coefficients[e] : 0.0F;
+    }
+    if (fwrite(&header, sizeof(input_log_header), 1, recorder->file) != 1)
+    {
+        log_error("Error: Couldn't write input log '%s'.\n", file_name);
+        close_input_recorder(recorder);
+        return -1;
+    }
+
+    return CL_SUCCESS;
+}
+
+int record_input(input_recorder* recorder, const input_state& input)
+{
+    if (recorder->repeat > 0 && 0 == memcmp(&recorder->last, &input, sizeof(input_state)) && recorder->repeat < CL_UINT_MAX)
+    {
+        recorder->repeat++;
+        return CL_SUCCESS;
+    }
+
+    if (CL_SUCCESS != flush_input_run(recorder))
+        return -1;
+
+    recorder->last = input;
+    recorder->repeat = 1;
+    return CL_SUCCESS;
+}
+
+void close_input_recorder(input_recorder* recorder)
+{
+    if (recorder->file)
+    {
+        flush_input_run(recorder);
+        fclose(recorder->file);
+        recorder->file = nullptr;
+    }
+}
+
+int open_input_player(input_player* player, const char* file_name)
+{
+    FILE* fp = nullptr;
+    fopen_s(&fp, file_name, "rb");
+    if (nullptr == fp)
+    {
+        log_error("Error: Couldn't find input log '%s'.\n", file_name);
+        return -1;
+    }
+
+    input_log_header header;
+    if (fread(&header, sizeof(input_log_header), 1, fp) != 1 || INPUT_LOG_MAGIC != header.magic)
+    {
+        log_error("Error: '%s' is not an input log.\n", file_name);
+        fclose(fp);
+        return -1;
+    }
+    if (INPUT_LOG_VERSION != header.version)
+    {
+        log_error("Error: input log '%s' was recorded by another version (%u, expected %u), record it again.\n", file_name, header.version, INPUT_LOG_VERSION);
+        fclose(fp);
+        return -1;
+    }
+
+    player->width = header.width;
+    player->height = header.height;
+    player->plate_initial_temperature = header.plate_initial_temperature;
+    player->model = header.model;
+    player->solver_options = header.solver_options;
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+    {
+        player->boundary_models[e] = header.boundary_models[e] < BOUNDARY_MODEL_COUNT ? static_cast<boundary_model>(header.boundary_models[e]) : BOUNDARY_DIRICHLET;
+        player->boundary_coefficients[e] = header.boundary_coefficients[e];
+    }
+    player->geometry_hash = header.geometry_hash;
+    player->inputs.clear();
+    player->repeats.clear();
+    player->run = 0;
+    player->repeat = 0;
+
+    input_log_record record;
+    while (fread(&record, sizeof(input_log_record), 1, fp) == 1)
+    {
+        player->inputs.push_back(record.input);
+        player->repeats.push_back(record.repeat);
+    }
+    fclose(fp);
+
+    return CL_SUCCESS;
+}
+
+bool next_input(input_player* player, input_state& input)
+{
+    while (player->run < player->inputs.size() && player->repeat >= player->repeats[player->run])
+    {
+        player->run++;
+        player->repeat = 0;
+    }
+
+    if (player->run >= player->inputs.size())
+        return false;
+
+    input = player->inputs[player->run];
+    player->repeat++;
+    return true;
+}
+
+cl_ulong input_frame_count(const input_player* player)
+{
+    cl_ulong frames = 0;
+    for (auto repeat : player->repeats)
+        frames += repeat;
+    return frames;
+}
+
+bool same_recorded_boundary(const input_player* player, const boundary_conditions& boundary)
+{
+    for (auto e = 0; e < BOUNDARY_EDGES; e++)
+    {
+        const auto model = boundary.enabled ? boundary.models[e] : BOUNDARY_DIRICHLET;
+        const auto coefficient = boundary.enabled ? boundary.coefficients[e] : 0.0F;
+        if (player->boundary_models[e] != model || player->boundary_coefficients[e] != coefficient)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <CL/cl.h>
+#include <stdio.h>
+#include <vector>
+
+#include "boundary.h"
+#include "heat_model.h"
+#include "solver.h"
+
+struct input_state
+{
+    cl_int           point_x;
+    cl_int           point_y;
+    cl_float         air_temperature;
+    cl_float         point_temperature;
+    cl_float         gpu_percent;
+    cl_uint          running;
+    cl_uint          solver;
+    cl_uint          backend;
+};
+
+struct input_recorder
+{
+    FILE*            file;
+    input_state      last;
+    cl_uint          repeat;
+};
+
+struct input_player
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_float         plate_initial_temperature;
+    heat_model       model;
+    solver_settings  solver_options;
+    /*the edge models the session ran with, all Dirichlet when it had none*/
+    boundary_model   boundary_models[BOUNDARY_EDGES];
+    cl_float         boundary_coefficients[BOUNDARY_EDGES];
+    /*geometry_hash of the mask of the session*/
+    cl_ulong         geometry_hash;
+    std::vector<input_state> inputs;
+    std::vector<cl_uint> repeats;
+    size_t           run;
+    cl_uint          repeat;
+};
+
+int open_input_recorder(input_recorder* recorder, const char* file_name, cl_uint width, cl_uint height, cl_float plate_initial_temperature, const heat_model& model,
+    const solver_settings& solver_options, const boundary_conditions& boundary, cl_ulong geometry_hash);
+int record_input(input_recorder* recorder, const input_state& input);
+void close_input_recorder(input_recorder* recorder);
+
+int open_input_player(input_player* player, const char* file_name);
+bool next_input(input_player* player, input_state& input);
+cl_ulong input_frame_count(const input_player* player);
+bool same_recorded_boundary(const input_player* player, const boundary_conditions& boundary);
@@ -0,0 +1,472 @@
+#include "jfnk.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+
+#include "heat_model.h"
+#include "log_utils.h"
+#include "parallel.h"
+
+/*
+ * Jacobian-free Newton-Krylov for a plate whose conductivity follows k(T). With D(x)_i = sum over the four faces of
+ * k_face (x_n - x_i), k_face the mean of the factors of the two cells and the air beyond the plate, a time step solves
+ * F(x) = x - theta r D(x) - (input + (1 - theta) r D(input)) = 0 and the steady state F(x) = -D(x) = 0, the source cell
+ * held at its temperature. Newton solves J dx = -F with restarted GMRES to JFNK_FORCING of |F|, where J v is never
+ * formed: it is the difference (F(x + e v) - F(x)) / e. GMRES is right preconditioned by a symmetric red-black
+ * Gauss-Seidel sweep of the linearisation with k frozen where the solve started, built once and reused by every Newton
+ * step, and each Newton step backtracks until |F| drops.
+ */
+
+/*what F needs besides x: mass is 1 for a time step and 0 for the steady state, coupling theta r or 1*/
+struct jfnk_system
+{
+    const plate_problem* problem;
+    const conductivity_curve* curve;
+    cl_float         mass;
+    cl_float         coupling;
+    cl_float         air_factor;
+    bool             source;
+};
+
+/*temperature, degrees, and conductivity, W/(m K), one pair per line in rising temperature; empty lines and lines starting with # are skipped*/
+int load_conductivity_curve(const char* file_name, const cl_float reference_conductivity, conductivity_curve& curve)
+{
+    std::ifstream input(file_name);
+    if (!input)
+    {
+        log_error("Error: Couldn't open conductivity table '%s'.\n", file_name);
+        return -1;
+    }
+
+    std::vector<std::pair<cl_float, cl_float>> points;
+    std::string line;
+    for (cl_uint number = 1; std::getline(input, line); number++)
+    {
+        if (line.empty() || '#' == line[0] || '\r' == line[0])
+            continue;
+        std::istringstream stream(line);
+        cl_float temperature, conductivity;
+        if (!(stream >> temperature >> conductivity) || conductivity <= 0.0F || (!points.empty() && temperature <= points.back().first))
+        {
+            log_error("Error: bad conductivity on line %u of '%s'.\n", number, file_name);
+            return -1;
+        }
+        points.emplace_back(temperature, conductivity);
+    }
+    if (points.empty())
+    {
+        log_error("Error: conductivity table '%s' is empty.\n", file_name);
+        return -1;
+    }
+
+    /*resampled on an even grid, so a lookup is one multiply and one interpolation*/
+    curve.start = points.front().first;
+    curve.step = points.size() > 1 ? (points.back().first - points.front().first) / (JFNK_TABLE_SIZE - 1) : 1.0F;
+    curve.factors.resize(points.size() > 1 ? JFNK_TABLE_SIZE : 1);
+    size_t segment = 0;
+    for (size_t i = 0; i < curve.factors.size(); i++)
+    {
+        const auto temperature = curve.start + curve.step * i;
+        while (segment + 2 < points.size() && temperature > points[segment + 1].first)
+            segment++;
+        const auto& low = points[segment];
+        const auto& high = points[std::min(segment + 1, points.size() - 1)];
+        const auto share = high.first > low.first ? std::min(std::max((temperature - low.first) / (high.first - low.first), 0.0F), 1.0F) : 0.0F;
+        curve.factors[i] = (low.second + share * (high.second - low.second)) / reference_conductivity;
+    }
+
+    const auto range = std::minmax_element(curve.factors.begin(), curve.factors.end());
+    log_info("Conductivity table %s: %u points from %g to %g degrees, k / k0 %g to %g\n", file_name, static_cast<cl_uint>(points.size()), points.front().first,
+        points.back().first, *range.first, *range.second);
+    return CL_SUCCESS;
+}
+
+static cl_float conductivity_factor(const conductivity_curve& curve, const cl_float temperature)
+{
+    if (curve.factors.size() < 2)
+        return curve.factors.empty() ? 1.0F : curve.factors[0];
+
+    const auto position = (temperature - curve.start) / curve.step;
+    if (position <= 0.0F)
+        return curve.factors.front();
+    if (position >= static_cast<cl_float>(curve.factors.size() - 1))
+        return curve.factors.back();
+    const auto k = static_cast<size_t>(position);
+    return curve.factors[k] + (position - k) * (curve.factors[k + 1] - curve.factors[k]);
+}
+
+static bool source_cell(const jfnk_system& system, const cl_uint x, const cl_uint y)
+{
+    return system.source && static_cast<cl_int>(x) == system.problem->point_x && static_cast<cl_int>(y) == system.problem->point_y;
+}
+
+/*
+ * out = mass * x - coupling * D(x) - base, base null for none; the source row is x - point_temperature. factors is
+ * scratch for the k(T) of every cell.
+ */
+static void evaluate_residual(const jfnk_system& system, const cl_float* x, const cl_float* base, cl_float* factors, cl_float* out)
+{
+    const auto& problem = *system.problem;
+    const auto width = problem.width;
+    const auto height = problem.height;
+    const auto air = problem.air_temperature;
+    parallel_for(static_cast<size_t>(width) * height, [&](const size_t begin, const size_t end)
+    {
+        for (auto i = begin; i < end; i++)
+            factors[i] = conductivity_factor(*system.curve, x[i]);
+    });
+
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * width + col;
+                if (source_cell(system, col, row))
+                {
+                    out[i] = x[i] - problem.point_temperature;
+                    continue;
+                }
+                const auto center = x[i];
+                const auto f = factors[i];
+                const auto face = [&](const bool inside, const size_t n)
+                {
+                    return inside ? 0.5F * (f + factors[n]) * (x[n] - center) : 0.5F * (f + system.air_factor) * (air - center);
+                };
+                const auto flux = face(col > 0, i - 1) + face(col + 1 < width, i + 1) + face(row > 0, i - width) + face(row + 1 < height, i + width);
+                out[i] = system.mass * center - system.coupling * flux - (base ? base[i] : 0.0F);
+            }
+        }
+    });
+}
+
+static double dot_product(const std::vector<cl_float>& a, const std::vector<cl_float>& b)
+{
+    return parallel_reduce(a.size(), 0.0, [&](const size_t begin, const size_t end)
+    {
+        auto sum = 0.0;
+        for (auto i = begin; i < end; i++)
+            sum += static_cast<double>(a[i]) * b[i];
+        return sum;
+    }, [](const double x, const double y) { return x + y; });
+}
+
+static cl_float max_norm(const std::vector<cl_float>& a)
+{
+    return parallel_reduce(a.size(), 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto maximum = 0.0F;
+        for (auto i = begin; i < end; i++)
+            maximum = std::max(maximum, std::fabs(a[i]));
+        return maximum;
+    }, [](const cl_float x, const cl_float y) { return std::max(x, y); });
+}
+
+/*y = a * x + b * y*/
+static void combine(std::vector<cl_float>& y, const cl_float a, const std::vector<cl_float>& x, const cl_float b)
+{
+    parallel_for(y.size(), [&](const size_t begin, const size_t end)
+    {
+        for (auto i = begin; i < end; i++)
+            y[i] = a * x[i] + b * y[i];
+    });
+}
+
+/*the face couplings and diagonal of the linearisation at x, k frozen; the preconditioner of the whole solve*/
+static void build_preconditioner(const jfnk_system& system, jfnk_state& state, const std::vector<cl_float>& x)
+{
+    const auto& problem = *system.problem;
+    const auto width = problem.width;
+    const auto height = problem.height;
+    auto& factors = state.factors;
+    parallel_for(x.size(), [&](const size_t begin, const size_t end)
+    {
+        for (auto i = begin; i < end; i++)
+            factors[i] = conductivity_factor(*system.curve, x[i]);
+    });
+
+    state.stiffness_x.resize(static_cast<size_t>(width + 1) * height);
+    state.stiffness_y.resize(static_cast<size_t>(width) * (height + 1));
+    state.diagonal.resize(x.size());
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col <= width; col++)
+            {
+                const auto left = col > 0 ? factors[static_cast<size_t>(row) * width + col - 1] : system.air_factor;
+                const auto right = col < width ? factors[static_cast<size_t>(row) * width + col] : system.air_factor;
+                state.stiffness_x[static_cast<size_t>(row) * (width + 1) + col] = system.coupling * 0.5F * (left + right);
+            }
+        }
+    });
+    parallel_for(height + 1, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < width; col++)
+            {
+                const auto top = row > 0 ? factors[static_cast<size_t>(row - 1) * width + col] : system.air_factor;
+                const auto bottom = row < height ? factors[static_cast<size_t>(row) * width + col] : system.air_factor;
+                state.stiffness_y[static_cast<size_t>(row) * width + col] = system.coupling * 0.5F * (top + bottom);
+            }
+        }
+    });
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * width + col;
+                const auto x_face = static_cast<size_t>(row) * (width + 1) + col;
+                state.diagonal[i] = source_cell(system, col, row) ? 1.0F :
+                    system.mass + state.stiffness_x[x_face] + state.stiffness_x[x_face + 1] + state.stiffness_y[i] + state.stiffness_y[i + width];
+            }
+        }
+    });
+}
+
+/*z = M^-1 v: red, black and red Gauss-Seidel sweeps from zero, a fixed linear map as right preconditioning needs*/
+static void apply_preconditioner(const jfnk_system& system, const jfnk_state& state, const std::vector<cl_float>& v, std::vector<cl_float>& z)
+{
+    const auto width = system.problem->width;
+    const auto height = system.problem->height;
+    std::fill(z.begin(), z.end(), 0.0F);
+    for (const auto color : { 0u, 1u, 0u })
+    {
+        parallel_for(height, [&](const size_t begin, const size_t end)
+        {
+            for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+            {
+                for (auto col = (row + color) & 1; col < width; col += 2)
+                {
+                    const auto i = static_cast<size_t>(row) * width + col;
+                    if (source_cell(system, col, row))
+                    {
+                        z[i] = v[i];
+                        continue;
+                    }
+                    const auto x_face = static_cast<size_t>(row) * (width + 1) + col;
+                    const auto sum = (col > 0 ? state.stiffness_x[x_face] * z[i - 1] : 0.0F) + (col + 1 < width ? state.stiffness_x[x_face + 1] * z[i + 1] : 0.0F) +
+                        (row > 0 ? state.stiffness_y[i] * z[i - width] : 0.0F) + (row + 1 < height ? state.stiffness_y[i + width] * z[i + width] : 0.0F);
+                    z[i] = (v[i] + sum) / state.diagonal[i];
+                }
+            }
+        });
+    }
+}
+
+/*out = J v = (F(x + e v) - F(x)) / e, e scaled so the largest cell moves by JFNK_PERTURBATION of the largest temperature*/
+static void jacobian_product(const jfnk_system& system, jfnk_state& state, const std::vector<cl_float>& x, const cl_float x_norm, const std::vector<cl_float>& v,
+    std::vector<cl_float>& out)
+{
+    const auto v_norm = max_norm(v);
+    if (0.0F == v_norm)
+    {
+        std::fill(out.begin(), out.end(), 0.0F);
+        return;
+    }
+    const auto e = JFNK_PERTURBATION * (1.0F + x_norm) / v_norm;
+    state.trial = x;
+    combine(state.trial, e, v, 1.0F);
+    evaluate_residual(system, state.trial.data(), state.base.empty() ? nullptr : state.base.data(), state.factors.data(), out.data());
+    combine(out, -1.0F / e, state.residual, 1.0F / e);
+}
+
+/*
+ * state.update = dx with J dx = -F to |J dx + F| <= target, GMRES(krylov_dimension) restarted until then or
+ * max_iterations; returns the iterations. basis[j] holds the Arnoldi vectors, the Hessenberg matrix is kept in double.
+ */
+static cl_uint solve_newton_step(const jfnk_system& system, jfnk_state& state, const solver_settings& settings, const std::vector<cl_float>& x, const cl_float x_norm,
+    const double target)
+{
+    const auto dimension = std::max(1u, settings.krylov_dimension);
+    state.basis.resize(dimension + 1);
+    for (auto& vector : state.basis)
+        vector.resize(x.size());
+    std::fill(state.update.begin(), state.update.end(), 0.0F);
+
+    std::vector<double> hessenberg((dimension + 1) * dimension);
+    std::vector<double> cosines(dimension), sines(dimension), g(dimension + 1), y(dimension);
+    cl_uint iterations = 0;
+    auto first = true;
+    while (iterations < settings.max_iterations)
+    {
+        /*r = -F - J dx; dx is still zero on the first cycle*/
+        auto& r = state.basis[0];
+        if (first)
+        {
+            r = state.residual;
+            combine(r, 0.0F, r, -1.0F);
+        }
+        else
+        {
+            jacobian_product(system, state, x, x_norm, state.update, r);
+            combine(r, -1.0F, state.residual, -1.0F);
+        }
+        first = false;
+        const auto beta = std::sqrt(dot_product(r, r));
+        if (beta <= target)
+            break;
+        combine(r, 0.0F, r, static_cast<cl_float>(1.0 / beta));
+        std::fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+
+        cl_uint used = 0;
+        for (cl_uint j = 0; j < dimension && iterations < settings.max_iterations; j++)
+        {
+            apply_preconditioner(system, state, state.basis[j], state.direction);
+            auto& w = state.basis[j + 1];
+            jacobian_product(system, state, x, x_norm, state.direction, w);
+
+            /*modified Gram-Schmidt against the basis so far*/
+            auto* column = hessenberg.data() + j * (dimension + 1);
+            for (cl_uint i = 0; i <= j; i++)
+            {
+                column[i] = dot_product(w, state.basis[i]);
+                combine(w, static_cast<cl_float>(-column[i]), state.basis[i], 1.0F);
+            }
+            column[j + 1] = std::sqrt(dot_product(w, w));
+            if (column[j + 1] > 0.0)
+                combine(w, 0.0F, w, static_cast<cl_float>(1.0 / column[j + 1]));
+
+            /*the earlier rotations, then the one that clears the subdiagonal*/
+            for (cl_uint i = 0; i < j; i++)
+            {
+                const auto a = column[i];
+                const auto b = column[i + 1];
+                column[i] = cosines[i] * a + sines[i] * b;
+                column[i + 1] = -sines[i] * a + cosines[i] * b;
+            }
+            const auto radius = std::hypot(column[j], column[j + 1]);
+            cosines[j] = radius > 0.0 ? column[j] / radius : 1.0;
+            sines[j] = radius > 0.0 ? column[j + 1] / radius : 0.0;
+            column[j] = radius;
+            column[j + 1] = 0.0;
+            g[j + 1] = -sines[j] * g[j];
+            g[j] = cosines[j] * g[j];
+
+            iterations++;
+            used = j + 1;
+            if (std::fabs(g[j + 1]) <= target || 0.0 == radius)
+                break;
+        }
+
+        /*dx += M^-1 (V y), y from the triangular system*/
+        for (auto i = static_cast<cl_int>(used) - 1; i >= 0; i--)
+        {
+            auto sum = g[i];
+            for (auto k = static_cast<cl_uint>(i) + 1; k < used; k++)
+                sum -= hessenberg[k * (dimension + 1) + i] * y[k];
+            const auto diagonal = hessenberg[i * (dimension + 1) + i];
+            y[i] = 0.0 != diagonal ? sum / diagonal : 0.0;
+        }
+        auto& combination = state.trial_residual;
+        std::fill(combination.begin(), combination.end(), 0.0F);
+        for (cl_uint i = 0; i < used; i++)
+            combine(combination, static_cast<cl_float>(y[i]), state.basis[i], 1.0F);
+        apply_preconditioner(system, state, combination, state.direction);
+        combine(state.update, 1.0F, state.direction, 1.0F);
+
+        if (0 == used || std::fabs(g[used]) <= target)
+            break;
+    }
+    return iterations;
+}
+
+/*
+ * Newton from the input, the source cell set, until |F| or the last update is below the tolerance or newton_iterations
+ * steps are taken; the line search halves a step up to four times.
+ */
+static int solve_newton(solver_state* solver, const jfnk_system& system, const cl_float* input, cl_float* output)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto& problem = *system.problem;
+    const auto& settings = solver->settings;
+    auto& state = solver_module(solver->jfnk);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    for (auto* vector : { &state.residual, &state.update, &state.trial, &state.trial_residual, &state.direction, &state.factors })
+        vector->resize(count);
+
+    std::vector<cl_float> x(input, input + count);
+    if (system.source)
+        x[static_cast<size_t>(problem.point_y) * problem.width + problem.point_x] = problem.point_temperature;
+    const auto* base = state.base.empty() ? nullptr : state.base.data();
+    evaluate_residual(system, x.data(), base, state.factors.data(), state.residual.data());
+    auto norm = max_norm(state.residual);
+    build_preconditioner(system, state, x);
+
+    cl_uint steps = 0;
+    cl_uint linear_iterations = 0;
+    std::vector<cl_float> candidate(count);
+    while (steps < settings.newton_iterations && norm > settings.tolerance)
+    {
+        const auto x_norm = max_norm(x);
+        linear_iterations += solve_newton_step(system, state, settings, x, x_norm, JFNK_FORCING * std::sqrt(dot_product(state.residual, state.residual)));
+        steps++;
+
+        auto length = 1.0F;
+        auto candidate_norm = norm;
+        for (auto halving = 0; halving <= 4; halving++, length *= 0.5F)
+        {
+            candidate = x;
+            combine(candidate, length, state.update, 1.0F);
+            evaluate_residual(system, candidate.data(), base, state.factors.data(), state.trial_residual.data());
+            candidate_norm = max_norm(state.trial_residual);
+            if (candidate_norm < norm)
+                break;
+        }
+        x.swap(candidate);
+        state.residual.swap(state.trial_residual);
+        norm = candidate_norm;
+        if (length * max_norm(state.update) <= settings.tolerance)
+            break;
+    }
+    std::copy(x.begin(), x.end(), output);
+
+    state.newton_steps = steps;
+    state.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    state.total_newton_steps += steps;
+    state.total_seconds += state.seconds;
+    solver->iterations = linear_iterations;
+    solver->residual = norm;
+    return CL_SUCCESS;
+}
+
+static jfnk_system make_system(const solver_state* solver, const plate_problem& problem, const cl_float mass, const cl_float coupling)
+{
+    const auto on_plate = problem.point_x >= 0 && problem.point_y >= 0 && static_cast<cl_uint>(problem.point_x) < problem.width &&
+        static_cast<cl_uint>(problem.point_y) < problem.height;
+    /*no table is a constant k*/
+    static const conductivity_curve constant = {};
+    const auto* curve = solver->conductivity ? solver->conductivity : &constant;
+    return { &problem, curve, mass, coupling, conductivity_factor(*curve, problem.air_temperature), on_plate };
+}
+
+/*one theta step; base = input + (1 - theta) r D(input) is the residual of the input at mass 1 and coupling -(1 - theta) r*/
+int jfnk_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    const auto ratio = diffusion_ratio(model, model.time_step);
+    const auto theta = solver->settings.theta;
+    auto& state = solver_module(solver->jfnk);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    state.base.resize(count);
+    state.factors.resize(count);
+
+    auto explicit_part = make_system(solver, problem, 1.0F, -(1.0F - theta) * ratio);
+    explicit_part.source = false;
+    evaluate_residual(explicit_part, input, nullptr, state.factors.data(), state.base.data());
+    return solve_newton(solver, make_system(solver, problem, 1.0F, theta * ratio), input, output);
+}
+
+int jfnk_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output)
+{
+    solver_module(solver->jfnk).base.clear();
+    return solve_newton(solver, make_system(solver, problem, 0.0F, 1.0F), input, output);
+}
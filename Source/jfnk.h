@@ -0,0 +1,47 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "solver.h"
+
+/*samples of a conductivity curve, the share of the residual a Newton step leaves to GMRES and the relative size of the difference step of J v*/
+#define JFNK_TABLE_SIZE 1024
+#define JFNK_FORCING 0.01F
+#define JFNK_PERTURBATION 1.0e-3F
+
+/*k(T) over the k the diffusivity stands for, factors[i] at start + i * step and held beyond both ends; no factors is a constant k*/
+struct conductivity_curve
+{
+    cl_float         start;
+    cl_float         step;
+    std::vector<cl_float> factors;
+};
+
+/*
+ * Vectors of the Newton-Krylov solver: the residual F and the update of the current Newton step, a trial point and its
+ * residual for the difference products and the line search, the cell factors of k(T) and the Krylov basis. stiffness
+ * holds the face couplings of the linearisation with k frozen at the start of the solve, the preconditioner of every
+ * Newton step of it. The counts and seconds are those of the last solve and of all of them.
+ */
+struct jfnk_state
+{
+    std::vector<cl_float> base;
+    std::vector<cl_float> residual;
+    std::vector<cl_float> update;
+    std::vector<cl_float> trial;
+    std::vector<cl_float> trial_residual;
+    std::vector<cl_float> direction;
+    std::vector<cl_float> factors;
+    std::vector<cl_float> stiffness_x;
+    std::vector<cl_float> stiffness_y;
+    std::vector<cl_float> diagonal;
+    std::vector<std::vector<cl_float>> basis;
+    cl_uint          newton_steps;
+    double           seconds;
+    cl_ulong         total_newton_steps;
+    double           total_seconds;
+};
+
+int load_conductivity_curve(const char* file_name, cl_float reference_conductivity, conductivity_curve& curve);
+int jfnk_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
+int jfnk_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output);
@@ -0,0 +1,158 @@
+#include "linear_system.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+#include "parallel.h"
+
+/*sum of the unknown neighbours of a cell, air and the source are excluded*/
+static cl_float inner_neighbour_sum(const linear_system& system, const cl_float* x, const cl_uint col, const cl_uint row)
+{
+    const auto i = static_cast<size_t>(row) * system.width + col;
+    auto sum = 0.0F;
+    if (col > 0 && !is_source(system, col - 1, row)) sum += x[i - 1];
+    if (col + 1 < system.width && !is_source(system, col + 1, row)) sum += x[i + 1];
+    if (row > 0 && !is_source(system, col, row - 1)) sum += x[i - system.width];
+    if (row + 1 < system.height && !is_source(system, col, row + 1)) sum += x[i + system.width];
+    return sum;
+}
+
+/*moves the known air and source values to the right hand side*/
+void add_boundary_terms(const linear_system& system, const cl_float air_temperature, const cl_float source_temperature, cl_float* rhs)
+{
+    parallel_for(system.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < system.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                if (is_source(system, col, row))
+                {
+                    rhs[i] = source_temperature;
+                    continue;
+                }
+
+                const auto air_weight = (col == 0 ? system.neighbour + system.edge.s[0] : 0.0F) + (col + 1 == system.width ? system.neighbour + system.edge.s[1] : 0.0F) +
+                    (row == 0 ? system.neighbour + system.edge.s[2] : 0.0F) + (row + 1 == system.height ? system.neighbour + system.edge.s[3] : 0.0F);
+                const auto source_count = (col > 0 && is_source(system, col - 1, row)) + (col + 1 < system.width && is_source(system, col + 1, row)) +
+                    (row > 0 && is_source(system, col, row - 1)) + (row + 1 < system.height && is_source(system, col, row + 1));
+                rhs[i] += air_weight * air_temperature + system.neighbour * source_count * source_temperature;
+            }
+        }
+    });
+}
+
+void apply_operator(const linear_system& system, const cl_float* x, cl_float* y)
+{
+    parallel_for(system.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < system.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                y[i] = is_source(system, col, row) ? x[i] : cell_diagonal(system, col, row) * x[i] - system.neighbour * inner_neighbour_sum(system, x, col, row);
+            }
+        }
+    });
+}
+
+/*
+ * Updates the cells with (col + row) % 2 == color. Cells of one color only depend on the other color,
+ * so the rows can be split between threads and the result is the same as a sequential sweep.
+ */
+void red_black_sweep(const linear_system& system, const cl_float* rhs, cl_float* x, const cl_uint color, const cl_float omega)
+{
+    parallel_for(system.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (auto col = (row + color) & 1; col < system.width; col += 2)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                if (is_source(system, col, row))
+                {
+                    x[i] = rhs[i];
+                    continue;
+                }
+
+                const auto solution = (rhs[i] + system.neighbour * inner_neighbour_sum(system, x, col, row)) / cell_diagonal(system, col, row);
+                x[i] += omega * (solution - x[i]);
+            }
+        }
+    });
+}
+
+/*b - A x, zero on the source row*/
+void compute_residual(const linear_system& system, const cl_float* rhs, const cl_float* x, cl_float* residual)
+{
+    parallel_for(system.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < system.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                residual[i] = is_source(system, col, row) ? 0.0F : rhs[i] - cell_diagonal(system, col, row) * x[i] + system.neighbour * inner_neighbour_sum(system, x, col, row);
+            }
+        }
+    });
+}
+
+/*max norm of b - A x, divided by the diagonal so it is measured in degrees like a change of x*/
+cl_float residual_norm(const linear_system& system, const cl_float* rhs, const cl_float* x)
+{
+    return parallel_reduce(system.height, 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto residual = 0.0F;
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < system.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                const auto diagonal = cell_diagonal(system, col, row);
+                const auto difference = is_source(system, col, row) ? rhs[i] - x[i] :
+                    (rhs[i] - diagonal * x[i] + system.neighbour * inner_neighbour_sum(system, x, col, row)) / diagonal;
+                residual = std::max(residual, std::fabs(difference));
+            }
+        }
+        return residual;
+    }, [](const cl_float a, const cl_float b) { return std::max(a, b); });
+}
+
+/*
+ * Convergence rate of Jacobi on the plate with the air one cell beyond its edges, the largest eigenvalue of the neighbour
+ * average. Fixing the source cell only removes a row of the system, which cannot raise it.
+ */
+cl_float jacobi_radius(const cl_uint width, const cl_uint height)
+{
+    const auto pi = 3.14159265358979323846;
+    return static_cast<cl_float>(0.5 * (std::cos(pi / (width + 1.0)) + std::cos(pi / (height + 1.0))));
+}
+
+/*
+ * Red-black Gauss-Seidel (omega = 1) or SOR. The residual is only measured every LINEAR_CHECK_INTERVAL iterations;
+ * a residual that stopped decreasing has hit the float rounding of the field and more sweeps would not help.
+ */
+linear_stats solve_red_black(const linear_system& system, const cl_float* rhs, cl_float* x, const cl_float omega, const cl_float tolerance, const cl_uint max_iterations)
+{
+    linear_stats stats = { 0, residual_norm(system, rhs, x) };
+    auto last_residual = stats.residual;
+    while (stats.residual > tolerance && stats.iterations < max_iterations)
+    {
+        red_black_sweep(system, rhs, x, 0, omega);
+        red_black_sweep(system, rhs, x, 1, omega);
+        stats.iterations++;
+
+        if (0 == stats.iterations % LINEAR_CHECK_INTERVAL || stats.iterations == max_iterations)
+        {
+            stats.residual = residual_norm(system, rhs, x);
+            if (stats.residual >= last_residual)
+                break;
+            last_residual = stats.residual;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <CL/cl.h>
+
+#define LINEAR_CHECK_INTERVAL 8
+
+/*
+ * Five-point system on the plate: (A x)_i = diagonal * x_i - neighbour * (sum of the neighbours inside the plate).
+ * Neighbours in the air and the fixed source cell are known values, their contribution lives in the right hand side,
+ * which keeps A symmetric. The source row is the identity. A source outside the plate (-1) means there is none.
+ * edge strengthens the coupling to the air beyond the west, east, north and south edges, for grids whose
+ * cell centers are not one cell away from the air; it is zero on the plate itself.
+ */
+struct linear_system
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_float         diagonal;
+    cl_float         neighbour;
+    cl_int           source_x;
+    cl_int           source_y;
+    cl_float4        edge;
+};
+
+struct linear_stats
+{
+    cl_uint          iterations;
+    cl_float         residual;
+};
+
+inline bool is_source(const linear_system& system, const cl_uint x, const cl_uint y)
+{
+    return static_cast<cl_int>(x) == system.source_x && static_cast<cl_int>(y) == system.source_y;
+}
+
+inline cl_float cell_diagonal(const linear_system& system, const cl_uint x, const cl_uint y)
+{
+    return system.diagonal + (x == 0 ? system.edge.s[0] : 0.0F) + (x + 1 == system.width ? system.edge.s[1] : 0.0F) +
+        (y == 0 ? system.edge.s[2] : 0.0F) + (y + 1 == system.height ? system.edge.s[3] : 0.0F);
+}
+
+/*sum of the 4 neighbours, the ones outside of the plate are at the air temperature*/
+inline cl_float neighbour_sum(const cl_float* field, const cl_uint x, const cl_uint y, const cl_uint width, const cl_uint height, const cl_float air_temperature)
+{
+    const auto i = static_cast<size_t>(y) * width + x;
+    return (x > 0 ? field[i - 1] : air_temperature) + (x + 1 < width ? field[i + 1] : air_temperature) +
+        (y > 0 ? field[i - width] : air_temperature) + (y + 1 < height ? field[i + width] : air_temperature);
+}
+
+void add_boundary_terms(const linear_system& system, cl_float air_temperature, cl_float source_temperature, cl_float* rhs);
+void apply_operator(const linear_system& system, const cl_float* x, cl_float* y);
+void red_black_sweep(const linear_system& system, const cl_float* rhs, cl_float* x, cl_uint color, cl_float omega);
+void compute_residual(const linear_system& system, const cl_float* rhs, const cl_float* x, cl_float* residual);
+cl_float residual_norm(const linear_system& system, const cl_float* rhs, const cl_float* x);
+cl_float jacobi_radius(cl_uint width, cl_uint height);
+linear_stats solve_red_black(const linear_system& system, const cl_float* rhs, cl_float* x, cl_float omega, cl_float tolerance, cl_uint max_iterations);
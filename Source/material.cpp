@@ -0,0 +1,268 @@
+#include "material.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdio.h>
+
+
+#include "log_utils.h"
+#include "ocl_args.h"
+#include "ocl_solver.h"
+#include "utils.h"
+
+ocl_material_t::ocl_material_t() :
+    kernel(nullptr),
+    face_x(nullptr),
+    face_y(nullptr)
+{
+}
+
+ocl_material_t::~ocl_material_t()
+{
+    if (kernel)
+        clReleaseKernel(kernel);
+    for (auto* buffer : { face_x, face_y })
+    {
+        if (buffer)
+            clReleaseMemObject(buffer);
+    }
+}
+
+/*a uniform plate of unit conductivity, what runs without a map*/
+void init_material_map(material_map* map, const cl_uint width, const cl_uint height)
+{
+    map->width = width;
+    map->height = height;
+    map->scale = 1.0F;
+    map->uniform = true;
+    map->conductivity.clear();
+    map->face_x.clear();
+    map->face_y.clear();
+}
+
+/*comma separated conductivities, indexed by material ID*/
+bool parse_material_table(const std::string& value, std::vector<cl_float>& materials)
+{
+    materials.clear();
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        try
+        {
+            materials.push_back(std::stof(item, nullptr));
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+    return !materials.empty();
+}
+
+/*the next number of a PGM header, past blanks and comments*/
+bool read_pgm_value(FILE* fp, cl_uint* value)
+{
+    auto c = fgetc(fp);
+    while (EOF != c && (isspace(c) || '#' == c))
+    {
+        if ('#' == c)
+        {
+            while (EOF != c && '\n' != c)
+                c = fgetc(fp);
+        }
+        c = fgetc(fp);
+    }
+    if (EOF == c || !isdigit(c))
+        return false;
+
+    *value = 0;
+    for (; EOF != c && isdigit(c); c = fgetc(fp))
+        *value = *value * 10 + (c - '0');
+    return true;
+}
+
+/*binary PGM (P5), every gray level is a material ID; without a table the gray level over maxval is the conductivity*/
+static int read_material_image(FILE* fp, const char* file_name, const std::vector<cl_float>& materials, material_map* map)
+{
+    cl_uint width, height, max_value;
+    if (!read_pgm_value(fp, &width) || !read_pgm_value(fp, &height) || !read_pgm_value(fp, &max_value) || 0 == max_value || max_value > 65535)
+    {
+        log_error("Error: '%s' is not a binary PGM image.\n", file_name);
+        return -1;
+    }
+    if (width != map->width || height != map->height)
+    {
+        log_error("Error: material map '%s' is %ux%u, the plate is %ux%u.\n", file_name, width, height, map->width, map->height);
+        return -1;
+    }
+
+    const auto count = static_cast<size_t>(width) * height;
+    const size_t sample_size = max_value < 256 ? 1 : 2;
+    std::vector<unsigned char> samples(count * sample_size);
+    if (fread(samples.data(), 1, samples.size(), fp) != samples.size())
+    {
+        log_error("Error: material map '%s' is truncated.\n", file_name);
+        return -1;
+    }
+
+    map->conductivity.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        /*16 bit samples are big endian*/
+        const cl_uint id = 1 == sample_size ? samples[i] : samples[2 * i] << 8 | samples[2 * i + 1];
+        if (materials.empty())
+        {
+            map->conductivity[i] = static_cast<cl_float>(id) / max_value;
+        }
+        else if (id < materials.size())
+        {
+            map->conductivity[i] = materials[id];
+        }
+        else
+        {
+            log_error("Error: material %u of '%s' is not in the table of %u materials.\n", id, file_name, static_cast<cl_uint>(materials.size()));
+            return -1;
+        }
+    }
+    return CL_SUCCESS;
+}
+
+/*raw little endian floats, one conductivity per cell*/
+static int read_material_floats(FILE* fp, const char* file_name, material_map* map)
+{
+    map->conductivity.resize(static_cast<size_t>(map->width) * map->height);
+    if (fread(map->conductivity.data(), sizeof(cl_float), map->conductivity.size(), fp) != map->conductivity.size() || EOF != fgetc(fp))
+    {
+        log_error("Error: material map '%s' does not hold %ux%u floats.\n", file_name, map->width, map->height);
+        return -1;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_float harmonic_mean(const cl_float a, const cl_float b)
+{
+    return a + b > 0.0F ? 2.0F * a * b / (a + b) : 0.0F;
+}
+
+static void setup_faces(material_map* map)
+{
+    const auto width = map->width;
+    const auto height = map->height;
+    const auto& k = map->conductivity;
+    const auto inverse_scale = 1.0F / map->scale;
+
+    map->face_x.resize(static_cast<size_t>(width + 1) * height);
+    for (cl_uint row = 0; row < height; row++)
+    {
+        const auto* cells = k.data() + static_cast<size_t>(row) * width;
+        auto* faces = map->face_x.data() + static_cast<size_t>(row) * (width + 1);
+        faces[0] = cells[0] * inverse_scale;
+        for (cl_uint col = 1; col < width; col++)
+            faces[col] = harmonic_mean(cells[col - 1], cells[col]) * inverse_scale;
+        faces[width] = cells[width - 1] * inverse_scale;
+    }
+
+    map->face_y.resize(static_cast<size_t>(width) * (height + 1));
+    for (cl_uint col = 0; col < width; col++)
+    {
+        map->face_y[col] = k[col] * inverse_scale;
+        map->face_y[static_cast<size_t>(height) * width + col] = k[static_cast<size_t>(height - 1) * width + col] * inverse_scale;
+    }
+    for (cl_uint row = 1; row < height; row++)
+    {
+        for (cl_uint col = 0; col < width; col++)
+        {
+            const auto i = static_cast<size_t>(row) * width + col;
+            map->face_y[i] = harmonic_mean(k[i - width], k[i]) * inverse_scale;
+        }
+    }
+}
+
+/*.pgm files are material images, anything else raw floats*/
+int load_material_map(material_map* map, const char* file_name, const std::vector<cl_float>& materials, const cl_uint width, const cl_uint height)
+{
+    init_material_map(map, width, height);
+
+    FILE* fp = nullptr;
+    fopen_s(&fp, file_name, "rb");
+    if (nullptr == fp)
+    {
+        log_error("Error: Couldn't open material map '%s'.\n", file_name);
+        return -1;
+    }
+
+    const std::string name(file_name);
+    const auto is_image = name.size() > 4 && 0 == _stricmp(name.c_str() + name.size() - 4, ".pgm");
+    auto err = -1;
+    if (!is_image)
+        err = read_material_floats(fp, file_name, map);
+    else if ('P' == fgetc(fp) && '5' == fgetc(fp))
+        err = read_material_image(fp, file_name, materials, map);
+    else
+        log_error("Error: '%s' is not a binary PGM image.\n", file_name);
+    fclose(fp);
+    if (CL_SUCCESS != err)
+        return -1;
+
+    const auto range = std::minmax_element(map->conductivity.begin(), map->conductivity.end());
+    if (*range.first < 0.0F || *range.second <= 0.0F)
+    {
+        log_error("Error: material map '%s' needs conductivities >= 0 and at least one above 0.\n", file_name);
+        return -1;
+    }
+
+    map->scale = *range.second;
+    map->uniform = *range.first == *range.second;
+    if (!map->uniform)
+        setup_faces(map);
+
+    log_info("Material map %s: conductivity %g to %g%s\n", file_name, *range.first, *range.second, map->uniform ? ", uniform" : "");
+    return CL_SUCCESS;
+}
+
+static cl_mem create_face_buffer(ocl_args_d_t* ocl, const std::vector<cl_float>& faces)
+{
+    cl_int err;
+    auto* buffer = clCreateBuffer(ocl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_float) * faces.size(), const_cast<cl_float*>(faces.data()), &err);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clCreateBuffer for the material faces returned %s\n", translate_open_cl_error(err));
+        return nullptr;
+    }
+    return buffer;
+}
+
+/*uniform maps need nothing on the device, the simulate kernel runs as is*/
+int setup_ocl_material(ocl_args_d_t* ocl, material_map* map)
+{
+    if (map->uniform)
+        return CL_SUCCESS;
+
+    auto* device = &map->device;
+    if (CL_SUCCESS != create_solver_kernel(ocl, "simulate_material", &device->kernel))
+        return -1;
+    device->face_x = create_face_buffer(ocl, map->face_x);
+    device->face_y = create_face_buffer(ocl, map->face_y);
+    return nullptr != device->face_x && nullptr != device->face_y ? CL_SUCCESS : -1;
+}
+
+int execute_material_kernel(ocl_args_d_t* ocl, material_map* map, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_float gpu_percent,
+    const cl_float ratio)
+{
+    auto* device = &map->device;
+    const size_t global_work_size[] = { width, height };
+    if (CL_SUCCESS != set_kernel_args(device->kernel, 0, ocl->input, ocl->output, width, height, air_temperature, ocl->plate_points, device_cell_count(width, height, gpu_percent), ratio,
+        device->face_x, device->face_y) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->kernel, 2, global_work_size, nullptr))
+        return -1;
+
+    const auto err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <CL/cl.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct ocl_args_d_t;
+
+/*device copies of the faces and the kernel that uses them*/
+struct ocl_material_t
+{
+    ocl_material_t();
+    ~ocl_material_t();
+
+    cl_kernel        kernel;
+    cl_mem           face_x;
+    cl_mem           face_y;
+};
+
+/*
+ * Per-cell conductivity, relative to the configured diffusivity. The stencil uses the harmonic mean of the two cells on
+ * each face, kept in two face arrays so a step streams through them like through the field: face_x[row * (width + 1) + col]
+ * is the face west of cell col, face_y[row * width + col] the face north of row. Faces to the air take the conductivity of
+ * the cell. Both are divided by scale, the largest conductivity, which is folded into the diffusivity instead so the
+ * stability limit of the explicit step still holds. A uniform map keeps no faces and runs the plain stencil.
+ */
+struct material_map
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_float         scale;
+    bool             uniform;
+    std::vector<cl_float> conductivity;
+    std::vector<cl_float> face_x;
+    std::vector<cl_float> face_y;
+    ocl_material_t   device;
+};
+
+/*FTCS step of one cell through its four faces, neighbours outside of the plate are at the air temperature*/
+inline cl_float material_step(const material_map& map, const cl_float* input, const cl_uint col, const cl_uint row, const cl_float air_temperature, const cl_float ratio)
+{
+    const auto width = map.width;
+    const auto i = static_cast<size_t>(row) * width + col;
+    const auto x = static_cast<size_t>(row) * (width + 1) + col;
+    const auto center = input[i];
+    const auto flux = map.face_x[x] * ((col > 0 ? input[i - 1] : air_temperature) - center) +
+        map.face_x[x + 1] * ((col + 1 < width ? input[i + 1] : air_temperature) - center) +
+        map.face_y[i] * ((row > 0 ? input[i - width] : air_temperature) - center) +
+        map.face_y[i + width] * ((row + 1 < map.height ? input[i + width] : air_temperature) - center);
+    return center + ratio * flux;
+}
+
+bool read_pgm_value(FILE* fp, cl_uint* value);
+void init_material_map(material_map* map, cl_uint width, cl_uint height);
+int load_material_map(material_map* map, const char* file_name, const std::vector<cl_float>& materials, cl_uint width, cl_uint height);
+bool parse_material_table(const std::string& value, std::vector<cl_float>& materials);
+int setup_ocl_material(ocl_args_d_t* ocl, material_map* map);
+int execute_material_kernel(ocl_args_d_t* ocl, material_map* map, cl_uint width, cl_uint height, cl_float air_temperature, cl_float gpu_percent, cl_float ratio);
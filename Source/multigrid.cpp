@@ -0,0 +1,340 @@
+#include "multigrid.h"
+
+#include <algorithm>
+
+
+#include "linear_system.h"
+#include "ocl_args.h"
+#include "parallel.h"
+
+/*
+ * Steady state of the plate: laplacian(T) = 0 with the air around the plate and the fixed source cell, which is
+ * the five-point system with diagonal 4 and neighbour 1. Cell centered multigrid: a coarse cell covers 2x2 fine
+ * cells, residuals are summed on the way down (the coarse cell is twice as wide) and corrections are interpolated
+ * bilinearly on the way up. Red-black Gauss-Seidel smooths every level and solves the coarsest one.
+ * Full multigrid solves the plate on the coarsest grid first and interpolates the solution as the starting
+ * point of every finer grid, otherwise the V-cycles start from the current field.
+ */
+
+static void level_size(const cl_uint width, const cl_uint height, const size_t level, cl_uint* level_width, cl_uint* level_height)
+{
+    *level_width = width;
+    *level_height = height;
+    for (size_t i = 0; i < level; i++)
+    {
+        *level_width = (*level_width + 1) / 2;
+        *level_height = (*level_height + 1) / 2;
+    }
+}
+
+static size_t level_count(const cl_uint width, const cl_uint height)
+{
+    size_t count = 1;
+    for (auto w = width, h = height; w > MULTIGRID_MIN_SIZE && h > MULTIGRID_MIN_SIZE; w = (w + 1) / 2, h = (h + 1) / 2)
+        count++;
+    return count;
+}
+
+static cl_float edge_coupling(const cl_float distance)
+{
+    return 1.0F / std::max(distance, 0.25F) - 1.0F;
+}
+
+/*
+ * The plate at the resolution of a level. The air stays one fine cell beyond the plate edges, which is closer than one
+ * cell of a coarse level: the coupling to the air grows to neighbour / distance. The coarse cell holding the source is
+ * the source of the level, in the error equations its correction stays zero.
+ */
+static linear_system level_system(const plate_problem& problem, const size_t level)
+{
+    linear_system system = { 0, 0, 4.0F, 1.0F, problem.point_x >> level, problem.point_y >> level, {} };
+    level_size(problem.width, problem.height, level, &system.width, &system.height);
+
+    /*in fine cells, the center of cell i of the level is at (i + 0.5) * scale - 0.5*/
+    const auto scale = static_cast<cl_float>(1u << level);
+    const auto near = (0.5F * scale + 0.5F) / scale;
+    const auto far_x = (problem.width + 0.5F - (system.width - 0.5F) * scale) / scale;
+    const auto far_y = (problem.height + 0.5F - (system.height - 0.5F) * scale) / scale;
+    system.edge.s[0] = edge_coupling(near);
+    system.edge.s[1] = edge_coupling(far_x);
+    system.edge.s[2] = edge_coupling(near);
+    system.edge.s[3] = edge_coupling(far_y);
+    return system;
+}
+
+static void setup_levels(std::vector<multigrid_level>& levels, const cl_uint width, const cl_uint height)
+{
+    if (!levels.empty() && levels[0].width == width && levels[0].height == height)
+        return;
+
+    levels.resize(level_count(width, height));
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        auto& level = levels[i];
+        level_size(width, height, i, &level.width, &level.height);
+        const auto count = static_cast<size_t>(level.width) * level.height;
+        level.x.assign(count, 0.0F);
+        level.rhs.assign(count, 0.0F);
+        level.residual.assign(count, 0.0F);
+    }
+}
+
+static void restrict_residual(const multigrid_level& fine, multigrid_level& coarse, const linear_system& coarse_system)
+{
+    parallel_for(coarse.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < coarse.width; col++)
+            {
+                const auto fine_col = 2 * col;
+                const auto fine_row = 2 * row;
+                const auto i = static_cast<size_t>(fine_row) * fine.width + fine_col;
+
+                auto sum = fine.residual[i];
+                if (fine_col + 1 < fine.width) sum += fine.residual[i + 1];
+                if (fine_row + 1 < fine.height) sum += fine.residual[i + fine.width];
+                if (fine_col + 1 < fine.width && fine_row + 1 < fine.height) sum += fine.residual[i + fine.width + 1];
+
+                coarse.rhs[static_cast<size_t>(row) * coarse.width + col] = is_source(coarse_system, col, row) ? 0.0F : sum;
+                coarse.x[static_cast<size_t>(row) * coarse.width + col] = 0.0F;
+            }
+        }
+    });
+}
+
+static cl_float coarse_value(const multigrid_level& coarse, const cl_int col, const cl_int row, const cl_float ghost)
+{
+    return col >= 0 && row >= 0 && col < static_cast<cl_int>(coarse.width) && row < static_cast<cl_int>(coarse.height) ?
+        coarse.x[static_cast<size_t>(row) * coarse.width + col] : ghost;
+}
+
+/*x = keep * x + bilinear interpolation of the coarse x, cells outside of the coarse grid are at ghost*/
+static void prolongate(const multigrid_level& coarse, multigrid_level& fine, const cl_float ghost, const cl_float keep)
+{
+    parallel_for(fine.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_int>(begin); row < static_cast<cl_int>(end); row++)
+        {
+            for (cl_int col = 0; col < static_cast<cl_int>(fine.width); col++)
+            {
+                const auto coarse_col = col / 2;
+                const auto coarse_row = row / 2;
+                const auto other_col = coarse_col + ((col & 1) ? 1 : -1);
+                const auto other_row = coarse_row + ((row & 1) ? 1 : -1);
+
+                const auto value = 0.5625F * coarse_value(coarse, coarse_col, coarse_row, ghost) + 0.1875F * coarse_value(coarse, other_col, coarse_row, ghost) +
+                    0.1875F * coarse_value(coarse, coarse_col, other_row, ghost) + 0.0625F * coarse_value(coarse, other_col, other_row, ghost);
+
+                const auto i = static_cast<size_t>(row) * fine.width + col;
+                fine.x[i] = keep * fine.x[i] + value;
+            }
+        }
+    });
+}
+
+static void smooth(const linear_system& system, multigrid_level& level)
+{
+    for (auto i = 0; i < MULTIGRID_SMOOTHING; i++)
+    {
+        red_black_sweep(system, level.rhs.data(), level.x.data(), 0, 1.0F);
+        red_black_sweep(system, level.rhs.data(), level.x.data(), 1, 1.0F);
+    }
+}
+
+static void v_cycle(std::vector<multigrid_level>& levels, const plate_problem& problem, const size_t level)
+{
+    auto& grid = levels[level];
+    const auto system = level_system(problem, level);
+    if (level + 1 == levels.size())
+    {
+        solve_red_black(system, grid.rhs.data(), grid.x.data(), 1.0F, 0.0F, MULTIGRID_COARSE_ITERATIONS);
+        return;
+    }
+
+    auto& coarse = levels[level + 1];
+    smooth(system, grid);
+    compute_residual(system, grid.rhs.data(), grid.x.data(), grid.residual.data());
+    restrict_residual(grid, coarse, level_system(problem, level + 1));
+    v_cycle(levels, problem, level + 1);
+    prolongate(coarse, grid, 0.0F, 1.0F);
+    smooth(system, grid);
+}
+
+static void plate_rhs(const linear_system& system, const plate_problem& problem, multigrid_level& level)
+{
+    std::fill(level.rhs.begin(), level.rhs.end(), 0.0F);
+    add_boundary_terms(system, problem.air_temperature, problem.point_temperature, level.rhs.data());
+}
+
+int multigrid_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output)
+{
+    auto& levels = solver_module(solver->multigrid).levels;
+    setup_levels(levels, problem.width, problem.height);
+    const auto system = level_system(problem, 0);
+
+    if (solver->settings.full_multigrid)
+    {
+        for (auto level = levels.size(); level-- > 0;)
+        {
+            plate_rhs(level_system(problem, level), problem, levels[level]);
+            if (level + 1 == levels.size())
+                std::fill(levels[level].x.begin(), levels[level].x.end(), problem.air_temperature);
+            else
+                prolongate(levels[level + 1], levels[level], problem.air_temperature, 0.0F);
+            v_cycle(levels, problem, level);
+        }
+    }
+    else
+    {
+        plate_rhs(system, problem, levels[0]);
+        std::copy(input, input + levels[0].x.size(), levels[0].x.begin());
+    }
+
+    linear_stats stats = { 0, residual_norm(system, levels[0].rhs.data(), levels[0].x.data()) };
+    while (stats.residual > solver->settings.tolerance && stats.iterations < solver->settings.max_iterations)
+    {
+        v_cycle(levels, problem, 0);
+        stats.iterations++;
+
+        const auto residual = residual_norm(system, levels[0].rhs.data(), levels[0].x.data());
+        if (residual >= stats.residual)
+            break;
+        stats.residual = residual;
+    }
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    std::copy(levels[0].x.begin(), levels[0].x.end(), output);
+    return CL_SUCCESS;
+}
+
+static int setup_device_levels(ocl_args_d_t* ocl, ocl_solver_t* device, const cl_uint width, const cl_uint height)
+{
+    if (!device->levels.empty())
+        return CL_SUCCESS;
+
+    device->levels.resize(level_count(width, height), ocl_level_t{ 0, 0, nullptr, nullptr, nullptr });
+    for (size_t i = 0; i < device->levels.size(); i++)
+    {
+        auto& level = device->levels[i];
+        level_size(width, height, i, &level.width, &level.height);
+        const auto size = sizeof(cl_float) * level.width * level.height;
+        level.x = create_solver_buffer(ocl, size);
+        level.rhs = create_solver_buffer(ocl, size);
+        level.residual = create_solver_buffer(ocl, size);
+        if (nullptr == level.x || nullptr == level.rhs || nullptr == level.residual)
+            return -1;
+    }
+    return CL_SUCCESS;
+}
+
+static int device_smooth(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, const ocl_level_t& level, const cl_uint sweeps)
+{
+    for (cl_uint i = 0; i < 2 * sweeps; i++)
+    {
+        if (CL_SUCCESS != device_red_black_sweep(ocl, device, system, level.rhs, level.x, i & 1, 1.0F))
+            return -1;
+    }
+    return CL_SUCCESS;
+}
+
+static int device_prolongate(ocl_args_d_t* ocl, ocl_solver_t* device, const ocl_level_t& coarse, const ocl_level_t& fine, const cl_float ghost, const cl_float keep)
+{
+    const size_t global_work_size[] = { fine.width, fine.height };
+    if (CL_SUCCESS != set_kernel_args(device->prolongate, 0, coarse.x, fine.x, fine.width, coarse.width, coarse.height, ghost, keep))
+        return -1;
+    return run_solver_kernel(ocl, device->prolongate, 2, global_work_size, nullptr);
+}
+
+/*the coarsest grid has a few dozen cells, a fixed number of sweeps replaces the residual checks*/
+static int device_v_cycle(ocl_args_d_t* ocl, ocl_solver_t* device, const plate_problem& problem, const size_t level)
+{
+    auto& grid = device->levels[level];
+    const auto system = level_system(problem, level);
+    if (level + 1 == device->levels.size())
+        return device_smooth(ocl, device, system, grid, MULTIGRID_COARSE_ITERATIONS);
+
+    auto& coarse = device->levels[level + 1];
+    const auto coarse_system = level_system(problem, level + 1);
+    const size_t coarse_work_size[] = { coarse.width, coarse.height };
+    if (CL_SUCCESS != device_smooth(ocl, device, system, grid, MULTIGRID_SMOOTHING) ||
+        CL_SUCCESS != device_residual_field(ocl, device, system, grid.rhs, grid.x, grid.residual) ||
+        CL_SUCCESS != set_kernel_args(device->restrict_residual, 0, grid.residual, coarse.rhs, coarse.x, grid.width, grid.height, coarse.width,
+            coarse_system.source_x, coarse_system.source_y) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->restrict_residual, 2, coarse_work_size, nullptr) ||
+        CL_SUCCESS != device_v_cycle(ocl, device, problem, level + 1) ||
+        CL_SUCCESS != device_prolongate(ocl, device, coarse, grid, 0.0F, 1.0F) ||
+        CL_SUCCESS != device_smooth(ocl, device, system, grid, MULTIGRID_SMOOTHING))
+        return -1;
+    return CL_SUCCESS;
+}
+
+static int device_plate_rhs(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, const plate_problem& problem, const ocl_level_t& level)
+{
+    if (CL_SUCCESS != fill_solver_buffer(ocl, level.rhs, 0.0F, static_cast<size_t>(level.width) * level.height))
+        return -1;
+    return device_boundary_terms(ocl, device, system, level.rhs, problem.air_temperature, problem.point_temperature);
+}
+
+/*same cycles on the device, only the residual maximum of the finest level comes back after every cycle*/
+int multigrid_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem)
+{
+    auto* device = &solver->device;
+    if (CL_SUCCESS != setup_device_levels(ocl, device, problem.width, problem.height))
+        return -1;
+
+    auto& levels = device->levels;
+    const auto system = level_system(problem, 0);
+    const auto field_count = static_cast<size_t>(problem.width) * problem.height;
+
+    if (solver->settings.full_multigrid)
+    {
+        for (auto level = levels.size(); level-- > 0;)
+        {
+            if (CL_SUCCESS != device_plate_rhs(ocl, device, level_system(problem, level), problem, levels[level]))
+                return -1;
+            if (level + 1 == levels.size())
+            {
+                if (CL_SUCCESS != fill_solver_buffer(ocl, levels[level].x, problem.air_temperature, static_cast<size_t>(levels[level].width) * levels[level].height))
+                    return -1;
+            }
+            else if (CL_SUCCESS != device_prolongate(ocl, device, levels[level + 1], levels[level], problem.air_temperature, 0.0F))
+            {
+                return -1;
+            }
+            if (CL_SUCCESS != device_v_cycle(ocl, device, problem, level))
+                return -1;
+        }
+    }
+    else if (CL_SUCCESS != device_plate_rhs(ocl, device, system, problem, levels[0]) ||
+        CL_SUCCESS != load_solver_field(ocl, device) ||
+        CL_SUCCESS != copy_solver_buffer(ocl, device->field, levels[0].x, 0, field_count))
+    {
+        return -1;
+    }
+
+    linear_stats stats = { 0, 0.0F };
+    if (CL_SUCCESS != device_residual_norm(ocl, device, system, levels[0].rhs, levels[0].x, &stats.residual))
+        return -1;
+
+    while (stats.residual > solver->settings.tolerance && stats.iterations < solver->settings.max_iterations)
+    {
+        if (CL_SUCCESS != device_v_cycle(ocl, device, problem, 0))
+            return -1;
+        stats.iterations++;
+
+        cl_float residual;
+        if (CL_SUCCESS != device_residual_norm(ocl, device, system, levels[0].rhs, levels[0].x, &residual))
+            return -1;
+        if (residual >= stats.residual)
+            break;
+        stats.residual = residual;
+    }
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    if (CL_SUCCESS != copy_solver_buffer(ocl, levels[0].x, device->field, 0, field_count))
+        return -1;
+    return store_solver_field(ocl, device);
+}
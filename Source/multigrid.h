@@ -0,0 +1,27 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "solver.h"
+
+#define MULTIGRID_MIN_SIZE 4
+#define MULTIGRID_SMOOTHING 2
+#define MULTIGRID_COARSE_ITERATIONS 64
+
+struct multigrid_level
+{
+    cl_uint          width;
+    cl_uint          height;
+    std::vector<cl_float> x;
+    std::vector<cl_float> rhs;
+    std::vector<cl_float> residual;
+};
+
+/*the grids from the plate down to MULTIGRID_MIN_SIZE, kept while the plate keeps its size*/
+struct multigrid_state
+{
+    std::vector<multigrid_level> levels;
+};
+
+int multigrid_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output);
+int multigrid_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem);
@@ -18,6 +18,8 @@ ocl_args_d_t::ocl_args_d_t() :
 	command_queue(nullptr),
 	program(nullptr),
 	kernel(nullptr),
+	stencil_order(2),
+	huge_grid(false),
 	platform_version(OPENCL_VERSION_1_2),
 	device_version(OPENCL_VERSION_1_2),
 	compiler_version(OPENCL_VERSION_1_2),
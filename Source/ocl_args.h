@@ -11,6 +11,9 @@ struct ocl_args_d_t
     cl_command_queue command_queue;
     cl_program       program;
     cl_kernel        kernel;
+    cl_uint          stencil_order;
+    /*the program is built with 64-bit cell indices*/
+    bool             huge_grid;
     float            platform_version;
     float            device_version;
     float            compiler_version;
@@ -1,5 +1,6 @@
 #include "ocl_kernel.h"
 
+#include <cstring>
 #include <vector>
 
 
@@ -7,13 +8,14 @@
 #include "ocl_args.h"
 #include "utils.h"
 
-static int create_and_build_program(ocl_args_d_t* ocl, const char* program_name);
+static int create_and_build_program(ocl_args_d_t* ocl, const char* program_name, const char* generated_source);
 
-cl_int setup_ocl_kernel(ocl_args_d_t* ocl, const char* program_name, const char* kernel_name)
+/*generated_source, when not null, is compiled after the program file, in the same program*/
+cl_int setup_ocl_kernel(ocl_args_d_t* ocl, const char* program_name, const char* kernel_name, const char* generated_source)
 {
     cl_int err;
 
-    if (CL_SUCCESS != create_and_build_program(ocl, program_name))
+    if (CL_SUCCESS != create_and_build_program(ocl, program_name, generated_source))
     {
         return -1;
     }
@@ -28,7 +30,7 @@ cl_int setup_ocl_kernel(ocl_args_d_t* ocl, const char* program_name, const char*
     return CL_SUCCESS;
 }
 
-int create_and_build_program(ocl_args_d_t* ocl, const char* program_name)
+int create_and_build_program(ocl_args_d_t* ocl, const char* program_name, const char* generated_source)
 {
     char* source = nullptr;
     size_t src_size = 0;
@@ -46,7 +48,9 @@ int create_and_build_program(ocl_args_d_t* ocl, const char* program_name)
         return err;
     }
 
-    ocl->program = clCreateProgramWithSource(ocl->context, 1, const_cast<const char**>(&source), &src_size, &err);
+    const char* sources[] = { source, generated_source };
+    const size_t sizes[] = { src_size, generated_source ? strlen(generated_source) : 0 };
+    ocl->program = clCreateProgramWithSource(ocl->context, generated_source ? 2 : 1, sources, sizes, &err);
     if (CL_SUCCESS != err)
     {
         log_error("Error: clCreateProgramWithSource returned %s.\n", translate_open_cl_error(err));
@@ -59,7 +63,7 @@ int create_and_build_program(ocl_args_d_t* ocl, const char* program_name)
         return err;
     }
 
-    err = clBuildProgram(ocl->program, 1, &ocl->device, "", nullptr, nullptr);
+    err = clBuildProgram(ocl->program, 1, &ocl->device, ocl->huge_grid ? "-D HUGE_GRID" : "", nullptr, nullptr);
     if (CL_SUCCESS != err)
     {
         log_error("Error: clBuildProgram() for source program returned %s.\n", translate_open_cl_error(err));
@@ -85,7 +89,7 @@ int create_and_build_program(ocl_args_d_t* ocl, const char* program_name)
     return err;
 }
 
-cl_uint set_kernel_arguments(ocl_args_d_t* ocl, cl_uint width, cl_uint height, cl_float air_temperature, cl_uint point_x, cl_uint point_y, cl_float point_temperature, cl_float gpu_percent)
+cl_uint set_kernel_arguments(ocl_args_d_t* ocl, cl_uint width, cl_uint height, cl_float air_temperature, cl_float gpu_percent, cl_float ratio)
 {
     auto err =  clSetKernelArg(ocl->kernel, 0, sizeof(cl_mem), static_cast<void*>(&ocl->input));
     if (CL_SUCCESS != err)
@@ -122,38 +126,25 @@ cl_uint set_kernel_arguments(ocl_args_d_t* ocl, cl_uint width, cl_uint height, c
         return err;
     }
 
-    err = clSetKernelArg(ocl->kernel, 5, sizeof(cl_uint), static_cast<void*>(&point_x));
+    err = clSetKernelArg(ocl->kernel, 5, sizeof(cl_mem), static_cast<void*>(&ocl->plate_points));
     if (CL_SUCCESS != err)
     {
-        log_error("Error: Failed to set argument point_x, returned %s\n", translate_open_cl_error(err));
-        return err;
-    }
-
-    err = clSetKernelArg(ocl->kernel, 6, sizeof(cl_uint), static_cast<void*>(&point_y));
-    if (CL_SUCCESS != err)
-    {
-        log_error("Error: Failed to set argument point_y, returned %s\n", translate_open_cl_error(err));
-        return err;
-    }
-
-    err = clSetKernelArg(ocl->kernel, 7, sizeof(cl_float), static_cast<void*>(&point_temperature));
-    if (CL_SUCCESS != err)
-    {
-        log_error("Error: Failed to set argument point_temperature, returned %s\n", translate_open_cl_error(err));
+        log_error("Error: Failed to set argument plate_points, returned %s\n", translate_open_cl_error(err));
         return err;
     }
 
-    err = clSetKernelArg(ocl->kernel, 8, sizeof(cl_mem), static_cast<void*>(&ocl->plate_points));
+    auto device_cells = device_cell_count(width, height, gpu_percent);
+    err = clSetKernelArg(ocl->kernel, 6, sizeof(cl_ulong), static_cast<void*>(&device_cells));
     if (CL_SUCCESS != err)
     {
-        log_error("Error: Failed to set argument plate_points, returned %s\n", translate_open_cl_error(err));
+        log_error("Error: Failed to set argument device_cells, returned %s\n", translate_open_cl_error(err));
         return err;
     }
 
-    err = clSetKernelArg(ocl->kernel, 9, sizeof(cl_float), static_cast<void*>(&gpu_percent));
+    err = clSetKernelArg(ocl->kernel, 7, sizeof(cl_float), static_cast<void*>(&ratio));
     if (CL_SUCCESS != err)
     {
-        log_error("Error: Failed to set argument gpu_percent, returned %s\n", translate_open_cl_error(err));
+        log_error("Error: Failed to set argument ratio, returned %s\n", translate_open_cl_error(err));
         return err;
     }
 
@@ -1,23 +1,37 @@
 #include "ocl_memory.h"
 
 #include <cmath>
+#include <thread>
 
 
 #include "log_utils.h"
 #include "ocl_args.h"
+#include "utils.h"
 
 
 void generate_input(cl_float* input_array, const cl_uint array_width, const cl_uint array_height, const cl_float temperature)
 {
-    const auto array_size = array_width * array_height;
-    for (cl_uint i = 0; i < array_size; ++i)
+    const auto array_size = static_cast<size_t>(array_width) * array_height;
+    for (size_t i = 0; i < array_size; ++i)
 		input_array[i] = temperature;
 }
 
-int create_buffer_arguments(ocl_args_d_t* ocl, cl_float* input, struct vertex_args* plate_points, const cl_uint array_width, const cl_uint array_height)
+/*with in_place the output is the input image itself: only solvers that work in place can run on it, on the CPU, for half the field memory*/
+int create_buffer_arguments(ocl_args_d_t* ocl, cl_float* input, struct vertex_args* plate_points, const cl_uint array_width, const cl_uint array_height, const bool in_place)
 {
     auto err = CL_SUCCESS;
 
+    /*the device field is one 2D image and its source and tile ids are 32-bit: a larger plate runs out_of_core on the CPU*/
+    size_t max_width = 0, max_height = 0;
+    clGetDeviceInfo(ocl->device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(max_width), &max_width, nullptr);
+    clGetDeviceInfo(ocl->device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(max_height), &max_height, nullptr);
+    if ((max_width && array_width > max_width) || (max_height && array_height > max_height) || static_cast<cl_ulong>(array_width) * array_height > INDEX_32_CELLS)
+    {
+        log_error("Error: a %ux%u plate is larger than the device images (%zux%zu) or 2^32 cells, step it with out_of_core.\n", array_width, array_height,
+            max_width, max_height);
+        return -1;
+    }
+
     cl_image_format format;
     cl_image_desc desc;
 
@@ -47,14 +61,28 @@ int create_buffer_arguments(ocl_args_d_t* ocl, cl_float* input, struct vertex_ar
         return err;
     }
 
-    ocl->output = clCreateImage(ocl->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &format, &desc, input, &err);
-    if (CL_SUCCESS != err)
+    if (in_place)
     {
-        log_error("Error: clCreateImage for output returned %s\n", translate_open_cl_error(err));
-        return err;
+        /*both handles are released on exit*/
+        err = clRetainMemObject(ocl->input);
+        if (CL_SUCCESS != err)
+        {
+            log_error("Error: clRetainMemObject for output returned %s\n", translate_open_cl_error(err));
+            return err;
+        }
+        ocl->output = ocl->input;
+    }
+    else
+    {
+        ocl->output = clCreateImage(ocl->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &format, &desc, input, &err);
+        if (CL_SUCCESS != err)
+        {
+            log_error("Error: clCreateImage for output returned %s\n", translate_open_cl_error(err));
+            return err;
+        }
     }
 
-    ocl->plate_points = clCreateBuffer(ocl->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, array_width * array_height * sizeof(struct vertex_args), plate_points, &err);
+    ocl->plate_points = clCreateBuffer(ocl->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, static_cast<size_t>(array_width) * array_height * sizeof(struct vertex_args), plate_points, &err);
     if (CL_SUCCESS != err)
     {
         log_error("Error: clCreateBuffer for output returned %s\n", translate_open_cl_error(err));
@@ -98,9 +126,9 @@ bool read_and_verify(ocl_args_d_t* ocl, const cl_uint width, const cl_uint heigh
         log_error("Error: clFinish returned %s\n", translate_open_cl_error(err));
     }
 
-    const auto size = width * height;
+    const auto size = static_cast<size_t>(width) * height;
 
-    for (unsigned int k = 0; k < size; k++)
+    for (size_t k = 0; k < size; k++)
     {    		
 		if (result && abs(input_ptr[k] - result_ptr[k]) >= CL_FLT_EPSILON * 1000)
 		    result = false;
@@ -123,4 +151,51 @@ bool read_and_verify(ocl_args_d_t* ocl, const cl_uint width, const cl_uint heigh
     return result;
 }
 
+int read_field(ocl_args_d_t* ocl, const cl_uint width, const cl_uint height, cl_float* field)
+{
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+
+    const auto err = clEnqueueReadImage(ocl->command_queue, ocl->input, true, origin, region, 0, 0, field, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueReadImage returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+
+    return CL_SUCCESS;
+}
+
+/*replaces the current field, the next step starts from it*/
+int write_field(ocl_args_d_t* ocl, const cl_uint width, const cl_uint height, const cl_float* field)
+{
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+
+    const auto err = clEnqueueWriteImage(ocl->command_queue, ocl->input, true, origin, region, 0, 0, field, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueWriteImage returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+
+    return CL_SUCCESS;
+}
 
+void colorize_field(const cl_float* field, struct vertex_args* plate_points, const size_t count)
+{
+    std::thread threads[CPU_THREAD_COUNT];
+    for (auto t = 0; t < CPU_THREAD_COUNT; t++)
+    {
+        threads[t] = std::thread([=]()
+        {
+            const auto end = t == CPU_THREAD_COUNT - 1 ? count : count / CPU_THREAD_COUNT * (t + 1);
+            for (auto i = count / CPU_THREAD_COUNT * t; i < end; i++)
+                set_temperature_color(plate_points[i], field[i]);
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
@@ -23,8 +23,39 @@ const struct vertex_args temperature_color[TEMPERATURES_COUNT] = {
 	{1315.0F, -1.0F, 1.0F, 1.0F, 1.0F}, //White
 };
 
+/*linear interpolation between the two colors that bracket the temperature*/
+inline void set_temperature_color(struct vertex_args& point, const float temperature)
+{
+	if (temperature < temperature_color[TEMPERATURES_COUNT - 1].x)
+	{
+		for (auto j = 0; j < TEMPERATURES_COUNT - 1; j++)
+		{
+			if (temperature < temperature_color[j].y)
+			{
+				const auto diff = temperature - temperature_color[j].x;
+				const auto diff_total = temperature_color[j].y - temperature_color[j].x;
+				const auto proc = diff / diff_total;
+
+				point.r = temperature_color[j].r + (temperature_color[j + 1].r - temperature_color[j].r) * proc;
+				point.g = temperature_color[j].g + (temperature_color[j + 1].g - temperature_color[j].g) * proc;
+				point.b = temperature_color[j].b + (temperature_color[j + 1].b - temperature_color[j].b) * proc;
+				break;
+			}
+		}
+	}
+	else
+	{
+		point.r = temperature_color[TEMPERATURES_COUNT - 1].r;
+		point.g = temperature_color[TEMPERATURES_COUNT - 1].g;
+		point.b = temperature_color[TEMPERATURES_COUNT - 1].b;
+	}
+}
+
 struct ocl_args_d_t;
 
 void generate_input(cl_float* input_array, cl_uint array_width, cl_uint array_height, cl_float temperature);
-int create_buffer_arguments(ocl_args_d_t* ocl, cl_float* input, struct vertex_args* plate_points, const cl_uint array_width, const cl_uint array_height);
+int create_buffer_arguments(ocl_args_d_t* ocl, cl_float* input, struct vertex_args* plate_points, const cl_uint array_width, const cl_uint array_height, bool in_place);
 bool read_and_verify(ocl_args_d_t* ocl, const cl_uint width, const cl_uint height, struct vertex_args plate_points[]);
+void colorize_field(const cl_float* field, struct vertex_args* plate_points, size_t count);
+int read_field(ocl_args_d_t* ocl, const cl_uint width, const cl_uint height, cl_float* field);
+int write_field(ocl_args_d_t* ocl, const cl_uint width, const cl_uint height, const cl_float* field);
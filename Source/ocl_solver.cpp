@@ -0,0 +1,344 @@
+#include "ocl_solver.h"
+
+#include <algorithm>
+
+
+#include "ocl_args.h"
+
+#define SOLVER_GROUP_COUNT 64
+
+ocl_solver_t::ocl_solver_t() :
+    colorize(nullptr),
+    implicit_rhs(nullptr),
+    boundary_terms(nullptr),
+    red_black_sweep(nullptr),
+    residual_norm(nullptr),
+    residual_field(nullptr),
+    restrict_residual(nullptr),
+    prolongate(nullptr),
+    pcg_direction(nullptr),
+    pcg_update(nullptr),
+    ic_black(nullptr),
+    ic_red(nullptr),
+    rkl2_first_stage(nullptr),
+    rkl2_stage(nullptr),
+    chebyshev_step(nullptr),
+    width(0),
+    height(0),
+    group_size(0),
+    field(nullptr),
+    rhs(nullptr),
+    partial(nullptr),
+    pcg{ nullptr, nullptr, nullptr, nullptr, nullptr },
+    stages{ nullptr, nullptr, nullptr }
+{
+}
+
+ocl_solver_t::~ocl_solver_t()
+{
+    release_solver_vectors(this);
+    for (auto* kernel : { colorize, implicit_rhs, boundary_terms, red_black_sweep, residual_norm, residual_field, restrict_residual, prolongate,
+        pcg_direction, pcg_update, ic_black, ic_red, rkl2_first_stage, rkl2_stage, chebyshev_step })
+    {
+        if (kernel)
+        {
+            const auto err = clReleaseKernel(kernel);
+            if (CL_SUCCESS != err)
+                log_error("Error: clReleaseKernel returned '%s'.\n", translate_open_cl_error(err));
+        }
+    }
+    for (auto* buffer : { field, rhs, partial })
+    {
+        if (buffer)
+        {
+            const auto err = clReleaseMemObject(buffer);
+            if (CL_SUCCESS != err)
+                log_error("Error: clReleaseMemObject returned '%s'.\n", translate_open_cl_error(err));
+        }
+    }
+}
+
+int create_solver_kernel(ocl_args_d_t* ocl, const char* kernel_name, cl_kernel* kernel)
+{
+    cl_int err;
+    *kernel = clCreateKernel(ocl->program, kernel_name, &err);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clCreateKernel(%s) returned %s\n", kernel_name, translate_open_cl_error(err));
+        return -1;
+    }
+    return CL_SUCCESS;
+}
+
+cl_mem create_solver_buffer(ocl_args_d_t* ocl, const size_t size)
+{
+    cl_int err;
+    auto* buffer = clCreateBuffer(ocl->context, CL_MEM_READ_WRITE, size, nullptr, &err);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clCreateBuffer returned %s\n", translate_open_cl_error(err));
+        return nullptr;
+    }
+    return buffer;
+}
+
+/*kernels are created once, buffers whenever the plate size changes*/
+int setup_ocl_solver(ocl_args_d_t* ocl, ocl_solver_t* solver, const cl_uint width, const cl_uint height)
+{
+    if (nullptr == solver->colorize)
+    {
+        if (CL_SUCCESS != create_solver_kernel(ocl, "colorize", &solver->colorize) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "implicit_rhs", &solver->implicit_rhs) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "boundary_terms", &solver->boundary_terms) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "red_black_sweep", &solver->red_black_sweep) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "residual_norm", &solver->residual_norm) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "residual_field", &solver->residual_field) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "restrict_residual", &solver->restrict_residual) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "prolongate", &solver->prolongate) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "pcg_direction", &solver->pcg_direction) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "pcg_update", &solver->pcg_update) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "ic_black", &solver->ic_black) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "ic_red", &solver->ic_red) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "rkl2_first_stage", &solver->rkl2_first_stage) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "rkl2_stage", &solver->rkl2_stage) ||
+            CL_SUCCESS != create_solver_kernel(ocl, "chebyshev_step", &solver->chebyshev_step))
+            return -1;
+
+        /*the reductions halve the group, so its size has to be a power of two*/
+        size_t max_group_size = SOLVER_GROUP_SIZE;
+        clGetKernelWorkGroupInfo(solver->residual_norm, ocl->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, nullptr);
+        solver->group_size = 1;
+        while (solver->group_size * 2 <= std::min<size_t>(max_group_size, SOLVER_GROUP_SIZE))
+            solver->group_size *= 2;
+
+        /*room for a (sum, maximum) pair per group*/
+        solver->partial = create_solver_buffer(ocl, 2 * sizeof(cl_float) * SOLVER_GROUP_COUNT);
+        if (nullptr == solver->partial)
+            return -1;
+        solver->partial_host.resize(2 * SOLVER_GROUP_COUNT);
+    }
+
+    if (solver->width == width && solver->height == height)
+        return CL_SUCCESS;
+
+    for (auto* buffer : { &solver->field, &solver->rhs })
+    {
+        if (*buffer)
+            clReleaseMemObject(*buffer);
+        *buffer = create_solver_buffer(ocl, sizeof(cl_float) * width * height);
+        if (nullptr == *buffer)
+            return -1;
+    }
+    release_solver_vectors(solver);
+    solver->width = width;
+    solver->height = height;
+
+    return CL_SUCCESS;
+}
+
+/*the multigrid, conjugate gradient and RKL2 vectors, allocated by their solvers on first use*/
+void release_solver_vectors(ocl_solver_t* solver)
+{
+    for (auto& level : solver->levels)
+    {
+        for (auto* buffer : { level.x, level.rhs, level.residual })
+        {
+            if (buffer)
+                clReleaseMemObject(buffer);
+        }
+    }
+    solver->levels.clear();
+
+    for (auto* buffer : { &solver->pcg.residual, &solver->pcg.preconditioned, &solver->pcg.direction, &solver->pcg.next_direction, &solver->pcg.product,
+        &solver->stages[0], &solver->stages[1], &solver->stages[2] })
+    {
+        if (*buffer)
+            clReleaseMemObject(*buffer);
+        *buffer = nullptr;
+    }
+}
+
+int run_solver_kernel(ocl_args_d_t* ocl, cl_kernel kernel, const cl_uint work_dim, const size_t* global_work_size, const size_t* local_work_size)
+{
+    const auto err = clEnqueueNDRangeKernel(ocl->command_queue, kernel, work_dim, nullptr, global_work_size, local_work_size, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: Failed to run kernel, return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*the image holds the field as raw 32 bit values, copying keeps the bits*/
+int load_solver_field(ocl_args_d_t* ocl, ocl_solver_t* solver)
+{
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { solver->width, solver->height, 1 };
+
+    const auto err = clEnqueueCopyImageToBuffer(ocl->command_queue, ocl->input, solver->field, origin, region, 0, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueCopyImageToBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*the solved field goes to the output image and the plate colors, like the simulate kernel leaves them*/
+int store_solver_field(ocl_args_d_t* ocl, ocl_solver_t* solver)
+{
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { solver->width, solver->height, 1 };
+
+    auto err = clEnqueueCopyBufferToImage(ocl->command_queue, solver->field, ocl->output, 0, origin, region, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueCopyBufferToImage returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+
+    const auto count = solver->width * solver->height;
+    const size_t global_work_size[] = { (count + solver->group_size - 1) / solver->group_size * solver->group_size };
+    if (CL_SUCCESS != set_kernel_args(solver->colorize, 0, solver->field, ocl->plate_points, count) ||
+        CL_SUCCESS != run_solver_kernel(ocl, solver->colorize, 1, global_work_size, &solver->group_size))
+        return -1;
+
+    err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*launches SOLVER_GROUP_COUNT groups of a reduction kernel, which leave their partial results in solver->partial*/
+int run_group_kernel(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_kernel kernel)
+{
+    const size_t global_work_size[] = { solver->group_size * SOLVER_GROUP_COUNT };
+    return run_solver_kernel(ocl, kernel, 1, global_work_size, &solver->group_size);
+}
+
+static int read_partials(ocl_args_d_t* ocl, ocl_solver_t* solver, const size_t count)
+{
+    const auto err = clEnqueueReadBuffer(ocl->command_queue, solver->partial, true, 0, sizeof(cl_float) * count, solver->partial_host.data(), 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueReadBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*runs a kernel that leaves one partial maximum per group and folds the partials on the host*/
+static int reduce_max_kernel(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_kernel kernel, cl_float* result)
+{
+    if (CL_SUCCESS != run_group_kernel(ocl, solver, kernel) || CL_SUCCESS != read_partials(ocl, solver, SOLVER_GROUP_COUNT))
+        return -1;
+
+    *result = *std::max_element(solver->partial_host.begin(), solver->partial_host.begin() + SOLVER_GROUP_COUNT);
+    return CL_SUCCESS;
+}
+
+/*same for kernels that leave a (sum, maximum) pair per group, the sums are folded in group order*/
+int reduce_sum_max_kernel(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_kernel kernel, cl_float* sum, cl_float* maximum)
+{
+    if (CL_SUCCESS != run_group_kernel(ocl, solver, kernel) || CL_SUCCESS != read_partials(ocl, solver, 2 * SOLVER_GROUP_COUNT))
+        return -1;
+
+    *sum = 0.0F;
+    *maximum = 0.0F;
+    for (size_t i = 0; i < SOLVER_GROUP_COUNT; i++)
+    {
+        *sum += solver->partial_host[2 * i];
+        *maximum = std::max(*maximum, solver->partial_host[2 * i + 1]);
+    }
+    return CL_SUCCESS;
+}
+
+int fill_solver_buffer(ocl_args_d_t* ocl, cl_mem buffer, const cl_float value, const size_t count)
+{
+    const auto err = clEnqueueFillBuffer(ocl->command_queue, buffer, &value, sizeof(cl_float), 0, sizeof(cl_float) * count, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueFillBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/*copies count floats starting at float index offset*/
+int copy_solver_buffer(ocl_args_d_t* ocl, cl_mem source, cl_mem destination, const size_t offset, const size_t count)
+{
+    const auto err = clEnqueueCopyBuffer(ocl->command_queue, source, destination, sizeof(cl_float) * offset, sizeof(cl_float) * offset, sizeof(cl_float) * count, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueCopyBuffer returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+int device_boundary_terms(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, const cl_float air_temperature, const cl_float source_temperature)
+{
+    const size_t global_work_size[] = { system.width, system.height };
+    if (CL_SUCCESS != set_kernel_args(solver->boundary_terms, 0, rhs, system.width, system.height, system.neighbour, system.source_x, system.source_y, system.edge,
+        air_temperature, source_temperature))
+        return -1;
+    return run_solver_kernel(ocl, solver->boundary_terms, 2, global_work_size, nullptr);
+}
+
+int device_red_black_sweep(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, const cl_uint color, const cl_float omega)
+{
+    const size_t global_work_size[] = { (system.width + 1) / 2, system.height };
+    if (CL_SUCCESS != set_kernel_args(solver->red_black_sweep, 0, rhs, x, system.width, system.height, system.diagonal, system.neighbour, system.source_x, system.source_y,
+        system.edge, color, omega))
+        return -1;
+    return run_solver_kernel(ocl, solver->red_black_sweep, 2, global_work_size, nullptr);
+}
+
+int device_residual_field(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, cl_mem residual)
+{
+    const size_t global_work_size[] = { system.width, system.height };
+    if (CL_SUCCESS != set_kernel_args(solver->residual_field, 0, rhs, x, residual, system.width, system.height, system.diagonal, system.neighbour,
+        system.source_x, system.source_y, system.edge))
+        return -1;
+    return run_solver_kernel(ocl, solver->residual_field, 2, global_work_size, nullptr);
+}
+
+int device_residual_norm(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, cl_float* residual)
+{
+    if (CL_SUCCESS != set_kernel_args(solver->residual_norm, 0, rhs, x, system.width, system.height, system.diagonal, system.neighbour, system.source_x, system.source_y,
+        system.edge, solver->partial, local_arg{ sizeof(cl_float) * solver->group_size }))
+        return -1;
+    return reduce_max_kernel(ocl, solver, solver->residual_norm, residual);
+}
+
+/*solve_red_black on the device->rhs and device->field, only the residual maximum comes back to the host every LINEAR_CHECK_INTERVAL iterations*/
+int device_solve_red_black(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, const cl_float omega, const cl_float tolerance, const cl_uint max_iterations, linear_stats* stats)
+{
+    *stats = { 0, 0.0F };
+    if (CL_SUCCESS != device_residual_norm(ocl, device, system, device->rhs, device->field, &stats->residual))
+        return -1;
+
+    auto last_residual = stats->residual;
+    while (stats->residual > tolerance && stats->iterations < max_iterations)
+    {
+        for (cl_uint color = 0; color < 2; color++)
+        {
+            if (CL_SUCCESS != device_red_black_sweep(ocl, device, system, device->rhs, device->field, color, omega))
+                return -1;
+        }
+        stats->iterations++;
+
+        if (0 == stats->iterations % LINEAR_CHECK_INTERVAL || stats->iterations == max_iterations)
+        {
+            if (CL_SUCCESS != device_residual_norm(ocl, device, system, device->rhs, device->field, &stats->residual))
+                return -1;
+            if (stats->residual >= last_residual)
+                break;
+            last_residual = stats->residual;
+        }
+    }
+    return CL_SUCCESS;
+}
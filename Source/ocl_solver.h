@@ -0,0 +1,119 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "linear_system.h"
+#include "log_utils.h"
+
+#define SOLVER_GROUP_SIZE 256
+
+struct ocl_args_d_t;
+
+/*one grid of the multigrid hierarchy on the device*/
+struct ocl_level_t
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_mem           x;
+    cl_mem           rhs;
+    cl_mem           residual;
+};
+
+/*device copies of the conjugate gradient vectors*/
+struct ocl_pcg_t
+{
+    cl_mem           residual;
+    cl_mem           preconditioned;
+    cl_mem           direction;
+    cl_mem           next_direction;
+    cl_mem           product;
+};
+
+/*kernels and device vectors of the solvers, the field is kept in a plain buffer while a solver works on it*/
+struct ocl_solver_t
+{
+    ocl_solver_t();
+    ~ocl_solver_t();
+
+    cl_kernel        colorize;
+    cl_kernel        implicit_rhs;
+    cl_kernel        boundary_terms;
+    cl_kernel        red_black_sweep;
+    cl_kernel        residual_norm;
+    cl_kernel        residual_field;
+    cl_kernel        restrict_residual;
+    cl_kernel        prolongate;
+    cl_kernel        pcg_direction;
+    cl_kernel        pcg_update;
+    cl_kernel        ic_black;
+    cl_kernel        ic_red;
+    cl_kernel        rkl2_first_stage;
+    cl_kernel        rkl2_stage;
+    cl_kernel        chebyshev_step;
+
+    cl_uint          width;
+    cl_uint          height;
+    size_t           group_size;
+    cl_mem           field;
+    cl_mem           rhs;
+    cl_mem           partial;
+    std::vector<cl_float> partial_host;
+    std::vector<ocl_level_t> levels;
+    ocl_pcg_t        pcg;
+    cl_mem           stages[3];
+};
+
+/*size of a __local kernel argument*/
+struct local_arg
+{
+    size_t           size;
+};
+
+inline cl_int set_kernel_args(cl_kernel, cl_uint)
+{
+    return CL_SUCCESS;
+}
+
+template <typename... Rest>
+cl_int set_kernel_args(cl_kernel kernel, cl_uint index, const local_arg& value, const Rest&... rest);
+
+template <typename T, typename... Rest>
+cl_int set_kernel_args(cl_kernel kernel, const cl_uint index, const T& value, const Rest&... rest)
+{
+    const auto err = clSetKernelArg(kernel, index, sizeof(T), &value);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: Failed to set kernel argument %u, returned %s\n", index, translate_open_cl_error(err));
+        return err;
+    }
+    return set_kernel_args(kernel, index + 1, rest...);
+}
+
+template <typename... Rest>
+cl_int set_kernel_args(cl_kernel kernel, const cl_uint index, const local_arg& value, const Rest&... rest)
+{
+    const auto err = clSetKernelArg(kernel, index, value.size, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: Failed to set local kernel argument %u, returned %s\n", index, translate_open_cl_error(err));
+        return err;
+    }
+    return set_kernel_args(kernel, index + 1, rest...);
+}
+
+int setup_ocl_solver(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_uint width, cl_uint height);
+int create_solver_kernel(ocl_args_d_t* ocl, const char* kernel_name, cl_kernel* kernel);
+cl_mem create_solver_buffer(ocl_args_d_t* ocl, size_t size);
+int run_solver_kernel(ocl_args_d_t* ocl, cl_kernel kernel, cl_uint work_dim, const size_t* global_work_size, const size_t* local_work_size);
+int load_solver_field(ocl_args_d_t* ocl, ocl_solver_t* solver);
+void release_solver_vectors(ocl_solver_t* solver);
+int store_solver_field(ocl_args_d_t* ocl, ocl_solver_t* solver);
+int run_group_kernel(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_kernel kernel);
+int reduce_sum_max_kernel(ocl_args_d_t* ocl, ocl_solver_t* solver, cl_kernel kernel, cl_float* sum, cl_float* maximum);
+int fill_solver_buffer(ocl_args_d_t* ocl, cl_mem buffer, cl_float value, size_t count);
+int copy_solver_buffer(ocl_args_d_t* ocl, cl_mem source, cl_mem destination, size_t offset, size_t count);
+int device_boundary_terms(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_float air_temperature, cl_float source_temperature);
+int device_red_black_sweep(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, cl_uint color, cl_float omega);
+int device_residual_field(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, cl_mem residual);
+int device_residual_norm(ocl_args_d_t* ocl, ocl_solver_t* solver, const linear_system& system, cl_mem rhs, cl_mem x, cl_float* residual);
+int device_solve_red_black(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, cl_float omega, cl_float tolerance, cl_uint max_iterations, linear_stats* stats);
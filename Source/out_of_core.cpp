@@ -0,0 +1,365 @@
+#include "out_of_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <Windows.h>
+
+#include "log_utils.h"
+#include "parallel.h"
+#include "utils.h"
+
+/*the cells of a tile, and of the tile with its halo cut to the plate*/
+struct tile_region
+{
+    cl_uint          x0;
+    cl_uint          x1;
+    cl_uint          y0;
+    cl_uint          y1;
+    cl_uint          halo_x0;
+    cl_uint          halo_x1;
+    cl_uint          halo_y0;
+    cl_uint          halo_y1;
+};
+
+static tile_region tile_bounds(const out_of_core_plate& plate, const size_t tile)
+{
+    const auto x0 = static_cast<cl_uint>(tile % plate.tile_columns) * plate.tile_size;
+    const auto y0 = static_cast<cl_uint>(tile / plate.tile_columns) * plate.tile_size;
+    const auto x1 = std::min(x0 + plate.tile_size, plate.width);
+    const auto y1 = std::min(y0 + plate.tile_size, plate.height);
+    return { x0, x1, y0, y1, x0 > plate.halo ? x0 - plate.halo : 0, std::min(x1 + plate.halo, plate.width), y0 > plate.halo ? y0 - plate.halo : 0,
+        std::min(y1 + plate.halo, plate.height) };
+}
+
+static out_of_core_header& plate_header(const out_of_core_plate& plate)
+{
+    return *reinterpret_cast<out_of_core_header*>(plate.view);
+}
+
+static cl_float* plate_field(const out_of_core_plate& plate, const cl_uint index)
+{
+    return reinterpret_cast<cl_float*>(plate.view + OUT_OF_CORE_ALIGNMENT + index * plate.field_bytes);
+}
+
+const out_of_core_header& out_of_core_state(const out_of_core_plate& plate)
+{
+    return plate_header(plate);
+}
+
+const cl_float* out_of_core_field(const out_of_core_plate& plate)
+{
+    return plate_field(plate, plate_header(plate).current);
+}
+
+void close_out_of_core_plate(out_of_core_plate* plate)
+{
+    if (plate->view)
+    {
+        FlushViewOfFile(plate->view, 0);
+        UnmapViewOfFile(plate->view);
+        plate->view = nullptr;
+    }
+    if (plate->mapping)
+    {
+        CloseHandle(plate->mapping);
+        plate->mapping = nullptr;
+    }
+    if (plate->file)
+    {
+        CloseHandle(plate->file);
+        plate->file = nullptr;
+    }
+}
+
+/*
+ * Opens the plate file, or creates it at the initial temperature. A file of the same plate continues from the step it
+ * was left at, so a long run can be spread over several.
+ */
+int open_out_of_core_plate(out_of_core_plate* plate, const char* file_name, const cl_uint width, const cl_uint height, const cl_float initial_temperature,
+    const cl_uint tile_size, const cl_uint halo, const cl_uint slot_count)
+{
+    plate->file = nullptr;
+    plate->mapping = nullptr;
+    plate->view = nullptr;
+    plate->width = width;
+    plate->height = height;
+    plate->tile_size = tile_size;
+    plate->halo = halo;
+    plate->tile_columns = (width + tile_size - 1) / tile_size;
+    plate->tile_rows = (height + tile_size - 1) / tile_size;
+    plate->field_bytes = (static_cast<cl_ulong>(width) * height * sizeof(cl_float) + OUT_OF_CORE_ALIGNMENT - 1) / OUT_OF_CORE_ALIGNMENT * OUT_OF_CORE_ALIGNMENT;
+    const auto file_bytes = OUT_OF_CORE_ALIGNMENT + 2 * plate->field_bytes;
+
+    auto* file = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        log_error("Error: Couldn't open plate file '%s' (error %lu).\n", file_name, GetLastError());
+        return -1;
+    }
+    plate->file = file;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        log_error("Error: Couldn't read the size of plate file '%s' (error %lu).\n", file_name, GetLastError());
+        close_out_of_core_plate(plate);
+        return -1;
+    }
+    const auto created = 0 == file_size.QuadPart;
+    if (!created && static_cast<cl_ulong>(file_size.QuadPart) != file_bytes)
+    {
+        log_error("Error: '%s' does not hold a %ux%u plate.\n", file_name, width, height);
+        close_out_of_core_plate(plate);
+        return -1;
+    }
+    if (created)
+    {
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(file_bytes);
+        if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            log_error("Error: Couldn't grow plate file '%s' to %llu bytes (error %lu).\n", file_name, static_cast<unsigned long long>(file_bytes), GetLastError());
+            close_out_of_core_plate(plate);
+            return -1;
+        }
+    }
+
+    plate->mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (nullptr != plate->mapping)
+        plate->view = static_cast<unsigned char*>(MapViewOfFile(plate->mapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (nullptr == plate->view)
+    {
+        log_error("Error: Couldn't map plate file '%s' (error %lu).\n", file_name, GetLastError());
+        close_out_of_core_plate(plate);
+        return -1;
+    }
+
+    auto& header = plate_header(*plate);
+    if (created)
+    {
+        header = { OUT_OF_CORE_MAGIC, OUT_OF_CORE_VERSION, width, height, 0, 0, 0 };
+        auto* field = plate_field(*plate, 0);
+        parallel_for(height, [&](const size_t begin, const size_t end)
+        {
+            std::fill(field + begin * width, field + end * width, initial_temperature);
+        });
+    }
+    else if (OUT_OF_CORE_MAGIC != header.magic || OUT_OF_CORE_VERSION != header.version || width != header.width || height != header.height || header.current > 1)
+    {
+        log_error("Error: '%s' does not hold a %ux%u plate.\n", file_name, width, height);
+        close_out_of_core_plate(plate);
+        return -1;
+    }
+
+    const auto halo_cells = static_cast<size_t>(std::min(tile_size + 2 * halo, width)) * std::min(tile_size + 2 * halo, height);
+    plate->slots.resize(slot_count);
+    for (auto& slot : plate->slots)
+    {
+        slot.state = OUT_OF_CORE_FREE;
+        slot.cells[0].resize(halo_cells);
+        slot.cells[1].resize(halo_cells);
+    }
+
+    log_info("Out-of-core plate %s: %ux%u, %s at step %llu, %u tiles of %u cells with a halo of %u, %u slots (%.1f MB)\n", file_name, width, height,
+        created ? "created" : "continued", static_cast<unsigned long long>(header.steps), plate->tile_columns * plate->tile_rows, tile_size, halo, slot_count,
+        2.0 * sizeof(cl_float) * halo_cells * slot_count / (1024.0 * 1024.0));
+    return CL_SUCCESS;
+}
+
+/*
+ * steps FTCS steps of the tile in its slot. Every step the cells next to a cut edge of the halo become stale, so the
+ * stepped rectangle shrinks by one on those sides; the edges of the plate keep their air neighbours. After steps <= halo
+ * steps the tile itself is still exact. The arithmetic is that of cpu_simulate, cell for cell.
+ */
+static void step_tile(const out_of_core_plate& plate, const tile_region& region, out_of_core_slot& slot, const cl_float* air_row, const cl_float air_temperature,
+    const cl_int point_x, const cl_int point_y, const cl_float point_temperature, const cl_float ratio, const cl_uint steps)
+{
+    const auto local_width = region.halo_x1 - region.halo_x0;
+    const auto local_height = region.halo_y1 - region.halo_y0;
+    for (cl_uint s = 1; s <= steps; s++)
+    {
+        const auto* input = slot.cells[(s - 1) & 1].data();
+        auto* output = slot.cells[s & 1].data();
+        const auto x_begin = region.halo_x0 > 0 ? s : 0;
+        const auto x_end = region.halo_x1 < plate.width ? local_width - s : local_width;
+        const auto y_begin = region.halo_y0 > 0 ? s : 0;
+        const auto y_end = region.halo_y1 < plate.height ? local_height - s : local_height;
+        for (auto y = y_begin; y < y_end; y++)
+        {
+            const auto* row = input + static_cast<size_t>(y) * local_width;
+            const auto* above = region.halo_y0 + y > 0 ? row - local_width : air_row;
+            const auto* below = region.halo_y0 + y + 1 < plate.height ? row + local_width : air_row;
+            auto* out = output + static_cast<size_t>(y) * local_width;
+            for (auto x = x_begin; x < x_end; x++)
+            {
+                const auto center = row[x];
+                const auto neighbours = (x > 0 ? row[x - 1] : air_temperature) + (x + 1 < local_width ? row[x + 1] : air_temperature) + above[x] + below[x];
+                out[x] = center + ratio * (neighbours - 4 * center);
+            }
+        }
+
+        /*the source, as the scatter kernel sets it after every step*/
+        const auto source_x = static_cast<cl_long>(point_x) - region.halo_x0;
+        const auto source_y = static_cast<cl_long>(point_y) - region.halo_y0;
+        if (source_x >= static_cast<cl_long>(x_begin) && source_x < static_cast<cl_long>(x_end) && source_y >= static_cast<cl_long>(y_begin) &&
+            source_y < static_cast<cl_long>(y_end))
+            output[static_cast<size_t>(source_y) * local_width + static_cast<size_t>(source_x)] = point_temperature;
+    }
+}
+
+/*the slot of the lowest tile in the given state, so tiles leave in about the order they came*/
+static out_of_core_slot* find_slot(out_of_core_plate* plate, const out_of_core_slot_state state)
+{
+    out_of_core_slot* found = nullptr;
+    for (auto& slot : plate->slots)
+    {
+        if (slot.state == state && (nullptr == found || slot.tile < found->tile))
+            found = &slot;
+    }
+    return found;
+}
+
+/*
+ * One pass of steps <= halo steps over the whole plate. The loader copies tiles from the current field into free slots
+ * in row order, CPU_THREAD_COUNT threads step the loaded slots and the writer copies the stepped tiles into the other
+ * field, all three at once. The current field is only switched once every tile is written.
+ */
+void step_out_of_core(out_of_core_plate* plate, const cl_float air_temperature, const cl_int point_x, const cl_int point_y, const cl_float point_temperature,
+    const cl_float ratio, const cl_uint steps)
+{
+    auto& header = plate_header(*plate);
+    const auto* input = plate_field(*plate, header.current);
+    auto* output = plate_field(*plate, header.current ^ 1);
+    const auto width = static_cast<size_t>(plate->width);
+    const auto tile_count = static_cast<size_t>(plate->tile_columns) * plate->tile_rows;
+    plate->claimed = 0;
+    plate->written = 0;
+    plate->load_seconds = 0.0;
+    plate->step_seconds = 0.0;
+    plate->write_seconds = 0.0;
+
+    std::thread loader([&]()
+    {
+        auto busy = 0.0;
+        for (size_t tile = 0; tile < tile_count; tile++)
+        {
+            std::unique_lock<std::mutex> guard(plate->lock);
+            out_of_core_slot* slot = nullptr;
+            plate->wake.wait(guard, [&]() { return nullptr != (slot = find_slot(plate, OUT_OF_CORE_FREE)); });
+            slot->state = OUT_OF_CORE_LOADING;
+            slot->tile = tile;
+            guard.unlock();
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto region = tile_bounds(*plate, tile);
+            const auto local_width = region.halo_x1 - region.halo_x0;
+            for (auto y = region.halo_y0; y < region.halo_y1; y++)
+                memcpy(slot->cells[0].data() + static_cast<size_t>(y - region.halo_y0) * local_width, input + y * width + region.halo_x0, sizeof(cl_float) * local_width);
+            busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            guard.lock();
+            slot->state = OUT_OF_CORE_LOADED;
+            guard.unlock();
+            plate->wake.notify_all();
+        }
+        std::lock_guard<std::mutex> guard(plate->lock);
+        plate->load_seconds = busy;
+    });
+
+    std::thread writer([&]()
+    {
+        auto busy = 0.0;
+        for (size_t k = 0; k < tile_count; k++)
+        {
+            std::unique_lock<std::mutex> guard(plate->lock);
+            out_of_core_slot* slot = nullptr;
+            plate->wake.wait(guard, [&]() { return nullptr != (slot = find_slot(plate, OUT_OF_CORE_STEPPED)); });
+            slot->state = OUT_OF_CORE_WRITING;
+            guard.unlock();
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto region = tile_bounds(*plate, slot->tile);
+            const auto local_width = region.halo_x1 - region.halo_x0;
+            const auto* result = slot->cells[steps & 1].data();
+            for (auto y = region.y0; y < region.y1; y++)
+                memcpy(output + y * width + region.x0, result + static_cast<size_t>(y - region.halo_y0) * local_width + (region.x0 - region.halo_x0),
+                    sizeof(cl_float) * (region.x1 - region.x0));
+            busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            guard.lock();
+            slot->state = OUT_OF_CORE_FREE;
+            plate->written++;
+            guard.unlock();
+            plate->wake.notify_all();
+        }
+        std::lock_guard<std::mutex> guard(plate->lock);
+        plate->write_seconds = busy;
+    });
+
+    std::thread workers[CPU_THREAD_COUNT];
+    for (auto& worker : workers)
+    {
+        worker = std::thread([&]()
+        {
+            const std::vector<cl_float> air_row(plate->tile_size + 2 * plate->halo, air_temperature);
+            auto busy = 0.0;
+            for (;;)
+            {
+                std::unique_lock<std::mutex> guard(plate->lock);
+                out_of_core_slot* slot = nullptr;
+                plate->wake.wait(guard, [&]() { return tile_count == plate->claimed || nullptr != (slot = find_slot(plate, OUT_OF_CORE_LOADED)); });
+                if (nullptr == slot)
+                    break;
+                slot->state = OUT_OF_CORE_STEPPING;
+                plate->claimed++;
+                guard.unlock();
+
+                const auto start = std::chrono::steady_clock::now();
+                step_tile(*plate, tile_bounds(*plate, slot->tile), *slot, air_row.data(), air_temperature, point_x, point_y, point_temperature, ratio, steps);
+                busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                guard.lock();
+                slot->state = OUT_OF_CORE_STEPPED;
+                guard.unlock();
+                plate->wake.notify_all();
+            }
+            std::lock_guard<std::mutex> guard(plate->lock);
+            plate->step_seconds += busy;
+        });
+    }
+
+    loader.join();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    writer.join();
+
+    header.current ^= 1;
+    header.steps += steps;
+}
+
+/*one step of the whole plate in memory, the reference the passes are checked and timed against*/
+void step_in_core(const cl_float* input, cl_float* output, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_int point_x,
+    const cl_int point_y, const cl_float point_temperature, const cl_float ratio)
+{
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto y = begin; y < end; y++)
+        {
+            const auto* row = input + y * width;
+            for (size_t x = 0; x < width; x++)
+            {
+                const auto center = row[x];
+                const auto neighbours = (x > 0 ? row[x - 1] : air_temperature) + (x + 1 < width ? row[x + 1] : air_temperature) +
+                    (y > 0 ? row[x - width] : air_temperature) + (y + 1 < height ? row[x + width] : air_temperature);
+                output[y * width + x] = center + ratio * (neighbours - 4 * center);
+            }
+        }
+    });
+    if (point_x >= 0 && point_y >= 0 && static_cast<cl_uint>(point_x) < width && static_cast<cl_uint>(point_y) < height)
+        output[static_cast<size_t>(point_y) * width + point_x] = point_temperature;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <CL/cl.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#define OUT_OF_CORE_MAGIC 0x45524F43
+#define OUT_OF_CORE_VERSION 1
+/*the fields start on a page boundary after the header*/
+#define OUT_OF_CORE_ALIGNMENT 4096
+
+/*what the plate file starts with; two fields follow, current is the one of step steps*/
+struct out_of_core_header
+{
+    cl_uint          magic;
+    cl_uint          version;
+    cl_uint          width;
+    cl_uint          height;
+    cl_uint          current;
+    cl_uint          reserved;
+    cl_ulong         steps;
+};
+
+enum out_of_core_slot_state
+{
+    OUT_OF_CORE_FREE,
+    OUT_OF_CORE_LOADING,
+    OUT_OF_CORE_LOADED,
+    OUT_OF_CORE_STEPPING,
+    OUT_OF_CORE_STEPPED,
+    OUT_OF_CORE_WRITING
+};
+
+/*one tile and its halo, stepped back and forth between the two buffers*/
+struct out_of_core_slot
+{
+    out_of_core_slot_state state;
+    size_t           tile;
+    std::vector<cl_float> cells[2];
+};
+
+/*
+ * A plate that lives in a memory-mapped file. A pass cuts the current field into tiles of tile_size cells, loads each
+ * with halo more cells on every side into a slot, steps it up to halo times on its own and writes the tile back into
+ * the other field; the cells a tile needs from its neighbours are all in its halo. The slots are the whole working
+ * set: the loader only fills a free slot and the writer frees the slots it has written, so however large the plate,
+ * the memory of the run stays bounded and the page cache holds the rest.
+ */
+struct out_of_core_plate
+{
+    void*            file;
+    void*            mapping;
+    unsigned char*   view;
+    cl_ulong         field_bytes;
+    cl_uint          width;
+    cl_uint          height;
+    cl_uint          tile_size;
+    cl_uint          halo;
+    cl_uint          tile_columns;
+    cl_uint          tile_rows;
+
+    std::mutex       lock;
+    std::condition_variable wake;
+    std::vector<out_of_core_slot> slots;
+    size_t           claimed;
+    size_t           written;
+    /*seconds the loader, the stepping threads together and the writer were busy in the last pass*/
+    double           load_seconds;
+    double           step_seconds;
+    double           write_seconds;
+};
+
+int open_out_of_core_plate(out_of_core_plate* plate, const char* file_name, cl_uint width, cl_uint height, cl_float initial_temperature, cl_uint tile_size,
+    cl_uint halo, cl_uint slot_count);
+void close_out_of_core_plate(out_of_core_plate* plate);
+const out_of_core_header& out_of_core_state(const out_of_core_plate& plate);
+const cl_float* out_of_core_field(const out_of_core_plate& plate);
+void step_out_of_core(out_of_core_plate* plate, cl_float air_temperature, cl_int point_x, cl_int point_y, cl_float point_temperature, cl_float ratio, cl_uint steps);
+void step_in_core(const cl_float* input, cl_float* output, cl_uint width, cl_uint height, cl_float air_temperature, cl_int point_x, cl_int point_y,
+    cl_float point_temperature, cl_float ratio);
@@ -0,0 +1,106 @@
+#include "parallel.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+ * The workers wait for the next generation of a job, run their range of it and count themselves off. One job runs at a
+ * time: dispatch is held by the caller for the whole job, so callers on other threads queue up behind it.
+ */
+struct worker_pool
+{
+    worker_pool();
+    ~worker_pool();
+
+    std::mutex       dispatch;
+    std::mutex       lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void             (*job)(void* context, int range);
+    void*            context;
+    cl_ulong         generation;
+    int              pending;
+    bool             stopping;
+    std::thread      threads[CPU_THREAD_COUNT - 1];
+};
+
+/*set on the workers and on a caller while its job runs, a nested call then cannot wait for itself*/
+static thread_local bool in_parallel_job = false;
+
+static void pool_worker(worker_pool* pool, const int range)
+{
+    in_parallel_job = true;
+    cl_ulong seen = 0;
+    for (;;)
+    {
+        void (*job)(void*, int);
+        void* context;
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->wake.wait(guard, [&]() { return pool->stopping || pool->generation != seen; });
+            if (pool->stopping)
+                return;
+            seen = pool->generation;
+            job = pool->job;
+            context = pool->context;
+        }
+
+        job(context, range);
+
+        std::lock_guard<std::mutex> guard(pool->lock);
+        if (0 == --pool->pending)
+            pool->done.notify_one();
+    }
+}
+
+worker_pool::worker_pool() :
+    job(nullptr),
+    context(nullptr),
+    generation(0),
+    pending(0),
+    stopping(false)
+{
+    for (auto t = 0; t < CPU_THREAD_COUNT - 1; t++)
+        threads[t] = std::thread(pool_worker, this, t);
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void run_parallel_ranges(void (*job)(void* context, int range), void* context)
+{
+    if (in_parallel_job)
+    {
+        for (auto range = 0; range < CPU_THREAD_COUNT; range++)
+            job(context, range);
+        return;
+    }
+
+    /*started on the first job*/
+    static worker_pool pool;
+    std::lock_guard<std::mutex> queued(pool.dispatch);
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.job = job;
+        pool.context = context;
+        pool.pending = CPU_THREAD_COUNT - 1;
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+
+    in_parallel_job = true;
+    job(context, CPU_THREAD_COUNT - 1);
+    in_parallel_job = false;
+
+    std::unique_lock<std::mutex> guard(pool.lock);
+    pool.done.wait(guard, [&]() { return 0 == pool.pending; });
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+
+#include "utils.h"
+
+/*
+ * runs job(context, range) for every range in [0, CPU_THREAD_COUNT), range CPU_THREAD_COUNT - 1 on the calling thread and
+ * the others on threads started once and kept for the whole run; a call made from inside a job runs its ranges in turn
+ */
+void run_parallel_ranges(void (*job)(void* context, int range), void* context);
+
+/*splits [0, count) into CPU_THREAD_COUNT contiguous ranges and runs body(range, begin, end) on each*/
+template <typename Body>
+void parallel_ranges(const size_t count, const Body& body)
+{
+    auto range_job = [&body, count](const int range) { body(range, count * range / CPU_THREAD_COUNT, count * (range + 1) / CPU_THREAD_COUNT); };
+    run_parallel_ranges([](void* context, const int range) { (*static_cast<decltype(range_job)*>(context))(range); }, &range_job);
+}
+
+template <typename Body>
+void parallel_for(const size_t count, const Body& body)
+{
+    parallel_ranges(count, [&body](int, const size_t begin, const size_t end) { body(begin, end); });
+}
+
+/*body(task) for every task in [0, count); the threads take the next task from a shared counter, so tasks of uneven cost balance out*/
+template <typename Body>
+void parallel_tasks(const size_t count, const Body& body)
+{
+    std::atomic<size_t> next(0);
+    parallel_ranges(CPU_THREAD_COUNT, [&](int, size_t, size_t)
+    {
+        for (auto task = next++; task < count; task = next++)
+            body(task);
+    });
+}
+
+/*every range returns a partial value, the partials are folded in range order so the result does not depend on timing*/
+template <typename T, typename Body, typename Combine>
+T parallel_reduce(const size_t count, const T identity, const Body& body, const Combine& combine)
+{
+    T partials[CPU_THREAD_COUNT];
+    parallel_ranges(count, [&](const int range, const size_t begin, const size_t end) { partials[range] = body(begin, end); });
+
+    auto result = identity;
+    for (const auto& partial : partials)
+    {
+        result = combine(result, partial);
+    }
+    return result;
+}
@@ -0,0 +1,405 @@
+#include "pcg.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+
+#include "ocl_args.h"
+#include "parallel.h"
+
+/*
+ * Matrix-free preconditioned conjugate gradient for the symmetric systems of linear_system.h. An iteration is two passes
+ * over the plate: the next search direction fused with its product by A and their dot product, then the update of x and
+ * of the residual fused with the Jacobi step, r . z and the residual norm. The red-black incomplete Cholesky factor of A
+ * adds one pass per color, so both triangular solves stay parallel. The source row is the identity: x starts at the
+ * source temperature there and the residual, z and the directions stay zero on it.
+ */
+
+struct pcg_sums
+{
+    cl_float         dot;
+    cl_float         maximum;
+};
+
+static pcg_sums combine_sums(const pcg_sums& a, const pcg_sums& b)
+{
+    return { a.dot + b.dot, std::max(a.maximum, b.maximum) };
+}
+
+static cl_float horizontal_sum(const __m128 value)
+{
+    alignas(16) cl_float lanes[4];
+    _mm_store_ps(lanes, value);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static cl_float horizontal_max(const __m128 value)
+{
+    alignas(16) cl_float lanes[4];
+    _mm_store_ps(lanes, value);
+    return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+}
+
+static bool source_on_plate(const linear_system& system)
+{
+    return system.source_x >= 0 && system.source_y >= 0 && static_cast<cl_uint>(system.source_x) < system.width && static_cast<cl_uint>(system.source_y) < system.height;
+}
+
+static void setup_pcg_vectors(pcg_vectors& vectors, const cl_uint width, const cl_uint height)
+{
+    const auto count = static_cast<size_t>(width) * height;
+    for (auto* vector : { &vectors.residual, &vectors.preconditioned, &vectors.direction, &vectors.next_direction, &vectors.product })
+        vector->resize(count);
+    vectors.zero.assign(width, 0.0F);
+}
+
+/*
+ * One row of next_direction = z + beta * direction and product = A next_direction, returns the row's part of next_direction . product.
+ * The border cells go through cell_diagonal, the inner ones share the diagonal of the row and run 4 at a time.
+ */
+static cl_float direction_row(const linear_system& system, pcg_vectors& vectors, const cl_float beta, const cl_uint row)
+{
+    const auto width = system.width;
+    const auto offset = static_cast<size_t>(row) * width;
+    const auto* z = vectors.preconditioned.data() + offset;
+    const auto* direction = vectors.direction.data() + offset;
+    const auto* z_north = row > 0 ? z - width : vectors.zero.data();
+    const auto* direction_north = row > 0 ? direction - width : vectors.zero.data();
+    const auto* z_south = row + 1 < system.height ? z + width : vectors.zero.data();
+    const auto* direction_south = row + 1 < system.height ? direction + width : vectors.zero.data();
+    auto* next_direction = vectors.next_direction.data() + offset;
+    auto* product = vectors.product.data() + offset;
+
+    const auto cell = [&](const cl_uint col)
+    {
+        const auto p = z[col] + beta * direction[col];
+        const auto sum = (col > 0 ? z[col - 1] + beta * direction[col - 1] : 0.0F) + (col + 1 < width ? z[col + 1] + beta * direction[col + 1] : 0.0F) +
+            (z_north[col] + beta * direction_north[col]) + (z_south[col] + beta * direction_south[col]);
+        const auto q = cell_diagonal(system, col, row) * p - system.neighbour * sum;
+        next_direction[col] = p;
+        product[col] = q;
+        return p * q;
+    };
+
+    auto dot = cell(0);
+    cl_uint col = 1;
+    const auto beta4 = _mm_set1_ps(beta);
+    const auto diagonal4 = _mm_set1_ps(cell_diagonal(system, 1, row));
+    const auto neighbour4 = _mm_set1_ps(system.neighbour);
+    auto dot4 = _mm_setzero_ps();
+    for (; col + 4 < width; col += 4)
+    {
+        const auto p = _mm_add_ps(_mm_loadu_ps(z + col), _mm_mul_ps(beta4, _mm_loadu_ps(direction + col)));
+        const auto west = _mm_add_ps(_mm_loadu_ps(z + col - 1), _mm_mul_ps(beta4, _mm_loadu_ps(direction + col - 1)));
+        const auto east = _mm_add_ps(_mm_loadu_ps(z + col + 1), _mm_mul_ps(beta4, _mm_loadu_ps(direction + col + 1)));
+        const auto north = _mm_add_ps(_mm_loadu_ps(z_north + col), _mm_mul_ps(beta4, _mm_loadu_ps(direction_north + col)));
+        const auto south = _mm_add_ps(_mm_loadu_ps(z_south + col), _mm_mul_ps(beta4, _mm_loadu_ps(direction_south + col)));
+        const auto sum = _mm_add_ps(_mm_add_ps(west, east), _mm_add_ps(north, south));
+        const auto q = _mm_sub_ps(_mm_mul_ps(diagonal4, p), _mm_mul_ps(neighbour4, sum));
+        _mm_storeu_ps(next_direction + col, p);
+        _mm_storeu_ps(product + col, q);
+        dot4 = _mm_add_ps(dot4, _mm_mul_ps(p, q));
+    }
+    dot += horizontal_sum(dot4);
+    for (; col < width; col++)
+        dot += cell(col);
+
+    if (static_cast<cl_int>(row) == system.source_y && source_on_plate(system))
+        product[system.source_x] = 0.0F;
+    return dot;
+}
+
+/*one row of x += alpha * direction, residual -= alpha * product, z = residual / diagonal, returns the row's r . z and max |z|*/
+static pcg_sums update_row(const linear_system& system, pcg_vectors& vectors, cl_float* x, const cl_float alpha, const cl_uint row)
+{
+    const auto offset = static_cast<size_t>(row) * system.width;
+    x += offset;
+    auto* residual = vectors.residual.data() + offset;
+    auto* z = vectors.preconditioned.data() + offset;
+    const auto* direction = vectors.direction.data() + offset;
+    const auto* product = vectors.product.data() + offset;
+
+    pcg_sums sums = { 0.0F, 0.0F };
+    const auto cell = [&](const cl_uint col)
+    {
+        const auto r = residual[col] - alpha * product[col];
+        const auto preconditioned = r / cell_diagonal(system, col, row);
+        x[col] += alpha * direction[col];
+        residual[col] = r;
+        z[col] = preconditioned;
+        sums.dot += r * preconditioned;
+        sums.maximum = std::max(sums.maximum, std::fabs(preconditioned));
+    };
+
+    cell(0);
+    cl_uint col = 1;
+    const auto alpha4 = _mm_set1_ps(alpha);
+    const auto diagonal4 = _mm_set1_ps(cell_diagonal(system, 1, row));
+    const auto sign4 = _mm_set1_ps(-0.0F);
+    auto dot4 = _mm_setzero_ps();
+    auto maximum4 = _mm_setzero_ps();
+    for (; col + 4 < system.width; col += 4)
+    {
+        const auto r = _mm_sub_ps(_mm_loadu_ps(residual + col), _mm_mul_ps(alpha4, _mm_loadu_ps(product + col)));
+        const auto preconditioned = _mm_div_ps(r, diagonal4);
+        _mm_storeu_ps(x + col, _mm_add_ps(_mm_loadu_ps(x + col), _mm_mul_ps(alpha4, _mm_loadu_ps(direction + col))));
+        _mm_storeu_ps(residual + col, r);
+        _mm_storeu_ps(z + col, preconditioned);
+        dot4 = _mm_add_ps(dot4, _mm_mul_ps(r, preconditioned));
+        maximum4 = _mm_max_ps(maximum4, _mm_andnot_ps(sign4, preconditioned));
+    }
+    sums.dot += horizontal_sum(dot4);
+    sums.maximum = std::max(sums.maximum, horizontal_max(maximum4));
+    for (; col < system.width; col++)
+        cell(col);
+    return sums;
+}
+
+static cl_float direction_pass(const linear_system& system, pcg_vectors& vectors, const cl_float beta)
+{
+    return parallel_reduce(system.height, 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto dot = 0.0F;
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+            dot += direction_row(system, vectors, beta, row);
+        return dot;
+    }, [](const cl_float a, const cl_float b) { return a + b; });
+}
+
+static pcg_sums update_pass(const linear_system& system, pcg_vectors& vectors, cl_float* x, const cl_float alpha)
+{
+    return parallel_reduce(system.height, pcg_sums{ 0.0F, 0.0F }, [&](const size_t begin, const size_t end)
+    {
+        pcg_sums sums = { 0.0F, 0.0F };
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+            sums = combine_sums(sums, update_row(system, vectors, x, alpha, row));
+        return sums;
+    }, combine_sums);
+}
+
+/*
+ * Red-black incomplete Cholesky: the red cells only couple to black ones, so with the red cells first the factor keeps the
+ * red diagonal and the black pivots lose the fill-in of their red neighbours. z holds residual / diagonal from update_pass,
+ * which is already the forward substitution of the red cells. Returns the new r . z.
+ */
+static cl_float incomplete_cholesky_pass(const linear_system& system, pcg_vectors& vectors)
+{
+    const auto* residual = vectors.residual.data();
+    auto* z = vectors.preconditioned.data();
+
+    parallel_for(system.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (auto col = (row + 1) & 1; col < system.width; col += 2)
+            {
+                if (is_source(system, col, row))
+                    continue;
+
+                auto sum = 0.0F;
+                auto pivot = cell_diagonal(system, col, row);
+                const auto red_neighbour = [&](const cl_uint neighbour_col, const cl_uint neighbour_row)
+                {
+                    if (is_source(system, neighbour_col, neighbour_row))
+                        return;
+                    sum += z[static_cast<size_t>(neighbour_row) * system.width + neighbour_col];
+                    pivot -= system.neighbour * system.neighbour / cell_diagonal(system, neighbour_col, neighbour_row);
+                };
+                if (col > 0) red_neighbour(col - 1, row);
+                if (col + 1 < system.width) red_neighbour(col + 1, row);
+                if (row > 0) red_neighbour(col, row - 1);
+                if (row + 1 < system.height) red_neighbour(col, row + 1);
+
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                z[i] = (residual[i] + system.neighbour * sum) / pivot;
+            }
+        }
+    });
+
+    return parallel_reduce(system.height, 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto dot = 0.0F;
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < system.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * system.width + col;
+                if (0 == ((col + row) & 1) && !is_source(system, col, row))
+                {
+                    auto sum = 0.0F;
+                    if (col > 0) sum += z[i - 1];
+                    if (col + 1 < system.width) sum += z[i + 1];
+                    if (row > 0) sum += z[i - system.width];
+                    if (row + 1 < system.height) sum += z[i + system.width];
+                    z[i] += system.neighbour * sum / cell_diagonal(system, col, row);
+                }
+                dot += residual[i] * z[i];
+            }
+        }
+        return dot;
+    }, [](const cl_float a, const cl_float b) { return a + b; });
+}
+
+static pcg_sums precondition(const linear_system& system, pcg_vectors& vectors, cl_float* x, const cl_float alpha, const cl_uint preconditioner)
+{
+    auto sums = update_pass(system, vectors, x, alpha);
+    if (PRECONDITIONER_IC == preconditioner)
+        sums.dot = incomplete_cholesky_pass(system, vectors);
+    return sums;
+}
+
+/*the residual is the max norm of (b - A x) / diagonal like residual_norm, taken from the recurrence instead of a separate pass*/
+linear_stats solve_pcg(const linear_system& system, const cl_float* rhs, cl_float* x, const cl_uint preconditioner, const cl_float tolerance, const cl_uint max_iterations,
+    pcg_vectors& vectors)
+{
+    setup_pcg_vectors(vectors, system.width, system.height);
+    if (source_on_plate(system))
+    {
+        const auto source = static_cast<size_t>(system.source_y) * system.width + system.source_x;
+        x[source] = rhs[source];
+    }
+    compute_residual(system, rhs, x, vectors.residual.data());
+    std::fill(vectors.direction.begin(), vectors.direction.end(), 0.0F);
+
+    auto sums = precondition(system, vectors, x, 0.0F, preconditioner);
+    linear_stats stats = { 0, sums.maximum };
+    auto beta = 0.0F;
+    while (stats.residual > tolerance && stats.iterations < max_iterations)
+    {
+        const auto curvature = direction_pass(system, vectors, beta);
+        std::swap(vectors.direction, vectors.next_direction);
+        if (curvature <= 0.0F)
+            break;
+
+        const auto last_dot = sums.dot;
+        sums = precondition(system, vectors, x, last_dot / curvature, preconditioner);
+        stats.iterations++;
+        stats.residual = sums.maximum;
+        beta = sums.dot / last_dot;
+    }
+    return stats;
+}
+
+static linear_system steady_system(const plate_problem& problem)
+{
+    return { problem.width, problem.height, 4.0F, 1.0F, problem.point_x, problem.point_y, {} };
+}
+
+int pcg_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output)
+{
+    const auto system = steady_system(problem);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    solver->rhs.assign(count, 0.0F);
+    add_boundary_terms(system, problem.air_temperature, problem.point_temperature, solver->rhs.data());
+    std::copy(input, input + count, output);
+
+    const auto stats = solve_pcg(system, solver->rhs.data(), output, solver->settings.preconditioner, solver->settings.tolerance, solver->settings.max_iterations, solver_module(solver->pcg));
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+    return CL_SUCCESS;
+}
+
+static int setup_device_pcg(ocl_args_d_t* ocl, ocl_solver_t* device)
+{
+    if (nullptr != device->pcg.residual)
+        return CL_SUCCESS;
+
+    const auto size = sizeof(cl_float) * device->width * device->height;
+    for (auto* buffer : { &device->pcg.residual, &device->pcg.preconditioned, &device->pcg.direction, &device->pcg.next_direction, &device->pcg.product })
+    {
+        *buffer = create_solver_buffer(ocl, size);
+        if (nullptr == *buffer)
+            return -1;
+    }
+    return CL_SUCCESS;
+}
+
+static int device_direction(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, const cl_float beta, cl_float* curvature)
+{
+    auto& pcg = device->pcg;
+    cl_float maximum;
+    if (CL_SUCCESS != set_kernel_args(device->pcg_direction, 0, pcg.preconditioned, pcg.direction, pcg.next_direction, pcg.product, system.width, system.height,
+        system.diagonal, system.neighbour, system.source_x, system.source_y, system.edge, beta, device->partial, local_arg{ 2 * sizeof(cl_float) * device->group_size }) ||
+        CL_SUCCESS != reduce_sum_max_kernel(ocl, device, device->pcg_direction, curvature, &maximum))
+        return -1;
+    std::swap(pcg.direction, pcg.next_direction);
+    return CL_SUCCESS;
+}
+
+/*with incomplete Cholesky the partials of pcg_update stay on the device, ic_red leaves both sums*/
+static int device_precondition(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, cl_mem x, const cl_float alpha, const cl_uint preconditioner, pcg_sums* sums)
+{
+    auto& pcg = device->pcg;
+    const local_arg scratch = { 2 * sizeof(cl_float) * device->group_size };
+    if (CL_SUCCESS != set_kernel_args(device->pcg_update, 0, x, pcg.residual, pcg.preconditioned, pcg.direction, pcg.product, system.width, system.height,
+        system.diagonal, system.edge, alpha, device->partial, scratch))
+        return -1;
+    if (PRECONDITIONER_IC != preconditioner)
+        return reduce_sum_max_kernel(ocl, device, device->pcg_update, &sums->dot, &sums->maximum);
+
+    const size_t black_work_size[] = { (system.width + 1) / 2, system.height };
+    if (CL_SUCCESS != run_group_kernel(ocl, device, device->pcg_update) ||
+        CL_SUCCESS != set_kernel_args(device->ic_black, 0, pcg.residual, pcg.preconditioned, system.width, system.height, system.diagonal, system.neighbour,
+            system.source_x, system.source_y, system.edge) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->ic_black, 2, black_work_size, nullptr) ||
+        CL_SUCCESS != set_kernel_args(device->ic_red, 0, pcg.residual, pcg.preconditioned, system.width, system.height, system.diagonal, system.neighbour,
+            system.source_x, system.source_y, system.edge, device->partial, scratch))
+        return -1;
+    return reduce_sum_max_kernel(ocl, device, device->ic_red, &sums->dot, &sums->maximum);
+}
+
+/*same iteration on the device, every vector stays there and each iteration reads back two or three pairs of partial sums*/
+int device_solve_pcg(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, cl_mem rhs, cl_mem x, const cl_uint preconditioner, const cl_float tolerance,
+    const cl_uint max_iterations, linear_stats* stats)
+{
+    if (CL_SUCCESS != setup_device_pcg(ocl, device))
+        return -1;
+    if (source_on_plate(system) &&
+        CL_SUCCESS != copy_solver_buffer(ocl, rhs, x, static_cast<size_t>(system.source_y) * system.width + system.source_x, 1))
+        return -1;
+    if (CL_SUCCESS != device_residual_field(ocl, device, system, rhs, x, device->pcg.residual) ||
+        CL_SUCCESS != fill_solver_buffer(ocl, device->pcg.direction, 0.0F, static_cast<size_t>(system.width) * system.height))
+        return -1;
+
+    pcg_sums sums;
+    if (CL_SUCCESS != device_precondition(ocl, device, system, x, 0.0F, preconditioner, &sums))
+        return -1;
+
+    *stats = { 0, sums.maximum };
+    auto beta = 0.0F;
+    while (stats->residual > tolerance && stats->iterations < max_iterations)
+    {
+        cl_float curvature;
+        if (CL_SUCCESS != device_direction(ocl, device, system, beta, &curvature))
+            return -1;
+        if (curvature <= 0.0F)
+            break;
+
+        const auto last_dot = sums.dot;
+        if (CL_SUCCESS != device_precondition(ocl, device, system, x, last_dot / curvature, preconditioner, &sums))
+            return -1;
+        stats->iterations++;
+        stats->residual = sums.maximum;
+        beta = sums.dot / last_dot;
+    }
+    return CL_SUCCESS;
+}
+
+int pcg_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem)
+{
+    auto* device = &solver->device;
+    const auto system = steady_system(problem);
+
+    linear_stats stats;
+    if (CL_SUCCESS != load_solver_field(ocl, device) ||
+        CL_SUCCESS != fill_solver_buffer(ocl, device->rhs, 0.0F, static_cast<size_t>(problem.width) * problem.height) ||
+        CL_SUCCESS != device_boundary_terms(ocl, device, system, device->rhs, problem.air_temperature, problem.point_temperature) ||
+        CL_SUCCESS != device_solve_pcg(ocl, device, system, device->rhs, device->field, solver->settings.preconditioner, solver->settings.tolerance,
+            solver->settings.max_iterations, &stats))
+        return -1;
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    return store_solver_field(ocl, device);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "linear_system.h"
+#include "solver.h"
+
+/*the vectors of the conjugate gradient iteration; zero is one row of zeros standing for the cells beyond the plate*/
+struct pcg_vectors
+{
+    std::vector<cl_float> residual;
+    std::vector<cl_float> preconditioned;
+    std::vector<cl_float> direction;
+    std::vector<cl_float> next_direction;
+    std::vector<cl_float> product;
+    std::vector<cl_float> zero;
+};
+
+linear_stats solve_pcg(const linear_system& system, const cl_float* rhs, cl_float* x, cl_uint preconditioner, cl_float tolerance, cl_uint max_iterations, pcg_vectors& vectors);
+int device_solve_pcg(ocl_args_d_t* ocl, ocl_solver_t* device, const linear_system& system, cl_mem rhs, cl_mem x, cl_uint preconditioner, cl_float tolerance, cl_uint max_iterations,
+    linear_stats* stats);
+int pcg_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output);
+int pcg_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem);
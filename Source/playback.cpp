@@ -0,0 +1,229 @@
+#include "playback.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+#include "log_utils.h"
+#include "ocl_memory.h"
+#include "utils.h"
+
+/*
+ * Frames are decoded by background workers into a small cache of slots, ahead of the playhead in the
+ * direction of play. The render loop never waits for a decode: if the frame under the playhead isn't
+ * ready yet (fast scrubbing) the previous one simply stays on screen. Only the pyramid level that fits
+ * the display is decoded.
+ */
+
+static cl_long current_frame(const playback_state* playback)
+{
+    return static_cast<cl_long>(std::floor(playback->position));
+}
+
+static bool cached(const playback_state* playback, const cl_long frame)
+{
+    for (const auto& slot : playback->slots)
+    {
+        if (slot.frame == frame && (slot.ready || slot.loading))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * first frame the playhead will land on, in the direction of play, that isn't cached yet. Playing faster than a frame
+ * per display frame skips frames, so the lookahead takes the frames of the next display frames, as far apart as the
+ * playhead moves per display frame; it is half the cache, the rest keeps the frames just passed for scrubbing back.
+ */
+static cl_long next_missing_frame(const playback_state* playback)
+{
+    const auto direction = playback->speed < 0.0F ? -1.0 : 1.0;
+    const auto frame_count = static_cast<cl_long>(playback->archive.frame_count);
+    const auto stride = playback->playing ? std::max(1.0, std::fabs(playback->speed) * playback->frame_seconds) : 1.0;
+
+    for (cl_long k = 0; k < PLAYBACK_CACHE_SIZE / 2; k++)
+    {
+        const auto frame = static_cast<cl_long>(std::floor(playback->position + direction * stride * k));
+        if (frame < 0 || frame >= frame_count)
+            break;
+        if (!cached(playback, frame))
+            return frame;
+    }
+    return -1;
+}
+
+/*evicts the frame farthest from the playhead, as long as it is farther than the frame to load*/
+static playback_slot* choose_slot(playback_state* playback, const cl_long frame)
+{
+    const auto current = current_frame(playback);
+    playback_slot* victim = nullptr;
+    auto victim_distance = std::llabs(frame - current);
+
+    for (auto& slot : playback->slots)
+    {
+        if (slot.loading || slot.pinned)
+            continue;
+        if (slot.frame < 0)
+            return &slot;
+
+        const auto distance = std::llabs(slot.frame - current);
+        if (distance > victim_distance)
+        {
+            victim = &slot;
+            victim_distance = distance;
+        }
+    }
+    return victim;
+}
+
+static void playback_worker(playback_state* playback)
+{
+    std::unique_lock<std::mutex> guard(playback->lock);
+    while (!playback->stop)
+    {
+        const auto frame = next_missing_frame(playback);
+        auto* slot = frame < 0 ? nullptr : choose_slot(playback, frame);
+        if (nullptr == slot)
+        {
+            playback->wake.wait(guard);
+            continue;
+        }
+
+        slot->frame = frame;
+        slot->ready = false;
+        slot->loading = true;
+
+        guard.unlock();
+        const auto err = read_archive_level(&playback->archive, frame, playback->level, slot->field.data());
+        guard.lock();
+
+        slot->loading = false;
+        slot->ready = CL_SUCCESS == err;
+        if (!slot->ready)
+            slot->frame = -1;
+    }
+}
+
+int open_playback(playback_state* playback, const char* file_name, const cl_uint max_width, const cl_uint max_height)
+{
+    if (CL_SUCCESS != open_archive_reader(&playback->archive, file_name))
+        return -1;
+
+    if (0 == playback->archive.frame_count)
+    {
+        log_error("Error: archive '%s' has no frames.\n", file_name);
+        close_archive_reader(&playback->archive);
+        return -1;
+    }
+
+    playback->level = choose_archive_level(&playback->archive, max_width, max_height);
+    archive_level_size(playback->archive.width, playback->archive.height, playback->level, &playback->width, &playback->height);
+    playback->position = 0.0;
+    playback->speed = 30.0F;
+    playback->playing = true;
+    playback->frame_seconds = 0.0;
+    playback->stop = false;
+
+    const auto field_size = static_cast<size_t>(playback->width) * playback->height;
+    for (auto& slot : playback->slots)
+    {
+        slot.frame = -1;
+        slot.ready = false;
+        slot.loading = false;
+        slot.pinned = false;
+        slot.field.resize(field_size);
+    }
+
+    for (auto& worker : playback->workers)
+    {
+        worker = std::thread(playback_worker, playback);
+    }
+
+    return CL_SUCCESS;
+}
+
+void close_playback(playback_state* playback)
+{
+    {
+        std::lock_guard<std::mutex> guard(playback->lock);
+        playback->stop = true;
+    }
+    playback->wake.notify_all();
+
+    for (auto& worker : playback->workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    close_archive_reader(&playback->archive);
+}
+
+void advance_playback(playback_state* playback, const double elapsed_seconds)
+{
+    std::lock_guard<std::mutex> guard(playback->lock);
+    if (!playback->playing)
+        return;
+
+    const auto previous = current_frame(playback);
+    const auto last = static_cast<double>(playback->archive.frame_count - 1);
+    playback->frame_seconds = elapsed_seconds;
+
+    playback->position += playback->speed * elapsed_seconds;
+    if (playback->position <= 0.0 || playback->position >= last)
+    {
+        playback->position = playback->position <= 0.0 ? 0.0 : last;
+        playback->playing = false;
+    }
+
+    if (current_frame(playback) != previous)
+        playback->wake.notify_all();
+}
+
+void seek_playback(playback_state* playback, const cl_long frame)
+{
+    std::lock_guard<std::mutex> guard(playback->lock);
+    const auto last = static_cast<cl_long>(playback->archive.frame_count - 1);
+    playback->position = static_cast<double>(frame < 0 ? 0 : frame > last ? last : frame);
+    playback->wake.notify_all();
+}
+
+/*the workers read the speed and whether it plays under the lock, so the UI writes them under it too*/
+void set_playback_speed(playback_state* playback, const float speed, const bool playing)
+{
+    std::lock_guard<std::mutex> guard(playback->lock);
+    playback->speed = speed;
+    playback->playing = playing;
+    playback->wake.notify_all();
+}
+
+cl_long playback_frame(const playback_state* playback)
+{
+    return current_frame(playback);
+}
+
+bool draw_playback_frame(playback_state* playback, const cl_long frame, struct vertex_args* plate_points)
+{
+    playback_slot* source = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(playback->lock);
+        for (auto& slot : playback->slots)
+        {
+            if (slot.ready && slot.frame == frame)
+            {
+                source = &slot;
+                source->pinned = true;
+                break;
+            }
+        }
+    }
+
+    if (nullptr == source)
+        return false;
+
+    colorize_field(source->field.data(), plate_points, source->field.size());
+
+    std::lock_guard<std::mutex> guard(playback->lock);
+    source->pinned = false;
+    return true;
+}
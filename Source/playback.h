@@ -0,0 +1,51 @@
+#pragma once
+#include <CL/cl.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "archive.h"
+
+#define PLAYBACK_THREAD_COUNT 2
+#define PLAYBACK_CACHE_SIZE 8
+/*largest playback_max_width and playback_max_height*/
+#define PLAYBACK_MAX_SIZE 16384
+
+struct vertex_args;
+
+struct playback_slot
+{
+    cl_long          frame;
+    bool             ready;
+    bool             loading;
+    bool             pinned;
+    std::vector<cl_float> field;
+};
+
+struct playback_state
+{
+    archive_reader   archive;
+    cl_uint          level;
+    cl_uint          width;
+    cl_uint          height;
+    double           position;
+    float            speed;
+    bool             playing;
+    /*length of the last display frame, which sets how far the playhead moves per display frame*/
+    double           frame_seconds;
+
+    std::mutex       lock;
+    std::condition_variable wake;
+    std::thread      workers[PLAYBACK_THREAD_COUNT];
+    playback_slot    slots[PLAYBACK_CACHE_SIZE];
+    bool             stop;
+};
+
+int open_playback(playback_state* playback, const char* file_name, cl_uint max_width, cl_uint max_height);
+void close_playback(playback_state* playback);
+void advance_playback(playback_state* playback, double elapsed_seconds);
+void seek_playback(playback_state* playback, cl_long frame);
+void set_playback_speed(playback_state* playback, float speed, bool playing);
+cl_long playback_frame(const playback_state* playback);
+bool draw_playback_frame(playback_state* playback, cl_long frame, struct vertex_args* plate_points);
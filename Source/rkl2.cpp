@@ -0,0 +1,160 @@
+#include "rkl2.h"
+
+
+#include "linear_system.h"
+#include "ocl_args.h"
+#include "parallel.h"
+
+/*
+ * Runge-Kutta-Legendre super time stepping (RKL2, Meyer, Balsara and Aslam 2014). s explicit stages of the FTCS stencil,
+ * combined with the Legendre recurrence, are stable up to (s^2 + s - 2) / 4 times the explicit limit and second order
+ * accurate, so a step of time_step seconds costs about the square root of the FTCS steps it replaces.
+ * The source cell is held at the source temperature in every stage.
+ */
+
+struct rkl2_coefficients
+{
+    cl_float         mu;
+    cl_float         nu;
+    cl_float         mu_tilde;
+    cl_float         gamma_tilde;
+};
+
+/*the fewest stages whose stability limit covers the configured step*/
+cl_uint rkl2_stage_count(const heat_model& model)
+{
+    const auto explicit_steps = model.time_step / max_stable_time_step(model);
+    cl_uint stages = 2;
+    while (stages * stages + stages - 2 < 4.0F * explicit_steps)
+        stages++;
+    return stages;
+}
+
+static double legendre_b(const cl_uint j)
+{
+    return j < 3 ? 1.0 / 3.0 : (j * j + j - 2.0) / (2.0 * j * (j + 1.0));
+}
+
+/*coefficients of stage j > 1 out of stages*/
+static rkl2_coefficients stage_coefficients(const cl_uint stages, const cl_uint j)
+{
+    const auto w1 = 4.0 / (stages * stages + stages - 2.0);
+    const auto mu = (2.0 * j - 1.0) / j * legendre_b(j) / legendre_b(j - 1);
+    const auto nu = -(j - 1.0) / j * legendre_b(j) / legendre_b(j - 2);
+    return { static_cast<cl_float>(mu), static_cast<cl_float>(nu), static_cast<cl_float>(mu * w1), static_cast<cl_float>(-(1.0 - legendre_b(j - 1)) * mu * w1) };
+}
+
+static cl_float first_stage_mu_tilde(const cl_uint stages)
+{
+    return static_cast<cl_float>(4.0 / (3.0 * (stages * stages + stages - 2.0)));
+}
+
+static cl_float laplacian(const cl_float* field, const cl_uint col, const cl_uint row, const cl_uint width, const cl_uint height, const cl_float air_temperature)
+{
+    return neighbour_sum(field, col, row, width, height, air_temperature) - 4.0F * field[static_cast<size_t>(row) * width + col];
+}
+
+/*stages are reported as the iterations of the step*/
+int rkl2_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    const auto stages = rkl2_stage_count(model);
+    const auto ratio = diffusion_ratio(model, model.time_step);
+    const auto count = static_cast<size_t>(problem.width) * problem.height;
+    const linear_system source = { problem.width, problem.height, 0.0F, 0.0F, problem.point_x, problem.point_y, {} };
+    solver->rhs.resize(count);
+    for (auto& stage : solver->stages)
+        stage.resize(count);
+    auto* m0 = solver->rhs.data();
+
+    const auto mu_tilde = first_stage_mu_tilde(stages);
+    auto* first = solver->stages[0].data();
+    parallel_for(problem.height, [&](const size_t begin, const size_t end)
+    {
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (cl_uint col = 0; col < problem.width; col++)
+            {
+                const auto i = static_cast<size_t>(row) * problem.width + col;
+                m0[i] = is_source(source, col, row) ? 0.0F : ratio * laplacian(input, col, row, problem.width, problem.height, problem.air_temperature);
+                first[i] = is_source(source, col, row) ? problem.point_temperature : input[i] + mu_tilde * m0[i];
+            }
+        }
+    });
+
+    /*stage j lives in stages[(j - 1) % 3], where stage j - 3 was; the last one goes straight to the output*/
+    const cl_float* before = input;
+    const cl_float* previous = first;
+    for (cl_uint j = 2; j <= stages; j++)
+    {
+        const auto c = stage_coefficients(stages, j);
+        auto* next = j == stages ? output : solver->stages[(j - 1) % 3].data();
+        parallel_for(problem.height, [&](const size_t begin, const size_t end)
+        {
+            for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+            {
+                for (cl_uint col = 0; col < problem.width; col++)
+                {
+                    const auto i = static_cast<size_t>(row) * problem.width + col;
+                    next[i] = is_source(source, col, row) ? problem.point_temperature :
+                        c.mu * previous[i] + c.nu * before[i] + (1.0F - c.mu - c.nu) * input[i] +
+                        c.mu_tilde * ratio * laplacian(previous, col, row, problem.width, problem.height, problem.air_temperature) + c.gamma_tilde * m0[i];
+                }
+            }
+        });
+        before = previous;
+        previous = next;
+    }
+
+    solver->iterations = stages;
+    solver->residual = 0.0F;
+    return CL_SUCCESS;
+}
+
+static int setup_device_stages(ocl_args_d_t* ocl, ocl_solver_t* device)
+{
+    for (auto*& stage : device->stages)
+    {
+        if (nullptr == stage)
+        {
+            stage = create_solver_buffer(ocl, sizeof(cl_float) * device->width * device->height);
+            if (nullptr == stage)
+                return -1;
+        }
+    }
+    return CL_SUCCESS;
+}
+
+/*same stages on the device, one kernel each; the last stage overwrites y0, which every work item only reads at its own cell*/
+int rkl2_step_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem, const heat_model& model)
+{
+    auto& device = solver->device;
+    const auto stages = rkl2_stage_count(model);
+    const auto ratio = diffusion_ratio(model, model.time_step);
+    const size_t global_work_size[] = { problem.width, problem.height };
+
+    if (CL_SUCCESS != setup_device_stages(ocl, &device) || CL_SUCCESS != load_solver_field(ocl, &device))
+        return -1;
+
+    if (CL_SUCCESS != set_kernel_args(device.rkl2_first_stage, 0, device.field, device.stages[0], device.rhs, problem.width, problem.height, problem.air_temperature,
+        problem.point_x, problem.point_y, problem.point_temperature, first_stage_mu_tilde(stages), ratio) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device.rkl2_first_stage, 2, global_work_size, nullptr))
+        return -1;
+
+    auto before = device.field;
+    auto previous = device.stages[0];
+    for (cl_uint j = 2; j <= stages; j++)
+    {
+        const auto c = stage_coefficients(stages, j);
+        auto next = j == stages ? device.field : device.stages[(j - 1) % 3];
+        if (CL_SUCCESS != set_kernel_args(device.rkl2_stage, 0, device.field, previous, before, device.rhs, next, problem.width, problem.height, problem.air_temperature,
+            problem.point_x, problem.point_y, problem.point_temperature, c.mu, c.nu, c.mu_tilde, c.gamma_tilde, ratio) ||
+            CL_SUCCESS != run_solver_kernel(ocl, device.rkl2_stage, 2, global_work_size, nullptr))
+            return -1;
+        before = previous;
+        previous = next;
+    }
+
+    solver->iterations = stages;
+    solver->residual = 0.0F;
+    return store_solver_field(ocl, &device);
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <CL/cl.h>
+
+#include "solver.h"
+
+cl_uint rkl2_stage_count(const heat_model& model);
+int rkl2_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
+int rkl2_step_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem, const heat_model& model);
@@ -0,0 +1,162 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <vector>
+
+
+#include "log_utils.h"
+
+#define SNAPSHOT_MAGIC 0x53535448
+#define SNAPSHOT_CONDUCTIVITY 1
+
+struct snapshot_header
+{
+    cl_uint magic;
+    cl_uint width;
+    cl_uint height;
+    cl_uint flags;
+    cl_ulong step;
+    cl_ulong stream_size;
+};
+
+static const cl_float report_tolerances[] = { 0.001F, 0.01F, 0.1F, 1.0F, 10.0F };
+
+/*encodes the field and, for lossy streams, decodes it back to measure the error actually achieved*/
+static int encode_and_verify(const cl_float* field, const cl_uint width, const cl_uint height, const codec_mode mode, const cl_float tolerance,
+    std::vector<unsigned char>& stream, cl_float& max_error)
+{
+    if (CL_SUCCESS != encode_field(field, width, height, mode, tolerance, stream))
+        return -1;
+
+    std::vector<cl_float> decoded(static_cast<size_t>(width) * height);
+    if (CL_SUCCESS != decode_field(stream.data(), stream.size(), decoded.data(), width, height))
+        return -1;
+
+    max_error = max_field_error(field, decoded.data(), decoded.size());
+    const auto bound = CODEC_LOSSY == mode ? tolerance : 0.0F;
+    if (max_error > bound)
+    {
+        log_error("Error: encoded field exceeds the error bound (%f > %f).\n", max_error, bound);
+        return -1;
+    }
+
+    return CL_SUCCESS;
+}
+
+/*
+ * Header, field stream and, with SNAPSHOT_CONDUCTIVITY, the conductivity map of the plate: its stream size and a
+ * lossless stream, so a checkpoint restores the material along with the temperatures.
+ */
+int write_snapshot(const char* file_name, const cl_float* field, const cl_float* conductivity, const cl_uint width, const cl_uint height, const cl_ulong step,
+    const codec_mode mode, const cl_float tolerance)
+{
+    std::vector<unsigned char> stream;
+    cl_float max_error;
+    if (CL_SUCCESS != encode_and_verify(field, width, height, mode, tolerance, stream, max_error))
+        return -1;
+
+    std::vector<unsigned char> material_stream;
+    cl_float material_error;
+    if (conductivity && CL_SUCCESS != encode_and_verify(conductivity, width, height, CODEC_LOSSLESS, 0.0F, material_stream, material_error))
+        return -1;
+
+    FILE* fp = nullptr;
+    fopen_s(&fp, file_name, "wb");
+    if (nullptr == fp)
+    {
+        log_error("Error: Couldn't create snapshot file '%s'.\n", file_name);
+        return -1;
+    }
+
+    const snapshot_header header = { SNAPSHOT_MAGIC, width, height, conductivity ? SNAPSHOT_CONDUCTIVITY : 0U, step, stream.size() };
+    const cl_ulong material_size = material_stream.size();
+    auto written = fwrite(&header, sizeof(snapshot_header), 1, fp) == 1 && fwrite(stream.data(), 1, stream.size(), fp) == stream.size();
+    if (conductivity)
+        written = written && fwrite(&material_size, sizeof(cl_ulong), 1, fp) == 1 && fwrite(material_stream.data(), 1, material_stream.size(), fp) == material_stream.size();
+    fclose(fp);
+    if (!written)
+    {
+        log_error("Error: Couldn't write snapshot file '%s'.\n", file_name);
+        return -1;
+    }
+
+    const auto raw_size = sizeof(cl_float) * width * height;
+    log_info("Snapshot %s: step=%llu ratio=%.2f max_error=%g\n", file_name, static_cast<unsigned long long>(step),
+        static_cast<double>(raw_size) / stream.size(), max_error);
+
+    return CL_SUCCESS;
+}
+
+/*conductivity, when given, gets the map of the snapshot or is left empty for a uniform plate*/
+int read_snapshot(const char* file_name, cl_float* field, std::vector<cl_float>* conductivity, const cl_uint width, const cl_uint height, cl_ulong* step)
+{
+    FILE* fp = nullptr;
+    fopen_s(&fp, file_name, "rb");
+    if (nullptr == fp)
+    {
+        log_error("Error: Couldn't find snapshot file '%s'.\n", file_name);
+        return -1;
+    }
+
+    snapshot_header header;
+    if (fread(&header, sizeof(snapshot_header), 1, fp) != 1 || SNAPSHOT_MAGIC != header.magic)
+    {
+        log_error("Error: '%s' is not a snapshot file.\n", file_name);
+        fclose(fp);
+        return -1;
+    }
+
+    if (header.width != width || header.height != height)
+    {
+        log_error("Error: snapshot '%s' holds a %ux%u plate, expected %ux%u.\n", file_name, header.width, header.height, width, height);
+        fclose(fp);
+        return -1;
+    }
+
+    std::vector<unsigned char> stream(header.stream_size);
+    auto read = fread(stream.data(), 1, stream.size(), fp) == stream.size();
+    cl_ulong material_size = 0;
+    if (header.flags & SNAPSHOT_CONDUCTIVITY)
+        read = read && fread(&material_size, sizeof(cl_ulong), 1, fp) == 1;
+    std::vector<unsigned char> material_stream(material_size);
+    read = read && fread(material_stream.data(), 1, material_stream.size(), fp) == material_stream.size();
+    fclose(fp);
+    if (!read)
+    {
+        log_error("Error: snapshot file '%s' is truncated.\n", file_name);
+        return -1;
+    }
+
+    if (step)
+        *step = header.step;
+
+    if (conductivity)
+    {
+        conductivity->clear();
+        if (header.flags & SNAPSHOT_CONDUCTIVITY)
+        {
+            conductivity->resize(static_cast<size_t>(width) * height);
+            if (CL_SUCCESS != decode_field(material_stream.data(), material_stream.size(), conductivity->data(), width, height))
+                return -1;
+        }
+    }
+
+    return decode_field(stream.data(), stream.size(), field, width, height);
+}
+
+void log_codec_report(const cl_float* field, const cl_uint width, const cl_uint height)
+{
+    const auto raw_size = static_cast<double>(sizeof(cl_float)) * width * height;
+    std::vector<unsigned char> stream;
+    cl_float max_error;
+
+    log_info("\ncodec report for a %ux%u plate\n", width, height);
+    if (CL_SUCCESS == encode_and_verify(field, width, height, CODEC_LOSSLESS, 0.0F, stream, max_error))
+        log_info("- lossless: ratio=%.2f max_error=%g\n", raw_size / stream.size(), max_error);
+
+    for (auto tolerance : report_tolerances)
+    {
+        if (CL_SUCCESS == encode_and_verify(field, width, height, CODEC_LOSSY, tolerance, stream, max_error))
+            log_info("- tolerance=%g: ratio=%.2f max_error=%g\n", tolerance, raw_size / stream.size(), max_error);
+    }
+}
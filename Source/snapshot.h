@@ -0,0 +1,9 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+#include "field_codec.h"
+
+int write_snapshot(const char* file_name, const cl_float* field, const cl_float* conductivity, cl_uint width, cl_uint height, cl_ulong step, codec_mode mode, cl_float tolerance);
+int read_snapshot(const char* file_name, cl_float* field, std::vector<cl_float>* conductivity, cl_uint width, cl_uint height, cl_ulong* step);
+void log_codec_report(const cl_float* field, cl_uint width, cl_uint height);
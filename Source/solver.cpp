@@ -0,0 +1,212 @@
+#include "solver.h"
+
+#include <cstring>
+
+
+#include "adi.h"
+#include "amr.h"
+#include "chebyshev.h"
+#include "implicit_solver.h"
+#include "jfnk.h"
+#include "log_utils.h"
+#include "multigrid.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "pcg.h"
+#include "rkl2.h"
+#include "sor.h"
+#include "spectral.h"
+
+const char* const solver_names[SOLVER_COUNT] = { "ftcs", "implicit", "multigrid", "pcg", "adi", "spectral", "rkl2", "sor", "chebyshev", "amr", "jfnk", "jfnk_steady" };
+
+bool parse_solver_kind(const char* name, solver_kind& kind)
+{
+    for (auto i = 0; i < SOLVER_COUNT; i++)
+    {
+        if (0 == strcmp(name, solver_names[i]))
+        {
+            kind = static_cast<solver_kind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*steady state solvers jump straight to the equilibrium of the current controls, no time passes*/
+bool is_steady_solver(const solver_kind kind)
+{
+    return SOLVER_MULTIGRID == kind || SOLVER_PCG == kind || SOLVER_SOR == kind || SOLVER_CHEBYSHEV == kind || SOLVER_JFNK_STEADY == kind;
+}
+
+/*ADI, the spectral solver, AMR and the Newton-Krylov solvers are CPU only, their line solves, transforms, patch trees and Krylov bases have no kernel*/
+bool has_device_step(const solver_kind kind)
+{
+    return SOLVER_ADI != kind && SOLVER_SPECTRAL != kind && SOLVER_AMR != kind && SOLVER_JFNK != kind && SOLVER_JFNK_STEADY != kind;
+}
+
+/*solvers that can read and write the same field, the only ones a single image (in_place:1) can run*/
+bool solves_in_place(const solver_kind kind)
+{
+    return SOLVER_SOR == kind;
+}
+
+cl_float solver_time_step(const heat_model& model, const solver_kind kind)
+{
+    if (is_steady_solver(kind))
+        return 0.0F;
+    return SOLVER_FTCS == kind ? explicit_time_step(model) : model.time_step;
+}
+
+solver_state::solver_state() :
+    settings(),
+    iterations(0),
+    residual(0.0F),
+    conductivity(nullptr)
+{
+}
+
+/*here, where the state of every module is complete*/
+solver_state::~solver_state()
+{
+}
+
+void init_solver(solver_state* solver, const solver_settings& settings)
+{
+    solver->settings = settings;
+    solver->iterations = 0;
+    solver->residual = 0.0F;
+    /*plans, trees and Newton counts start over; the grids and vectors are only sized*/
+    solver->spectral.reset();
+    solver->amr.reset();
+    solver->jfnk.reset();
+}
+
+static cl_float* map_field(ocl_args_d_t* ocl, cl_mem image, const cl_uint width, const cl_uint height, const cl_map_flags flags)
+{
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    size_t image_row_pitch;
+    size_t image_slice_pitch;
+
+    cl_int err;
+    auto* field = static_cast<cl_float*>(clEnqueueMapImage(ocl->command_queue, image, true, flags, origin, region,
+        &image_row_pitch, &image_slice_pitch, 0, nullptr, nullptr, &err));
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueMapImage returned %s\n", translate_open_cl_error(err));
+        return nullptr;
+    }
+    return field;
+}
+
+static int unmap_field(ocl_args_d_t* ocl, cl_mem image, cl_float* field)
+{
+    const auto err = clEnqueueUnmapMemObject(ocl->command_queue, image, field, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueUnmapMemObject returned %s\n", translate_open_cl_error(err));
+        return -1;
+    }
+    return CL_SUCCESS;
+}
+
+static int step_solver_cpu(ocl_args_d_t* ocl, solver_state* solver, const solver_kind kind, const plate_problem& problem, const heat_model& model, struct vertex_args* plate_points)
+{
+    /*a single image is mapped once and solved in place*/
+    const auto in_place = ocl->input == ocl->output;
+    auto* input = map_field(ocl, ocl->input, problem.width, problem.height, in_place ? CL_MAP_READ | CL_MAP_WRITE : CL_MAP_READ);
+    if (nullptr == input)
+        return -1;
+    auto* output = in_place ? input : map_field(ocl, ocl->output, problem.width, problem.height, CL_MAP_WRITE);
+    if (nullptr == output)
+        return -1;
+
+    auto err = -1;
+    switch (kind)
+    {
+    case SOLVER_IMPLICIT:
+        err = implicit_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_MULTIGRID:
+        err = multigrid_solve_cpu(solver, problem, input, output);
+        break;
+    case SOLVER_PCG:
+        err = pcg_solve_cpu(solver, problem, input, output);
+        break;
+    case SOLVER_ADI:
+        err = adi_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_SPECTRAL:
+        err = spectral_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_RKL2:
+        err = rkl2_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_SOR:
+        err = sor_solve_cpu(solver, problem, input, output);
+        break;
+    case SOLVER_CHEBYSHEV:
+        err = chebyshev_solve_cpu(solver, problem, input, output);
+        break;
+    case SOLVER_AMR:
+        err = amr_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_JFNK:
+        err = jfnk_step_cpu(solver, problem, model, input, output);
+        break;
+    case SOLVER_JFNK_STEADY:
+        err = jfnk_solve_cpu(solver, problem, input, output);
+        break;
+    default:
+        log_error("Error: solver '%s' has no CPU step.\n", solver_names[kind]);
+        break;
+    }
+    if (CL_SUCCESS == err)
+        colorize_field(output, plate_points, static_cast<size_t>(problem.width) * problem.height);
+
+    if (CL_SUCCESS != unmap_field(ocl, ocl->input, input) || (!in_place && CL_SUCCESS != unmap_field(ocl, ocl->output, output)))
+        return -1;
+    return err;
+}
+
+static int step_solver_ocl(ocl_args_d_t* ocl, solver_state* solver, const solver_kind kind, const plate_problem& problem, const heat_model& model)
+{
+    if (CL_SUCCESS != setup_ocl_solver(ocl, &solver->device, problem.width, problem.height))
+        return -1;
+
+    switch (kind)
+    {
+    case SOLVER_IMPLICIT:
+        return implicit_step_ocl(ocl, solver, problem, model);
+    case SOLVER_MULTIGRID:
+        return multigrid_solve_ocl(ocl, solver, problem);
+    case SOLVER_PCG:
+        return pcg_solve_ocl(ocl, solver, problem);
+    case SOLVER_RKL2:
+        return rkl2_step_ocl(ocl, solver, problem, model);
+    case SOLVER_SOR:
+        return sor_solve_ocl(ocl, solver, problem);
+    case SOLVER_CHEBYSHEV:
+        return chebyshev_solve_ocl(ocl, solver, problem);
+    default:
+        log_error("Error: solver '%s' has no OpenCL step.\n", solver_names[kind]);
+        return -1;
+    }
+}
+
+/*
+ * One step of any solver but FTCS, which keeps its split between the CPU threads and the simulate kernel; the result is left in ocl->output.
+ * Solvers without a device step run on the CPU whatever the backend, and so does a single image: the device buffers would
+ * take more memory than in_place saves.
+ */
+int step_solver(ocl_args_d_t* ocl, solver_state* solver, const solver_kind kind, const solver_backend backend, const plate_problem& problem, const heat_model& model, struct vertex_args* plate_points)
+{
+    if (ocl->input == ocl->output && !solves_in_place(kind))
+    {
+        log_error("Error: solver '%s' needs separate input and output fields.\n", solver_names[kind]);
+        return -1;
+    }
+    if (BACKEND_CPU == backend || !has_device_step(kind) || ocl->input == ocl->output)
+        return step_solver_cpu(ocl, solver, kind, problem, model, plate_points);
+    return step_solver_ocl(ocl, solver, kind, problem, model);
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <CL/cl.h>
+#include <memory>
+#include <vector>
+
+#include "heat_model.h"
+#include "ocl_solver.h"
+
+#define SOLVER_COUNT 12
+
+enum solver_kind
+{
+    SOLVER_FTCS = 0,
+    SOLVER_IMPLICIT = 1,
+    SOLVER_MULTIGRID = 2,
+    SOLVER_PCG = 3,
+    SOLVER_ADI = 4,
+    SOLVER_SPECTRAL = 5,
+    SOLVER_RKL2 = 6,
+    SOLVER_SOR = 7,
+    SOLVER_CHEBYSHEV = 8,
+    SOLVER_AMR = 9,
+    SOLVER_JFNK = 10,
+    SOLVER_JFNK_STEADY = 11
+};
+
+enum solver_backend
+{
+    BACKEND_CPU = 0,
+    BACKEND_OPENCL = 1
+};
+
+/*how the implicit solver solves its system*/
+enum linear_solver_kind
+{
+    LINEAR_GAUSS_SEIDEL = 0,
+    LINEAR_PCG = 1
+};
+
+enum preconditioner_kind
+{
+    PRECONDITIONER_JACOBI = 0,
+    PRECONDITIONER_IC = 1
+};
+
+extern const char* const solver_names[SOLVER_COUNT];
+
+struct solver_settings
+{
+    cl_float         theta;
+    cl_float         tolerance;
+    cl_uint          max_iterations;
+    cl_uint          full_multigrid;
+    cl_uint          linear_solver;
+    cl_uint          preconditioner;
+    cl_float         omega;
+    cl_uint          amr_levels;
+    cl_float         amr_threshold;
+    cl_uint          newton_iterations;
+    cl_uint          krylov_dimension;
+};
+
+/*what one step of the plate needs to know about the current controls*/
+struct plate_problem
+{
+    cl_uint          width;
+    cl_uint          height;
+    cl_float         air_temperature;
+    cl_int           point_x;
+    cl_int           point_y;
+    cl_float         point_temperature;
+};
+
+/*the state each solver keeps between steps, defined by its own module*/
+struct multigrid_state;
+struct pcg_vectors;
+struct spectral_state;
+struct amr_state;
+struct jfnk_state;
+struct conductivity_curve;
+
+/*
+ * rhs, transposed and stages are scratch fields any solver may use. The state of a solver module is created on its
+ * first step, see solver_module. conductivity is the k(T) table of the config, none for a constant k.
+ */
+struct solver_state
+{
+    solver_state();
+    ~solver_state();
+
+    solver_settings  settings;
+    cl_uint          iterations;
+    cl_float         residual;
+    std::vector<cl_float> rhs;
+    std::vector<cl_float> transposed;
+    std::vector<cl_float> stages[3];
+    std::unique_ptr<multigrid_state> multigrid;
+    std::unique_ptr<pcg_vectors> pcg;
+    std::unique_ptr<spectral_state> spectral;
+    std::unique_ptr<amr_state> amr;
+    std::unique_ptr<jfnk_state> jfnk;
+    const conductivity_curve* conductivity;
+    ocl_solver_t     device;
+};
+
+/*the state of a solver module, created when the module first asks for it*/
+template <typename T>
+T& solver_module(std::unique_ptr<T>& state)
+{
+    if (!state)
+        state.reset(new T());
+    return *state;
+}
+
+struct ocl_args_d_t;
+struct vertex_args;
+
+bool parse_solver_kind(const char* name, solver_kind& kind);
+bool is_steady_solver(solver_kind kind);
+bool has_device_step(solver_kind kind);
+bool solves_in_place(solver_kind kind);
+cl_float solver_time_step(const heat_model& model, solver_kind kind);
+void init_solver(solver_state* solver, const solver_settings& settings);
+int step_solver(ocl_args_d_t* ocl, solver_state* solver, solver_kind kind, solver_backend backend, const plate_problem& problem, const heat_model& model, struct vertex_args* plate_points);
@@ -0,0 +1,93 @@
+#include "sor.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+#include "linear_system.h"
+#include "ocl_args.h"
+#include "parallel.h"
+
+/*
+ * Steady state by red-black successive over-relaxation. Each cell moves omega times the way to the average of its
+ * neighbours, the air and the source cell read straight from the field, so the CPU iteration needs no right hand side and
+ * works on the field in place; with in_place:1 the plate keeps a single image. omega = 0 takes the optimum for the
+ * rectangle, 2 / (1 + sqrt(1 - rho^2)) with rho the convergence rate of Jacobi, which needs O(n) sweeps where
+ * Gauss-Seidel needs O(n^2).
+ */
+
+cl_float sor_omega(const solver_settings& settings, const cl_uint width, const cl_uint height)
+{
+    if (settings.omega > 0.0F)
+        return settings.omega;
+
+    const auto rho = static_cast<double>(jacobi_radius(width, height));
+    return static_cast<cl_float>(2.0 / (1.0 + std::sqrt(1.0 - rho * rho)));
+}
+
+/*one color, in place; returns the largest Gauss-Seidel correction, in degrees like residual_norm*/
+static cl_float sor_sweep(const plate_problem& problem, cl_float* field, const cl_uint color, const cl_float omega)
+{
+    const linear_system source = { problem.width, problem.height, 0.0F, 0.0F, problem.point_x, problem.point_y, {} };
+    return parallel_reduce(problem.height, 0.0F, [&](const size_t begin, const size_t end)
+    {
+        auto residual = 0.0F;
+        for (auto row = static_cast<cl_uint>(begin); row < end; row++)
+        {
+            for (auto col = (row + color) & 1; col < problem.width; col += 2)
+            {
+                const auto i = static_cast<size_t>(row) * problem.width + col;
+                if (is_source(source, col, row))
+                {
+                    residual = std::max(residual, std::fabs(problem.point_temperature - field[i]));
+                    field[i] = problem.point_temperature;
+                    continue;
+                }
+
+                const auto correction = 0.25F * neighbour_sum(field, col, row, problem.width, problem.height, problem.air_temperature) - field[i];
+                residual = std::max(residual, std::fabs(correction));
+                field[i] += omega * correction;
+            }
+        }
+        return residual;
+    }, [](const cl_float a, const cl_float b) { return std::max(a, b); });
+}
+
+/*output may be the input itself, which is how the single image of in_place:1 is solved*/
+int sor_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output)
+{
+    const auto& settings = solver->settings;
+    const auto omega = sor_omega(settings, problem.width, problem.height);
+    if (output != input)
+        std::copy(input, input + static_cast<size_t>(problem.width) * problem.height, output);
+
+    solver->iterations = 0;
+    solver->residual = settings.tolerance + 1.0F;
+    while (solver->residual > settings.tolerance && solver->iterations < settings.max_iterations)
+    {
+        const auto red = sor_sweep(problem, output, 0, omega);
+        const auto black = sor_sweep(problem, output, 1, omega);
+        solver->residual = std::max(red, black);
+        solver->iterations++;
+    }
+    return CL_SUCCESS;
+}
+
+/*the device sweeps the red_black_sweep kernel with the boundary terms in device->rhs*/
+int sor_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem)
+{
+    auto* device = &solver->device;
+    const auto& settings = solver->settings;
+    const linear_system system = { problem.width, problem.height, 4.0F, 1.0F, problem.point_x, problem.point_y, {} };
+
+    linear_stats stats;
+    if (CL_SUCCESS != load_solver_field(ocl, device) ||
+        CL_SUCCESS != fill_solver_buffer(ocl, device->rhs, 0.0F, static_cast<size_t>(problem.width) * problem.height) ||
+        CL_SUCCESS != device_boundary_terms(ocl, device, system, device->rhs, problem.air_temperature, problem.point_temperature) ||
+        CL_SUCCESS != device_solve_red_black(ocl, device, system, sor_omega(settings, problem.width, problem.height), settings.tolerance, settings.max_iterations, &stats))
+        return -1;
+    solver->iterations = stats.iterations;
+    solver->residual = stats.residual;
+
+    return store_solver_field(ocl, device);
+}
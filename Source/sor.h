@@ -0,0 +1,8 @@
+#pragma once
+#include <CL/cl.h>
+
+#include "solver.h"
+
+cl_float sor_omega(const solver_settings& settings, cl_uint width, cl_uint height);
+int sor_solve_cpu(solver_state* solver, const plate_problem& problem, const cl_float* input, cl_float* output);
+int sor_solve_ocl(ocl_args_d_t* ocl, solver_state* solver, const plate_problem& problem);
@@ -0,0 +1,265 @@
+#include "sources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+
+#include "geometry.h"
+#include "log_utils.h"
+#include "material.h"
+#include "ocl_args.h"
+#include "ocl_solver.h"
+
+static const double pi = 3.14159265358979323846;
+
+ocl_sources_t::ocl_sources_t() :
+    kernel(nullptr),
+    cells(nullptr),
+    owner(nullptr),
+    values(nullptr)
+{
+}
+
+ocl_sources_t::~ocl_sources_t()
+{
+    if (kernel)
+        clReleaseKernel(kernel);
+    for (auto* buffer : { cells, owner, values })
+    {
+        if (buffer)
+            clReleaseMemObject(buffer);
+    }
+}
+
+/*
+ * <shape>,<x>,<y>[,<size_x>[,<size_y>]],<mode>,<value>[,<amplitude>,<period>]: point takes no size, disc a radius,
+ * rect a width and a height; mode is fixed (degrees) or power (degrees per second).
+ */
+bool parse_heat_source(const std::string& value, heat_source& source)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        items.push_back(item);
+    if (items.empty())
+        return false;
+
+    size_t sizes;
+    if (items[0] == "point") { source.shape = SOURCE_POINT; sizes = 0; }
+    else if (items[0] == "disc") { source.shape = SOURCE_DISC; sizes = 1; }
+    else if (items[0] == "rect") { source.shape = SOURCE_RECTANGLE; sizes = 2; }
+    else return false;
+
+    const auto mode = 3 + sizes;
+    if (items.size() != mode + 2 && items.size() != mode + 4)
+        return false;
+    if (items[mode] == "fixed") source.mode = SOURCE_FIXED;
+    else if (items[mode] == "power") source.mode = SOURCE_POWER;
+    else return false;
+
+    try
+    {
+        source.x = std::stoi(items[1], nullptr);
+        source.y = std::stoi(items[2], nullptr);
+        source.size_x = sizes > 0 ? std::stoi(items[3], nullptr) : 0;
+        source.size_y = sizes > 1 ? std::stoi(items[4], nullptr) : 0;
+        source.value = std::stof(items[mode + 1], nullptr);
+        source.amplitude = items.size() > mode + 2 ? std::stof(items[mode + 2], nullptr) : 0.0F;
+        source.period = items.size() > mode + 2 ? std::stof(items[mode + 3], nullptr) : 0.0F;
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return source.size_x >= 0 && source.size_y >= 0 && (0.0F == source.amplitude || source.period > 0.0F);
+}
+
+/*one source per line, in the format of parse_heat_source; empty lines and lines starting with # are skipped*/
+int load_heat_sources(const char* file_name, std::vector<heat_source>& sources)
+{
+    std::ifstream input(file_name);
+    if (!input)
+    {
+        log_error("Error: Couldn't open source list '%s'.\n", file_name);
+        return -1;
+    }
+
+    std::string line;
+    for (cl_uint number = 1; std::getline(input, line); number++)
+    {
+        if (line.empty() || '#' == line[0] || '\r' == line[0])
+            continue;
+        heat_source source;
+        if (!parse_heat_source(line.substr(0, line.find_last_not_of("\r") + 1), source))
+        {
+            log_error("Error: bad source on line %u of '%s'.\n", number, file_name);
+            return -1;
+        }
+        sources.push_back(source);
+    }
+    return CL_SUCCESS;
+}
+
+/*the cells of one source that lie on the plate, tagged with its slot*/
+static void cover_source(const heat_source& source, const cl_uint slot, const cl_int width, const cl_int height, std::vector<std::pair<cl_uint, cl_uint>>& covered)
+{
+    const auto radius = SOURCE_DISC == source.shape ? source.size_x : 0;
+    const auto left = std::max(source.x - radius, 0);
+    const auto top = std::max(source.y - radius, 0);
+    const auto right = std::min(SOURCE_RECTANGLE == source.shape ? source.x + source.size_x : source.x + radius + 1, width);
+    const auto bottom = std::min(SOURCE_RECTANGLE == source.shape ? source.y + source.size_y : source.y + radius + 1, height);
+    for (auto row = top; row < bottom; row++)
+    {
+        for (auto col = left; col < right; col++)
+        {
+            const auto dx = col - source.x;
+            const auto dy = row - source.y;
+            if (SOURCE_DISC != source.shape || dx * dx + dy * dy <= radius * radius)
+                covered.emplace_back(static_cast<cl_uint>(row) * width + col, slot);
+        }
+    }
+}
+
+/*with a mask, the cells of a source outside the part are left to the air*/
+void setup_source_cells(source_set* set, const std::vector<heat_source>& sources, const cl_uint width, const cl_uint height, const geometry_mask* mask)
+{
+    set->sources = sources;
+
+    std::vector<std::pair<cl_uint, cl_uint>> covered;
+    for (size_t s = 0; s < sources.size(); s++)
+        cover_source(sources[s], static_cast<cl_uint>(s + 1), static_cast<cl_int>(width), static_cast<cl_int>(height), covered);
+    if (mask)
+        covered.erase(std::remove_if(covered.begin(), covered.end(), [&](const std::pair<cl_uint, cl_uint>& cell) { return !geometry_contains(*mask, cell.first % width, cell.first / width); }),
+            covered.end());
+
+    /*the last source listed keeps a shared cell*/
+    std::stable_sort(covered.begin(), covered.end(), [](const std::pair<cl_uint, cl_uint>& a, const std::pair<cl_uint, cl_uint>& b) { return a.first < b.first; });
+    std::vector<std::pair<cl_uint, cl_uint>> cells;
+    for (size_t i = 0; i < covered.size(); i++)
+    {
+        if (i + 1 == covered.size() || covered[i + 1].first != covered[i].first)
+            cells.push_back(covered[i]);
+    }
+
+    set->sorted.resize(cells.size());
+    for (size_t i = 0; i < cells.size(); i++)
+        set->sorted[i] = cells[i].first;
+
+    const auto power = std::stable_partition(cells.begin(), cells.end(), [&](const std::pair<cl_uint, cl_uint>& cell) { return SOURCE_FIXED == sources[cell.second - 1].mode; });
+    set->fixed_count = static_cast<cl_uint>(1 + (power - cells.begin()));
+    set->cells.assign(1, 0);
+    set->owner.assign(1, 0);
+    for (const auto& cell : cells)
+    {
+        set->cells.push_back(cell.first);
+        set->owner.push_back(cell.second);
+    }
+
+    set->values.assign(sources.size() + 1, 0.0F);
+    set->device_cell = 0;
+    set->device_values.clear();
+    set->time = 0.0;
+
+    if (!sources.empty())
+        log_info("Sources: %u over %u cells, %u of them fixed\n", static_cast<cl_uint>(sources.size()), static_cast<cl_uint>(cells.size()), set->fixed_count - 1);
+}
+
+static cl_mem create_list_buffer(ocl_args_d_t* ocl, const std::vector<cl_uint>& list)
+{
+    cl_int err;
+    auto* buffer = clCreateBuffer(ocl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * list.size(), const_cast<cl_uint*>(list.data()), &err);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clCreateBuffer for the source cells returned %s\n", translate_open_cl_error(err));
+        return nullptr;
+    }
+    return buffer;
+}
+
+int setup_ocl_sources(ocl_args_d_t* ocl, source_set* set)
+{
+    auto* device = &set->device;
+    if (CL_SUCCESS != create_solver_kernel(ocl, "scatter_sources", &device->kernel))
+        return -1;
+    device->cells = create_list_buffer(ocl, set->cells);
+    device->owner = create_list_buffer(ocl, set->owner);
+    device->values = create_solver_buffer(ocl, sizeof(cl_float) * set->values.size());
+    return nullptr != device->cells && nullptr != device->owner && nullptr != device->values ? CL_SUCCESS : -1;
+}
+
+/*
+ * Sets the source cells of the field that was just stepped into ocl->output. Only the cell of the mouse and the values
+ * of the sources travel to the device, and only when they changed; the kernel runs over the covered cells alone.
+ * changed is the flag buffer of the active tiles, or null without them.
+ */
+int execute_source_kernel(ocl_args_d_t* ocl, source_set* set, const material_map& material, const cl_uint width, const cl_uint height, const cl_float air_temperature,
+    const cl_int point_x, const cl_int point_y, const cl_float point_temperature, const cl_float ratio, const cl_float time_step, const cl_mem changed, const cl_uint tile_columns)
+{
+    auto* device = &set->device;
+    cl_int err;
+
+    /*the mouse is skipped outside of the plate and on the cells of the other sources*/
+    cl_uint first = 1;
+    if (point_x >= 0 && point_y >= 0 && static_cast<cl_uint>(point_x) < width && static_cast<cl_uint>(point_y) < height)
+    {
+        const auto cell = static_cast<cl_uint>(point_y) * width + static_cast<cl_uint>(point_x);
+        if (!std::binary_search(set->sorted.begin(), set->sorted.end(), cell))
+            first = 0;
+        if (0 == first && cell != set->device_cell)
+        {
+            err = clEnqueueWriteBuffer(ocl->command_queue, device->cells, true, 0, sizeof(cl_uint), &cell, 0, nullptr, nullptr);
+            if (CL_SUCCESS != err)
+            {
+                log_error("Error: clEnqueueWriteBuffer returned %s\n", translate_open_cl_error(err));
+                return err;
+            }
+            set->device_cell = cell;
+        }
+    }
+
+    /*a power source adds its rate over the step*/
+    set->values[0] = point_temperature;
+    for (size_t s = 0; s < set->sources.size(); s++)
+    {
+        const auto& source = set->sources[s];
+        auto value = static_cast<double>(source.value);
+        if (0.0F != source.amplitude)
+            value += source.amplitude * std::sin(2.0 * pi * set->time / source.period);
+        set->values[s + 1] = static_cast<cl_float>(SOURCE_POWER == source.mode ? value * time_step : value);
+    }
+    set->time += time_step;
+    if (set->values != set->device_values)
+    {
+        err = clEnqueueWriteBuffer(ocl->command_queue, device->values, true, 0, sizeof(cl_float) * set->values.size(), set->values.data(), 0, nullptr, nullptr);
+        if (CL_SUCCESS != err)
+        {
+            log_error("Error: clEnqueueWriteBuffer returned %s\n", translate_open_cl_error(err));
+            return err;
+        }
+        set->device_values = set->values;
+    }
+
+    const auto count = set->cells.size() - first;
+    if (0 == count)
+        return CL_SUCCESS;
+
+    const cl_mem face_x = material.uniform ? nullptr : material.device.face_x;
+    const cl_mem face_y = material.uniform ? nullptr : material.device.face_y;
+    const size_t global_work_size[] = { count };
+    if (CL_SUCCESS != set_kernel_args(device->kernel, 0, ocl->input, ocl->output, width, height, air_temperature, ocl->plate_points, ratio, device->cells, device->owner,
+        device->values, first, set->fixed_count, face_x, face_y, changed, tile_columns) ||
+        CL_SUCCESS != run_solver_kernel(ocl, device->kernel, 1, global_work_size, nullptr))
+        return -1;
+
+    err = clFinish(ocl->command_queue);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    return CL_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <CL/cl.h>
+#include <string>
+#include <vector>
+
+struct ocl_args_d_t;
+struct material_map;
+struct geometry_mask;
+
+enum source_shape
+{
+    SOURCE_POINT,
+    SOURCE_DISC,
+    SOURCE_RECTANGLE
+};
+
+enum source_mode
+{
+    SOURCE_FIXED,
+    SOURCE_POWER
+};
+
+/*
+ * A source or sink on the plate, in cells: a point at (x, y), a disc of radius size_x around it, or a rectangle of
+ * size_x * size_y with its top left corner there. A fixed source holds its cells at a temperature, a power source adds
+ * degrees per second to them. Either value follows value + amplitude * sin(2 pi t / period) over the simulated time.
+ */
+struct heat_source
+{
+    source_shape     shape;
+    source_mode      mode;
+    cl_int           x;
+    cl_int           y;
+    cl_int           size_x;
+    cl_int           size_y;
+    cl_float         value;
+    cl_float         amplitude;
+    cl_float         period;
+};
+
+/*device copies of the cell list and the kernel that scatters it*/
+struct ocl_sources_t
+{
+    ocl_sources_t();
+    ~ocl_sources_t();
+
+    cl_kernel        kernel;
+    cl_mem           cells;
+    cl_mem           owner;
+    cl_mem           values;
+};
+
+/*
+ * The sources, flattened once into the cells they cover: cells[j] belongs to owner[j], whose value this step is
+ * values[owner[j]]. Slot 0 of both lists is the mouse source, a single fixed cell that moves every frame. Fixed cells
+ * come first, up to fixed_count, power cells after them. A cell under several sources belongs to the last one listed, and
+ * the mouse gives way to any of them, so that no two work-items write the same cell; sorted keeps the covered cells for
+ * that lookup. The device copies of cells[0] and values are only rewritten when they change.
+ */
+struct source_set
+{
+    std::vector<heat_source> sources;
+    std::vector<cl_uint> cells;
+    std::vector<cl_uint> owner;
+    std::vector<cl_uint> sorted;
+    std::vector<cl_float> values;
+    cl_uint          fixed_count;
+    cl_uint          device_cell;
+    std::vector<cl_float> device_values;
+    double           time;
+    ocl_sources_t    device;
+};
+
+bool parse_heat_source(const std::string& value, heat_source& source);
+int load_heat_sources(const char* file_name, std::vector<heat_source>& sources);
+void setup_source_cells(source_set* set, const std::vector<heat_source>& sources, cl_uint width, cl_uint height, const geometry_mask* mask);
+int setup_ocl_sources(ocl_args_d_t* ocl, source_set* set);
+int execute_source_kernel(ocl_args_d_t* ocl, source_set* set, const material_map& material, cl_uint width, cl_uint height, cl_float air_temperature, cl_int point_x,
+    cl_int point_y, cl_float point_temperature, cl_float ratio, cl_float time_step, cl_mem changed, cl_uint tile_columns);
@@ -0,0 +1,262 @@
+#include "spectral.h"
+
+#include <cmath>
+
+
+#include "parallel.h"
+
+/*
+ * Exact time jumps for the uniform plate. With the air one cell beyond the edges, the five-point laplacian is diagonal
+ * in the sine basis sin(pi k (i + 1) / (n + 1)): mode (k, l) decays as exp(-r (eigenvalue_k + eigenvalue_l)) for any
+ * r = alpha * t / dx^2, so a step costs two 2D sine transforms whatever its length.
+ * The source enters by superposition: the field is the steady state of a heater at the source cell, scaled so the cell
+ * sits at the source temperature, plus a deviation that decays mode by mode. On its own the deviation would leak into the
+ * source cell, so every jump adds a heater of constant power over the jump, chosen in the sine basis so that the cell is
+ * back at the source temperature at its end.
+ */
+
+typedef std::complex<double> complex;
+
+static const double pi = 3.14159265358979323846;
+
+/*plain product, without the checks for infinities of the library operator*/
+static complex multiply(const complex& a, const complex& b)
+{
+    return complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+/*iterative radix-2 FFT, size is a power of two and twiddle[k] = exp(-2 pi i k / size)*/
+static void fft(complex* data, const size_t size, const std::vector<complex>& twiddle)
+{
+    for (size_t i = 1, j = 0; i < size; i++)
+    {
+        auto bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    for (size_t length = 2; length <= size; length <<= 1)
+    {
+        const auto half = length / 2;
+        const auto step = size / length;
+        for (size_t start = 0; start < size; start += length)
+        {
+            for (size_t k = 0; k < half; k++)
+            {
+                const auto odd = multiply(data[start + k + half], twiddle[k * step]);
+                data[start + k + half] = data[start + k] - odd;
+                data[start + k] += odd;
+            }
+        }
+    }
+}
+
+/*
+ * The sine transform of n values is the FFT of their odd extension, 2 (n + 1) long. Bluestein's chirp turns that
+ * length into a convolution of a power of two size, so any plate size gets an N log N transform.
+ */
+static void setup_sine_transform(sine_transform& transform, const cl_uint length)
+{
+    const size_t extended = 2 * (static_cast<size_t>(length) + 1);
+    size_t padded = 1;
+    while (padded < 2 * extended - 1)
+        padded <<= 1;
+
+    transform.length = length;
+    transform.padded = padded;
+    transform.twiddle.resize(padded / 2);
+    for (size_t k = 0; k < padded / 2; k++)
+        transform.twiddle[k] = std::polar(1.0, -2.0 * pi * k / padded);
+
+    /*n^2 is reduced modulo 2 * extended before the angle is taken, large n would lose the phase otherwise*/
+    transform.chirp.resize(extended);
+    for (size_t n = 0; n < extended; n++)
+        transform.chirp[n] = std::polar(1.0, -pi * static_cast<double>(n * n % (2 * extended)) / extended);
+
+    transform.chirp_spectrum.assign(padded, complex(0.0, 0.0));
+    transform.chirp_spectrum[0] = std::conj(transform.chirp[0]);
+    for (size_t n = 1; n < extended; n++)
+        transform.chirp_spectrum[n] = transform.chirp_spectrum[padded - n] = std::conj(transform.chirp[n]);
+    fft(transform.chirp_spectrum.data(), padded, transform.twiddle);
+
+    transform.eigenvalue.resize(length);
+    for (cl_uint k = 0; k < length; k++)
+        transform.eigenvalue[k] = 2.0 - 2.0 * std::cos(pi * (k + 1) / (length + 1.0));
+}
+
+/*
+ * line[k] = sum over i of line[i] * sin(pi (k + 1) (i + 1) / (n + 1)), for two lines at once, their values stride apart.
+ * The spectrum of a real odd extension is imaginary, so the first line goes in the real part and the second in the
+ * imaginary part of one complex transform and they come out apart again.
+ */
+static void sine_transform_lines(const sine_transform& transform, double* first, double* second, const size_t stride, std::vector<complex>& work)
+{
+    const auto length = transform.length;
+    const auto extended = transform.chirp.size();
+    const auto padded = transform.padded;
+    work.assign(padded, complex(0.0, 0.0));
+    for (size_t i = 0; i < length; i++)
+    {
+        const complex value(first[i * stride], second ? second[i * stride] : 0.0);
+        work[i + 1] = multiply(value, transform.chirp[i + 1]);
+        work[extended - 1 - i] = -multiply(value, transform.chirp[extended - 1 - i]);
+    }
+
+    fft(work.data(), padded, transform.twiddle);
+    for (size_t k = 0; k < padded; k++)
+        work[k] = std::conj(multiply(work[k], transform.chirp_spectrum[k]));
+    fft(work.data(), padded, transform.twiddle);
+
+    /*the second FFT of the conjugate is the inverse up to a conjugate and 1 / padded; the spectrum is -2i times the first transform plus 2 times the second*/
+    for (size_t k = 0; k < length; k++)
+    {
+        const auto spectrum = multiply(transform.chirp[k + 1], std::conj(work[k + 1])) / static_cast<double>(padded);
+        first[k * stride] = -0.5 * spectrum.imag();
+        if (second)
+            second[k * stride] = 0.5 * spectrum.real();
+    }
+}
+
+/*all lines, count of them start apart with their values stride apart, in pairs*/
+static void sine_transform_all(const sine_transform& transform, double* field, const size_t count, const size_t start, const size_t stride)
+{
+    parallel_for((count + 1) / 2, [&](const size_t begin, const size_t end)
+    {
+        std::vector<complex> work;
+        for (auto pair = begin; pair < end; pair++)
+        {
+            auto* first = field + 2 * pair * start;
+            sine_transform_lines(transform, first, 2 * pair + 1 < count ? first + start : nullptr, stride, work);
+        }
+    });
+}
+
+/*the 2D transform is its own inverse up to 4 / ((width + 1) (height + 1)); rows, then columns, split between the CPU threads*/
+static void sine_transform_field(const spectral_state& spectral, double* field)
+{
+    const auto width = spectral.rows.length;
+    const auto height = spectral.columns.length;
+    sine_transform_all(spectral.rows, field, height, width, 1);
+    sine_transform_all(spectral.columns, field, width, 1, width);
+}
+
+static bool source_on_plate(const plate_problem& problem)
+{
+    return problem.point_x >= 0 && problem.point_y >= 0 && static_cast<cl_uint>(problem.point_x) < problem.width && static_cast<cl_uint>(problem.point_y) < problem.height;
+}
+
+/*steady field of a unit heater at the source: the inverse laplacian is a division in the sine basis*/
+static void setup_green(spectral_state& spectral, const plate_problem& problem)
+{
+    const auto width = problem.width;
+    const auto height = problem.height;
+    spectral.source_x = problem.point_x;
+    spectral.source_y = problem.point_y;
+    spectral.source_modes_x.resize(width);
+    spectral.source_modes_y.resize(height);
+    for (cl_uint k = 0; k < width; k++)
+        spectral.source_modes_x[k] = std::sin(pi * (k + 1) * (problem.point_x + 1) / (width + 1.0));
+    for (cl_uint l = 0; l < height; l++)
+        spectral.source_modes_y[l] = std::sin(pi * (l + 1) * (problem.point_y + 1) / (height + 1.0));
+
+    const auto scale = 4.0 / ((width + 1.0) * (height + 1.0));
+    spectral.green.resize(static_cast<size_t>(width) * height);
+    parallel_for(height, [&](const size_t begin, const size_t end)
+    {
+        for (auto l = begin; l < end; l++)
+        {
+            for (cl_uint k = 0; k < width; k++)
+                spectral.green[l * width + k] = scale * spectral.source_modes_x[k] * spectral.source_modes_y[l] / (spectral.rows.eigenvalue[k] + spectral.columns.eigenvalue[l]);
+        }
+    });
+    sine_transform_field(spectral, spectral.green.data());
+}
+
+/*the deviation and the field of a unit heater over the jump, both at the source cell*/
+struct source_values
+{
+    double           deviation;
+    double           heater;
+};
+
+/*a direct solve: no iterations and no residual to report*/
+int spectral_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output)
+{
+    auto& spectral = solver_module(solver->spectral);
+    const auto width = problem.width;
+    const auto height = problem.height;
+    const auto count = static_cast<size_t>(width) * height;
+    const auto has_source = source_on_plate(problem);
+
+    if (spectral.rows.length != width || spectral.columns.length != height)
+    {
+        setup_sine_transform(spectral.rows, width);
+        setup_sine_transform(spectral.columns, height);
+        spectral.green.clear();
+    }
+    if (has_source && (spectral.green.empty() || spectral.source_x != problem.point_x || spectral.source_y != problem.point_y))
+        setup_green(spectral, problem);
+
+    const auto source = has_source ? static_cast<size_t>(problem.point_y) * width + problem.point_x : 0;
+    const auto heater = has_source ? (problem.point_temperature - problem.air_temperature) / spectral.green[source] : 0.0;
+    auto& coefficients = spectral.coefficients;
+    coefficients.resize(count);
+    for (size_t i = 0; i < count; i++)
+        coefficients[i] = input[i] - problem.air_temperature - (has_source ? heater * spectral.green[i] : 0.0);
+
+    sine_transform_field(spectral, coefficients.data());
+
+    /*decay of every mode; a mode's value at the source cell is its coefficient times the source modes*/
+    const auto ratio = static_cast<double>(diffusion_ratio(model, model.time_step));
+    const auto scale = 4.0 / ((width + 1.0) * (height + 1.0));
+    const auto decay = [&](const size_t k, const size_t l) { return std::exp(-ratio * (spectral.rows.eigenvalue[k] + spectral.columns.eigenvalue[l])); };
+    const auto at_source = parallel_reduce(height, source_values{ 0.0, 0.0 }, [&](const size_t begin, const size_t end)
+    {
+        source_values values = { 0.0, 0.0 };
+        for (auto l = begin; l < end; l++)
+        {
+            for (cl_uint k = 0; k < width; k++)
+            {
+                const auto factor = decay(k, l);
+                auto& coefficient = coefficients[l * width + k];
+                coefficient *= scale * factor;
+                if (!has_source)
+                    continue;
+
+                const auto mode = spectral.source_modes_x[k] * spectral.source_modes_y[l];
+                values.deviation += coefficient * mode;
+                values.heater += scale * mode * mode * (1.0 - factor) / (spectral.rows.eigenvalue[k] + spectral.columns.eigenvalue[l]);
+            }
+        }
+        return values;
+    }, [](const source_values& a, const source_values& b) { return source_values{ a.deviation + b.deviation, a.heater + b.heater }; });
+
+    if (has_source && at_source.heater > 0.0)
+    {
+        const auto correction = -at_source.deviation / at_source.heater;
+        parallel_for(height, [&](const size_t begin, const size_t end)
+        {
+            for (auto l = begin; l < end; l++)
+            {
+                for (cl_uint k = 0; k < width; k++)
+                {
+                    coefficients[l * width + k] += correction * scale * spectral.source_modes_x[k] * spectral.source_modes_y[l] * (1.0 - decay(k, l)) /
+                        (spectral.rows.eigenvalue[k] + spectral.columns.eigenvalue[l]);
+                }
+            }
+        });
+    }
+    sine_transform_field(spectral, coefficients.data());
+
+    for (size_t i = 0; i < count; i++)
+        output[i] = static_cast<cl_float>(problem.air_temperature + coefficients[i] + (has_source ? heater * spectral.green[i] : 0.0));
+    if (has_source)
+        output[source] = problem.point_temperature;
+
+    solver->iterations = 0;
+    solver->residual = 0.0F;
+    return CL_SUCCESS;
+}
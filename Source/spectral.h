@@ -0,0 +1,32 @@
+#pragma once
+#include <CL/cl.h>
+#include <complex>
+#include <vector>
+
+#include "solver.h"
+
+/*sine transform of one line length through a Bluestein FFT, eigenvalue[k] is the decay rate of mode k + 1*/
+struct sine_transform
+{
+    cl_uint          length;
+    size_t           padded;
+    std::vector<std::complex<double>> chirp;
+    std::vector<std::complex<double>> chirp_spectrum;
+    std::vector<std::complex<double>> twiddle;
+    std::vector<double> eigenvalue;
+};
+
+/*plans of the spectral solver and the steady response to the source, kept while the source stays in place*/
+struct spectral_state
+{
+    sine_transform   rows;
+    sine_transform   columns;
+    cl_int           source_x;
+    cl_int           source_y;
+    std::vector<double> source_modes_x;
+    std::vector<double> source_modes_y;
+    std::vector<double> green;
+    std::vector<double> coefficients;
+};
+
+int spectral_step_cpu(solver_state* solver, const plate_problem& problem, const heat_model& model, const cl_float* input, cl_float* output);
@@ -0,0 +1,154 @@
+#include "stencil.h"
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+
+#include "log_utils.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "ocl_solver.h"
+
+bool is_stencil_order(const cl_uint order)
+{
+    return 2 == order || 4 == order || 6 == order;
+}
+
+cl_float stencil_ratio_limit(const cl_uint order)
+{
+    switch (order)
+    {
+    case 4:
+        return laplacian_stencil<4>::ratio_limit();
+    case 6:
+        return laplacian_stencil<6>::ratio_limit();
+    default:
+        return laplacian_stencil<2>::ratio_limit();
+    }
+}
+
+/*the second order step is the hand-written simulate, the others are generated*/
+const char* stencil_kernel_name(const cl_uint order)
+{
+    switch (order)
+    {
+    case 4:
+        return "simulate_order_4";
+    case 6:
+        return "simulate_order_6";
+    default:
+        return "simulate";
+    }
+}
+
+static std::string float_literal(const cl_float value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.1fF", value);
+    return text;
+}
+
+/*a kernel with the arguments of simulate, the radius unrolled and the weights written in*/
+template <typename Stencil>
+static void append_stencil_kernel(std::ostringstream& source, const char* name)
+{
+    source << "\n__kernel void " << name << "(read_only image2d_t input, write_only image2d_t output, uint width, uint height, float air_temperature,\n"
+        "\t__global struct vertex_args* plate_points, ulong device_cells, float ratio)\n"
+        "{\n"
+        "\tint2 coords = (int2)(get_global_id(0), get_global_id(1));\n"
+        "\tindex_t global_index = cell_index(coords.x, coords.y, width);\n"
+        "\tif (global_index >= device_cells)\n"
+        "\t\treturn;\n"
+        "\n"
+        "\tfloat center = read_imagef(input, sampler, coords).x;\n"
+        "\tfloat sum = " << float_literal(2.0F * Stencil::weight(0)) << " * center;\n";
+    for (auto k = 1; k <= Stencil::radius(); k++)
+    {
+        source << "\tsum += " << float_literal(Stencil::weight(k)) << " * (stencil_cell(input, coords.x - " << k << ", coords.y, width, height, air_temperature) + "
+            "stencil_cell(input, coords.x + " << k << ", coords.y, width, height, air_temperature) + "
+            "stencil_cell(input, coords.x, coords.y - " << k << ", width, height, air_temperature) + "
+            "stencil_cell(input, coords.x, coords.y + " << k << ", width, height, air_temperature));\n";
+    }
+    source << "\tfloat value = center + ratio / " << float_literal(Stencil::divisor()) << " * sum;\n"
+        "\tset_temperature_color(&plate_points[global_index], value);\n"
+        "\twrite_imagef(output, coords, (float4)(value, value, value, value));\n"
+        "}\n";
+}
+
+/*the generated kernels, built into the same program as simulation.cl, whose helpers they use*/
+std::string stencil_program_source()
+{
+    std::ostringstream source;
+    source << "\n/*generated from laplacian_stencil in stencil.h*/\n";
+    append_stencil_kernel<laplacian_stencil<4>>(source, stencil_kernel_name(4));
+    append_stencil_kernel<laplacian_stencil<6>>(source, stencil_kernel_name(6));
+    return source.str();
+}
+
+void step_stencil(const cl_uint order, const cl_float* input, cl_float* output, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_float ratio,
+    const size_t first, const size_t last)
+{
+    switch (order)
+    {
+    case 4:
+        step_stencil_cells<laplacian_stencil<4>>(input, output, width, height, air_temperature, ratio, first, last);
+        break;
+    case 6:
+        step_stencil_cells<laplacian_stencil<6>>(input, output, width, height, air_temperature, ratio, first, last);
+        break;
+    default:
+        step_stencil_cells<laplacian_stencil<2>>(input, output, width, height, air_temperature, ratio, first, last);
+        break;
+    }
+}
+
+/*
+ * One step of a rough field with the kernel of the order and with the CPU template, compared cell by cell. The field
+ * is left in the images: the caller writes the plate back.
+ */
+int check_stencil(ocl_args_d_t* ocl, const cl_uint order, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_float ratio)
+{
+    const auto count = static_cast<size_t>(width) * height;
+    std::vector<cl_float> field(count);
+    std::vector<cl_float> expected(count);
+    std::vector<cl_float> actual(count);
+    for (cl_uint y = 0; y < height; y++)
+    {
+        for (cl_uint x = 0; x < width; x++)
+            field[static_cast<size_t>(y) * width + x] = air_temperature + 500.0F * (1.0F + std::sin(0.37F * x) * std::cos(0.23F * y));
+    }
+    step_stencil(order, field.data(), expected.data(), width, height, air_temperature, ratio, 0, count);
+
+    cl_kernel kernel = nullptr;
+    if (CL_SUCCESS != write_field(ocl, width, height, field.data()) || CL_SUCCESS != create_solver_kernel(ocl, stencil_kernel_name(order), &kernel))
+        return -1;
+    const size_t global_work_size[] = { width, height };
+    auto err = set_kernel_args(kernel, 0, ocl->input, ocl->output, width, height, air_temperature, ocl->plate_points, static_cast<cl_ulong>(width) * height, ratio);
+    if (CL_SUCCESS == err)
+        err = run_solver_kernel(ocl, kernel, 2, global_work_size, nullptr);
+    clReleaseKernel(kernel);
+    if (CL_SUCCESS != err)
+        return -1;
+
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = clEnqueueReadImage(ocl->command_queue, ocl->output, true, origin, region, 0, 0, actual.data(), 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueReadImage returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+
+    auto difference = 0.0F;
+    for (size_t i = 0; i < count; i++)
+        difference = std::max(difference, std::fabs(actual[i] - expected[i]));
+    if (difference > STENCIL_CHECK_TOLERANCE)
+    {
+        log_error("Error: the order %u stencil differs by %g degrees between the CPU and OpenCL.\n", order, difference);
+        return -1;
+    }
+    log_info("Stencil: order %u, CPU and OpenCL steps agree to %g degrees\n", order, difference);
+    return CL_SUCCESS;
+}
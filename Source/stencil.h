@@ -0,0 +1,105 @@
+#pragma once
+#include <CL/cl.h>
+#include <algorithm>
+#include <string>
+
+/*largest difference between the CPU and the OpenCL step of a stencil that the startup check accepts, in degrees*/
+#define STENCIL_CHECK_TOLERANCE 1.0e-3F
+
+struct ocl_args_d_t;
+
+/*
+ * The Laplacian along both axes as a cross of radius cells each way: weight(k) / divisor for the cells at distance k on
+ * either side along one axis, weight(0) / divisor for the center, counted once per axis. The centered differences of
+ * order 2, 4 and 6; ratio_limit is the largest stable r = alpha dt / dx^2 of the explicit step, 2 over the largest
+ * eigenvalue of the 2D stencil. Everything is a compile-time constant, so the CPU loops over the radius unroll and the
+ * OpenCL kernels are generated with the weights as literals.
+ */
+template <int Order>
+struct laplacian_stencil;
+
+template <>
+struct laplacian_stencil<2>
+{
+    static constexpr int radius() { return 1; }
+    static constexpr cl_float weight(const int k) { return 0 == k ? -2.0F : 1.0F; }
+    static constexpr cl_float divisor() { return 1.0F; }
+    static constexpr cl_float ratio_limit() { return 0.25F; }
+};
+
+template <>
+struct laplacian_stencil<4>
+{
+    static constexpr int radius() { return 2; }
+    static constexpr cl_float weight(const int k) { return 0 == k ? -30.0F : 1 == k ? 16.0F : -1.0F; }
+    static constexpr cl_float divisor() { return 12.0F; }
+    static constexpr cl_float ratio_limit() { return 0.1875F; }
+};
+
+template <>
+struct laplacian_stencil<6>
+{
+    static constexpr int radius() { return 3; }
+    static constexpr cl_float weight(const int k) { return 0 == k ? -490.0F : 1 == k ? 270.0F : 2 == k ? -27.0F : 2.0F; }
+    static constexpr cl_float divisor() { return 180.0F; }
+    static constexpr cl_float ratio_limit() { return 180.0F / 1088.0F; }
+};
+
+/*the weighted sum at cell i, which lies at least radius cells inside the plate*/
+template <typename Stencil>
+inline cl_float stencil_sum_inner(const cl_float* input, const size_t i, const size_t width)
+{
+    auto sum = 2.0F * Stencil::weight(0) * input[i];
+    for (auto k = 1; k <= Stencil::radius(); k++)
+        sum += Stencil::weight(k) * (input[i - k] + input[i + k] + input[i - k * width] + input[i + k * width]);
+    return sum;
+}
+
+/*the weighted sum at cell (x, y) anywhere on the plate, the cells beyond it at the air temperature*/
+template <typename Stencil>
+inline cl_float stencil_sum_edge(const cl_float* input, const size_t i, const cl_uint x, const cl_uint y, const cl_uint width, const cl_uint height, const cl_float air_temperature)
+{
+    auto sum = 2.0F * Stencil::weight(0) * input[i];
+    for (auto k = 1; k <= Stencil::radius(); k++)
+    {
+        const auto n = static_cast<cl_uint>(k);
+        sum += Stencil::weight(k) * ((x >= n ? input[i - n] : air_temperature) + (x + n < width ? input[i + n] : air_temperature) +
+            (y >= n ? input[i - n * static_cast<size_t>(width)] : air_temperature) + (y + n < height ? input[i + n * static_cast<size_t>(width)] : air_temperature));
+    }
+    return sum;
+}
+
+/*
+ * Explicit step of the cells [first, last) in row order. Within a row the cells at least radius away from the edges
+ * take the inner sum, which has no tests and vectorizes; only the border cells look for the air.
+ */
+template <typename Stencil>
+void step_stencil_cells(const cl_float* input, cl_float* output, const cl_uint width, const cl_uint height, const cl_float air_temperature, const cl_float ratio,
+    const size_t first, const size_t last)
+{
+    const auto scale = ratio / Stencil::divisor();
+    const auto radius = static_cast<cl_uint>(Stencil::radius());
+    for (auto row_start = first - first % width; row_start < last; row_start += width)
+    {
+        const auto y = static_cast<cl_uint>(row_start / width);
+        const auto begin = static_cast<cl_uint>(std::max(first, row_start) - row_start);
+        const auto end = static_cast<cl_uint>(std::min(last, row_start + width) - row_start);
+        const auto inner_row = y >= radius && y + radius < height;
+        const auto inner_begin = inner_row ? std::min(std::max(begin, radius), end) : end;
+        const auto inner_end = inner_row && width > radius ? std::max(inner_begin, std::min(end, width - radius)) : inner_begin;
+
+        for (auto x = begin; x < inner_begin; x++)
+            output[row_start + x] = input[row_start + x] + scale * stencil_sum_edge<Stencil>(input, row_start + x, x, y, width, height, air_temperature);
+        for (auto x = inner_begin; x < inner_end; x++)
+            output[row_start + x] = input[row_start + x] + scale * stencil_sum_inner<Stencil>(input, row_start + x, width);
+        for (auto x = inner_end; x < end; x++)
+            output[row_start + x] = input[row_start + x] + scale * stencil_sum_edge<Stencil>(input, row_start + x, x, y, width, height, air_temperature);
+    }
+}
+
+bool is_stencil_order(cl_uint order);
+cl_float stencil_ratio_limit(cl_uint order);
+const char* stencil_kernel_name(cl_uint order);
+std::string stencil_program_source();
+void step_stencil(cl_uint order, const cl_float* input, cl_float* output, cl_uint width, cl_uint height, cl_float air_temperature, cl_float ratio, size_t first, size_t last);
+int check_stencil(ocl_args_d_t* ocl, cl_uint order, cl_uint width, cl_uint height, cl_float air_temperature, cl_float ratio);
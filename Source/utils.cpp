@@ -11,12 +11,38 @@
 
 
 
+#include "archive.h"
 #include "log_utils.h"
+#include "material.h"
+#include "playback.h"
+#include "sources.h"
 
 //we want to use POSIX functions
 #pragma warning( push )
 #pragma warning( disable : 4996 )
 
+/*FNV-1a, chained through hash so that several blocks can be hashed as one*/
+cl_ulong hash_bytes(const void* data, const size_t size, cl_ulong hash)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*a count of the config within [low, high]; anything else, a negative one too, keeps the default*/
+static void parse_count(const std::string& name, const std::string& value, const long long low, const long long high, cl_uint& count)
+{
+    const auto parsed = std::stoll(value, nullptr);
+    if (parsed < low || parsed > high)
+        log_error("Warning: %s %lld is not within [%lld, %lld], keeping %u.\n", name.c_str(), parsed, low, high, count);
+    else
+        count = static_cast<cl_uint>(parsed);
+}
+
 int read_source_from_file(const char* file_name, char** source, size_t* source_size)
 {
 	auto error_code = CL_SUCCESS;
@@ -64,7 +90,7 @@ void log_device_info(cl_device_id device)
     }
 }
 
-void read_config(const char* input_file, const char*& preferred_platform, cl_uint& array_width, cl_uint& array_height, cl_float& plate_initial_temperature, float& air_temperature, float& point_temperature)
+void read_config(const char* input_file, const char*& preferred_platform, cl_uint& array_width, cl_uint& array_height, cl_float& plate_initial_temperature, float& air_temperature, float& point_temperature, app_config& config)
 {
     std::ifstream input(input_file);
     std::string line;
@@ -84,6 +110,57 @@ void read_config(const char* input_file, const char*& preferred_platform, cl_uin
         else if (attribute_name == "initial_temp") plate_initial_temperature = std::stof(attribute_value, nullptr);
         else if (attribute_name == "air_temp") air_temperature = std::stof(attribute_value, nullptr);
         else if (attribute_name == "point_temp") point_temperature = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "diffusivity") config.model.diffusivity = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "cell_size") config.model.cell_size = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "time_step") config.model.time_step = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "snapshot_tolerance") config.snapshot_tolerance = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "archive") config.archive_file = attribute_value;
+        else if (attribute_name == "archive_interval") parse_count(attribute_name, attribute_value, 1, CL_UINT_MAX, config.archive_interval);
+        else if (attribute_name == "archive_tolerance") config.archive_tolerance = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "archive_levels") parse_count(attribute_name, attribute_value, 1, ARCHIVE_MAX_LEVELS, config.archive_levels);
+        else if (attribute_name == "playback") config.playback_file = attribute_value;
+        else if (attribute_name == "playback_max_width") parse_count(attribute_name, attribute_value, 1, PLAYBACK_MAX_SIZE, config.playback_max_width);
+        else if (attribute_name == "playback_max_height") parse_count(attribute_name, attribute_value, 1, PLAYBACK_MAX_SIZE, config.playback_max_height);
+        else if (attribute_name == "export") config.export_file = attribute_value;
+        else if (attribute_name == "export_step") config.export_step = std::stoull(attribute_value, nullptr);
+        else if (attribute_name == "record") config.record_file = attribute_value;
+        else if (attribute_name == "replay") config.replay_file = attribute_value;
+        else if (attribute_name == "benchmark") config.benchmark_time = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "out_of_core") config.out_of_core_file = attribute_value;
+        else if (attribute_name == "out_of_core_time") config.out_of_core_time = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "out_of_core_tile") config.out_of_core_tile = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "out_of_core_halo") config.out_of_core_halo = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "out_of_core_slots") config.out_of_core_slots = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "out_of_core_check") config.out_of_core_check = attribute_value == "1";
+        else if (attribute_name == "chebyshev_check") config.chebyshev_check = attribute_value == "1";
+        else if (attribute_name == "index_check") config.index_check = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "solver") { if (!parse_solver_kind(attribute_value.c_str(), config.solver)) log_error("Warning: unknown solver '%s'.\n", attribute_value.c_str()); }
+        else if (attribute_name == "backend") config.backend = attribute_value == "cpu" ? BACKEND_CPU : BACKEND_OPENCL;
+        else if (attribute_name == "theta") config.solver_options.theta = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "solver_tolerance") config.solver_options.tolerance = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "solver_max_iterations") config.solver_options.max_iterations = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "multigrid_cycle") config.solver_options.full_multigrid = attribute_value == "fmg";
+        else if (attribute_name == "linear_solver") config.solver_options.linear_solver = attribute_value == "pcg" ? LINEAR_PCG : LINEAR_GAUSS_SEIDEL;
+        else if (attribute_name == "preconditioner") config.solver_options.preconditioner = attribute_value == "jacobi" ? PRECONDITIONER_JACOBI : PRECONDITIONER_IC;
+        else if (attribute_name == "omega") config.solver_options.omega = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "amr_levels") config.solver_options.amr_levels = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "amr_threshold") config.solver_options.amr_threshold = std::stof(attribute_value, nullptr);
+        else if (attribute_name == "newton_iterations") config.solver_options.newton_iterations = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "krylov_dimension") config.solver_options.krylov_dimension = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "conductivity_table") config.conductivity_file = attribute_value;
+        else if (attribute_name == "in_place") config.in_place = attribute_value == "1";
+        else if (attribute_name == "material_map") config.material_file = attribute_value;
+        else if (attribute_name == "materials") { if (!parse_material_table(attribute_value, config.materials)) log_error("Warning: bad material table '%s'.\n", attribute_value.c_str()); }
+        else if (attribute_name == "source") { heat_source source; if (parse_heat_source(attribute_value, source)) config.sources.push_back(source); else log_error("Warning: bad source '%s'.\n", attribute_value.c_str()); }
+        else if (attribute_name == "sources") config.source_file = attribute_value;
+        else if (attribute_name == "active_tiles") config.active_tiles = attribute_value == "1";
+        else if (attribute_name == "plate_depth") config.plate_depth = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "stencil") config.stencil = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "stencil_order") config.stencil_order = std::stoi(attribute_value, nullptr);
+        else if (attribute_name == "geometry_map") config.geometry_file = attribute_value;
+        else if (attribute_name == "geometry_boundary") config.geometry_insulated = attribute_value == "insulated";
+        else if (attribute_name == "conductivity") config.boundary.conductivity = std::stof(attribute_value, nullptr);
+        else if (0 == attribute_name.compare(0, 8, "boundary")) { if (!parse_boundary_setting(attribute_name, attribute_value, config.boundary)) log_error("Warning: bad boundary '%s:%s'.\n", attribute_name.c_str(), attribute_value.c_str()); }
     }
 }
 
@@ -1,11 +1,23 @@
 #pragma once
 #include "CL/cl.h"
 #include <d3d9.h>
+#include <string>
+#include <vector>
+
+#include "boundary.h"
+#include "heat_model.h"
+#include "jfnk.h"
+#include "solver.h"
+#include "sources.h"
 
 #define OPENCL_VERSION_1_2  1.2f
 #define OPENCL_VERSION_2_0  2.0f
 #define INTEL_PLATFORM "Intel"
 #define AMD_PLATFORM "AMD"
+#define CPU_THREAD_COUNT 4
+#define HASH_SEED 14695981039346656037ULL
+/*a field with more cells than this is indexed with 64 bits in the kernels (HUGE_GRID), any other with 32*/
+#define INDEX_32_CELLS 0xFFFFFFFFULL
 
 #define NEW_LINE 					"\n"
 
@@ -14,9 +26,61 @@
 											#call, __FILE__, __LINE__, translate_open_cl_error(status));	\
 										return status; } } while (0)
 
+struct app_config
+{
+    heat_model model = { 1.11e-4F, 1.0e-3F, 0.0F };
+    cl_float snapshot_tolerance = 0.0F;
+    std::string archive_file;
+    cl_uint archive_interval = 100;
+    cl_float archive_tolerance = 0.0F;
+    cl_uint archive_levels = 1;
+    std::string playback_file;
+    cl_uint playback_max_width = 1280;
+    cl_uint playback_max_height = 720;
+    std::string export_file;
+    cl_ulong export_step = CL_ULONG_MAX;
+    std::string record_file;
+    std::string replay_file;
+    cl_float benchmark_time = 0.0F;
+    std::string out_of_core_file;
+    cl_float out_of_core_time = 0.0F;
+    cl_uint out_of_core_tile = 1024;
+    cl_uint out_of_core_halo = 8;
+    cl_uint out_of_core_slots = 0;
+    bool out_of_core_check = false;
+    bool chebyshev_check = false;
+    cl_uint index_check = 0;
+    solver_kind solver = SOLVER_FTCS;
+    solver_backend backend = BACKEND_OPENCL;
+    bool in_place = false;
+    std::string material_file;
+    std::vector<cl_float> materials;
+    std::vector<heat_source> sources;
+    std::string source_file;
+    bool active_tiles = false;
+    cl_uint plate_depth = 1;
+    cl_uint stencil = 7;
+    cl_uint stencil_order = 2;
+    std::string geometry_file;
+    bool geometry_insulated = false;
+    std::string conductivity_file;
+    conductivity_curve conductivity;
+    boundary_settings boundary = { { { BOUNDARY_DIRICHLET, 0.0F }, { BOUNDARY_DIRICHLET, 0.0F }, { BOUNDARY_DIRICHLET, 0.0F }, { BOUNDARY_DIRICHLET, 0.0F } }, 401.0F };
+    solver_settings solver_options = { 0.5F, 1.0e-3F, 1000, 1, LINEAR_GAUSS_SEIDEL, PRECONDITIONER_IC, 0.0F, 4, 1.0F, 10, 20 };
+};
+
+/*the cells the device steps, the first ones in row order; the CPU threads step the rest*/
+inline cl_ulong device_cell_count(const cl_uint width, const cl_uint height, const cl_float gpu_percent)
+{
+    const auto count = static_cast<cl_ulong>(width) * height;
+    const auto cells = static_cast<cl_ulong>(static_cast<double>(count) * gpu_percent / 100.0);
+    return cells < count ? cells : count;
+}
+
+cl_ulong hash_bytes(const void* data, size_t size, cl_ulong hash = HASH_SEED);
 int read_source_from_file(const char* file_name, char** source, size_t* source_size);
 void log_device_info(cl_device_id device);
-void read_config(const char* input_file, const char*& preferred_platform, cl_uint & array_width, cl_uint & array_height, cl_float & plate_initial_temperature, float& air_temperature, float& point_temperature);
+void read_config(const char* input_file, const char*& preferred_platform, cl_uint & array_width, cl_uint & array_height, cl_float & plate_initial_temperature, float& air_temperature, float& point_temperature, app_config& config);
 
 
 
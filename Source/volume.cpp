@@ -0,0 +1,275 @@
+#include "volume.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+#include "log_utils.h"
+#include "ocl_args.h"
+#include "ocl_memory.h"
+#include "ocl_solver.h"
+#include "parallel.h"
+
+/*largest stable ratio of each stencil: 2 over the largest eigenvalue of its Laplacian, 12 and 184 / 30*/
+static const cl_float ratio_limit_7 = 1.0F / 6.0F;
+static const cl_float ratio_limit_27 = 15.0F / 46.0F;
+
+ocl_volume_t::ocl_volume_t() :
+    kernel(nullptr),
+    surface(nullptr),
+    fields{ nullptr, nullptr }
+{
+}
+
+ocl_volume_t::~ocl_volume_t()
+{
+    for (auto* kernel_object : { kernel, surface })
+    {
+        if (kernel_object)
+            clReleaseKernel(kernel_object);
+    }
+    for (auto* buffer : fields)
+    {
+        if (buffer)
+            clReleaseMemObject(buffer);
+    }
+}
+
+static size_t volume_size(const volume_state& volume)
+{
+    return static_cast<size_t>(volume.width) * volume.height * volume.depth;
+}
+
+/*a depth of one cell is the 2D plate and keeps the 2D path*/
+void init_volume(volume_state* volume, const cl_uint width, const cl_uint height, const cl_uint depth, const cl_uint stencil, const cl_float temperature)
+{
+    volume->enabled = depth > 1;
+    volume->width = width;
+    volume->height = height;
+    volume->depth = depth;
+    volume->stencil = 27 == stencil ? 27 : 7;
+    volume->on_device = false;
+    volume->current = 0;
+    if (!volume->enabled)
+        return;
+
+    volume->fields[0].assign(volume_size(*volume), temperature);
+    volume->fields[1].resize(volume_size(*volume));
+    log_info("Volume: %ux%ux%u cells, %u-point stencil, %.1f MB per field\n", width, height, depth, volume->stencil,
+        sizeof(cl_float) * volume_size(*volume) / (1024.0 * 1024.0));
+}
+
+int setup_ocl_volume(ocl_args_d_t* ocl, volume_state* volume)
+{
+    if (!volume->enabled)
+        return CL_SUCCESS;
+
+    auto* device = &volume->device;
+    if (CL_SUCCESS != create_solver_kernel(ocl, "simulate_volume", &device->kernel) ||
+        CL_SUCCESS != create_solver_kernel(ocl, "volume_surface", &device->surface))
+        return -1;
+    for (auto& field : device->fields)
+    {
+        field = create_solver_buffer(ocl, sizeof(cl_float) * volume_size(*volume));
+        if (nullptr == field)
+            return -1;
+    }
+    return CL_SUCCESS;
+}
+
+/*the whole volume back at one temperature, on the side that holds it*/
+int reset_volume(ocl_args_d_t* ocl, volume_state* volume, const cl_float temperature)
+{
+    if (!volume->enabled)
+        return CL_SUCCESS;
+    if (volume->on_device)
+        return fill_solver_buffer(ocl, volume->device.fields[volume->current], temperature, volume_size(*volume));
+    std::fill(volume->fields[volume->current].begin(), volume->fields[volume->current].end(), temperature);
+    return CL_SUCCESS;
+}
+
+/*moves the current field to the side that steps next and frees the other side*/
+static int move_volume(ocl_args_d_t* ocl, volume_state* volume, const bool on_device)
+{
+    if (volume->on_device == on_device)
+        return CL_SUCCESS;
+
+    const auto size = sizeof(cl_float) * volume_size(*volume);
+    auto* buffer = volume->device.fields[volume->current];
+    cl_int err;
+    if (on_device)
+    {
+        err = clEnqueueWriteBuffer(ocl->command_queue, buffer, true, 0, size, volume->fields[volume->current].data(), 0, nullptr, nullptr);
+        for (auto& field : volume->fields)
+            std::vector<cl_float>().swap(field);
+    }
+    else
+    {
+        for (auto& field : volume->fields)
+            field.resize(volume_size(*volume));
+        err = clEnqueueReadBuffer(ocl->command_queue, buffer, true, 0, size, volume->fields[volume->current].data(), 0, nullptr, nullptr);
+    }
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: moving the volume returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    volume->on_device = on_device;
+    return CL_SUCCESS;
+}
+
+/*the frame ratio in as many equal steps as the stencil needs to stay stable*/
+cl_uint volume_substeps(const volume_state& volume, const cl_float ratio)
+{
+    const auto limit = 27 == volume.stencil ? ratio_limit_27 : ratio_limit_7;
+    return std::max(1u, static_cast<cl_uint>(std::ceil(ratio / limit)));
+}
+
+/*
+ * The Laplacian of cell x, read(dz, dy, dx) being the cell at x + dx of rows[dz][dy]; rows[dz][dy] is the row at
+ * z + dz - 1, y + dy - 1, a row of air where that lies outside the volume.
+ */
+template <bool Wide, typename Read>
+static cl_float volume_laplacian(const cl_float* const rows[3][3], const cl_uint x, const Read& read)
+{
+    const auto center = rows[1][1][x];
+    const auto faces = read(1, 1, -1) + read(1, 1, 1) + rows[1][0][x] + rows[1][2][x] + rows[0][1][x] + rows[2][1][x];
+    if (!Wide)
+        return faces - 6.0F * center;
+
+    const auto edges = read(1, 0, -1) + read(1, 0, 1) + read(1, 2, -1) + read(1, 2, 1) + read(0, 1, -1) + read(0, 1, 1) + read(2, 1, -1) + read(2, 1, 1) +
+        rows[0][0][x] + rows[0][2][x] + rows[2][0][x] + rows[2][2][x];
+    const auto corners = read(0, 0, -1) + read(0, 0, 1) + read(0, 2, -1) + read(0, 2, 1) + read(2, 0, -1) + read(2, 0, 1) + read(2, 2, -1) + read(2, 2, 1);
+    return (14.0F * faces + 3.0F * edges + corners - 128.0F * center) / 30.0F;
+}
+
+/*one row of cells; only the first and the last one test for the air beyond the plate*/
+template <bool Wide>
+static void step_row(const cl_float* const rows[3][3], cl_float* output, const cl_uint width, const cl_float air_temperature, const cl_float ratio)
+{
+    for (cl_uint x = 1; x + 1 < width; x++)
+        output[x] = rows[1][1][x] + ratio * volume_laplacian<Wide>(rows, x, [&](const int dz, const int dy, const int dx) { return rows[dz][dy][x + dx]; });
+
+    for (const auto x : { 0u, width - 1 })
+    {
+        const auto read = [&](const int dz, const int dy, const int dx)
+        {
+            const auto col = static_cast<cl_int>(x) + dx;
+            return col < 0 || col >= static_cast<cl_int>(width) ? air_temperature : rows[dz][dy][col];
+        };
+        output[x] = rows[1][1][x] + ratio * volume_laplacian<Wide>(rows, x, read);
+    }
+}
+
+/*
+ * A 3D FTCS step on the CPU threads. Every thread takes strips of VOLUME_STRIP_ROWS rows and streams each strip through
+ * the depth, plane by plane: the strip of plane z is read for the planes z - 1, z and z + 1, so it is loaded once and
+ * used three times while it is still in cache, instead of once per plane when whole planes are stepped in turn.
+ */
+void step_volume_cpu(volume_state* volume, const cl_float air_temperature, const cl_int point_x, const cl_int point_y, const cl_float point_temperature, const cl_float ratio)
+{
+    const auto width = volume->width;
+    const auto height = volume->height;
+    const auto depth = volume->depth;
+    const auto plane = static_cast<size_t>(width) * height;
+    const auto* input = volume->fields[volume->current].data();
+    auto* output = volume->fields[1 - volume->current].data();
+    const std::vector<cl_float> air(width, air_temperature);
+    const auto strips = (height + VOLUME_STRIP_ROWS - 1) / VOLUME_STRIP_ROWS;
+
+    parallel_tasks(strips, [&](const size_t strip)
+    {
+        const auto top = static_cast<cl_uint>(strip) * VOLUME_STRIP_ROWS;
+        const auto bottom = std::min(top + VOLUME_STRIP_ROWS, height);
+        for (cl_uint z = 0; z < depth; z++)
+        {
+            for (auto y = top; y < bottom; y++)
+            {
+                const cl_float* rows[3][3];
+                for (auto dz = 0; dz < 3; dz++)
+                {
+                    for (auto dy = 0; dy < 3; dy++)
+                    {
+                        const auto nz = static_cast<cl_int>(z) + dz - 1;
+                        const auto ny = static_cast<cl_int>(y) + dy - 1;
+                        const auto inside = nz >= 0 && nz < static_cast<cl_int>(depth) && ny >= 0 && ny < static_cast<cl_int>(height);
+                        rows[dz][dy] = inside ? input + nz * plane + static_cast<size_t>(ny) * width : air.data();
+                    }
+                }
+                auto* row = output + z * plane + static_cast<size_t>(y) * width;
+                if (27 == volume->stencil)
+                    step_row<true>(rows, row, width, air_temperature, ratio);
+                else
+                    step_row<false>(rows, row, width, air_temperature, ratio);
+            }
+        }
+    });
+
+    if (point_x >= 0 && point_y >= 0 && static_cast<cl_uint>(point_x) < width && static_cast<cl_uint>(point_y) < height)
+        output[static_cast<size_t>(point_y) * width + point_x] = point_temperature;
+    volume->current = 1 - volume->current;
+}
+
+/*the top face into the output image and the plate colors, where the 2D path would have left them*/
+static int show_surface(ocl_args_d_t* ocl, volume_state* volume, vertex_args* plate_points)
+{
+    const auto width = volume->width;
+    const auto height = volume->height;
+    if (volume->on_device)
+    {
+        const size_t global_work_size[] = { width, height };
+        if (CL_SUCCESS != set_kernel_args(volume->device.surface, 0, volume->device.fields[volume->current], ocl->output, width, ocl->plate_points) ||
+            CL_SUCCESS != run_solver_kernel(ocl, volume->device.surface, 2, global_work_size, nullptr))
+            return -1;
+        const auto err = clFinish(ocl->command_queue);
+        if (CL_SUCCESS != err)
+        {
+            log_error("Error: clFinish return %s\n", translate_open_cl_error(err));
+            return err;
+        }
+        return CL_SUCCESS;
+    }
+
+    const auto* top = volume->fields[volume->current].data();
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    const auto err = clEnqueueWriteImage(ocl->command_queue, ocl->output, true, origin, region, 0, 0, top, 0, nullptr, nullptr);
+    if (CL_SUCCESS != err)
+    {
+        log_error("Error: clEnqueueWriteImage returned %s\n", translate_open_cl_error(err));
+        return err;
+    }
+    colorize_field(top, plate_points, static_cast<size_t>(width) * height);
+    return CL_SUCCESS;
+}
+
+/*
+ * One frame of the volume: the explicit ratio of the plate in volume_substeps steps, on the device or on the CPU, then
+ * the top face is shown. The mouse heats the top face.
+ */
+int step_volume(ocl_args_d_t* ocl, volume_state* volume, const bool on_device, const cl_float air_temperature, const cl_int point_x, const cl_int point_y,
+    const cl_float point_temperature, const cl_float ratio, vertex_args* plate_points)
+{
+    if (CL_SUCCESS != move_volume(ocl, volume, on_device))
+        return -1;
+
+    const auto substeps = volume_substeps(*volume, ratio);
+    const auto step_ratio = ratio / substeps;
+    for (cl_uint k = 0; k < substeps; k++)
+    {
+        if (!on_device)
+        {
+            step_volume_cpu(volume, air_temperature, point_x, point_y, point_temperature, step_ratio);
+            continue;
+        }
+
+        auto* device = &volume->device;
+        const size_t global_work_size[] = { volume->width, volume->height, volume->depth };
+        if (CL_SUCCESS != set_kernel_args(device->kernel, 0, device->fields[volume->current], device->fields[1 - volume->current], volume->width, volume->height,
+            volume->depth, air_temperature, step_ratio, volume->stencil, point_x, point_y, point_temperature) ||
+            CL_SUCCESS != run_solver_kernel(ocl, device->kernel, 3, global_work_size, nullptr))
+            return -1;
+        volume->current = 1 - volume->current;
+    }
+    return show_surface(ocl, volume, plate_points);
+}
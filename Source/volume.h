@@ -0,0 +1,49 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+/*rows of a CPU strip: three planes of it stay in cache while the strip streams through the depth*/
+#define VOLUME_STRIP_ROWS 16
+
+struct ocl_args_d_t;
+struct vertex_args;
+
+/*device copies of the two volume fields and the kernels that step them and show the top face*/
+struct ocl_volume_t
+{
+    ocl_volume_t();
+    ~ocl_volume_t();
+
+    cl_kernel        kernel;
+    cl_kernel        surface;
+    cl_mem           fields[2];
+};
+
+/*
+ * A plate of depth cells through its thickness, stored plane by plane: cell (x, y, z) is
+ * fields[current][(z * height + y) * width + x], z = 0 the top face that is shown and heated by the mouse. Every face of
+ * the volume touches the air. The stencil is the 7-point Laplacian or the 27-point one, (14 faces + 3 edges + 1 corners -
+ * 128 center) / 30, which is isotropic to second order and stable for a larger ratio. The fields live on one side at a
+ * time, the host while the CPU steps them and the device while the kernel does, and move when the side changes; a side
+ * that does not hold them keeps no copy, so a 512^3 plate needs 1 GB on one side only.
+ */
+struct volume_state
+{
+    bool             enabled;
+    cl_uint          width;
+    cl_uint          height;
+    cl_uint          depth;
+    cl_uint          stencil;
+    bool             on_device;
+    cl_uint          current;
+    std::vector<cl_float> fields[2];
+    ocl_volume_t     device;
+};
+
+void init_volume(volume_state* volume, cl_uint width, cl_uint height, cl_uint depth, cl_uint stencil, cl_float temperature);
+int setup_ocl_volume(ocl_args_d_t* ocl, volume_state* volume);
+int reset_volume(ocl_args_d_t* ocl, volume_state* volume, cl_float temperature);
+cl_uint volume_substeps(const volume_state& volume, cl_float ratio);
+void step_volume_cpu(volume_state* volume, cl_float air_temperature, cl_int point_x, cl_int point_y, cl_float point_temperature, cl_float ratio);
+int step_volume(ocl_args_d_t* ocl, volume_state* volume, bool on_device, cl_float air_temperature, cl_int point_x, cl_int point_y, cl_float point_temperature,
+    cl_float ratio, vertex_args* plate_points);